@@ -0,0 +1,152 @@
+/* See LICENSE file for copyright and license details. */
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+
+#include "libterminput.hpp"
+
+
+/* Same input as bench.c */
+static const char *const samples[] = {
+	"hello world",
+	"\033[A", "\033[B", "\033[1;5C", "\033[1;2D",
+	"\033OP", "\033[15~", "\033[3;2~", "\033[Z",
+	"\033x", "\303\266", "\033[13;5u", "\t", "\n", "\177",
+	"\033[<0;12;34M", "\033[<0;12;34m", "\033[<35;80;24M", "\033[<64;1;1M",
+	"\033[200~pasted text\033[201~",
+	NULL
+};
+
+
+static double
+elapsed(const struct timespec *start, const struct timespec *end)
+{
+	return (double)(end->tv_sec - start->tv_sec) + (double)(end->tv_nsec - start->tv_nsec) / 1000000000.;
+}
+
+
+/* Dispatch with the C API, and return the time it took */
+static double
+run_c(const char *data, size_t size, size_t *neventsp, unsigned long long int *sump)
+{
+	struct libterminput_state ctx;
+	union libterminput_input input;
+	struct timespec start, end;
+	const char *buf = data;
+	size_t len = size;
+
+	memset(&ctx, 0, sizeof(ctx));
+	*neventsp = 0;
+	*sump = 0;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	while (libterminput_read_mem(&buf, &len, &input, &ctx) > 0) {
+		switch (input.type) {
+		case LIBTERMINPUT_NONE:
+			continue;
+		case LIBTERMINPUT_KEYPRESS:
+			*sump += (unsigned long long int)input.keypress.key + input.keypress.mods;
+			break;
+		case LIBTERMINPUT_TEXT:
+			*sump += input.text.nbytes;
+			break;
+		case LIBTERMINPUT_MOUSEEVENT:
+			*sump += input.mouseevent.x + input.mouseevent.y;
+			break;
+		default:
+			*sump += 1;
+			break;
+		}
+		*neventsp += 1;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	return elapsed(&start, &end);
+}
+
+
+/* Dispatch with libterminput.hpp, and return the time it took */
+static double
+run_cxx(const char *data, size_t size, size_t *neventsp, unsigned long long int *sump)
+{
+	libterminput::session session;
+	struct timespec start, end;
+	unsigned long long int sum = 0;
+	size_t nevents = 0;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (auto ev : session.events(std::string_view(data, size))) {
+		sum += ev.visit(libterminput::overloaded{
+			[](libterminput::keypress_event k) { return (unsigned long long int)k.data.key + k.data.mods; },
+			[](libterminput::text_event t) { return (unsigned long long int)t.data.nbytes; },
+			[](libterminput::mouse_event m) { return (unsigned long long int)(m.data.x + m.data.y); },
+			[](auto) { return 1ULL; }
+		});
+		nevents += 1;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	*neventsp = nevents;
+	*sump = sum;
+	return elapsed(&start, &end);
+}
+
+
+static void
+report(const char *name, double t, size_t size, size_t nevents)
+{
+	printf("%-12s %8.3f seconds, %7.2f MB/s, %6.2f ns/event\n", name, t,
+	       (double)size / t / 1000000., t * 1000000000. / (double)nevents);
+}
+
+
+int
+main(int argc, char *argv[])
+{
+	size_t size, n, i, j, nevents1, nevents2;
+	unsigned long long int sum1, sum2;
+	int rounds;
+	double t, t1 = 0, t2 = 0;
+	char *data;
+
+	if (argc > 2) {
+		fprintf(stderr, "usage: %s [megabytes]\n", argv[0]);
+		return 1;
+	}
+	size = (argc > 1 ? (size_t)strtoul(argv[1], NULL, 0) : 16) << 20;
+	rounds = 5;
+
+	data = (char *)malloc(size);
+	if (!data) {
+		perror(argv[0]);
+		return 1;
+	}
+	for (i = j = 0; i < size; i += n, j++) {
+		if (!samples[j])
+			j = 0;
+		n = strlen(samples[j]);
+		if (n > size - i)
+			n = size - i;
+		memcpy(&data[i], samples[j], n);
+	}
+
+	/* Alternate between the interfaces and keep the best time of each,
+	 * to reduce the influence of frequency scaling and other noise */
+	for (i = 0; i < (size_t)rounds; i++) {
+		t = run_c(data, size, &nevents1, &sum1);
+		if (!i || t < t1)
+			t1 = t;
+		t = run_cxx(data, size, &nevents2, &sum2);
+		if (!i || t < t2)
+			t2 = t;
+	}
+	if (nevents1 != nevents2 || sum1 != sum2) {
+		fprintf(stderr, "%s: the C and C++ interfaces decoded different events\n", argv[0]);
+		free(data);
+		return 1;
+	}
+	report("c", t1, size, nevents1);
+	report("c++", t2, size, nevents2);
+	printf("overhead     %8.3f\n", t2 / t1);
+
+	free(data);
+	return 0;
+}
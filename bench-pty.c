@@ -0,0 +1,284 @@
+/* See LICENSE file for copyright and license details. */
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+#if defined(__linux__)
+# include <pty.h>
+#else
+# include <util.h>
+#endif
+
+#include "libterminput.h"
+
+
+/* Each decodes to one event, except that a lone ESC, unless reported on
+ * its own, is merged with the key that follows it, which therefore is
+ * never an ESC itself */
+static const char *const keys[] = {
+	"a", "\033[A", "\033[1;5C", "\033OP", "\033", "x", "\033[15~", "\303\266", "\033[13;5u", "\t",
+	NULL
+};
+
+static const char *const mice[] = {
+	"\033[<35;80;24M", "\033[<0;12;34M", "\033[<0;12;34m", "\033[<64;1;1M",
+	NULL
+};
+
+
+struct scheduled {
+	const char *str;
+	unsigned long long int due;
+	unsigned long long int sent;
+};
+
+struct writer {
+	int fd;
+	struct scheduled *schedule;
+	size_t n;
+	struct timespec start;
+};
+
+
+static unsigned long long int
+elapsed(const struct timespec *start)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (unsigned long long int)(now.tv_sec - start->tv_sec) * 1000000000ULL + (unsigned long long int)now.tv_nsec
+	       - (unsigned long long int)start->tv_nsec;
+}
+
+
+/* Interleave keystrokes and mouse reports at the given rates, per second */
+static struct scheduled *
+make_schedule(double key_rate, double mouse_rate, double seconds, size_t *np)
+{
+	struct scheduled *schedule;
+	unsigned long long int end = (unsigned long long int)(seconds * 1000000000.);
+	unsigned long long int key_interval = key_rate > 0 ? (unsigned long long int)(1000000000. / key_rate) : 0;
+	unsigned long long int mouse_interval = mouse_rate > 0 ? (unsigned long long int)(1000000000. / mouse_rate) : 0;
+	unsigned long long int next_key = 0, next_mouse = 0;
+	size_t n = 0, size, k = 0, m = 0;
+	int use_key;
+
+	size = (size_t)(seconds * (key_rate + mouse_rate)) + 2;
+	schedule = calloc(size, sizeof(*schedule));
+	if (!schedule)
+		return NULL;
+
+	if (!key_interval)
+		next_key = end;
+	if (!mouse_interval)
+		next_mouse = end;
+	while (n < size && (next_key < end || next_mouse < end)) {
+		use_key = next_key <= next_mouse;
+		/* The mouse waits for the key that completes a lone ESC */
+		if (n && !strcmp(schedule[n - 1].str, "\033"))
+			use_key = 1;
+		if (use_key) {
+			if (!keys[k])
+				k = 0;
+			schedule[n].str = keys[k++];
+			schedule[n++].due = next_key;
+			next_key += key_interval;
+		} else {
+			if (!mice[m])
+				m = 0;
+			schedule[n].str = mice[m++];
+			schedule[n++].due = next_mouse;
+			next_mouse += mouse_interval;
+		}
+	}
+	if (n && !strcmp(schedule[n - 1].str, "\033"))
+		n -= 1;
+
+	*np = n;
+	return schedule;
+}
+
+
+static void *
+write_schedule(void *data)
+{
+	struct writer *w = data;
+	struct timespec due;
+	size_t i, len;
+
+	for (i = 0; i < w->n; i++) {
+		due.tv_sec = w->start.tv_sec + (time_t)(w->schedule[i].due / 1000000000ULL);
+		due.tv_nsec = w->start.tv_nsec + (long int)(w->schedule[i].due % 1000000000ULL);
+		if (due.tv_nsec >= 1000000000L) {
+			due.tv_sec += 1;
+			due.tv_nsec -= 1000000000L;
+		}
+		while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &due, NULL) == EINTR);
+		/* Stored before the input is written, so the reader sees it after reading the input */
+		w->schedule[i].sent = elapsed(&w->start);
+		len = strlen(w->schedule[i].str);
+		if (write(w->fd, w->schedule[i].str, len) != (ssize_t)len) {
+			perror("write");
+			exit(1);
+		}
+	}
+	return NULL;
+}
+
+
+/* Return the number of read(3) calls made by this process, or 0 if unknown */
+static unsigned long long int
+count_reads(void)
+{
+	unsigned long long int n = 0;
+#if defined(__linux__)
+	char line[128];
+	FILE *fp = fopen("/proc/self/io", "r");
+	if (!fp)
+		return 0;
+	while (fgets(line, sizeof(line), fp))
+		if (sscanf(line, "syscr: %llu", &n) == 1)
+			break;
+	fclose(fp);
+#endif
+	return n;
+}
+
+
+static int
+compare(const void *a, const void *b)
+{
+	unsigned long long int x = *(const unsigned long long int *)a;
+	unsigned long long int y = *(const unsigned long long int *)b;
+	return x < y ? -1 : x > y;
+}
+
+
+static double
+percentile(const unsigned long long int *latencies, size_t n, double p)
+{
+	return (double)latencies[(size_t)(p * (double)(n - 1))] / 1000.;
+}
+
+
+/* Send the schedule through a pty, and report the latency of the events read from it */
+static int
+run(const char *name, struct scheduled *schedule, size_t n, enum libterminput_flags flags)
+{
+	struct libterminput_state ctx;
+	union libterminput_input input;
+	struct termios stty;
+	struct writer w;
+	pthread_t thread;
+	unsigned long long int *latencies, reads;
+	size_t i, nevents = 0;
+	int master, slave, r;
+
+	if (openpty(&master, &slave, NULL, NULL, NULL)) {
+		perror("openpty");
+		return -1;
+	}
+	if (tcgetattr(slave, &stty)) {
+		perror("tcgetattr");
+		return -1;
+	}
+	cfmakeraw(&stty);
+	stty.c_cc[VMIN] = 1;
+	stty.c_cc[VTIME] = 0;
+	if (tcsetattr(slave, TCSANOW, &stty)) {
+		perror("tcsetattr");
+		return -1;
+	}
+
+	latencies = malloc(n * sizeof(*latencies));
+	if (!latencies) {
+		perror("malloc");
+		return -1;
+	}
+
+	memset(&ctx, 0, sizeof(ctx));
+	libterminput_set_flags(&ctx, flags);
+	w.fd = master;
+	w.schedule = schedule;
+	w.n = n;
+	clock_gettime(CLOCK_MONOTONIC, &w.start);
+	reads = count_reads();
+	errno = pthread_create(&thread, NULL, write_schedule, &w);
+	if (errno) {
+		perror("pthread_create");
+		return -1;
+	}
+
+	/* Each event is attributed to the first unaccounted for keystroke
+	 * or mouse report, so a lone ESC that is merged with the next key
+	 * is delayed until that key is sent */
+	for (i = 0; i < n;) {
+		r = libterminput_read(slave, &input, &ctx);
+		if (r <= 0) {
+			perror(r ? "libterminput_read" : "libterminput_read: unexpected end of input");
+			return -1;
+		}
+		if (input.type == LIBTERMINPUT_NONE)
+			continue;
+		latencies[nevents++] = elapsed(&w.start) - schedule[i].sent;
+		if (!strcmp(schedule[i].str, "\033") &&
+		    !(input.type == LIBTERMINPUT_KEYPRESS && input.keypress.key == LIBTERMINPUT_ESC && !input.keypress.mods))
+			i += 1;
+		i += 1;
+	}
+	reads = count_reads() - reads;
+
+	pthread_join(thread, NULL);
+	close(master);
+	close(slave);
+
+	qsort(latencies, nevents, sizeof(*latencies), compare);
+	printf("%-14s %7zu %10.1f %10.1f %10.1f", name, nevents,
+	       percentile(latencies, nevents, .5), percentile(latencies, nevents, .99), percentile(latencies, nevents, .999));
+	if (reads)
+		printf(" %12.2f\n", (double)reads / (double)nevents);
+	else
+		printf(" %12s\n", "-");
+
+	free(latencies);
+	return 0;
+}
+
+
+int
+main(int argc, char *argv[])
+{
+	struct scheduled *schedule;
+	double key_rate, mouse_rate, seconds;
+	size_t n;
+
+	if (argc > 4) {
+		fprintf(stderr, "usage: %s [keys-per-second [mouse-reports-per-second [seconds]]]\n", argv[0]);
+		return 1;
+	}
+	key_rate = argc > 1 ? strtod(argv[1], NULL) : 500;
+	mouse_rate = argc > 2 ? strtod(argv[2], NULL) : 500;
+	seconds = argc > 3 ? strtod(argv[3], NULL) : 2;
+
+	schedule = make_schedule(key_rate, mouse_rate, seconds, &n);
+	if (!schedule) {
+		perror(argv[0]);
+		return 1;
+	}
+	if (!n) {
+		fprintf(stderr, "%s: nothing to send\n", argv[0]);
+		return 1;
+	}
+
+	/* Latencies are in microseconds, from write(3) on the master
+	 * until libterminput_read(3) returns the event on the slave */
+	printf("%-14s %7s %10s %10s %10s %12s\n", "flags", "events", "p50", "p99", "p99.9", "reads/event");
+	if (run("default", schedule, n, 0) || run("esc-on-block", schedule, n, LIBTERMINPUT_ESC_ON_BLOCK))
+		return 1;
+
+	free(schedule);
+	return 0;
+}
@@ -0,0 +1,100 @@
+/* See LICENSE file for copyright and license details. */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "libterminput.h"
+
+
+/* A mix of typing, special keys, modifiers, mouse events, and pastes */
+static const char *const samples[] = {
+	"hello world",
+	"\033[A", "\033[B", "\033[1;5C", "\033[1;2D",
+	"\033OP", "\033[15~", "\033[3;2~", "\033[Z",
+	"\033x", "\303\266", "\033[13;5u", "\t", "\n", "\177",
+	"\033[<0;12;34M", "\033[<0;12;34m", "\033[<35;80;24M", "\033[<64;1;1M",
+	"\033[200~pasted text\033[201~",
+	NULL
+};
+
+
+static double
+elapsed(const struct timespec *start, const struct timespec *end)
+{
+	return (double)(end->tv_sec - start->tv_sec) + (double)(end->tv_nsec - start->tv_nsec) / 1000000000.;
+}
+
+
+/* Decode all data once and return the time it took */
+static double
+run(const char *data, size_t size, enum libterminput_flags flags, size_t *neventsp)
+{
+	struct libterminput_state ctx;
+	union libterminput_input input;
+	struct timespec start, end;
+	const char *buf = data;
+	size_t len = size;
+
+	memset(&ctx, 0, sizeof(ctx));
+	libterminput_set_flags(&ctx, flags);
+	*neventsp = 0;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	while (libterminput_read_mem(&buf, &len, &input, &ctx) > 0)
+		*neventsp += input.type != LIBTERMINPUT_NONE;
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	return elapsed(&start, &end);
+}
+
+
+static void
+report(const char *name, double t, size_t size, size_t nevents)
+{
+	printf("%-12s %8.3f seconds, %7.2f MB/s, %6.2f ns/event\n", name, t,
+	       (double)size / t / 1000000., t * 1000000000. / (double)nevents);
+}
+
+
+int
+main(int argc, char *argv[])
+{
+	enum libterminput_flags flags;
+	size_t size, n, i, j, nevents;
+	int rounds;
+	double t, best = 0;
+	char *data;
+
+	if (argc > 3) {
+		fprintf(stderr, "usage: %s [megabytes [flags]]\n", argv[0]);
+		return 1;
+	}
+	size = (argc > 1 ? (size_t)strtoul(argv[1], NULL, 0) : 16) << 20;
+	flags = argc > 2 ? (enum libterminput_flags)strtoul(argv[2], NULL, 0) : 0;
+	rounds = 5;
+
+	data = malloc(size);
+	if (!data) {
+		perror(argv[0]);
+		return 1;
+	}
+	for (i = j = 0; i < size; i += n, j++) {
+		if (!samples[j])
+			j = 0;
+		n = strlen(samples[j]);
+		if (n > size - i)
+			n = size - i;
+		memcpy(&data[i], samples[j], n);
+	}
+
+	/* Keep the best time, to reduce the influence of
+	 * frequency scaling and other noise */
+	for (i = 0; i < (size_t)rounds; i++) {
+		t = run(data, size, flags, &nevents);
+		if (!i || t < best)
+			best = t;
+	}
+	report("read_mem", best, size, nevents);
+
+	free(data);
+	return 0;
+}
@@ -2,7 +2,15 @@ PREFIX    = /usr
 MANPREFIX = $(PREFIX)/share/man
 
 CC = c99
+CXX = c++
 
 CPPFLAGS = -D_DEFAULT_SOURCE -D_BSD_SOURCE -D_XOPEN_SOURCE=700
 CFLAGS   = -Wall -O2
+CXXFLAGS = -std=c++20 -Wall -O2
 LDFLAGS  = -s
+
+# Used by `make pgo`, PGO_WORKLOAD is the number of megabytes the bench decodes
+PGO_GENERATE = -fprofile-generate
+PGO_USE      = -fprofile-use -fprofile-correction -Wno-missing-profile
+LTO          = -flto -ffat-lto-objects
+PGO_WORKLOAD = 4
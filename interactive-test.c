@@ -181,6 +181,18 @@ main(void)
 			printf("cursor position:\n");
 			printf("\tx: %zu\n", input.position.x);
 			printf("\ty: %zu\n", input.position.y);
+			printf("\tpage: %zu\n", input.position.page);
+			printf("\tsequence: %llu\n", input.position.sequence);
+		} else if (input.type == LIBTERMINPUT_FOCUS_IN) {
+			printf("focus in\n");
+		} else if (input.type == LIBTERMINPUT_FOCUS_OUT) {
+			printf("focus out\n");
+		} else if (input.type == LIBTERMINPUT_RESIZE) {
+			printf("resize:\n");
+			printf("\trows: %zu\n", input.resize.rows);
+			printf("\tcolumns: %zu\n", input.resize.columns);
+			printf("\theight: %zu\n", input.resize.height);
+			printf("\twidth: %zu\n", input.resize.width);
 		} else {
 			printf("other\n");
 		}
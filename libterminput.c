@@ -3,9 +3,15 @@
 
 #include <alloca.h>
 #include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
 #include <limits.h>
+#include <poll.h>
 #include <string.h>
 #include <unistd.h>
+#if defined(__linux__)
+# include <sys/eventfd.h>
+#endif
 
 
 struct input {
@@ -13,9 +19,61 @@ struct input {
 	char symbol[7];
 };
 
+struct source {
+	int fd;
+	const char **bufp; /* NULL if reading from `fd` */
+	size_t *lenp;
+	int wakeup_fd; /* -1 unless libterminput_enable_wakeup has been called */
+};
+
 
+/* Wait until `src->fd` is readable, unless libterminput_wakeup is called first;
+ * a non-blocking `src->fd` is not waited for, so that read(3) fails with EAGAIN */
 static int
-read_input(int fd, struct input *input, struct libterminput_state *ctx)
+wait_for_input(struct source *src)
+{
+	struct pollfd pfds[2];
+	char drain[64];
+	int flags;
+
+	flags = fcntl(src->fd, F_GETFL);
+	if (flags < 0)
+		return -1;
+	pfds[0].fd = src->fd;
+	pfds[0].events = POLLIN;
+	pfds[1].fd = src->wakeup_fd;
+	pfds[1].events = POLLIN;
+	if (poll(pfds, 2, (flags & O_NONBLOCK) ? 0 : -1) < 0)
+		return -1;
+	if (!pfds[1].revents)
+		return 0;
+
+	/* Consume the wakeup, the partially read input is left in the state */
+	while (read(src->wakeup_fd, drain, sizeof(drain)) > 0);
+	errno = ECANCELED;
+	return -1;
+}
+
+
+static ssize_t
+read_source(struct source *src, void *buf, size_t n)
+{
+	if (!src->bufp) {
+		if (src->wakeup_fd >= 0 && wait_for_input(src))
+			return -1;
+		return read(src->fd, buf, n);
+	}
+	if (n > *src->lenp)
+		n = *src->lenp;
+	memcpy(buf, *src->bufp, n);
+	*src->bufp += n;
+	*src->lenp -= n;
+	return (ssize_t)n;
+}
+
+
+static int
+read_input(struct source *src, struct input *input, struct libterminput_state *ctx)
 {
 	unsigned char c, tc;
 	ssize_t r;
@@ -26,7 +84,7 @@ read_input(int fd, struct input *input, struct libterminput_state *ctx)
 		if (ctx->stored_tail == ctx->stored_head)
 			ctx->stored_tail = ctx->stored_head = 0;
 	} else {
-		r = read(fd, ctx->stored, sizeof(ctx->stored));
+		r = read_source(src, ctx->stored, sizeof(ctx->stored));
 		if (r <= 0)
 			return (int)r;
 		c = (unsigned char)ctx->stored[0];
@@ -46,7 +104,12 @@ again:
 			ctx->n = 0;
 			ctx->npartial = 0;
 			ctx->mods = 0;
-			ctx->stored[ctx->stored_head++] = (char)c;
+			if (ctx->stored_tail) {
+				ctx->stored_tail -= 1;
+			} else {
+				ctx->stored[0] = (char)c;
+				ctx->stored_head = 1;
+			}
 			strcpy(input->symbol, ctx->partial);
 			return 1;
 		} else {
@@ -93,6 +156,7 @@ again:
 			ctx->n++;
 		if (ctx->n > 6) {
 			/* If overlong, return first byte a single-byte-character */
+			ctx->n = 0;
 			input->symbol[0] = (char)c;
 			input->symbol[1] = '\0';
 			input->mods = ctx->mods;
@@ -252,12 +316,173 @@ need_1:
 }
 
 
+static void
+set_position(union libterminput_input *input, struct libterminput_state *ctx,
+             unsigned long long int y, unsigned long long int x, unsigned long long int page)
+{
+	input->position.type = LIBTERMINPUT_CURSOR_POSITION;
+	input->position.y = (size_t)y + (size_t)!y;
+	input->position.x = (size_t)x + (size_t)!x;
+	input->position.page = (size_t)page + (size_t)!page;
+	input->position.sequence = ctx->positions_received++;
+	if (ctx->awaiting_positions)
+		ctx->awaiting_positions -= 1;
+}
+
+
+static void
+set_resize(union libterminput_input *input, const unsigned long long int *nums, size_t nnums)
+{
+	input->resize.type = LIBTERMINPUT_RESIZE;
+	input->resize.rows = (size_t)nums[0];
+	input->resize.columns = (size_t)nums[1];
+	input->resize.height = nnums > 2 ? (size_t)nums[2] : 0;
+	input->resize.width = nnums > 3 ? (size_t)nums[3] : 0;
+}
+
+
+/* Replace a resize notification with the last of any directly following ones that are already buffered */
+static void
+coalesce_resizes(union libterminput_input *input, struct libterminput_state *ctx)
+{
+	unsigned long long int nums[4];
+	size_t i, n, nnums;
+	const char *s;
+
+	for (;;) {
+		s = &ctx->stored[ctx->stored_tail];
+		n = ctx->stored_head - ctx->stored_tail;
+		if (n < 5 || strncmp(s, "\033[48;", 5))
+			return;
+		nums[0] = 0;
+		for (i = 5, nnums = 1; i < n && (isdigit(s[i]) || s[i] == ';'); i++) {
+			if (s[i] == ';') {
+				if (nnums < 4)
+					nums[nnums] = 0;
+				nnums += 1;
+			} else if (nnums <= 4) {
+				if (nums[nnums - 1] < (ULLONG_MAX - (s[i] & 15)) / 10)
+					nums[nnums - 1] = nums[nnums - 1] * 10 + (s[i] & 15);
+				else
+					nums[nnums - 1] = ULLONG_MAX;
+			}
+		}
+		if (i == n || s[i] != 't' || nnums < 2)
+			return;
+		set_resize(input, nums, nnums < 4 ? nnums : 4);
+		ctx->stored_tail += i + 1;
+		if (ctx->stored_tail == ctx->stored_head)
+			ctx->stored_tail = ctx->stored_head = 0;
+	}
+}
+
+
+static void
+parse_report(union libterminput_input *input, struct libterminput_state *ctx)
+{
+	struct libterminput_report *report = &input->report;
+	const size_t maxparams = sizeof(report->params) / sizeof(*report->params);
+	size_t i = 0;
+	char *p = &ctx->key[2];
+
+	report->type = LIBTERMINPUT_REPORT;
+	report->prefix = ctx->key[1];
+	report->intermediate = '\0';
+	report->params[0] = 0;
+	report->nparams = p[1] ? 1 : 0;
+
+	for (; p[1]; p++) {
+		if (*p == ';' || *p == ':') {
+			if (++i < maxparams) {
+				report->params[i] = 0;
+				report->nparams = i + 1;
+			}
+		} else if (!isdigit(*p)) {
+			report->intermediate = *p;
+		} else if (i < maxparams) {
+			if (report->params[i] < (ULLONG_MAX - (*p & 15)) / 10)
+				report->params[i] = report->params[i] * 10 + (*p & 15);
+			else
+				report->params[i] = ULLONG_MAX;
+		}
+	}
+	report->final = *p;
+}
+
+
+static void
+parse_raw_sequence(union libterminput_input *input, const char *key)
+{
+	struct libterminput_sequence *sequence = &input->sequence;
+	const size_t maxparams = sizeof(sequence->params) / sizeof(*sequence->params);
+	size_t i = 0, nintermediates = 0;
+	const char *p = &key[1];
+
+	sequence->type = LIBTERMINPUT_RAW_SEQUENCE;
+	sequence->introducer = key[0];
+	sequence->prefix = '\0';
+	if (*p == '<' || *p == '=' || *p == '>' || *p == '?')
+		sequence->prefix = *p++;
+	sequence->params[0] = 0;
+	sequence->nparams = 0;
+	sequence->subparams = 0;
+
+	for (; p[1]; p++) {
+		if (*p == ';' || *p == ':') {
+			if (++i < maxparams) {
+				sequence->params[i] = 0;
+				if (*p == ':')
+					sequence->subparams |= 1U << i;
+			}
+		} else if (isdigit(*p)) {
+			if (i < maxparams) {
+				if (sequence->params[i] < (ULLONG_MAX - (*p & 15)) / 10)
+					sequence->params[i] = sequence->params[i] * 10 + (*p & 15);
+				else
+					sequence->params[i] = ULLONG_MAX;
+			}
+		} else {
+			if (nintermediates < sizeof(sequence->intermediates) - 1)
+				sequence->intermediates[nintermediates++] = *p;
+			continue;
+		}
+		sequence->nparams = i < maxparams ? i + 1 : maxparams;
+	}
+	sequence->intermediates[nintermediates] = '\0';
+	sequence->final = *p;
+}
+
+
 static void
 parse_sequence(union libterminput_input *input, struct libterminput_state *ctx)
 {
 	unsigned long long int *nums, numsbuf[6];
 	size_t keylen, n, nnums = 0, pos;
-	char *p;
+	char *p, raw[sizeof(ctx->key)];
+
+	if (ctx->key[0] == '[' && (ctx->key[1] == '?' || ctx->key[1] == '>')) {
+		parse_report(input, ctx);
+		if (input->report.prefix == '?' && input->report.final == 'R' &&
+		    !input->report.intermediate && input->report.nparams >= 2) {
+			/* DECXCPR, CSI ? Pl ; Pc ; Pp R, cannot be mistaken for a key press */
+			numsbuf[0] = input->report.params[0];
+			numsbuf[1] = input->report.params[1];
+			numsbuf[2] = input->report.nparams >= 3 ? input->report.params[2] : 1;
+			set_position(input, ctx, numsbuf[0], numsbuf[1], numsbuf[2]);
+		} else if (ctx->flags & LIBTERMINPUT_AWAITING_DEVICE_REPORTS) {
+			/* keep report */
+		} else if (ctx->flags & LIBTERMINPUT_RAW_UNKNOWN_SEQUENCES) {
+			parse_raw_sequence(input, ctx->key);
+		} else {
+			input->type = LIBTERMINPUT_NONE;
+		}
+		return;
+	}
+
+	/* The numbers are removed from the sequence below, so keep
+	 * a copy in case the sequence turns out to be unknown */
+	if (ctx->flags & LIBTERMINPUT_RAW_UNKNOWN_SEQUENCES)
+		strcpy(raw, ctx->key);
 
 	/* Get number of numbers in the sequence, and allocate an array of at least 2 */
 	if (ctx->key[0] == '[' && (ctx->key[1] == '<' ? isdigit(ctx->key[2]) : isdigit(ctx->key[1])))
@@ -277,7 +502,7 @@ parse_sequence(union libterminput_input *input, struct libterminput_state *ctx)
 			nums[++n] = 0; /* We made sure above to allocate one extra */
 		} else if (!isdigit(*p)) {
 			ctx->key[keylen++] = *p;
-		} else if (n < 3) {
+		} else {
 			if (nums[n] < (ULLONG_MAX - (*p & 15)) / 10)
 				nums[n] = nums[n] * 10 + (*p & 15);
 			else
@@ -306,6 +531,14 @@ parse_sequence(union libterminput_input *input, struct libterminput_state *ctx)
 			case 'F': input->keypress.key = LIBTERMINPUT_END;   break;
 			case 'G': input->keypress.key = LIBTERMINPUT_BEGIN; break;
 			case 'H': input->keypress.key = LIBTERMINPUT_HOME;  break;
+			case 'I':
+			case 'O':
+				/* Focus tracking (\e[?1004h) */
+				if (nnums)
+					goto suppress;
+				ctx->unfocused = ctx->key[1] == 'O';
+				input->type = ctx->unfocused ? LIBTERMINPUT_FOCUS_OUT : LIBTERMINPUT_FOCUS_IN;
+				break;
 			case 'M':
 				if (ctx->flags & LIBTERMINPUT_MACRO_ON_CSI_M) {
 					input->keypress.key = LIBTERMINPUT_MACRO;
@@ -330,7 +563,7 @@ parse_sequence(union libterminput_input *input, struct libterminput_state *ctx)
 						}
 					}
 					input->mouseevent.button = (enum libterminput_button)nums[0];
-				} else if (!nnums & !(ctx->flags & LIBTERMINPUT_DECSET_1005)) {
+				} else if (!nnums && !(ctx->flags & LIBTERMINPUT_DECSET_1005)) {
 					/* Parsing output for legacy mouse tracking output. */
 					ctx->mouse_tracking = 0;
 					nums = numsbuf;
@@ -374,10 +607,8 @@ parse_sequence(union libterminput_input *input, struct libterminput_state *ctx)
 				input->keypress.key = LIBTERMINPUT_F2;
 				break;
 			case 'R':
-				if ((ctx->flags & LIBTERMINPUT_AWAITING_CURSOR_POSITION) && nnums >= 2) {
-					input->position.type = LIBTERMINPUT_CURSOR_POSITION;
-					input->position.y = (size_t)nums[0] + (size_t)!nums[0];
-					input->position.x = (size_t)nums[1] + (size_t)!nums[1];
+				if (((ctx->flags & LIBTERMINPUT_AWAITING_CURSOR_POSITION) || ctx->awaiting_positions) && nnums >= 2) {
+					set_position(input, ctx, nums[0], nums[1], 1);
 				} else {
 					input->keypress.key = LIBTERMINPUT_F3;
 				}
@@ -386,7 +617,10 @@ parse_sequence(union libterminput_input *input, struct libterminput_state *ctx)
 				input->keypress.key = LIBTERMINPUT_F4;
 				break;
 			case 'T':
-				/* Parsing output for legacy mouse highlight tracking output. (\e[?1001h) */
+				/* Parsing output for legacy mouse highlight tracking output. (\e[?1001h);
+				 * only CSI T, which is followed by 6 bytes, is such output */
+				if (nnums || ctx->stored_head - ctx->stored_tail < 6)
+					goto suppress;
 				ctx->mouse_tracking = 0;
 				nums = numsbuf;
 				nums[0] = (unsigned long long int)(unsigned char)ctx->stored[ctx->stored_tail++];
@@ -450,7 +684,16 @@ parse_sequence(union libterminput_input *input, struct libterminput_state *ctx)
 				}
 				break;
 			case 't':
+				if (nnums) {
+					/* In-band window resize notification (\e[?2048h) */
+					if (nums[0] != 48 || nnums < 3)
+						goto suppress;
+					set_resize(input, &nums[1], nnums - 1);
+					break;
+				}
 				/* Parsing output for legacy mouse highlight tracking output (\e[?1001h). */
+				if (ctx->stored_head - ctx->stored_tail < 2)
+					goto suppress;
 				ctx->mouse_tracking = 0;
 				nums = numsbuf;
 				nums[0] = (unsigned long long int)(unsigned char)ctx->stored[ctx->stored_tail++];
@@ -467,12 +710,22 @@ parse_sequence(union libterminput_input *input, struct libterminput_state *ctx)
 				input->mouseevent.y = (size_t)nums[1] + (size_t)!nums[1];
 				break;
 			case 'u':
-				if (nums[0] > 0x10FFFFULL || (nums[0] & 0xFFF800ULL) == 0xD800ULL) {
-					input->type = LIBTERMINPUT_NONE;
+				input->keypress.times = 1;
+				/* Keys that the kitty keyboard protocol encodes by their legacy byte */
+				switch (nums[0]) {
+				case   9: input->keypress.key = LIBTERMINPUT_TAB;   break;
+				case  13: input->keypress.key = LIBTERMINPUT_ENTER; break;
+				case  27: input->keypress.key = LIBTERMINPUT_ESC;   break;
+				case 127: input->keypress.key = LIBTERMINPUT_ERASE; break;
+				default:
+					if (nums[0] > 0x10FFFFULL || (nums[0] & 0xFFF800ULL) == 0xD800ULL) {
+						input->type = LIBTERMINPUT_NONE;
+						break;
+					}
+					input->keypress.key = LIBTERMINPUT_SYMBOL;
+					encode_utf8(nums[0], input->keypress.symbol);
 					break;
 				}
-				encode_utf8(nums[0], input->keypress.symbol);
-				input->keypress.times = 1;
 				break;
 			case '$':
 				input->keypress.mods |= LIBTERMINPUT_SHIFT;
@@ -606,14 +859,17 @@ parse_sequence(union libterminput_input *input, struct libterminput_state *ctx)
 	default:
 		/* This shouldn't happen (without goto) */
 	suppress:
-		input->type = LIBTERMINPUT_NONE;
+		if (ctx->flags & LIBTERMINPUT_RAW_UNKNOWN_SEQUENCES)
+			parse_raw_sequence(input, raw);
+		else
+			input->type = LIBTERMINPUT_NONE;
 		break;
 	}		
 }
 
 
 static int
-read_bracketed_paste(int fd, union libterminput_input *input, struct libterminput_state *ctx)
+read_bracketed_paste(struct source *src, union libterminput_input *input, struct libterminput_state *ctx)
 {
 	ssize_t r;
 	size_t n;
@@ -638,7 +894,7 @@ read_bracketed_paste(int fd, union libterminput_input *input, struct libterminpu
 			}
 			input->text.nbytes = ctx->stored_head - ctx->stored_tail;
 			memcpy(input->text.bytes, &ctx->stored[ctx->stored_tail], input->text.nbytes);
-			r = read(fd, &input->text.bytes[input->text.nbytes], sizeof(input->text.bytes) - input->text.nbytes);
+			r = read_source(src, &input->text.bytes[input->text.nbytes], sizeof(input->text.bytes) - input->text.nbytes);
 			if (r <= 0)
 				return (int)r;
 			input->text.nbytes += (size_t)r;
@@ -651,7 +907,7 @@ read_bracketed_paste(int fd, union libterminput_input *input, struct libterminpu
 		goto normal;
 	}
 
-	r = read(fd, input->text.bytes, sizeof(input->text.bytes));
+	r = read_source(src, input->text.bytes, sizeof(input->text.bytes));
 	if (r <= 0)
 		return (int)r;
 	input->text.nbytes = (size_t)r;
@@ -718,8 +974,75 @@ normal:
 }
 
 
-int
-libterminput_read(int fd, union libterminput_input *input, struct libterminput_state *ctx)
+static int
+read_control_string(struct source *src, union libterminput_input *input, struct libterminput_state *ctx)
+{
+	struct libterminput_string *string = &input->string;
+	ssize_t r;
+	size_t n, i;
+	char *p, *q;
+
+	if (ctx->paused) {
+		/* An ESC was left at the end, it may be the beginning of the ST */
+		memmove(ctx->stored, &ctx->stored[ctx->stored_tail], ctx->stored_head - ctx->stored_tail);
+		ctx->stored_head -= ctx->stored_tail;
+		ctx->stored_tail = 0;
+		r = read_source(src, &ctx->stored[ctx->stored_head], sizeof(ctx->stored) - ctx->stored_head);
+		if (r <= 0)
+			return (int)r;
+		ctx->stored_head += (size_t)r;
+		ctx->paused = 0;
+	} else if (ctx->stored_head == ctx->stored_tail) {
+		r = read_source(src, ctx->stored, sizeof(ctx->stored));
+		if (r <= 0)
+			return (int)r;
+		ctx->stored_tail = 0;
+		ctx->stored_head = (size_t)r;
+	}
+
+	p = &ctx->stored[ctx->stored_tail];
+	n = ctx->stored_head - ctx->stored_tail;
+	if (ctx->control_string == ']') {
+		for (i = 0; i < n && p[i] != '\033' && p[i] != '\a'; i++);
+		string->type = LIBTERMINPUT_OPERATING_SYSTEM_COMMAND;
+	} else {
+		q = memchr(p, '\033', n);
+		i = q ? (size_t)(q - p) : n;
+		string->type = LIBTERMINPUT_DEVICE_CONTROL_STRING;
+	}
+
+	string->more = 1;
+	string->nbytes = i;
+	memcpy(string->bytes, p, i);
+	ctx->stored_tail += i;
+
+	if (i < n && p[i] == '\a') {
+		/* BEL terminates operating system commands */
+		string->more = 0;
+		ctx->control_string = 0;
+		ctx->stored_tail += 1;
+	} else if (i + 1 == n) {
+		/* Wait for the byte after the ESC */
+		if (!i) {
+			input->type = LIBTERMINPUT_NONE;
+			ctx->paused = 1;
+		}
+		return 1;
+	} else if (i < n) {
+		/* ESC \ terminates the string, any other ESC aborts it and is parsed normally */
+		string->more = 0;
+		ctx->control_string = 0;
+		if (p[i + 1] == '\\')
+			ctx->stored_tail += 2;
+	}
+	if (ctx->stored_tail == ctx->stored_head)
+		ctx->stored_tail = ctx->stored_head = 0;
+	return 1;
+}
+
+
+static int
+read_event(struct source *src, union libterminput_input *input, struct libterminput_state *ctx)
 {
 	struct input ret;
 	size_t n, m;
@@ -736,18 +1059,20 @@ libterminput_read(int fd, union libterminput_input *input, struct libterminput_s
 	}
 
 	if (ctx->bracketed_paste)
-		return read_bracketed_paste(fd, input, ctx);
+		return read_bracketed_paste(src, input, ctx);
+	if (ctx->control_string)
+		return read_control_string(src, input, ctx);
 	if (!ctx->mouse_tracking) {
-		r = read_input(fd, &ret, ctx);
+		r = read_input(src, &ret, ctx);
 		if (r <= 0)
 			return r;
 	} else if (ctx->mouse_tracking == 1) {
 		if (ctx->stored_tail == sizeof(ctx->stored)) {
 			memmove(ctx->stored, &ctx->stored[ctx->stored_tail], ctx->stored_head - ctx->stored_tail);
-			ctx->stored_tail -= ctx->stored_head;
-			ctx->stored_head = 0;
+			ctx->stored_head -= ctx->stored_tail;
+			ctx->stored_tail = 0;
 		}
-		rd = read(fd, &ctx->stored[ctx->stored_head], 1);
+		rd = read_source(src, &ctx->stored[ctx->stored_head], 1);
 		if (rd <= 0)
 			return (int)rd;
 		ctx->stored_head += 1;
@@ -756,10 +1081,10 @@ libterminput_read(int fd, union libterminput_input *input, struct libterminput_s
 	} else {
 		if (ctx->stored_tail > sizeof(ctx->stored) - (size_t)ctx->mouse_tracking) {
 			memmove(ctx->stored, &ctx->stored[ctx->stored_tail], ctx->stored_head - ctx->stored_tail);
-			ctx->stored_tail -= ctx->stored_head;
-			ctx->stored_head = 0;
+			ctx->stored_head -= ctx->stored_tail;
+			ctx->stored_tail = 0;
 		}
-		rd = read(fd, &ctx->stored[ctx->stored_head], (size_t)ctx->mouse_tracking - (ctx->stored_head - ctx->stored_tail));
+		rd = read_source(src, &ctx->stored[ctx->stored_head], (size_t)ctx->mouse_tracking - (ctx->stored_head - ctx->stored_tail));
 		if (rd <= 0)
 			return (int)rd;
 		ctx->stored_head += (size_t)rd;
@@ -803,6 +1128,10 @@ again:
 		if (!isalpha(p[-1]) && p[-1] != '~' && p[-1] != '@' && p[-1] != '^' && p[-1] != '$') {
 			input->type = LIBTERMINPUT_NONE;
 			return 1;
+		} else if (p[-1] == '$' && ctx->key[1] == '?' && (ctx->flags & LIBTERMINPUT_AWAITING_DEVICE_REPORTS)) {
+			/* DECRPM, CSI ? Pd ; Ps $ y */
+			input->type = LIBTERMINPUT_NONE;
+			return 1;
 		} else if (ctx->key[0] == '[' && ctx->key[1] == '<' && p == &ctx->key[2]) {
 			input->type = LIBTERMINPUT_NONE;
 			return 1;
@@ -859,8 +1188,23 @@ again:
 		/* Reset */
 		ctx->meta = 0;
 		ctx->key[0] = '\0';
-	} else if (ctx->meta && (!strcmp(ret.symbol, "[") || !strcmp(ret.symbol, "O"))) {
-		/* ESC [ or ESC 0 is used as the beginning of most special keys */
+		/* Only when reading from a terminal, so that the
+		 * events in memory do not depend on how it is split */
+		if (input->type == LIBTERMINPUT_RESIZE && !src->bufp)
+			coalesce_resizes(input, ctx);
+	} else if (ctx->meta && !(ret.mods & LIBTERMINPUT_CTRL) && !strcmp(ret.symbol, "P") && (ctx->flags & LIBTERMINPUT_AWAITING_DEVICE_REPORTS)) {
+		/* ESC P begins a device control string */
+		ctx->control_string = 'P';
+		ctx->meta = 0;
+		input->type = LIBTERMINPUT_NONE;
+	} else if (ctx->meta && !(ret.mods & LIBTERMINPUT_CTRL) && !strcmp(ret.symbol, "]") && (ctx->flags & LIBTERMINPUT_AWAITING_OSC)) {
+		/* ESC ] begins an operating system command */
+		ctx->control_string = ']';
+		ctx->meta = 0;
+		input->type = LIBTERMINPUT_NONE;
+	} else if (ctx->meta && !(ret.mods & LIBTERMINPUT_CTRL) && (!strcmp(ret.symbol, "[") || !strcmp(ret.symbol, "O"))) {
+		/* ESC [ or ESC 0 is used as the beginning of most special keys,
+		 * but ESC ^O is Meta+Ctrl+O */
 		strcpy(ctx->key, ret.symbol);
 		input->type = LIBTERMINPUT_NONE;
 	} else {
@@ -902,6 +1246,94 @@ again:
 }
 
 
+/* Get the class of input for libterminput_set_event_mask, 0 if it has none */
+static enum libterminput_event_class
+get_event_class(const union libterminput_input *input)
+{
+	switch (input->type) {
+	case LIBTERMINPUT_KEYPRESS:
+		if (input->keypress.key >= LIBTERMINPUT_KEYPAD_0 && input->keypress.key <= LIBTERMINPUT_KEYPAD_ENTER)
+			return LIBTERMINPUT_EVENT_KEYPAD;
+		return 0;
+	case LIBTERMINPUT_MOUSEEVENT:
+		if (input->mouseevent.event == LIBTERMINPUT_MOTION)
+			return LIBTERMINPUT_EVENT_MOUSE_MOTION;
+		if (input->mouseevent.event != LIBTERMINPUT_PRESS && input->mouseevent.event != LIBTERMINPUT_RELEASE)
+			return LIBTERMINPUT_EVENT_MOUSE_HIGHLIGHT;
+		if (input->mouseevent.button >= LIBTERMINPUT_SCROLL_UP && input->mouseevent.button <= LIBTERMINPUT_SCROLL_RIGHT)
+			return LIBTERMINPUT_EVENT_MOUSE_SCROLL;
+		return LIBTERMINPUT_EVENT_MOUSE_BUTTON;
+	case LIBTERMINPUT_BRACKETED_PASTE_START:
+	case LIBTERMINPUT_BRACKETED_PASTE_END:
+	case LIBTERMINPUT_TEXT:
+		return LIBTERMINPUT_EVENT_PASTE;
+	case LIBTERMINPUT_TERMINAL_IS_OK:
+	case LIBTERMINPUT_TERMINAL_IS_NOT_OK:
+		return LIBTERMINPUT_EVENT_TERMINAL_STATUS;
+	case LIBTERMINPUT_FOCUS_IN:
+	case LIBTERMINPUT_FOCUS_OUT:
+		return LIBTERMINPUT_EVENT_FOCUS;
+	default:
+		return 0;
+	}
+}
+
+
+static int
+read_common(struct source *src, union libterminput_input *input, struct libterminput_state *ctx)
+{
+	enum libterminput_event_class class;
+	int r, i;
+
+	for (;;) {
+		r = read_event(src, input, ctx);
+		if (r <= 0 || !ctx->event_mask)
+			return r;
+		class = get_event_class(input) & ctx->event_mask;
+		if (!class)
+			return r;
+		for (i = 0; !(class & (1 << i)); i++);
+		ctx->dropped_events[i] += 1;
+		input->type = LIBTERMINPUT_NONE;
+		/* Continue with input that has already been read, but do
+		 * not block on the terminal, the caller may want to poll */
+		if (ctx->stored_head == ctx->stored_tail && !(src->lenp && *src->lenp))
+			return 1;
+	}
+}
+
+
+int
+libterminput_read(int fd, union libterminput_input *input, struct libterminput_state *ctx)
+{
+	struct source src;
+	src.fd = fd;
+	src.bufp = NULL;
+	src.lenp = NULL;
+	src.wakeup_fd = ctx->wakeup ? ctx->wakeup_fds[0] : -1;
+	return read_common(&src, input, ctx);
+}
+
+
+int
+libterminput_read_mem(const char **bufp, size_t *lenp, union libterminput_input *input, struct libterminput_state *ctx)
+{
+	struct source src;
+	src.fd = -1;
+	src.bufp = bufp;
+	src.lenp = lenp;
+	src.wakeup_fd = -1;
+	return read_common(&src, input, ctx);
+}
+
+
+unsigned long long int
+libterminput_await_cursor_position(struct libterminput_state *ctx)
+{
+	return ctx->positions_received + (unsigned long long int)ctx->awaiting_positions++;
+}
+
+
 int
 libterminput_set_flags(struct libterminput_state *ctx, enum libterminput_flags flags)
 {
@@ -919,4 +1351,278 @@ libterminput_clear_flags(struct libterminput_state *ctx, enum libterminput_flags
 }
 
 
+int
+libterminput_set_event_mask(struct libterminput_state *ctx, enum libterminput_event_class mask)
+{
+	ctx->event_mask = mask;
+	return 0;
+}
+
+
+unsigned long long int
+libterminput_get_dropped_events(const struct libterminput_state *ctx, enum libterminput_event_class classes)
+{
+	unsigned long long int n = 0;
+	int i;
+	for (i = 0; i < LIBTERMINPUT_EVENT_CLASSES; i++)
+		if (classes & (1 << i))
+			n += ctx->dropped_events[i];
+	return n;
+}
+
+
+static uint32_t
+saturate_u32(unsigned long long int value)
+{
+	return value > UINT32_MAX ? UINT32_MAX : (uint32_t)value;
+}
+
+
+/* Append data for a compact input to the side buffer */
+static int
+append_compact(uint32_t *offsetp, const void *data, size_t n, char *buf, size_t size, size_t *lenp)
+{
+	if (n > size - *lenp || *lenp > UINT32_MAX) {
+		errno = ENOBUFS;
+		return -1;
+	}
+	*offsetp = (uint32_t)*lenp;
+	memcpy(&buf[*lenp], data, n);
+	*lenp += n;
+	return 0;
+}
+
+
+int
+libterminput_compact(union libterminput_compact_input *out, const union libterminput_input *in,
+                     char *buf, size_t size, size_t *lenp)
+{
+	size_t i = 0;
+
+	memset(out, 0, sizeof(*out));
+	out->type = (uint8_t)in->type;
+
+	switch (in->type) {
+	case LIBTERMINPUT_KEYPRESS:
+		out->keypress.key = (uint8_t)in->keypress.key;
+		out->keypress.mods = (uint8_t)in->keypress.mods;
+		out->keypress.times = saturate_u32(in->keypress.times);
+		memcpy(out->keypress.symbol, in->keypress.symbol, sizeof(out->keypress.symbol));
+		if (in->keypress.key == LIBTERMINPUT_SYMBOL && *in->keypress.symbol)
+			out->keypress.codepoint = saturate_u32(utf8_decode(in->keypress.symbol, &i));
+		break;
+
+	case LIBTERMINPUT_MOUSEEVENT:
+		out->mouseevent.mods = (uint8_t)in->mouseevent.mods;
+		out->mouseevent.button = (uint8_t)in->mouseevent.button;
+		out->mouseevent.event = (uint8_t)in->mouseevent.event;
+		out->mouseevent.x = saturate_u32(in->mouseevent.x);
+		out->mouseevent.y = saturate_u32(in->mouseevent.y);
+		out->mouseevent.start_x = saturate_u32(in->mouseevent.start_x);
+		out->mouseevent.start_y = saturate_u32(in->mouseevent.start_y);
+		out->mouseevent.end_x = saturate_u32(in->mouseevent.end_x);
+		out->mouseevent.end_y = saturate_u32(in->mouseevent.end_y);
+		break;
+
+	case LIBTERMINPUT_CURSOR_POSITION:
+		out->position.x = saturate_u32(in->position.x);
+		out->position.y = saturate_u32(in->position.y);
+		out->position.page = saturate_u32(in->position.page);
+		out->position.sequence = (uint64_t)in->position.sequence;
+		break;
+
+	case LIBTERMINPUT_RESIZE:
+		out->resize.rows = saturate_u32(in->resize.rows);
+		out->resize.columns = saturate_u32(in->resize.columns);
+		out->resize.height = saturate_u32(in->resize.height);
+		out->resize.width = saturate_u32(in->resize.width);
+		break;
+
+	case LIBTERMINPUT_REPORT:
+		out->report.prefix = in->report.prefix;
+		out->report.intermediate = in->report.intermediate;
+		out->report.final = in->report.final;
+		out->report.nparams = (uint32_t)in->report.nparams;
+		return append_compact(&out->report.offset, in->report.params,
+		                      in->report.nparams * sizeof(*in->report.params), buf, size, lenp);
+
+	case LIBTERMINPUT_RAW_SEQUENCE:
+		out->sequence.introducer = in->sequence.introducer;
+		out->sequence.prefix = in->sequence.prefix;
+		out->sequence.final = in->sequence.final;
+		memcpy(out->sequence.intermediates, in->sequence.intermediates, sizeof(out->sequence.intermediates));
+		out->sequence.nparams = (uint32_t)in->sequence.nparams;
+		out->sequence.subparams = (uint32_t)in->sequence.subparams;
+		return append_compact(&out->sequence.offset, in->sequence.params,
+		                      in->sequence.nparams * sizeof(*in->sequence.params), buf, size, lenp);
+
+	case LIBTERMINPUT_TEXT:
+		out->text.nbytes = (uint32_t)in->text.nbytes;
+		return append_compact(&out->text.offset, in->text.bytes, in->text.nbytes, buf, size, lenp);
+
+	case LIBTERMINPUT_DEVICE_CONTROL_STRING:
+	case LIBTERMINPUT_OPERATING_SYSTEM_COMMAND:
+		out->text.more = in->string.more;
+		out->text.nbytes = (uint32_t)in->string.nbytes;
+		return append_compact(&out->text.offset, in->string.bytes, in->string.nbytes, buf, size, lenp);
+
+	default:
+		break;
+	}
+
+	return 0;
+}
+
+
+void
+libterminput_expand(union libterminput_input *out, const union libterminput_compact_input *in, const char *buf)
+{
+	size_t n;
+
+	out->type = (enum libterminput_type)in->type;
+
+	switch (out->type) {
+	case LIBTERMINPUT_KEYPRESS:
+		out->keypress.key = (enum libterminput_key)in->keypress.key;
+		out->keypress.mods = (enum libterminput_mod)in->keypress.mods;
+		out->keypress.times = (unsigned long long int)in->keypress.times;
+		memcpy(out->keypress.symbol, in->keypress.symbol, sizeof(out->keypress.symbol));
+		break;
+
+	case LIBTERMINPUT_MOUSEEVENT:
+		out->mouseevent.mods = (enum libterminput_mod)in->mouseevent.mods;
+		out->mouseevent.button = (enum libterminput_button)in->mouseevent.button;
+		out->mouseevent.event = (enum libterminput_event)in->mouseevent.event;
+		out->mouseevent.x = (size_t)in->mouseevent.x;
+		out->mouseevent.y = (size_t)in->mouseevent.y;
+		out->mouseevent.start_x = (size_t)in->mouseevent.start_x;
+		out->mouseevent.start_y = (size_t)in->mouseevent.start_y;
+		out->mouseevent.end_x = (size_t)in->mouseevent.end_x;
+		out->mouseevent.end_y = (size_t)in->mouseevent.end_y;
+		break;
+
+	case LIBTERMINPUT_CURSOR_POSITION:
+		out->position.x = (size_t)in->position.x;
+		out->position.y = (size_t)in->position.y;
+		out->position.page = (size_t)in->position.page;
+		out->position.sequence = (unsigned long long int)in->position.sequence;
+		break;
+
+	case LIBTERMINPUT_RESIZE:
+		out->resize.rows = (size_t)in->resize.rows;
+		out->resize.columns = (size_t)in->resize.columns;
+		out->resize.height = (size_t)in->resize.height;
+		out->resize.width = (size_t)in->resize.width;
+		break;
+
+	case LIBTERMINPUT_REPORT:
+		out->report.prefix = in->report.prefix;
+		out->report.intermediate = in->report.intermediate;
+		out->report.final = in->report.final;
+		n = (size_t)in->report.nparams;
+		if (n > sizeof(out->report.params) / sizeof(*out->report.params))
+			n = sizeof(out->report.params) / sizeof(*out->report.params);
+		out->report.nparams = n;
+		memcpy(out->report.params, &buf[in->report.offset], n * sizeof(*out->report.params));
+		break;
+
+	case LIBTERMINPUT_RAW_SEQUENCE:
+		out->sequence.introducer = in->sequence.introducer;
+		out->sequence.prefix = in->sequence.prefix;
+		out->sequence.final = in->sequence.final;
+		memcpy(out->sequence.intermediates, in->sequence.intermediates, sizeof(out->sequence.intermediates));
+		out->sequence.intermediates[sizeof(out->sequence.intermediates) - 1] = '\0';
+		out->sequence.subparams = (unsigned int)in->sequence.subparams;
+		n = (size_t)in->sequence.nparams;
+		if (n > sizeof(out->sequence.params) / sizeof(*out->sequence.params))
+			n = sizeof(out->sequence.params) / sizeof(*out->sequence.params);
+		out->sequence.nparams = n;
+		memcpy(out->sequence.params, &buf[in->sequence.offset], n * sizeof(*out->sequence.params));
+		break;
+
+	case LIBTERMINPUT_TEXT:
+		n = (size_t)in->text.nbytes;
+		if (n > sizeof(out->text.bytes))
+			n = sizeof(out->text.bytes);
+		out->text.nbytes = n;
+		memcpy(out->text.bytes, &buf[in->text.offset], n);
+		break;
+
+	case LIBTERMINPUT_DEVICE_CONTROL_STRING:
+	case LIBTERMINPUT_OPERATING_SYSTEM_COMMAND:
+		n = (size_t)in->text.nbytes;
+		if (n > sizeof(out->string.bytes))
+			n = sizeof(out->string.bytes);
+		out->string.more = in->text.more;
+		out->string.nbytes = n;
+		memcpy(out->string.bytes, &buf[in->text.offset], n);
+		break;
+
+	default:
+		break;
+	}
+}
+
+
 extern inline int libterminput_is_ready(union libterminput_input *input, struct libterminput_state *ctx);
+extern inline int libterminput_is_focused(struct libterminput_state *ctx);
+
+
+int
+libterminput_enable_wakeup(struct libterminput_state *ctx)
+{
+#if !defined(__linux__)
+	int i, flags;
+#endif
+
+	if (ctx->wakeup)
+		return 0;
+
+#if defined(__linux__)
+	ctx->wakeup_fds[0] = ctx->wakeup_fds[1] = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (ctx->wakeup_fds[0] < 0)
+		return -1;
+#else
+	if (pipe(ctx->wakeup_fds))
+		return -1;
+	for (i = 0; i < 2; i++) {
+		flags = fcntl(ctx->wakeup_fds[i], F_GETFL);
+		if (flags < 0 || fcntl(ctx->wakeup_fds[i], F_SETFL, flags | O_NONBLOCK) ||
+		    fcntl(ctx->wakeup_fds[i], F_SETFD, FD_CLOEXEC)) {
+			close(ctx->wakeup_fds[0]);
+			close(ctx->wakeup_fds[1]);
+			return -1;
+		}
+	}
+#endif
+
+	ctx->wakeup = 1;
+	return 0;
+}
+
+
+void
+libterminput_disable_wakeup(struct libterminput_state *ctx)
+{
+	if (!ctx->wakeup)
+		return;
+	close(ctx->wakeup_fds[0]);
+	if (ctx->wakeup_fds[1] != ctx->wakeup_fds[0])
+		close(ctx->wakeup_fds[1]);
+	ctx->wakeup = 0;
+}
+
+
+int
+libterminput_wakeup(struct libterminput_state *ctx)
+{
+	uint64_t one = 1; /* an eventfd requires exactly 8 bytes */
+	if (!ctx->wakeup) {
+		errno = EINVAL;
+		return -1;
+	}
+	/* EAGAIN means that a wakeup is already pending */
+	if (write(ctx->wakeup_fds[1], &one, sizeof(one)) < 0 && errno != EAGAIN)
+		return -1;
+	return 0;
+}
@@ -3,6 +3,12 @@
 #define LIBTERMINPUT_H
 
 #include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
 
 
 /**
@@ -27,9 +33,51 @@ enum libterminput_flags {
 	 */
 	LIBTERMINPUT_ESC_ON_BLOCK             = 0x0020,
 
-	LIBTERMINPUT_AWAITING_CURSOR_POSITION = 0x0040
+	LIBTERMINPUT_AWAITING_CURSOR_POSITION = 0x0040,
+
+	/**
+	 * Parse replies to device attribute, mode and capability
+	 * queries (CSI ? ... c, CSI > ... c, CSI ? ... $ y, CSI ? ... u)
+	 * as LIBTERMINPUT_REPORT, and device control strings
+	 * (ESC P ... ESC \) as LIBTERMINPUT_DEVICE_CONTROL_STRING;
+	 * the latter conflicts with meta+P key presses.
+	 */
+	LIBTERMINPUT_AWAITING_DEVICE_REPORTS  = 0x0080,
+
+	/**
+	 * Parse operating system commands (ESC ] ... BEL
+	 * or ESC ] ... ESC \), such as replies to clipboard
+	 * and colour queries, as LIBTERMINPUT_OPERATING_SYSTEM_COMMAND;
+	 * this conflicts with meta+] key presses.
+	 */
+	LIBTERMINPUT_AWAITING_OSC             = 0x0100,
+
+	/**
+	 * Return escape sequences that would otherwise be
+	 * discarded, because they are not recognised, as
+	 * LIBTERMINPUT_RAW_SEQUENCE, with the parameters
+	 * already parsed
+	 */
+	LIBTERMINPUT_RAW_UNKNOWN_SEQUENCES    = 0x0200
+};
+
+/**
+ * Classes of input that can be discarded by the
+ * decoder, see libterminput_set_event_mask
+ */
+enum libterminput_event_class {
+	LIBTERMINPUT_EVENT_MOUSE_MOTION    = 0x0001, /* LIBTERMINPUT_MOTION */
+	LIBTERMINPUT_EVENT_MOUSE_HIGHLIGHT = 0x0002, /* LIBTERMINPUT_HIGHLIGHT_INSIDE and LIBTERMINPUT_HIGHLIGHT_OUTSIDE */
+	LIBTERMINPUT_EVENT_MOUSE_SCROLL    = 0x0004, /* presses and releases of LIBTERMINPUT_SCROLL_* */
+	LIBTERMINPUT_EVENT_MOUSE_BUTTON    = 0x0008, /* presses and releases of other buttons */
+	LIBTERMINPUT_EVENT_PASTE           = 0x0010, /* LIBTERMINPUT_BRACKETED_PASTE_* and LIBTERMINPUT_TEXT */
+	LIBTERMINPUT_EVENT_TERMINAL_STATUS = 0x0020, /* LIBTERMINPUT_TERMINAL_IS_OK and LIBTERMINPUT_TERMINAL_IS_NOT_OK */
+	LIBTERMINPUT_EVENT_FOCUS           = 0x0040, /* LIBTERMINPUT_FOCUS_IN and LIBTERMINPUT_FOCUS_OUT */
+	LIBTERMINPUT_EVENT_KEYPAD          = 0x0080  /* key presses of LIBTERMINPUT_KEYPAD_* */
 };
 
+#define LIBTERMINPUT_EVENT_CLASSES 8
+
 enum libterminput_mod {
 	LIBTERMINPUT_SHIFT = 0x01,
 	LIBTERMINPUT_META  = 0x02,
@@ -110,9 +158,17 @@ enum libterminput_type {
 	LIBTERMINPUT_BRACKETED_PASTE_END,
 	LIBTERMINPUT_TEXT,
 	LIBTERMINPUT_MOUSEEVENT,
-	LIBTERMINPUT_TERMINAL_IS_OK,     /* response to CSI 5 n */
-	LIBTERMINPUT_TERMINAL_IS_NOT_OK, /* response to CSI 5 n */
-	LIBTERMINPUT_CURSOR_POSITION     /* response to CSI 6 n */
+	LIBTERMINPUT_TERMINAL_IS_OK,        /* response to CSI 5 n */
+	LIBTERMINPUT_TERMINAL_IS_NOT_OK,    /* response to CSI 5 n */
+	LIBTERMINPUT_CURSOR_POSITION,       /* response to CSI 6 n */
+	LIBTERMINPUT_REPORT,                /* requires LIBTERMINPUT_AWAITING_DEVICE_REPORTS */
+	LIBTERMINPUT_DEVICE_CONTROL_STRING, /* requires LIBTERMINPUT_AWAITING_DEVICE_REPORTS */
+	LIBTERMINPUT_RESIZE,                /* requires CSI ? 2048 h */
+	LIBTERMINPUT_FOCUS_IN,              /* requires CSI ? 1004 h */
+	LIBTERMINPUT_FOCUS_OUT,             /* requires CSI ? 1004 h */
+	LIBTERMINPUT_OPERATING_SYSTEM_COMMAND, /* requires LIBTERMINPUT_AWAITING_OSC */
+	LIBTERMINPUT_RAW_SEQUENCE,          /* requires LIBTERMINPUT_RAW_UNKNOWN_SEQUENCES */
+	LIBTERMINPUT_PASTE_TRUNCATED        /* only returned by libterminput_queue_pop */
 };
 
 enum libterminput_event {
@@ -154,6 +210,43 @@ struct libterminput_position {
 	enum libterminput_type type;
 	size_t x;
 	size_t y;
+	size_t page;                     /* 1 unless reported with DECXCPR */
+	unsigned long long int sequence; /* number of cursor position reports before this one */
+};
+
+struct libterminput_resize {
+	enum libterminput_type type;
+	size_t rows;
+	size_t columns;
+	size_t height; /* in pixels, 0 if not reported */
+	size_t width;  /* in pixels, 0 if not reported */
+};
+
+struct libterminput_report {
+	enum libterminput_type type;
+	char prefix;       /* '?' or '>' */
+	char intermediate; /* '$' for DECRPM, otherwise '\0' */
+	char final;        /* 'c' for DA1 and DA2, 'y' for DECRPM, 'u' for keyboard flags */
+	size_t nparams;
+	unsigned long long int params[16]; /* excess parameters are discarded */
+};
+
+struct libterminput_sequence {
+	enum libterminput_type type;
+	char introducer;       /* '[' for CSI, 'O' for SS3 */
+	char prefix;           /* private marker ('<', '=', '>', or '?'), or '\0' if none */
+	char intermediates[4]; /* NUL-terminated, excess bytes are discarded */
+	char final;
+	size_t nparams;
+	unsigned long long int params[16]; /* omitted parameters are 0, excess parameters are discarded */
+	unsigned int subparams;            /* bit i is set if .params[i] is a sub-parameter (preceded by ':') */
+};
+
+struct libterminput_string {
+	enum libterminput_type type;
+	char more;        /* if set, the string continues in the next event */
+	size_t nbytes;
+	char bytes[512];  /* not NUL-terminated, excludes the introducer and the terminator */
 };
 
 union libterminput_input {
@@ -162,6 +255,96 @@ union libterminput_input {
 	struct libterminput_text text;             /* use if .type == LIBTERMINPUT_TEXT */
 	struct libterminput_mouseevent mouseevent; /* use if .type == LIBTERMINPUT_MOUSEEVENT */
 	struct libterminput_position position;     /* use if .type == LIBTERMINPUT_CURSOR_POSITION */
+	struct libterminput_report report;         /* use if .type == LIBTERMINPUT_REPORT */
+	struct libterminput_string string;         /* use if .type == LIBTERMINPUT_DEVICE_CONTROL_STRING or
+	                                            *        .type == LIBTERMINPUT_OPERATING_SYSTEM_COMMAND */
+	struct libterminput_resize resize;         /* use if .type == LIBTERMINPUT_RESIZE */
+	struct libterminput_sequence sequence;     /* use if .type == LIBTERMINPUT_RAW_SEQUENCE */
+};
+
+
+/*
+ * Fixed-size, 32-byte, representation of union libterminput_input
+ * for event queues and interprocess communication; text, strings,
+ * and report parameters are stored in a separate buffer and referred
+ * to by offset. See libterminput_compact and libterminput_expand.
+ */
+
+struct libterminput_compact_keypress {
+	uint8_t type;
+	uint8_t key;        /* enum libterminput_key */
+	uint8_t mods;       /* enum libterminput_mod */
+	uint32_t times;     /* saturated at UINT32_MAX */
+	uint32_t codepoint; /* the codepoint of .symbol, 0 unless .key == LIBTERMINPUT_SYMBOL */
+	char symbol[7];
+};
+
+struct libterminput_compact_mouseevent {
+	uint8_t type;
+	uint8_t mods;   /* enum libterminput_mod */
+	uint8_t button; /* enum libterminput_button */
+	uint8_t event;  /* enum libterminput_event */
+	uint32_t x;
+	uint32_t y;
+	uint32_t start_x;
+	uint32_t start_y;
+	uint32_t end_x;
+	uint32_t end_y;
+};
+
+struct libterminput_compact_position {
+	uint8_t type;
+	uint32_t x;
+	uint32_t y;
+	uint32_t page;
+	uint64_t sequence;
+};
+
+struct libterminput_compact_resize {
+	uint8_t type;
+	uint32_t rows;
+	uint32_t columns;
+	uint32_t height;
+	uint32_t width;
+};
+
+struct libterminput_compact_report {
+	uint8_t type;
+	char prefix;
+	char intermediate;
+	char final;
+	uint32_t offset;  /* position of the parameters, as unsigned long long int, in the buffer */
+	uint32_t nparams;
+};
+
+struct libterminput_compact_sequence {
+	uint8_t type;
+	char introducer;
+	char prefix;
+	char final;
+	char intermediates[4];
+	uint32_t offset;  /* position of the parameters, as unsigned long long int, in the buffer */
+	uint32_t nparams;
+	uint32_t subparams;
+};
+
+struct libterminput_compact_text {
+	uint8_t type;
+	char more;        /* only used for strings */
+	uint32_t offset;  /* position of the bytes in the buffer */
+	uint32_t nbytes;
+};
+
+union libterminput_compact_input {
+	uint8_t type; /* enum libterminput_type */
+	struct libterminput_compact_keypress keypress;
+	struct libterminput_compact_mouseevent mouseevent;
+	struct libterminput_compact_position position;
+	struct libterminput_compact_resize resize;
+	struct libterminput_compact_report report;
+	struct libterminput_compact_sequence sequence;
+	struct libterminput_compact_text text; /* also used for strings */
+	uint64_t aligned_size[4];
 };
 
 
@@ -173,6 +356,8 @@ struct libterminput_state {
 	enum libterminput_mod mods;
 	enum libterminput_flags flags;
 	char bracketed_paste;
+	char control_string;
+	char unfocused;
 	char mouse_tracking;
 	char meta;
 	char n;
@@ -183,6 +368,138 @@ struct libterminput_state {
 	char partial[7];
 	char key[44];
 	char stored[512];
+	size_t awaiting_positions;
+	unsigned long long int positions_received;
+	enum libterminput_event_class event_mask;
+	unsigned long long int dropped_events[LIBTERMINPUT_EVENT_CLASSES];
+	char wakeup;
+	int wakeup_fds[2];
+};
+
+/**
+ * State for libterminput_base64_decode; shall
+ * be zero-initialised before the first call
+ */
+struct libterminput_base64 {
+	unsigned long int bits;
+	int nbits;
+	char padded;
+};
+
+/**
+ * Handle for a shared memory event ring, see
+ * libterminput_ring_create and libterminput_ring_attach;
+ * this struct should be considered opaque
+ */
+struct libterminput_ring {
+	void *map;
+	size_t map_size;
+	char writable;
+	unsigned long long int cursor;
+	char buf[512];
+};
+
+/**
+ * Key bindings, see libterminput_keymap_create
+ */
+struct libterminput_keymap;
+
+/**
+ * Bounded event queue, see libterminput_queue_create
+ */
+struct libterminput_queue;
+
+/**
+ * What a bounded event queue may do when it is full;
+ * key presses, mouse button presses and releases, and
+ * the beginning and end of pastes are never discarded
+ */
+enum libterminput_overload_policy {
+	LIBTERMINPUT_DROP_OLDEST_MOTION = 0x0001, /* discard the oldest mouse motion event */
+	LIBTERMINPUT_MERGE_SCROLL       = 0x0002, /* discard repeated scroll events */
+	LIBTERMINPUT_TRUNCATE_PASTE     = 0x0004  /* discard the rest of the paste, marked by LIBTERMINPUT_PASTE_TRUNCATED */
+};
+
+enum libterminput_keymap_result {
+	LIBTERMINPUT_KEYMAP_UNBOUND, /* the input is not bound, any pending chord is cancelled */
+	LIBTERMINPUT_KEYMAP_PREFIX,  /* the input begins or continues a chord */
+	LIBTERMINPUT_KEYMAP_MATCH    /* the input completes a binding */
+};
+
+enum libterminput_mouse_encoding {
+	LIBTERMINPUT_MOUSE_X10,   /* CSI M Cb Cx Cy, the default */
+	LIBTERMINPUT_MOUSE_UTF8,  /* CSI ? 1005 h */
+	LIBTERMINPUT_MOUSE_SGR,   /* CSI ? 1006 h */
+	LIBTERMINPUT_MOUSE_URXVT  /* CSI ? 1015 h */
+};
+
+enum libterminput_kitty_flags {
+	LIBTERMINPUT_KITTY_DISAMBIGUATE    = 0x0001,
+	LIBTERMINPUT_KITTY_REPORT_ALL_KEYS = 0x0008
+};
+
+/**
+ * The modes an application has set on its terminal
+ * that affect how input is encoded, see libterminput_encode
+ */
+struct libterminput_mode {
+	char application_cursor_keys; /* CSI ? 1 h */
+	char application_keypad;      /* ESC = */
+	char bracketed_paste;         /* CSI ? 2004 h */
+	char focus_events;            /* CSI ? 1004 h */
+	enum libterminput_mouse_encoding mouse_encoding;
+	enum libterminput_kitty_flags kitty_flags; /* CSI > flags u, other flags are ignored */
+};
+
+#define LIBTERMINPUT_PROBE_MAX_MODES 8
+#define LIBTERMINPUT_PROBE_MAX_CAPABILITIES 8
+
+enum libterminput_probe_query {
+	LIBTERMINPUT_PROBE_DA2            = 0x0001, /* CSI > c */
+	LIBTERMINPUT_PROBE_XTVERSION      = 0x0002, /* CSI > q */
+	LIBTERMINPUT_PROBE_KITTY_KEYBOARD = 0x0004  /* CSI ? u */
+};
+
+struct libterminput_probe_mode {
+	unsigned int mode; /* DEC private mode, set by the application */
+	int value;         /* 0 = not recognised, 1 = set, 2 = reset, 3 = permanently set,
+	                    * 4 = permanently reset, -1 if the terminal did not reply */
+};
+
+struct libterminput_probe_capability {
+	char name[32];  /* terminfo capability name, set by the application */
+	int status;     /* 1 if supported, 0 if not, -1 if the terminal did not reply */
+	char value[96]; /* NUL-terminated, truncated if too long */
+};
+
+/**
+ * Queries to send with libterminput_probe_send and their
+ * replies; the application shall zero-initialise the
+ * struct and then set the query fields
+ */
+struct libterminput_probe {
+	/* Queries */
+	enum libterminput_probe_query queries;
+	size_t nmodes;
+	struct libterminput_probe_mode modes[LIBTERMINPUT_PROBE_MAX_MODES];
+	size_t ncapabilities;
+	struct libterminput_probe_capability capabilities[LIBTERMINPUT_PROBE_MAX_CAPABILITIES];
+
+	/* Replies */
+	char complete;                   /* set if the DA1 reply arrived, cleared on timeout */
+	char have_da2;
+	size_t nda1;
+	unsigned long long int da1[16];  /* DA1 parameters, the first is the conformance level */
+	unsigned long long int da2[3];   /* terminal type, firmware version, and ROM cartridge number */
+	char version[96];                /* XTVERSION reply, empty if none */
+	long int kitty_keyboard_flags;   /* -1 if the terminal did not reply */
+
+	/* Internal */
+	char finished;
+	char set_flag;
+	unsigned long long int deadline;
+	size_t nstring;
+	char string[256];
 };
 
 
@@ -196,6 +513,17 @@ struct libterminput_state {
  */
 int libterminput_read(int fd, union libterminput_input *input, struct libterminput_state *ctx);
 
+/**
+ * Parse input from a memory buffer rather than from the terminal
+ * 
+ * @param   bufp   Pointer to the input, will be updated to point to the unread input
+ * @param   lenp   Pointer to the length of the input, will be updated to the length of the unread input
+ * @param   input  Output parameter for input
+ * @param   ctx    State for the terminal, parts of the state may be stored in `input`
+ * @return         1 normally, 0 when the buffer has been fully consumed
+ */
+int libterminput_read_mem(const char **bufp, size_t *lenp, union libterminput_input *input, struct libterminput_state *ctx);
+
 inline int
 libterminput_is_ready(union libterminput_input *input, struct libterminput_state *ctx)
 {
@@ -206,8 +534,401 @@ libterminput_is_ready(union libterminput_input *input, struct libterminput_state
 	return ctx->stored_head > ctx->stored_tail;
 }
 
+/**
+ * Check whether the terminal has focus, according to
+ * the last focus event; requires CSI ? 1004 h
+ * 
+ * @param   ctx  State for the terminal
+ * @return       1 if the terminal has focus or no focus
+ *               event has been received, 0 otherwise
+ */
+inline int
+libterminput_is_focused(struct libterminput_state *ctx)
+{
+	return !ctx->unfocused;
+}
+
 int libterminput_set_flags(struct libterminput_state *ctx, enum libterminput_flags flags);
 int libterminput_clear_flags(struct libterminput_state *ctx, enum libterminput_flags flags);
 
+/**
+ * Select classes of input that shall be discarded by the
+ * decoder rather than returned; discarded input is still
+ * parsed, so that the input after it is decoded correctly
+ * 
+ * @param   ctx   State for the terminal
+ * @param   mask  The classes of input to discard, replaces the previous mask
+ * @return        0
+ */
+int libterminput_set_event_mask(struct libterminput_state *ctx, enum libterminput_event_class mask);
+
+/**
+ * Get the number of events that have been discarded
+ * because of libterminput_set_event_mask
+ * 
+ * @param   ctx      State for the terminal
+ * @param   classes  The classes of input to count
+ * @return           The number of discarded events in `classes`
+ */
+unsigned long long int libterminput_get_dropped_events(const struct libterminput_state *ctx, enum libterminput_event_class classes);
+
+/**
+ * Make blocking reads from the terminal, with libterminput_read,
+ * interruptible by libterminput_wakeup
+ * 
+ * @param   ctx  State for the terminal
+ * @return       0 on success, -1 on error
+ */
+int libterminput_enable_wakeup(struct libterminput_state *ctx);
+
+/**
+ * Undo libterminput_enable_wakeup and release its resources
+ * 
+ * @param  ctx  State for the terminal
+ */
+void libterminput_disable_wakeup(struct libterminput_state *ctx);
+
+/**
+ * Make the current, or next, blocking read from the
+ * terminal fail with ECANCELED; any partially read
+ * input is kept and decoding resumes with the next read
+ * 
+ * This function may be called from any thread,
+ * and from signal handlers
+ * 
+ * @param   ctx  State for the terminal
+ * @return       0 on success, -1 on error (EINVAL if
+ *               libterminput_enable_wakeup has not been called)
+ */
+int libterminput_wakeup(struct libterminput_state *ctx);
+
+/**
+ * Register that a cursor position query (CSI 6 n or,
+ * preferably, CSI ? 6 n) has been sent to the terminal
+ * 
+ * Replies are matched in order, and while any query is
+ * outstanding, CSI Ps ; Ps R is parsed as a cursor
+ * position report rather than as an F3 key press
+ * 
+ * @param   ctx  State for the terminal
+ * @return       The value the reply's `.position.sequence` will have
+ */
+unsigned long long int libterminput_await_cursor_position(struct libterminput_state *ctx);
+
+/**
+ * Send a batch of capability queries to the terminal,
+ * followed by a DA1 query that marks the end of the batch
+ * 
+ * @param   fd       The file descriptor to the terminal
+ * @param   ctx      State for the terminal, LIBTERMINPUT_AWAITING_DEVICE_REPORTS will be set
+ * @param   probe    The queries to send, and output parameter for the replies
+ * @param   timeout  The number of milliseconds to wait for the replies
+ * @return           0 on success, -1 on error
+ */
+int libterminput_probe_send(int fd, struct libterminput_state *ctx, struct libterminput_probe *probe, unsigned int timeout);
+
+/**
+ * Get input from the terminal while waiting for the
+ * replies to libterminput_probe_send
+ * 
+ * @param   fd     The file descriptor to the terminal
+ * @param   input  Output parameter for input that is not a reply
+ * @param   ctx    State for the terminal, parts of the state may be stored in `input`
+ * @param   probe  The probe passed to libterminput_probe_send
+ * @return         1 if other input was read, 0 when all replies have
+ *                 arrived or the timeout has expired, -1 on error
+ */
+int libterminput_probe_read(int fd, union libterminput_input *input, struct libterminput_state *ctx, struct libterminput_probe *probe);
+
+
+/**
+ * Decode a part of a base64 string, such as the
+ * payload of an OSC 52 clipboard reply, which may
+ * be split at any position
+ * 
+ * @param   state  Decoding state, zero-initialised before the first part
+ * @param   in     The part to decode
+ * @param   n      The number of bytes in `in`
+ * @param   out    Output buffer, must fit at least `n / 4 * 3 + 3` bytes
+ * @return         The number of bytes written to `out`, -1 on error
+ */
+ssize_t libterminput_base64_decode(struct libterminput_base64 *state, const char *in, size_t n, void *out);
+
+
+/**
+ * Convert input to its compact representation
+ * 
+ * @param   out     Output parameter for the compact input
+ * @param   in      The input to convert
+ * @param   buf     Buffer that text, strings, and report parameters are appended to
+ * @param   size    The size of `buf`
+ * @param   lenp    Pointer to the number of bytes used in `buf`, will be updated
+ * @return          0 on success, -1 on error
+ */
+int libterminput_compact(union libterminput_compact_input *out, const union libterminput_input *in,
+                         char *buf, size_t size, size_t *lenp);
+
+/**
+ * Convert input from its compact representation
+ * 
+ * @param  out  Output parameter for the input
+ * @param  in   The compact input to convert
+ * @param  buf  The buffer passed to libterminput_compact
+ */
+void libterminput_expand(union libterminput_input *out, const union libterminput_compact_input *in, const char *buf);
+
+
+/**
+ * Create an event ring, for publishing input to other
+ * processes, in a shared memory object
+ * 
+ * @param   ring      Output parameter for the ring
+ * @param   fd        File descriptor to the shared memory object, e.g. from
+ *                    memfd_create(2) or shm_open(3), it will be resized
+ * @param   capacity  The number of events the ring can hold, must be a power of 2
+ * @return            0 on success, -1 on error
+ */
+int libterminput_ring_create(struct libterminput_ring *ring, int fd, size_t capacity);
+
+/**
+ * Attach to an event ring, created by another process
+ * with libterminput_ring_create, for reading
+ * 
+ * @param   ring  Output parameter for the ring
+ * @param   fd    File descriptor to the shared memory object
+ * @return        0 on success, -1 on error
+ */
+int libterminput_ring_attach(struct libterminput_ring *ring, int fd);
+
+/**
+ * Unmap an event ring, the file descriptor is not closed
+ * 
+ * @param  ring  The ring
+ */
+void libterminput_ring_close(struct libterminput_ring *ring);
+
+/**
+ * Publish input to an event ring; only one process
+ * may publish to a ring, and it must have created it
+ * 
+ * @param   ring   The ring
+ * @param   input  The input to publish
+ * @return         0 on success, -1 on error
+ */
+int libterminput_ring_publish(struct libterminput_ring *ring, const union libterminput_input *input);
+
+/**
+ * Get the next input published to an event ring,
+ * without blocking
+ * 
+ * @param   ring     The ring
+ * @param   input    Output parameter for the input
+ * @param   missedp  Output parameter for the number of events that were
+ *                   overwritten before they could be read, and thus skipped
+ * @return           1 if input was read, 0 if there was no new input
+ */
+int libterminput_ring_consume(struct libterminput_ring *ring, union libterminput_input *input, unsigned long long int *missedp);
+
+
+/**
+ * Create an empty set of key bindings
+ * 
+ * @return  The key bindings, `NULL` on error
+ */
+struct libterminput_keymap *libterminput_keymap_create(void);
+
+/**
+ * Deallocate a set of key bindings
+ * 
+ * @param  map  The key bindings, may be `NULL`
+ */
+void libterminput_keymap_free(struct libterminput_keymap *map);
+
+/**
+ * Add a key binding
+ * 
+ * @param   map   The key bindings
+ * @param   spec  The keys, separated by spaces, for example "C-x C-s",
+ *                "M-<up>", or "<f5>"
+ * @param   data  User data to return when the binding is matched
+ * @return        0 on success, -1 on error
+ */
+int libterminput_keymap_bind(struct libterminput_keymap *map, const char *spec, void *data);
+
+/**
+ * Set the maximum time between the keys in a chord
+ * 
+ * @param  map      The key bindings
+ * @param  timeout  The timeout in milliseconds, 0 for no timeout
+ */
+void libterminput_keymap_set_timeout(struct libterminput_keymap *map, unsigned int timeout);
+
+/**
+ * Cancel any pending chord
+ * 
+ * @param  map  The key bindings
+ */
+void libterminput_keymap_reset(struct libterminput_keymap *map);
+
+/**
+ * Look up input in a set of key bindings
+ * 
+ * @param   map     The key bindings
+ * @param   input   Input from libterminput_read
+ * @param   datap   Output parameter for the binding's user data
+ * @param   timesp  Output parameter for the number of times the binding
+ *                  was pressed; if greater than 1, `input` is updated so
+ *                  that libterminput_read will not return the repetitions
+ * @return          Whether the input matched a binding
+ */
+enum libterminput_keymap_result libterminput_keymap_lookup(struct libterminput_keymap *map, union libterminput_input *input,
+                                                           void **datap, unsigned long long int *timesp);
+
+
+/**
+ * Create a bounded queue for decoded input
+ * 
+ * @param   capacity   The maximum number of queued events
+ * @param   text_size  The number of bytes for text, strings, and
+ *                     report parameters, at least 512
+ * @param   policies   What the queue may do when it is full
+ * @return             The queue, `NULL` on error
+ */
+struct libterminput_queue *libterminput_queue_create(size_t capacity, size_t text_size, enum libterminput_overload_policy policies);
+
+/**
+ * Deallocate a bounded event queue
+ * 
+ * @param  queue  The queue, may be `NULL`
+ */
+void libterminput_queue_free(struct libterminput_queue *queue);
+
+/**
+ * Decode input from the terminal into a bounded event
+ * queue, until the queue is full or no more input is
+ * available without blocking; only the first read may block
+ * 
+ * @param   fd     The file descriptor to the terminal
+ * @param   queue  The queue
+ * @param   ctx    State for the terminal
+ * @return         1 normally, 0 on end of input, -1 on error
+ */
+int libterminput_queue_fill(int fd, struct libterminput_queue *queue, struct libterminput_state *ctx);
+
+/**
+ * Decode input from a memory buffer into a bounded event
+ * queue, until the queue is full or the buffer has been
+ * fully consumed
+ * 
+ * @param   bufp   Pointer to the input, will be updated to point to the unread input
+ * @param   lenp   Pointer to the length of the input, will be updated to the length of the unread input
+ * @param   queue  The queue
+ * @param   ctx    State for the terminal
+ * @return         1 normally, 0 when the buffer has been fully consumed
+ */
+int libterminput_queue_fill_mem(const char **bufp, size_t *lenp, struct libterminput_queue *queue, struct libterminput_state *ctx);
+
+/**
+ * Deliver replies to queries through a separate lane of a
+ * bounded event queue, so that they are not delayed by user
+ * input; when the queue is full, the remaining input that is
+ * available is scanned for replies
+ * 
+ * @param   queue     The queue
+ * @param   capacity  The maximum number of queued replies
+ * @return            0 on success, -1 on error
+ */
+int libterminput_queue_separate_replies(struct libterminput_queue *queue, size_t capacity);
+
+/**
+ * Remove the oldest event from a bounded event queue
+ * 
+ * @param   queue  The queue
+ * @param   input  Output parameter for the input
+ * @return         1 if input was removed, 0 if the queue is empty
+ */
+int libterminput_queue_pop(struct libterminput_queue *queue, union libterminput_input *input);
+
+/**
+ * Remove the oldest reply to a query from a bounded event
+ * queue, see libterminput_queue_separate_replies
+ * 
+ * @param   queue  The queue
+ * @param   input  Output parameter for the reply
+ * @return         1 if a reply was removed, 0 if there is none
+ */
+int libterminput_queue_pop_reply(struct libterminput_queue *queue, union libterminput_input *input);
+
+/**
+ * Get the number of events a bounded event queue
+ * has discarded because of its overload policies
+ * 
+ * @param   queue     The queue
+ * @param   policies  The policies to count
+ * @return            The number of events discarded by `policies`
+ */
+unsigned long long int libterminput_queue_dropped(const struct libterminput_queue *queue, enum libterminput_overload_policy policies);
+
+
+/**
+ * Encode input as a terminal would send it to an
+ * application that has set the specified modes
+ * 
+ * @param   input  The input to encode, .keypress.times is ignored
+ * @param   mode   The application's modes
+ * @param   out    Output buffer, it will not be NUL-terminated
+ * @param   size   The size of `out`
+ * @return         The number of bytes written to `out`, 0 if the
+ *                 input is not sent to the application, -1 on error
+ */
+ssize_t libterminput_encode(const union libterminput_input *input, const struct libterminput_mode *mode, char *out, size_t size);
+
+
+/**
+ * The version of the format written by libterminput_save_state
+ */
+#define LIBTERMINPUT_SAVED_STATE_VERSION 1
+
+/**
+ * The maximum number of bytes written by libterminput_save_state
+ */
+#define LIBTERMINPUT_SAVED_STATE_MAX 1024
+
+/**
+ * Serialise the decoder state, including partially read
+ * input and a keypress that is being repeated, so that
+ * decoding can be resumed in another process
+ * 
+ * The result does not depend on the host's byte order
+ * or type sizes; libterminput_enable_wakeup is not saved
+ * 
+ * @param   ctx    State for the terminal
+ * @param   input  The last input returned for the terminal
+ * @param   buf    Output buffer
+ * @param   size   The size of `buf`
+ * @return         The number of bytes written to `buf`, -1 on error
+ */
+ssize_t libterminput_save_state(const struct libterminput_state *ctx, const union libterminput_input *input, void *buf, size_t size);
+
+/**
+ * Restore a decoder state saved with libterminput_save_state
+ * 
+ * Nothing is modified on failure, and whether
+ * libterminput_enable_wakeup has been called for
+ * `ctx` is not changed
+ * 
+ * @param   ctx    Output parameter for the state
+ * @param   input  Output parameter for the input, to be passed to
+ *                 libterminput_read or libterminput_read_mem with `ctx`
+ * @param   buf    The saved state
+ * @param   len    The number of bytes in `buf`
+ * @return         0 on success, -1 on error
+ */
+int libterminput_restore_state(struct libterminput_state *ctx, union libterminput_input *input, const void *buf, size_t len);
+
+
+#ifdef __cplusplus
+}
+#endif
 
 #endif
@@ -0,0 +1,543 @@
+/* See LICENSE file for copyright and license details. */
+#ifndef LIBTERMINPUT_HPP
+#define LIBTERMINPUT_HPP
+
+#include "libterminput.h"
+
+#include <cerrno>
+#include <coroutine>
+#include <cstddef>
+#include <exception>
+#include <iterator>
+#include <span>
+#include <string_view>
+#include <system_error>
+#include <utility>
+
+
+namespace libterminput {
+
+
+/*
+ * Typed views of union libterminput_input, see event::visit; they
+ * refer to the session's input, and are valid until the next event
+ */
+
+struct keypress_event {
+	const struct libterminput_keypress &data;
+	mutable char32_t codepoint = 0;
+
+	/**
+	 * Get the symbol as codepoints, empty
+	 * unless .data.key == LIBTERMINPUT_SYMBOL
+	 */
+	std::u32string_view
+	codepoints() const noexcept
+	{
+		const unsigned char *u = reinterpret_cast<const unsigned char *>(data.symbol);
+		int n, i;
+		if (data.key != LIBTERMINPUT_SYMBOL)
+			return {};
+		if (!codepoint) {
+			for (n = 0; n < 7 && (u[0] & (0x80 >> n)); n++);
+			codepoint = u[0] & (0x7F >> n);
+			for (i = 1; i < n; i++)
+				codepoint = (codepoint << 6) | (u[i] & 0x3F);
+		}
+		return {&codepoint, 1};
+	}
+};
+
+struct text_event {
+	const struct libterminput_text &data;
+	std::string_view bytes() const noexcept { return {data.bytes, data.nbytes}; }
+};
+
+struct mouse_event {
+	const struct libterminput_mouseevent &data;
+};
+
+struct position_event {
+	const struct libterminput_position &data;
+};
+
+struct report_event {
+	const struct libterminput_report &data;
+	std::span<const unsigned long long int> params() const noexcept { return {data.params, data.nparams}; }
+};
+
+/* LIBTERMINPUT_DEVICE_CONTROL_STRING or LIBTERMINPUT_OPERATING_SYSTEM_COMMAND */
+struct string_event {
+	const struct libterminput_string &data;
+	std::string_view bytes() const noexcept { return {data.bytes, data.nbytes}; }
+};
+
+struct resize_event {
+	const struct libterminput_resize &data;
+};
+
+struct sequence_event {
+	const struct libterminput_sequence &data;
+	std::span<const unsigned long long int> params() const noexcept { return {data.params, data.nparams}; }
+};
+
+/* Events without any data other than the type, such as LIBTERMINPUT_FOCUS_IN */
+struct signal_event {
+	enum libterminput_type type;
+};
+
+
+/**
+ * Combine lambdas into one visitor for event::visit
+ */
+template <class... F>
+struct overloaded : F... {
+	using F::operator()...;
+};
+
+template <class... F>
+overloaded(F...) -> overloaded<F...>;
+
+
+/**
+ * Read-only view of a decoded event
+ */
+class event {
+public:
+	explicit event(const union libterminput_input &input) noexcept : input(input) {}
+
+	enum libterminput_type type() const noexcept { return input.type; }
+	const union libterminput_input &data() const noexcept { return input; }
+
+	/**
+	 * Call `f` with the typed view of the event, as
+	 * std::visit does for a std::variant; this is
+	 * the same switch as on .data().type
+	 */
+	template <class F>
+	decltype(auto)
+	visit(F &&f) const
+	{
+		switch (input.type) {
+		case LIBTERMINPUT_KEYPRESS:
+			return std::forward<F>(f)(keypress_event{input.keypress});
+		case LIBTERMINPUT_TEXT:
+			return std::forward<F>(f)(text_event{input.text});
+		case LIBTERMINPUT_MOUSEEVENT:
+			return std::forward<F>(f)(mouse_event{input.mouseevent});
+		case LIBTERMINPUT_CURSOR_POSITION:
+			return std::forward<F>(f)(position_event{input.position});
+		case LIBTERMINPUT_REPORT:
+			return std::forward<F>(f)(report_event{input.report});
+		case LIBTERMINPUT_DEVICE_CONTROL_STRING:
+		case LIBTERMINPUT_OPERATING_SYSTEM_COMMAND:
+			return std::forward<F>(f)(string_event{input.string});
+		case LIBTERMINPUT_RESIZE:
+			return std::forward<F>(f)(resize_event{input.resize});
+		case LIBTERMINPUT_RAW_SEQUENCE:
+			return std::forward<F>(f)(sequence_event{input.sequence});
+		default:
+			return std::forward<F>(f)(signal_event{input.type});
+		}
+	}
+
+private:
+	const union libterminput_input &input;
+};
+
+
+/* Where an event_range reads its input from */
+
+struct fd_source {
+	int fd;
+	int read(union libterminput_input *input, struct libterminput_state *ctx) noexcept { return libterminput_read(fd, input, ctx); }
+};
+
+struct mem_source {
+	const char *buf;
+	size_t len;
+	int read(union libterminput_input *input, struct libterminput_state *ctx) noexcept { return libterminput_read_mem(&buf, &len, input, ctx); }
+};
+
+
+/**
+ * Input range of the events read by a session, see session::events
+ *
+ * Iteration ends on end of input, when the input in memory has
+ * been consumed, or when a non-blocking file descriptor has no
+ * more input; errors are thrown as std::system_error
+ */
+template <class Source>
+class event_range {
+public:
+	struct sentinel {};
+
+	class iterator {
+	public:
+		using iterator_concept = std::input_iterator_tag;
+		using value_type = event;
+		using difference_type = std::ptrdiff_t;
+
+		iterator() noexcept = default;
+		explicit iterator(event_range *range) noexcept : range(range) {}
+
+		event operator*() const noexcept { return event(range->input); }
+		iterator &operator++() { range->advance(); return *this; }
+		void operator++(int) { range->advance(); }
+		bool operator==(sentinel) const noexcept { return range->done; }
+
+	private:
+		event_range *range = nullptr;
+	};
+
+	event_range(struct libterminput_state &ctx, union libterminput_input &input, Source src) noexcept
+		: ctx(ctx), input(input), src(src) {}
+
+	iterator begin() { advance(); return iterator(this); }
+	sentinel end() const noexcept { return {}; }
+
+private:
+	struct libterminput_state &ctx;
+	union libterminput_input &input;
+	Source src;
+	bool done = false;
+
+	void
+	advance()
+	{
+		int r;
+		for (;;) {
+			r = src.read(&input, &ctx);
+			if (r > 0) {
+				if (input.type != LIBTERMINPUT_NONE)
+					return;
+			} else if (!r || errno == EAGAIN || errno == EWOULDBLOCK) {
+				done = true;
+				return;
+			} else if (errno != EINTR) {
+				done = true;
+				throw std::system_error(errno, std::generic_category());
+			}
+		}
+	}
+};
+
+
+/**
+ * Owner of the decoder state of a terminal; it is move-only,
+ * and releases the state's resources, see libterminput_enable_wakeup,
+ * when destroyed
+ */
+class session {
+public:
+	session() noexcept = default;
+	session(session &&other) noexcept : ctx(std::exchange(other.ctx, {})), in(std::exchange(other.in, {})) {}
+	session(const session &) = delete;
+	session &operator=(const session &) = delete;
+	~session() { libterminput_disable_wakeup(&ctx); }
+
+	session &
+	operator=(session &&other) noexcept
+	{
+		if (this != &other) {
+			libterminput_disable_wakeup(&ctx);
+			ctx = std::exchange(other.ctx, {});
+			in = std::exchange(other.in, {});
+		}
+		return *this;
+	}
+
+	/**
+	 * Get the state, for example to set parsing flags
+	 */
+	struct libterminput_state &state() noexcept { return ctx; }
+
+	/**
+	 * Get the events read from a file descriptor
+	 *
+	 * The range does not allocate memory, and
+	 * the session must outlive it
+	 */
+	event_range<fd_source> events(int fd) noexcept { return {ctx, in, fd_source{fd}}; }
+
+	/**
+	 * Get the events decoded from memory, any
+	 * incomplete input at the end is kept in the
+	 * state, see libterminput_read_mem(3)
+	 *
+	 * The range does not allocate memory, and
+	 * the session must outlive it
+	 */
+	event_range<mem_source> events(std::string_view data) noexcept { return {ctx, in, mem_source{data.data(), data.size()}}; }
+
+private:
+	friend class terminal;
+
+	struct libterminput_state ctx = {};
+	union libterminput_input in = {};
+};
+
+
+/**
+ * Callback for reactor::wait_readable
+ */
+class waiter {
+public:
+	/**
+	 * Called by the reactor when the terminal is
+	 * readable or the timeout has expired
+	 *
+	 * @param  timed_out  Whether the timeout expired
+	 */
+	virtual void wake(bool timed_out) = 0;
+
+protected:
+	~waiter() = default;
+};
+
+
+/**
+ * The application's event loop, which coroutines that
+ * read from the terminal suspend on when it has no input
+ */
+class reactor {
+public:
+	/**
+	 * Call `w.wake` once, when `fd` becomes readable,
+	 * or after `timeout` milliseconds have passed
+	 *
+	 * `w.wake` may be called before this function
+	 * returns, but need not be
+	 *
+	 * @param  fd       The terminal's file descriptor
+	 * @param  timeout  The timeout in milliseconds, -1 for none
+	 * @param  w        The object to call when done
+	 */
+	virtual void wait_readable(int fd, int timeout, waiter &w) = 0;
+
+protected:
+	~reactor() = default;
+};
+
+
+/**
+ * Coroutine that yields every event that a terminal
+ * sends, see terminal::events
+ */
+class event_generator {
+public:
+	struct promise_type;
+	using handle_type = std::coroutine_handle<promise_type>;
+
+private:
+	/* Hand control back to the coroutine awaiting next() */
+	struct transfer {
+		bool await_ready() const noexcept { return false; }
+		std::coroutine_handle<> await_suspend(handle_type h) const noexcept { return h.promise().consumer; }
+		void await_resume() const noexcept {}
+	};
+
+public:
+	struct promise_type {
+		const union libterminput_input *current = nullptr;
+		std::coroutine_handle<> consumer;
+		std::exception_ptr error;
+
+		event_generator get_return_object() noexcept { return event_generator(handle_type::from_promise(*this)); }
+		std::suspend_always initial_suspend() const noexcept { return {}; }
+		transfer final_suspend() const noexcept { return {}; }
+		transfer yield_value(const union libterminput_input &input) noexcept { current = &input; return {}; }
+		void return_void() noexcept { current = nullptr; }
+		void unhandled_exception() noexcept { current = nullptr; error = std::current_exception(); }
+	};
+
+	struct next_awaiter {
+		handle_type h;
+
+		bool await_ready() const noexcept { return h.done(); }
+
+		std::coroutine_handle<>
+		await_suspend(std::coroutine_handle<> consumer) const noexcept
+		{
+			h.promise().consumer = consumer;
+			return h;
+		}
+
+		const union libterminput_input *
+		await_resume() const
+		{
+			if (h.promise().error)
+				std::rethrow_exception(std::exchange(h.promise().error, nullptr));
+			return h.done() ? nullptr : h.promise().current;
+		}
+	};
+
+	explicit event_generator(handle_type h) noexcept : h(h) {}
+	event_generator(event_generator &&other) noexcept : h(std::exchange(other.h, nullptr)) {}
+	event_generator(const event_generator &) = delete;
+	event_generator &operator=(const event_generator &) = delete;
+	~event_generator() { if (h) h.destroy(); }
+
+	/**
+	 * Get the next event
+	 *
+	 * The returned pointer is valid until the
+	 * next call; a null pointer is returned on
+	 * end of input; errors are thrown as
+	 * std::system_error
+	 */
+	next_awaiter next() noexcept { return {h}; }
+
+private:
+	handle_type h;
+};
+
+
+/**
+ * Coroutine interface to a terminal, whose file
+ * descriptor must be in non-blocking mode
+ *
+ * Only one coroutine may wait for input at a time
+ */
+class terminal final : private waiter {
+public:
+	struct next_event_awaiter {
+		terminal &t;
+
+		bool await_ready() { return t.poll_event(); }
+
+		void
+		await_suspend(std::coroutine_handle<> h)
+		{
+			t.resumee = h;
+			t.suspend();
+		}
+
+		const union libterminput_input *
+		await_resume()
+		{
+			if (t.error)
+				std::rethrow_exception(std::exchange(t.error, nullptr));
+			return t.eof ? nullptr : &t.s.in;
+		}
+	};
+
+	/**
+	 * @param  fd           The terminal's file descriptor, which must be non-blocking
+	 * @param  loop         The event loop to wait for input on
+	 * @param  esc_timeout  The number of milliseconds to wait for input after
+	 *                      an ESC before it is returned as an ESC keypress,
+	 *                      -1 to wait until the next input
+	 */
+	terminal(int fd, reactor &loop, int esc_timeout = 50) noexcept : fd(fd), loop(loop), esc_timeout(esc_timeout) {}
+	terminal(const terminal &) = delete;
+	terminal &operator=(const terminal &) = delete;
+
+	/**
+	 * Get the state, for example to set parsing flags
+	 */
+	struct libterminput_state &state() noexcept { return s.ctx; }
+
+	/**
+	 * Get the next event
+	 *
+	 * `co_await` evaluates to a pointer to the event,
+	 * which is valid until the next event is read, or
+	 * to a null pointer on end of input; errors are
+	 * thrown as std::system_error
+	 *
+	 * The coroutine only suspends if the terminal has
+	 * no input, not for input that has already been read
+	 */
+	next_event_awaiter next_event() noexcept { return {*this}; }
+
+	/**
+	 * Get a generator that yields every event, until
+	 * end of input, without allocating per event
+	 */
+	event_generator events();
+
+private:
+	int fd;
+	reactor &loop;
+	int esc_timeout;
+	bool eof = false;
+	session s;
+	std::coroutine_handle<> resumee;
+	std::exception_ptr error;
+
+	/* Whether the only pending input is one or two ESC's */
+	bool
+	esc_pending() const noexcept
+	{
+		const struct libterminput_state &ctx = s.ctx;
+		return ctx.meta && !ctx.n && !*ctx.key && !ctx.bracketed_paste && !ctx.control_string &&
+		       !ctx.mouse_tracking && ctx.stored_head == ctx.stored_tail;
+	}
+
+	/* Read the next event, false if the terminal would block */
+	bool
+	poll_event()
+	{
+		int r;
+		for (;;) {
+			r = libterminput_read(fd, &s.in, &s.ctx);
+			if (r < 0) {
+				if (errno == EAGAIN || errno == EWOULDBLOCK)
+					return false;
+				if (errno != EINTR)
+					throw std::system_error(errno, std::generic_category());
+			} else if (!r) {
+				eof = true;
+				return true;
+			} else if (s.in.type != LIBTERMINPUT_NONE) {
+				return true;
+			}
+		}
+	}
+
+	void
+	suspend()
+	{
+		loop.wait_readable(fd, esc_timeout >= 0 && esc_pending() ? esc_timeout : -1, *this);
+	}
+
+	void
+	wake(bool timed_out) override
+	{
+		if (timed_out && esc_pending()) {
+			/* As with LIBTERMINPUT_ESC_ON_BLOCK: ESC ESC is Meta+ESC */
+			s.in.keypress.type = LIBTERMINPUT_KEYPRESS;
+			s.in.keypress.key = LIBTERMINPUT_ESC;
+			s.in.keypress.mods = (enum libterminput_mod)(s.ctx.mods | (s.ctx.meta > 1 ? LIBTERMINPUT_META : 0));
+			s.in.keypress.times = 1;
+			s.in.keypress.symbol[0] = '\0';
+			s.ctx.mods = (enum libterminput_mod)0;
+			s.ctx.meta = 0;
+		} else {
+			try {
+				if (!poll_event()) {
+					suspend();
+					return;
+				}
+			} catch (...) {
+				error = std::current_exception();
+			}
+		}
+		std::exchange(resumee, nullptr).resume();
+	}
+};
+
+
+inline event_generator
+terminal::events()
+{
+	const union libterminput_input *input;
+	while ((input = co_await next_event()))
+		co_yield *input;
+}
+
+
+}
+
+#endif
@@ -0,0 +1,84 @@
+/* See LICENSE file for copyright and license details. */
+#include "libterminput.h"
+
+#include <errno.h>
+
+
+#define XX 0xFF /* not in the alphabet */
+#define PD 0xFE /* padding */
+
+static const unsigned char values[256] = {
+	XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX,
+	XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX,
+	XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, 62, XX, XX, XX, 63,
+	52, 53, 54, 55, 56, 57, 58, 59, 60, 61, XX, XX, XX, PD, XX, XX,
+	XX,  0,  1,  2,  3,  4,  5,  6,  7,  8,  9, 10, 11, 12, 13, 14,
+	15, 16, 17, 18, 19, 20, 21, 22, 23, 24, 25, XX, XX, XX, XX, XX,
+	XX, 26, 27, 28, 29, 30, 31, 32, 33, 34, 35, 36, 37, 38, 39, 40,
+	41, 42, 43, 44, 45, 46, 47, 48, 49, 50, 51, XX, XX, XX, XX, XX,
+	XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX,
+	XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX,
+	XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX,
+	XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX,
+	XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX,
+	XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX,
+	XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX,
+	XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX
+};
+
+
+ssize_t
+libterminput_base64_decode(struct libterminput_base64 *state, const char *in, size_t n, void *out)
+{
+	const unsigned char *s = (const void *)in;
+	unsigned char *o = out;
+	unsigned long int a, b, c, d;
+	size_t i = 0;
+
+	for (;;) {
+		/* Whole groups of four characters, which make three bytes,
+		 * are decoded together and checked with a single branch */
+		if (!state->nbits && !state->padded) {
+			for (; n - i >= 4; i += 4, o += 3) {
+				a = values[s[i + 0]];
+				b = values[s[i + 1]];
+				c = values[s[i + 2]];
+				d = values[s[i + 3]];
+				if ((a | b | c | d) & 0x80)
+					break;
+				a = (a << 18) | (b << 12) | (c << 6) | d;
+				o[0] = (unsigned char)(a >> 16);
+				o[1] = (unsigned char)(a >> 8);
+				o[2] = (unsigned char)(a >> 0);
+			}
+		}
+		if (i == n)
+			break;
+
+		/* Otherwise decode one character at a time, this happens at
+		 * padding and when a group was split between two parts */
+		a = values[s[i++]];
+		if (a == PD) {
+			if (!state->padded && state->nbits != 2 && state->nbits != 4)
+				goto einval;
+			state->padded = 1;
+			state->nbits = 0;
+			state->bits = 0;
+		} else if (a == XX || state->padded) {
+			goto einval;
+		} else {
+			state->bits = ((state->bits << 6) | a) & 0xFFFUL;
+			state->nbits += 6;
+			if (state->nbits >= 8) {
+				state->nbits -= 8;
+				*o++ = (unsigned char)(state->bits >> state->nbits);
+			}
+		}
+	}
+
+	return (ssize_t)(o - (unsigned char *)out);
+
+einval:
+	errno = EINVAL;
+	return -1;
+}
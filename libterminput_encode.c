@@ -0,0 +1,490 @@
+/* See LICENSE file for copyright and license details. */
+#include "libterminput.h"
+
+#include <errno.h>
+#include <string.h>
+
+
+enum encoding {
+	ENCODE_SYMBOL,  /* the text, or CSI codepoint u */
+	ENCODE_CONTROL, /* a control character, or CSI codepoint u */
+	ENCODE_CURSOR,  /* CSI final, or SS3 final in application cursor key mode */
+	ENCODE_SS3,     /* SS3 final */
+	ENCODE_CSI,     /* CSI final */
+	ENCODE_TILDE,   /* CSI number ~ */
+	ENCODE_KEYPAD   /* SS3 final in application keypad mode, otherwise the character `number` */
+};
+
+/* Modified keys are encoded as CSI 1 ; modifiers final, except
+ * ENCODE_TILDE keys which are encoded as CSI number ; modifiers ~ */
+static const struct key_encoding {
+	unsigned char encoding;
+	char final;
+	unsigned char number;
+} keys[] = {
+	[LIBTERMINPUT_SYMBOL]          = {ENCODE_SYMBOL,  0,    0},
+	[LIBTERMINPUT_UP]              = {ENCODE_CURSOR,  'A',  0},
+	[LIBTERMINPUT_DOWN]            = {ENCODE_CURSOR,  'B',  0},
+	[LIBTERMINPUT_RIGHT]           = {ENCODE_CURSOR,  'C',  0},
+	[LIBTERMINPUT_LEFT]            = {ENCODE_CURSOR,  'D',  0},
+	[LIBTERMINPUT_BEGIN]           = {ENCODE_CURSOR,  'E',  0},
+	[LIBTERMINPUT_TAB]             = {ENCODE_CONTROL, 0,    '\t'},
+	[LIBTERMINPUT_BACKTAB]         = {ENCODE_CSI,     'Z',  0},
+	[LIBTERMINPUT_F1]              = {ENCODE_SS3,     'P',  0},
+	[LIBTERMINPUT_F2]              = {ENCODE_SS3,     'Q',  0},
+	[LIBTERMINPUT_F3]              = {ENCODE_SS3,     'R',  0},
+	[LIBTERMINPUT_F4]              = {ENCODE_SS3,     'S',  0},
+	[LIBTERMINPUT_F5]              = {ENCODE_TILDE,   '~',  15},
+	[LIBTERMINPUT_F6]              = {ENCODE_TILDE,   '~',  17},
+	[LIBTERMINPUT_F7]              = {ENCODE_TILDE,   '~',  18},
+	[LIBTERMINPUT_F8]              = {ENCODE_TILDE,   '~',  19},
+	[LIBTERMINPUT_F9]              = {ENCODE_TILDE,   '~',  20},
+	[LIBTERMINPUT_F10]             = {ENCODE_TILDE,   '~',  21},
+	[LIBTERMINPUT_F11]             = {ENCODE_TILDE,   '~',  23},
+	[LIBTERMINPUT_F12]             = {ENCODE_TILDE,   '~',  24},
+	[LIBTERMINPUT_HOME]            = {ENCODE_CURSOR,  'H',  0},
+	[LIBTERMINPUT_INS]             = {ENCODE_TILDE,   '~',  2},
+	[LIBTERMINPUT_DEL]             = {ENCODE_TILDE,   '~',  3},
+	[LIBTERMINPUT_END]             = {ENCODE_CURSOR,  'F',  0},
+	[LIBTERMINPUT_PRIOR]           = {ENCODE_TILDE,   '~',  5},
+	[LIBTERMINPUT_NEXT]            = {ENCODE_TILDE,   '~',  6},
+	[LIBTERMINPUT_ERASE]           = {ENCODE_CONTROL, 0,    127},
+	[LIBTERMINPUT_ENTER]           = {ENCODE_CONTROL, 0,    '\r'},
+	[LIBTERMINPUT_ESC]             = {ENCODE_CONTROL, 0,    033},
+	[LIBTERMINPUT_MACRO]           = {ENCODE_CSI,     'M',  0},
+	[LIBTERMINPUT_PAUSE]           = {ENCODE_CSI,     'P',  0},
+	[LIBTERMINPUT_KEYPAD_0]        = {ENCODE_KEYPAD,  'p',  '0'},
+	[LIBTERMINPUT_KEYPAD_1]        = {ENCODE_KEYPAD,  'q',  '1'},
+	[LIBTERMINPUT_KEYPAD_2]        = {ENCODE_KEYPAD,  'r',  '2'},
+	[LIBTERMINPUT_KEYPAD_3]        = {ENCODE_KEYPAD,  's',  '3'},
+	[LIBTERMINPUT_KEYPAD_4]        = {ENCODE_KEYPAD,  't',  '4'},
+	[LIBTERMINPUT_KEYPAD_5]        = {ENCODE_KEYPAD,  'u',  '5'},
+	[LIBTERMINPUT_KEYPAD_6]        = {ENCODE_KEYPAD,  'v',  '6'},
+	[LIBTERMINPUT_KEYPAD_7]        = {ENCODE_KEYPAD,  'w',  '7'},
+	[LIBTERMINPUT_KEYPAD_8]        = {ENCODE_KEYPAD,  'x',  '8'},
+	[LIBTERMINPUT_KEYPAD_9]        = {ENCODE_KEYPAD,  'y',  '9'},
+	[LIBTERMINPUT_KEYPAD_PLUS]     = {ENCODE_KEYPAD,  'k',  '+'},
+	[LIBTERMINPUT_KEYPAD_MINUS]    = {ENCODE_KEYPAD,  'm',  '-'},
+	[LIBTERMINPUT_KEYPAD_TIMES]    = {ENCODE_KEYPAD,  'j',  '*'},
+	[LIBTERMINPUT_KEYPAD_DIVISION] = {ENCODE_KEYPAD,  'o',  '/'},
+	[LIBTERMINPUT_KEYPAD_DECIMAL]  = {ENCODE_KEYPAD,  'n',  '.'},
+	[LIBTERMINPUT_KEYPAD_COMMA]    = {ENCODE_KEYPAD,  'l',  ','},
+	[LIBTERMINPUT_KEYPAD_POINT]    = {ENCODE_KEYPAD,  'b',  '.'},
+	[LIBTERMINPUT_KEYPAD_ENTER]    = {ENCODE_KEYPAD,  'M',  '\r'}
+};
+
+/* Button numbers in mouse reports, before modifiers and motion are added */
+static const unsigned char buttons[] = {
+	[LIBTERMINPUT_NO_BUTTON]    = 3,
+	[LIBTERMINPUT_BUTTON1]      = 0,
+	[LIBTERMINPUT_BUTTON2]      = 1,
+	[LIBTERMINPUT_BUTTON3]      = 2,
+	[LIBTERMINPUT_SCROLL_UP]    = 64,
+	[LIBTERMINPUT_SCROLL_DOWN]  = 65,
+	[LIBTERMINPUT_SCROLL_LEFT]  = 66,
+	[LIBTERMINPUT_SCROLL_RIGHT] = 67,
+	[LIBTERMINPUT_XBUTTON1]     = 128,
+	[LIBTERMINPUT_XBUTTON2]     = 129,
+	[LIBTERMINPUT_XBUTTON3]     = 130,
+	[LIBTERMINPUT_XBUTTON4]     = 131
+};
+
+
+/* Output is counted even if it does not fit, so that
+ * overflow can be checked once at the end */
+struct output {
+	char *buf;
+	size_t size;
+	size_t len;
+};
+
+
+static void
+put(struct output *out, const char *s, size_t n)
+{
+	if (out->len <= out->size && n <= out->size - out->len)
+		memcpy(&out->buf[out->len], s, n);
+	out->len += n;
+}
+
+
+static void
+put_byte(struct output *out, unsigned char c)
+{
+	if (out->len < out->size)
+		out->buf[out->len] = (char)c;
+	out->len += 1;
+}
+
+
+static void
+put_number(struct output *out, unsigned long long int n)
+{
+	char digits[3 * sizeof(n)];
+	size_t i = sizeof(digits);
+	do
+		digits[--i] = (char)('0' + n % 10);
+	while (n /= 10);
+	put(out, &digits[i], sizeof(digits) - i);
+}
+
+
+/* CSI parameter ; parameter final, the second parameter is omitted if 0 */
+static void
+put_csi(struct output *out, unsigned long long int param1, unsigned int param2, char final)
+{
+	put(out, "\033[", 2);
+	put_number(out, param1);
+	if (param2) {
+		put_byte(out, ';');
+		put_number(out, param2);
+	}
+	put_byte(out, (unsigned char)final);
+}
+
+
+/* Get the codepoint of a NUL-terminated UTF-8 character, and its length, 0 if invalid */
+static size_t
+symbol_codepoint(const char *s, unsigned long int *cpp)
+{
+	const unsigned char *u = (const void *)s;
+	size_t n, i;
+
+	if (u[0] < 0x80) {
+		*cpp = u[0];
+		return u[0] ? 1 : 0;
+	}
+	for (n = 0; n < 7 && (u[0] & (0x80 >> n)); n++);
+	if (n < 2 || n > 6)
+		return 0;
+	*cpp = u[0] & (0x7FU >> n);
+	for (i = 1; i < n; i++) {
+		if ((u[i] & 0xC0) != 0x80)
+			return 0;
+		*cpp = (*cpp << 6) | (u[i] & 0x3F);
+	}
+	return u[n] ? 0 : n;
+}
+
+
+static int
+encode_keypress(struct output *out, const struct libterminput_keypress *keypress, const struct libterminput_mode *mode)
+{
+	const struct key_encoding *key;
+	unsigned int mods = (unsigned int)keypress->mods & 7U;
+	unsigned int modparam = mods ? mods + 1 : 0;
+	unsigned long int cp;
+	const char *text;
+	size_t n;
+	unsigned char c;
+
+	if ((size_t)keypress->key >= sizeof(keys) / sizeof(*keys))
+		goto einval;
+	key = &keys[keypress->key];
+
+	switch (key->encoding) {
+	case ENCODE_CURSOR:
+		if (!mods && mode->application_cursor_keys) {
+			put(out, "\033O", 2);
+			put_byte(out, (unsigned char)key->final);
+			return 0;
+		}
+		/* fall through */
+	case ENCODE_CSI:
+		if (!mods) {
+			put(out, "\033[", 2);
+			put_byte(out, (unsigned char)key->final);
+		} else {
+			put_csi(out, 1, modparam, key->final);
+		}
+		return 0;
+
+	case ENCODE_SS3:
+		if (!mods) {
+			put(out, "\033O", 2);
+			put_byte(out, (unsigned char)key->final);
+		} else {
+			put_csi(out, 1, modparam, key->final);
+		}
+		return 0;
+
+	case ENCODE_TILDE:
+		put_csi(out, key->number, modparam, '~');
+		return 0;
+
+	case ENCODE_KEYPAD:
+		if (!mods && mode->application_keypad) {
+			put(out, "\033O", 2);
+			put_byte(out, (unsigned char)key->final);
+			return 0;
+		}
+		if (key->number == '\r')
+			goto control;
+		cp = key->number;
+		text = (const char *)&key->number;
+		n = 1;
+		goto symbol;
+
+	case ENCODE_CONTROL:
+	control:
+		c = key->number;
+		cp = c;
+		if (mode->kitty_flags & LIBTERMINPUT_KITTY_REPORT_ALL_KEYS)
+			goto csi_u;
+		if (!mode->kitty_flags && c == '\t' && mods == LIBTERMINPUT_SHIFT) {
+			put(out, "\033[Z", 3);
+			return 0;
+		}
+		if (c == 033 && (mods || (mode->kitty_flags & LIBTERMINPUT_KITTY_DISAMBIGUATE)))
+			goto csi_u;
+		if (mods == LIBTERMINPUT_META && !mode->kitty_flags)
+			put_byte(out, 033);
+		else if (mods)
+			goto csi_u;
+		put_byte(out, c);
+		return 0;
+
+	case ENCODE_SYMBOL:
+	default:
+		text = keypress->symbol;
+		n = symbol_codepoint(text, &cp);
+		if (!n) {
+			if (*text)
+				goto einval;
+			cp = 0;
+			goto csi_u;
+		}
+	symbol:
+		if (mode->kitty_flags & LIBTERMINPUT_KITTY_REPORT_ALL_KEYS)
+			goto csi_u;
+		if ((mode->kitty_flags & LIBTERMINPUT_KITTY_DISAMBIGUATE) && (mods & (LIBTERMINPUT_META | LIBTERMINPUT_CTRL)))
+			goto csi_u;
+		if (mods & LIBTERMINPUT_CTRL) {
+			/* Only some characters have control characters, and some
+			 * control characters are the same as other keys */
+			c = (unsigned char)text[0];
+			if (n != 1 || !(c == ' ' || ('@' <= c && c <= '_') || ('a' <= c && c <= 'z')))
+				goto csi_u;
+			c &= 0x1F;
+			if (c == '\b' || c == '\t' || c == '\n' || c == 033)
+				goto csi_u;
+			if (mods & LIBTERMINPUT_META)
+				put_byte(out, 033);
+			put_byte(out, c);
+			return 0;
+		}
+		if (mods & LIBTERMINPUT_META) {
+			/* ESC [ and ESC O begin escape sequences */
+			if (n == 1 && (text[0] == '[' || text[0] == 'O'))
+				goto csi_u;
+			put_byte(out, 033);
+		}
+		/* Shift is already applied to the text */
+		put(out, text, n);
+		return 0;
+	}
+
+csi_u:
+	put_csi(out, cp, modparam, 'u');
+	return 0;
+
+einval:
+	errno = EINVAL;
+	return -1;
+}
+
+
+static void
+put_utf8(struct output *out, unsigned long long int value)
+{
+	if (value < 0x80) {
+		put_byte(out, (unsigned char)value);
+	} else {
+		put_byte(out, (unsigned char)(0xC0 | (value >> 6)));
+		put_byte(out, (unsigned char)(0x80 | (value & 0x3F)));
+	}
+}
+
+
+static int
+encode_mouseevent(struct output *out, const struct libterminput_mouseevent *mouse, const struct libterminput_mode *mode)
+{
+	unsigned long long int b, values[6];
+	size_t i, n = 3;
+
+	if (mouse->event == LIBTERMINPUT_HIGHLIGHT_INSIDE || mouse->event == LIBTERMINPUT_HIGHLIGHT_OUTSIDE) {
+		/* Mouse highlight tracking, CSI t Cx Cy or CSI T Cx Cy Cx Cy Cx Cy */
+		if (mouse->event == LIBTERMINPUT_HIGHLIGHT_INSIDE) {
+			put(out, "\033[t", 3);
+			values[0] = mouse->x;
+			values[1] = mouse->y;
+			n = 2;
+		} else {
+			put(out, "\033[T", 3);
+			values[0] = mouse->start_x;
+			values[1] = mouse->start_y;
+			values[2] = mouse->end_x;
+			values[3] = mouse->end_y;
+			values[4] = mouse->x;
+			values[5] = mouse->y;
+			n = 6;
+		}
+		for (i = 0; i < n; i++) {
+			if (values[i] > 255 - 32)
+				goto einval;
+			put_byte(out, (unsigned char)(values[i] + 32));
+		}
+		return 0;
+	}
+
+	if ((size_t)mouse->button >= sizeof(buttons) / sizeof(*buttons))
+		goto einval;
+	b = buttons[mouse->button];
+	if (mouse->event == LIBTERMINPUT_RELEASE && mode->mouse_encoding != LIBTERMINPUT_MOUSE_SGR)
+		b = 3; /* only SGR reports which button was released */
+	b |= ((unsigned long long int)mouse->mods & 7ULL) << 2;
+	if (mouse->event == LIBTERMINPUT_MOTION)
+		b |= 32;
+
+	switch (mode->mouse_encoding) {
+	case LIBTERMINPUT_MOUSE_SGR:
+		put(out, "\033[<", 3);
+		put_number(out, b);
+		put_byte(out, ';');
+		put_number(out, mouse->x);
+		put_byte(out, ';');
+		put_number(out, mouse->y);
+		put_byte(out, mouse->event == LIBTERMINPUT_RELEASE ? 'm' : 'M');
+		return 0;
+
+	case LIBTERMINPUT_MOUSE_URXVT:
+		put(out, "\033[", 2);
+		put_number(out, b + 32);
+		put_byte(out, ';');
+		put_number(out, mouse->x);
+		put_byte(out, ';');
+		put_number(out, mouse->y);
+		put_byte(out, 'M');
+		return 0;
+
+	case LIBTERMINPUT_MOUSE_UTF8:
+	case LIBTERMINPUT_MOUSE_X10:
+		values[0] = b;
+		values[1] = mouse->x;
+		values[2] = mouse->y;
+		put(out, "\033[M", 3);
+		for (i = 0; i < n; i++) {
+			if (mode->mouse_encoding == LIBTERMINPUT_MOUSE_X10) {
+				if (values[i] > 255 - 32)
+					goto einval;
+				put_byte(out, (unsigned char)(values[i] + 32));
+			} else {
+				if (values[i] > 0x7FF - 32)
+					goto einval;
+				put_utf8(out, values[i] + 32);
+			}
+		}
+		return 0;
+
+	default:
+		goto einval;
+	}
+
+einval:
+	errno = EINVAL;
+	return -1;
+}
+
+
+static void
+encode_sequence(struct output *out, const struct libterminput_sequence *sequence)
+{
+	size_t i;
+	put_byte(out, 033);
+	put_byte(out, (unsigned char)sequence->introducer);
+	if (sequence->prefix)
+		put_byte(out, (unsigned char)sequence->prefix);
+	for (i = 0; i < sequence->nparams && i < sizeof(sequence->params) / sizeof(*sequence->params); i++) {
+		if (i)
+			put_byte(out, ((sequence->subparams >> i) & 1U) ? ':' : ';');
+		put_number(out, sequence->params[i]);
+	}
+	put(out, sequence->intermediates, strnlen(sequence->intermediates, sizeof(sequence->intermediates)));
+	put_byte(out, (unsigned char)sequence->final);
+}
+
+
+ssize_t
+libterminput_encode(const union libterminput_input *input, const struct libterminput_mode *mode, char *buf, size_t size)
+{
+	struct output out;
+
+	out.buf = buf;
+	out.size = size;
+	out.len = 0;
+
+	switch (input->type) {
+	case LIBTERMINPUT_KEYPRESS:
+		if (encode_keypress(&out, &input->keypress, mode))
+			return -1;
+		break;
+
+	case LIBTERMINPUT_MOUSEEVENT:
+		if (encode_mouseevent(&out, &input->mouseevent, mode))
+			return -1;
+		break;
+
+	case LIBTERMINPUT_BRACKETED_PASTE_START:
+		if (mode->bracketed_paste)
+			put(&out, "\033[200~", 6);
+		break;
+
+	case LIBTERMINPUT_BRACKETED_PASTE_END:
+		if (mode->bracketed_paste)
+			put(&out, "\033[201~", 6);
+		break;
+
+	case LIBTERMINPUT_TEXT:
+		put(&out, input->text.bytes, input->text.nbytes);
+		break;
+
+	case LIBTERMINPUT_FOCUS_IN:
+		if (mode->focus_events)
+			put(&out, "\033[I", 3);
+		break;
+
+	case LIBTERMINPUT_FOCUS_OUT:
+		if (mode->focus_events)
+			put(&out, "\033[O", 3);
+		break;
+
+	case LIBTERMINPUT_TERMINAL_IS_OK:
+		put(&out, "\033[0n", 4);
+		break;
+
+	case LIBTERMINPUT_TERMINAL_IS_NOT_OK:
+		put(&out, "\033[3n", 4);
+		break;
+
+	case LIBTERMINPUT_CURSOR_POSITION:
+		put_csi(&out, input->position.y, 0, ';');
+		put_number(&out, input->position.x);
+		put_byte(&out, 'R');
+		break;
+
+	case LIBTERMINPUT_RAW_SEQUENCE:
+		encode_sequence(&out, &input->sequence);
+		break;
+
+	default:
+		/* Replies to queries and notifications that the
+		 * application has not asked for are not sent */
+		break;
+	}
+
+	if (out.len > size) {
+		errno = ENOBUFS;
+		return -1;
+	}
+	return (ssize_t)out.len;
+}
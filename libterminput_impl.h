@@ -0,0 +1,4933 @@
+#if defined(LIBTERMINPUT_IMPLEMENTATION) && !defined(LIBTERMINPUT_IMPLEMENTED)
+# ifndef _DEFAULT_SOURCE
+#  define _DEFAULT_SOURCE
+# endif
+# ifndef _BSD_SOURCE
+#  define _BSD_SOURCE
+# endif
+# ifndef _XOPEN_SOURCE
+#  define _XOPEN_SOURCE 700
+# endif
+#endif
+
+/* See LICENSE file for copyright and license details. */
+#ifndef LIBTERMINPUT_H
+#define LIBTERMINPUT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/**
+ * Flags for supporting incompatible input; the user must
+ * set or clear his flag after setting or clearing it on
+ * the terminal, and the user must make sure that the
+ * terminal support this flag if set.
+ */
+enum libterminput_flags {
+	LIBTERMINPUT_DECSET_1005              = 0x0001,
+	LIBTERMINPUT_MACRO_ON_CSI_M           = 0x0002,
+	LIBTERMINPUT_PAUSE_ON_CSI_P           = 0x0004,
+	LIBTERMINPUT_INS_ON_CSI_AT            = 0x0008,
+	LIBTERMINPUT_SEPARATE_BACKTAB         = 0x0010,
+
+	/**
+	 * If an ESC is received without anything after it,
+	 * return ESC keypress. This is not always desirable
+	 * behaviour as the user may manually press ESC to
+	 * simulate a keypress that terminal does not support
+	 * (yes, this is a real world issue).
+	 */
+	LIBTERMINPUT_ESC_ON_BLOCK             = 0x0020,
+
+	LIBTERMINPUT_AWAITING_CURSOR_POSITION = 0x0040,
+
+	/**
+	 * Parse replies to device attribute, mode and capability
+	 * queries (CSI ? ... c, CSI > ... c, CSI ? ... $ y, CSI ? ... u)
+	 * as LIBTERMINPUT_REPORT, and device control strings
+	 * (ESC P ... ESC \) as LIBTERMINPUT_DEVICE_CONTROL_STRING;
+	 * the latter conflicts with meta+P key presses.
+	 */
+	LIBTERMINPUT_AWAITING_DEVICE_REPORTS  = 0x0080,
+
+	/**
+	 * Parse operating system commands (ESC ] ... BEL
+	 * or ESC ] ... ESC \), such as replies to clipboard
+	 * and colour queries, as LIBTERMINPUT_OPERATING_SYSTEM_COMMAND;
+	 * this conflicts with meta+] key presses.
+	 */
+	LIBTERMINPUT_AWAITING_OSC             = 0x0100,
+
+	/**
+	 * Return escape sequences that would otherwise be
+	 * discarded, because they are not recognised, as
+	 * LIBTERMINPUT_RAW_SEQUENCE, with the parameters
+	 * already parsed
+	 */
+	LIBTERMINPUT_RAW_UNKNOWN_SEQUENCES    = 0x0200
+};
+
+/**
+ * Classes of input that can be discarded by the
+ * decoder, see libterminput_set_event_mask
+ */
+enum libterminput_event_class {
+	LIBTERMINPUT_EVENT_MOUSE_MOTION    = 0x0001, /* LIBTERMINPUT_MOTION */
+	LIBTERMINPUT_EVENT_MOUSE_HIGHLIGHT = 0x0002, /* LIBTERMINPUT_HIGHLIGHT_INSIDE and LIBTERMINPUT_HIGHLIGHT_OUTSIDE */
+	LIBTERMINPUT_EVENT_MOUSE_SCROLL    = 0x0004, /* presses and releases of LIBTERMINPUT_SCROLL_* */
+	LIBTERMINPUT_EVENT_MOUSE_BUTTON    = 0x0008, /* presses and releases of other buttons */
+	LIBTERMINPUT_EVENT_PASTE           = 0x0010, /* LIBTERMINPUT_BRACKETED_PASTE_* and LIBTERMINPUT_TEXT */
+	LIBTERMINPUT_EVENT_TERMINAL_STATUS = 0x0020, /* LIBTERMINPUT_TERMINAL_IS_OK and LIBTERMINPUT_TERMINAL_IS_NOT_OK */
+	LIBTERMINPUT_EVENT_FOCUS           = 0x0040, /* LIBTERMINPUT_FOCUS_IN and LIBTERMINPUT_FOCUS_OUT */
+	LIBTERMINPUT_EVENT_KEYPAD          = 0x0080  /* key presses of LIBTERMINPUT_KEYPAD_* */
+};
+
+#define LIBTERMINPUT_EVENT_CLASSES 8
+
+enum libterminput_mod {
+	LIBTERMINPUT_SHIFT = 0x01,
+	LIBTERMINPUT_META  = 0x02,
+	LIBTERMINPUT_CTRL  = 0x04
+};
+
+enum libterminput_key {
+	LIBTERMINPUT_SYMBOL,
+	LIBTERMINPUT_UP,
+	LIBTERMINPUT_DOWN,
+	LIBTERMINPUT_RIGHT,
+	LIBTERMINPUT_LEFT,
+	LIBTERMINPUT_BEGIN,   /* keypad 5 without numlock */
+	LIBTERMINPUT_TAB,     /* backtab is interpreted as shift+tab by default */
+	LIBTERMINPUT_BACKTAB, /* requires LIBTERMINPUT_SEPARATE_BACKTAB */
+	LIBTERMINPUT_F1,
+	LIBTERMINPUT_F2,
+	LIBTERMINPUT_F3,
+	LIBTERMINPUT_F4,
+	LIBTERMINPUT_F5,
+	LIBTERMINPUT_F6,
+	LIBTERMINPUT_F7,
+	LIBTERMINPUT_F8,
+	LIBTERMINPUT_F9,
+	LIBTERMINPUT_F10,
+	LIBTERMINPUT_F11,
+	LIBTERMINPUT_F12,
+	LIBTERMINPUT_HOME,  /* = find */
+	LIBTERMINPUT_INS,
+	LIBTERMINPUT_DEL,   /* = remove */
+	LIBTERMINPUT_END,   /* = select */
+	LIBTERMINPUT_PRIOR, /* page up   */
+	LIBTERMINPUT_NEXT,  /* page down */
+	LIBTERMINPUT_ERASE, /* backspace */
+	LIBTERMINPUT_ENTER, /* return    */
+	LIBTERMINPUT_ESC,
+	LIBTERMINPUT_MACRO,
+	LIBTERMINPUT_PAUSE,
+	LIBTERMINPUT_KEYPAD_0,
+	LIBTERMINPUT_KEYPAD_1,
+	LIBTERMINPUT_KEYPAD_2,
+	LIBTERMINPUT_KEYPAD_3,
+	LIBTERMINPUT_KEYPAD_4,
+	LIBTERMINPUT_KEYPAD_5,
+	LIBTERMINPUT_KEYPAD_6,
+	LIBTERMINPUT_KEYPAD_7,
+	LIBTERMINPUT_KEYPAD_8,
+	LIBTERMINPUT_KEYPAD_9,
+	LIBTERMINPUT_KEYPAD_PLUS,
+	LIBTERMINPUT_KEYPAD_MINUS,
+	LIBTERMINPUT_KEYPAD_TIMES,
+	LIBTERMINPUT_KEYPAD_DIVISION,
+	LIBTERMINPUT_KEYPAD_DECIMAL,
+	LIBTERMINPUT_KEYPAD_COMMA,
+	LIBTERMINPUT_KEYPAD_POINT,
+	LIBTERMINPUT_KEYPAD_ENTER,
+};
+
+enum libterminput_button {
+	LIBTERMINPUT_NO_BUTTON,
+	LIBTERMINPUT_BUTTON1,      /* left (assuming right-handed) */
+	LIBTERMINPUT_BUTTON2,      /* middle */
+	LIBTERMINPUT_BUTTON3,      /* right (assuming right-handed) */
+	LIBTERMINPUT_SCROLL_UP,    /* no corresponding release event shall be generated */
+	LIBTERMINPUT_SCROLL_DOWN,  /* no corresponding release event shall be generated */
+	LIBTERMINPUT_SCROLL_LEFT,  /* may or may not have a corresponding release event */
+	LIBTERMINPUT_SCROLL_RIGHT, /* may or may not have a corresponding release event */
+	LIBTERMINPUT_XBUTTON1,     /* extended button 1, also known as backward */
+	LIBTERMINPUT_XBUTTON2,     /* extended button 2, also known as forward */
+	LIBTERMINPUT_XBUTTON3,     /* extended button 3, you probably don't have this button */
+	LIBTERMINPUT_XBUTTON4      /* extended button 4, you probably don't have this button */
+};
+
+enum libterminput_type {
+	LIBTERMINPUT_NONE,
+	LIBTERMINPUT_KEYPRESS,
+	LIBTERMINPUT_BRACKETED_PASTE_START,
+	LIBTERMINPUT_BRACKETED_PASTE_END,
+	LIBTERMINPUT_TEXT,
+	LIBTERMINPUT_MOUSEEVENT,
+	LIBTERMINPUT_TERMINAL_IS_OK,        /* response to CSI 5 n */
+	LIBTERMINPUT_TERMINAL_IS_NOT_OK,    /* response to CSI 5 n */
+	LIBTERMINPUT_CURSOR_POSITION,       /* response to CSI 6 n */
+	LIBTERMINPUT_REPORT,                /* requires LIBTERMINPUT_AWAITING_DEVICE_REPORTS */
+	LIBTERMINPUT_DEVICE_CONTROL_STRING, /* requires LIBTERMINPUT_AWAITING_DEVICE_REPORTS */
+	LIBTERMINPUT_RESIZE,                /* requires CSI ? 2048 h */
+	LIBTERMINPUT_FOCUS_IN,              /* requires CSI ? 1004 h */
+	LIBTERMINPUT_FOCUS_OUT,             /* requires CSI ? 1004 h */
+	LIBTERMINPUT_OPERATING_SYSTEM_COMMAND, /* requires LIBTERMINPUT_AWAITING_OSC */
+	LIBTERMINPUT_RAW_SEQUENCE,          /* requires LIBTERMINPUT_RAW_UNKNOWN_SEQUENCES */
+	LIBTERMINPUT_PASTE_TRUNCATED        /* only returned by libterminput_queue_pop */
+};
+
+enum libterminput_event {
+	LIBTERMINPUT_PRESS,
+	LIBTERMINPUT_RELEASE,
+	LIBTERMINPUT_MOTION,
+	LIBTERMINPUT_HIGHLIGHT_INSIDE,
+	LIBTERMINPUT_HIGHLIGHT_OUTSIDE
+};
+
+struct libterminput_keypress {
+	enum libterminput_type type;
+	enum libterminput_key key;
+	unsigned long long int times; /* if .times > 1, next will be the same, but will .times -= 1 */
+	enum libterminput_mod mods;
+	char symbol[7];               /* use if .key == LIBTERMINPUT_SYMBOL */
+};
+
+struct libterminput_text {
+	enum libterminput_type type;
+	size_t nbytes;
+	char bytes[512];
+};
+
+struct libterminput_mouseevent {
+	enum libterminput_type type;
+	enum libterminput_mod mods;      /* Set to 0 for LIBTERMINPUT_HIGHLIGHT_INSIDE and LIBTERMINPUT_HIGHLIGHT_OUTSIDE */
+	enum libterminput_button button; /* Set to 1 for LIBTERMINPUT_HIGHLIGHT_INSIDE and LIBTERMINPUT_HIGHLIGHT_OUTSIDE */
+	enum libterminput_event event;
+	size_t x;
+	size_t y;
+	size_t start_x; /* Only set for LIBTERMINPUT_HIGHLIGHT_OUTSIDE */
+	size_t start_y; /* Only set for LIBTERMINPUT_HIGHLIGHT_OUTSIDE */
+	size_t end_x;   /* Only set for LIBTERMINPUT_HIGHLIGHT_OUTSIDE */
+	size_t end_y;   /* Only set for LIBTERMINPUT_HIGHLIGHT_OUTSIDE */
+};
+
+struct libterminput_position {
+	enum libterminput_type type;
+	size_t x;
+	size_t y;
+	size_t page;                     /* 1 unless reported with DECXCPR */
+	unsigned long long int sequence; /* number of cursor position reports before this one */
+};
+
+struct libterminput_resize {
+	enum libterminput_type type;
+	size_t rows;
+	size_t columns;
+	size_t height; /* in pixels, 0 if not reported */
+	size_t width;  /* in pixels, 0 if not reported */
+};
+
+struct libterminput_report {
+	enum libterminput_type type;
+	char prefix;       /* '?' or '>' */
+	char intermediate; /* '$' for DECRPM, otherwise '\0' */
+	char final;        /* 'c' for DA1 and DA2, 'y' for DECRPM, 'u' for keyboard flags */
+	size_t nparams;
+	unsigned long long int params[16]; /* excess parameters are discarded */
+};
+
+struct libterminput_sequence {
+	enum libterminput_type type;
+	char introducer;       /* '[' for CSI, 'O' for SS3 */
+	char prefix;           /* private marker ('<', '=', '>', or '?'), or '\0' if none */
+	char intermediates[4]; /* NUL-terminated, excess bytes are discarded */
+	char final;
+	size_t nparams;
+	unsigned long long int params[16]; /* omitted parameters are 0, excess parameters are discarded */
+	unsigned int subparams;            /* bit i is set if .params[i] is a sub-parameter (preceded by ':') */
+};
+
+struct libterminput_string {
+	enum libterminput_type type;
+	char more;        /* if set, the string continues in the next event */
+	size_t nbytes;
+	char bytes[512];  /* not NUL-terminated, excludes the introducer and the terminator */
+};
+
+union libterminput_input {
+	enum libterminput_type type;
+	struct libterminput_keypress keypress;     /* use if .type == LIBTERMINPUT_KEYPRESS */
+	struct libterminput_text text;             /* use if .type == LIBTERMINPUT_TEXT */
+	struct libterminput_mouseevent mouseevent; /* use if .type == LIBTERMINPUT_MOUSEEVENT */
+	struct libterminput_position position;     /* use if .type == LIBTERMINPUT_CURSOR_POSITION */
+	struct libterminput_report report;         /* use if .type == LIBTERMINPUT_REPORT */
+	struct libterminput_string string;         /* use if .type == LIBTERMINPUT_DEVICE_CONTROL_STRING or
+	                                            *        .type == LIBTERMINPUT_OPERATING_SYSTEM_COMMAND */
+	struct libterminput_resize resize;         /* use if .type == LIBTERMINPUT_RESIZE */
+	struct libterminput_sequence sequence;     /* use if .type == LIBTERMINPUT_RAW_SEQUENCE */
+};
+
+
+/*
+ * Fixed-size, 32-byte, representation of union libterminput_input
+ * for event queues and interprocess communication; text, strings,
+ * and report parameters are stored in a separate buffer and referred
+ * to by offset. See libterminput_compact and libterminput_expand.
+ */
+
+struct libterminput_compact_keypress {
+	uint8_t type;
+	uint8_t key;        /* enum libterminput_key */
+	uint8_t mods;       /* enum libterminput_mod */
+	uint32_t times;     /* saturated at UINT32_MAX */
+	uint32_t codepoint; /* the codepoint of .symbol, 0 unless .key == LIBTERMINPUT_SYMBOL */
+	char symbol[7];
+};
+
+struct libterminput_compact_mouseevent {
+	uint8_t type;
+	uint8_t mods;   /* enum libterminput_mod */
+	uint8_t button; /* enum libterminput_button */
+	uint8_t event;  /* enum libterminput_event */
+	uint32_t x;
+	uint32_t y;
+	uint32_t start_x;
+	uint32_t start_y;
+	uint32_t end_x;
+	uint32_t end_y;
+};
+
+struct libterminput_compact_position {
+	uint8_t type;
+	uint32_t x;
+	uint32_t y;
+	uint32_t page;
+	uint64_t sequence;
+};
+
+struct libterminput_compact_resize {
+	uint8_t type;
+	uint32_t rows;
+	uint32_t columns;
+	uint32_t height;
+	uint32_t width;
+};
+
+struct libterminput_compact_report {
+	uint8_t type;
+	char prefix;
+	char intermediate;
+	char final;
+	uint32_t offset;  /* position of the parameters, as unsigned long long int, in the buffer */
+	uint32_t nparams;
+};
+
+struct libterminput_compact_sequence {
+	uint8_t type;
+	char introducer;
+	char prefix;
+	char final;
+	char intermediates[4];
+	uint32_t offset;  /* position of the parameters, as unsigned long long int, in the buffer */
+	uint32_t nparams;
+	uint32_t subparams;
+};
+
+struct libterminput_compact_text {
+	uint8_t type;
+	char more;        /* only used for strings */
+	uint32_t offset;  /* position of the bytes in the buffer */
+	uint32_t nbytes;
+};
+
+union libterminput_compact_input {
+	uint8_t type; /* enum libterminput_type */
+	struct libterminput_compact_keypress keypress;
+	struct libterminput_compact_mouseevent mouseevent;
+	struct libterminput_compact_position position;
+	struct libterminput_compact_resize resize;
+	struct libterminput_compact_report report;
+	struct libterminput_compact_sequence sequence;
+	struct libterminput_compact_text text; /* also used for strings */
+	uint64_t aligned_size[4];
+};
+
+
+/**
+ * This struct should be considered opaque
+ */
+struct libterminput_state {
+	int inited; /* whether the input in initialised, not this struct */
+	enum libterminput_mod mods;
+	enum libterminput_flags flags;
+	char bracketed_paste;
+	char control_string;
+	char unfocused;
+	char mouse_tracking;
+	char meta;
+	char n;
+	size_t stored_head;
+	size_t stored_tail;
+	char paused;
+	char npartial;
+	char partial[7];
+	char key[44];
+	char stored[512];
+	size_t awaiting_positions;
+	unsigned long long int positions_received;
+	enum libterminput_event_class event_mask;
+	unsigned long long int dropped_events[LIBTERMINPUT_EVENT_CLASSES];
+	char wakeup;
+	int wakeup_fds[2];
+};
+
+/**
+ * State for libterminput_base64_decode; shall
+ * be zero-initialised before the first call
+ */
+struct libterminput_base64 {
+	unsigned long int bits;
+	int nbits;
+	char padded;
+};
+
+/**
+ * Handle for a shared memory event ring, see
+ * libterminput_ring_create and libterminput_ring_attach;
+ * this struct should be considered opaque
+ */
+struct libterminput_ring {
+	void *map;
+	size_t map_size;
+	char writable;
+	unsigned long long int cursor;
+	char buf[512];
+};
+
+/**
+ * Key bindings, see libterminput_keymap_create
+ */
+struct libterminput_keymap;
+
+/**
+ * Bounded event queue, see libterminput_queue_create
+ */
+struct libterminput_queue;
+
+/**
+ * What a bounded event queue may do when it is full;
+ * key presses, mouse button presses and releases, and
+ * the beginning and end of pastes are never discarded
+ */
+enum libterminput_overload_policy {
+	LIBTERMINPUT_DROP_OLDEST_MOTION = 0x0001, /* discard the oldest mouse motion event */
+	LIBTERMINPUT_MERGE_SCROLL       = 0x0002, /* discard repeated scroll events */
+	LIBTERMINPUT_TRUNCATE_PASTE     = 0x0004  /* discard the rest of the paste, marked by LIBTERMINPUT_PASTE_TRUNCATED */
+};
+
+enum libterminput_keymap_result {
+	LIBTERMINPUT_KEYMAP_UNBOUND, /* the input is not bound, any pending chord is cancelled */
+	LIBTERMINPUT_KEYMAP_PREFIX,  /* the input begins or continues a chord */
+	LIBTERMINPUT_KEYMAP_MATCH    /* the input completes a binding */
+};
+
+enum libterminput_mouse_encoding {
+	LIBTERMINPUT_MOUSE_X10,   /* CSI M Cb Cx Cy, the default */
+	LIBTERMINPUT_MOUSE_UTF8,  /* CSI ? 1005 h */
+	LIBTERMINPUT_MOUSE_SGR,   /* CSI ? 1006 h */
+	LIBTERMINPUT_MOUSE_URXVT  /* CSI ? 1015 h */
+};
+
+enum libterminput_kitty_flags {
+	LIBTERMINPUT_KITTY_DISAMBIGUATE    = 0x0001,
+	LIBTERMINPUT_KITTY_REPORT_ALL_KEYS = 0x0008
+};
+
+/**
+ * The modes an application has set on its terminal
+ * that affect how input is encoded, see libterminput_encode
+ */
+struct libterminput_mode {
+	char application_cursor_keys; /* CSI ? 1 h */
+	char application_keypad;      /* ESC = */
+	char bracketed_paste;         /* CSI ? 2004 h */
+	char focus_events;            /* CSI ? 1004 h */
+	enum libterminput_mouse_encoding mouse_encoding;
+	enum libterminput_kitty_flags kitty_flags; /* CSI > flags u, other flags are ignored */
+};
+
+#define LIBTERMINPUT_PROBE_MAX_MODES 8
+#define LIBTERMINPUT_PROBE_MAX_CAPABILITIES 8
+
+enum libterminput_probe_query {
+	LIBTERMINPUT_PROBE_DA2            = 0x0001, /* CSI > c */
+	LIBTERMINPUT_PROBE_XTVERSION      = 0x0002, /* CSI > q */
+	LIBTERMINPUT_PROBE_KITTY_KEYBOARD = 0x0004  /* CSI ? u */
+};
+
+struct libterminput_probe_mode {
+	unsigned int mode; /* DEC private mode, set by the application */
+	int value;         /* 0 = not recognised, 1 = set, 2 = reset, 3 = permanently set,
+	                    * 4 = permanently reset, -1 if the terminal did not reply */
+};
+
+struct libterminput_probe_capability {
+	char name[32];  /* terminfo capability name, set by the application */
+	int status;     /* 1 if supported, 0 if not, -1 if the terminal did not reply */
+	char value[96]; /* NUL-terminated, truncated if too long */
+};
+
+/**
+ * Queries to send with libterminput_probe_send and their
+ * replies; the application shall zero-initialise the
+ * struct and then set the query fields
+ */
+struct libterminput_probe {
+	/* Queries */
+	enum libterminput_probe_query queries;
+	size_t nmodes;
+	struct libterminput_probe_mode modes[LIBTERMINPUT_PROBE_MAX_MODES];
+	size_t ncapabilities;
+	struct libterminput_probe_capability capabilities[LIBTERMINPUT_PROBE_MAX_CAPABILITIES];
+
+	/* Replies */
+	char complete;                   /* set if the DA1 reply arrived, cleared on timeout */
+	char have_da2;
+	size_t nda1;
+	unsigned long long int da1[16];  /* DA1 parameters, the first is the conformance level */
+	unsigned long long int da2[3];   /* terminal type, firmware version, and ROM cartridge number */
+	char version[96];                /* XTVERSION reply, empty if none */
+	long int kitty_keyboard_flags;   /* -1 if the terminal did not reply */
+
+	/* Internal */
+	char finished;
+	char set_flag;
+	unsigned long long int deadline;
+	size_t nstring;
+	char string[256];
+};
+
+
+/**
+ * Get input from the terminal
+ * 
+ * @param   fd     The file descriptor to the terminal
+ * @param   input  Output parameter for input
+ * @param   ctx    State for the terminal, parts of the state may be stored in `input`
+ * @return         1 normally, 0 on end of input, -1 on error
+ */
+int libterminput_read(int fd, union libterminput_input *input, struct libterminput_state *ctx);
+
+/**
+ * Parse input from a memory buffer rather than from the terminal
+ * 
+ * @param   bufp   Pointer to the input, will be updated to point to the unread input
+ * @param   lenp   Pointer to the length of the input, will be updated to the length of the unread input
+ * @param   input  Output parameter for input
+ * @param   ctx    State for the terminal, parts of the state may be stored in `input`
+ * @return         1 normally, 0 when the buffer has been fully consumed
+ */
+int libterminput_read_mem(const char **bufp, size_t *lenp, union libterminput_input *input, struct libterminput_state *ctx);
+
+inline int
+libterminput_is_ready(union libterminput_input *input, struct libterminput_state *ctx)
+{
+	if (!ctx->inited || ctx->paused || ctx->mouse_tracking)
+		return 0;
+	if (input->type == LIBTERMINPUT_KEYPRESS && input->keypress.times > 1)
+		return 1;
+	return ctx->stored_head > ctx->stored_tail;
+}
+
+/**
+ * Check whether the terminal has focus, according to
+ * the last focus event; requires CSI ? 1004 h
+ * 
+ * @param   ctx  State for the terminal
+ * @return       1 if the terminal has focus or no focus
+ *               event has been received, 0 otherwise
+ */
+inline int
+libterminput_is_focused(struct libterminput_state *ctx)
+{
+	return !ctx->unfocused;
+}
+
+int libterminput_set_flags(struct libterminput_state *ctx, enum libterminput_flags flags);
+int libterminput_clear_flags(struct libterminput_state *ctx, enum libterminput_flags flags);
+
+/**
+ * Select classes of input that shall be discarded by the
+ * decoder rather than returned; discarded input is still
+ * parsed, so that the input after it is decoded correctly
+ * 
+ * @param   ctx   State for the terminal
+ * @param   mask  The classes of input to discard, replaces the previous mask
+ * @return        0
+ */
+int libterminput_set_event_mask(struct libterminput_state *ctx, enum libterminput_event_class mask);
+
+/**
+ * Get the number of events that have been discarded
+ * because of libterminput_set_event_mask
+ * 
+ * @param   ctx      State for the terminal
+ * @param   classes  The classes of input to count
+ * @return           The number of discarded events in `classes`
+ */
+unsigned long long int libterminput_get_dropped_events(const struct libterminput_state *ctx, enum libterminput_event_class classes);
+
+/**
+ * Make blocking reads from the terminal, with libterminput_read,
+ * interruptible by libterminput_wakeup
+ * 
+ * @param   ctx  State for the terminal
+ * @return       0 on success, -1 on error
+ */
+int libterminput_enable_wakeup(struct libterminput_state *ctx);
+
+/**
+ * Undo libterminput_enable_wakeup and release its resources
+ * 
+ * @param  ctx  State for the terminal
+ */
+void libterminput_disable_wakeup(struct libterminput_state *ctx);
+
+/**
+ * Make the current, or next, blocking read from the
+ * terminal fail with ECANCELED; any partially read
+ * input is kept and decoding resumes with the next read
+ * 
+ * This function may be called from any thread,
+ * and from signal handlers
+ * 
+ * @param   ctx  State for the terminal
+ * @return       0 on success, -1 on error (EINVAL if
+ *               libterminput_enable_wakeup has not been called)
+ */
+int libterminput_wakeup(struct libterminput_state *ctx);
+
+/**
+ * Register that a cursor position query (CSI 6 n or,
+ * preferably, CSI ? 6 n) has been sent to the terminal
+ * 
+ * Replies are matched in order, and while any query is
+ * outstanding, CSI Ps ; Ps R is parsed as a cursor
+ * position report rather than as an F3 key press
+ * 
+ * @param   ctx  State for the terminal
+ * @return       The value the reply's `.position.sequence` will have
+ */
+unsigned long long int libterminput_await_cursor_position(struct libterminput_state *ctx);
+
+/**
+ * Send a batch of capability queries to the terminal,
+ * followed by a DA1 query that marks the end of the batch
+ * 
+ * @param   fd       The file descriptor to the terminal
+ * @param   ctx      State for the terminal, LIBTERMINPUT_AWAITING_DEVICE_REPORTS will be set
+ * @param   probe    The queries to send, and output parameter for the replies
+ * @param   timeout  The number of milliseconds to wait for the replies
+ * @return           0 on success, -1 on error
+ */
+int libterminput_probe_send(int fd, struct libterminput_state *ctx, struct libterminput_probe *probe, unsigned int timeout);
+
+/**
+ * Get input from the terminal while waiting for the
+ * replies to libterminput_probe_send
+ * 
+ * @param   fd     The file descriptor to the terminal
+ * @param   input  Output parameter for input that is not a reply
+ * @param   ctx    State for the terminal, parts of the state may be stored in `input`
+ * @param   probe  The probe passed to libterminput_probe_send
+ * @return         1 if other input was read, 0 when all replies have
+ *                 arrived or the timeout has expired, -1 on error
+ */
+int libterminput_probe_read(int fd, union libterminput_input *input, struct libterminput_state *ctx, struct libterminput_probe *probe);
+
+
+/**
+ * Decode a part of a base64 string, such as the
+ * payload of an OSC 52 clipboard reply, which may
+ * be split at any position
+ * 
+ * @param   state  Decoding state, zero-initialised before the first part
+ * @param   in     The part to decode
+ * @param   n      The number of bytes in `in`
+ * @param   out    Output buffer, must fit at least `n / 4 * 3 + 3` bytes
+ * @return         The number of bytes written to `out`, -1 on error
+ */
+ssize_t libterminput_base64_decode(struct libterminput_base64 *state, const char *in, size_t n, void *out);
+
+
+/**
+ * Convert input to its compact representation
+ * 
+ * @param   out     Output parameter for the compact input
+ * @param   in      The input to convert
+ * @param   buf     Buffer that text, strings, and report parameters are appended to
+ * @param   size    The size of `buf`
+ * @param   lenp    Pointer to the number of bytes used in `buf`, will be updated
+ * @return          0 on success, -1 on error
+ */
+int libterminput_compact(union libterminput_compact_input *out, const union libterminput_input *in,
+                         char *buf, size_t size, size_t *lenp);
+
+/**
+ * Convert input from its compact representation
+ * 
+ * @param  out  Output parameter for the input
+ * @param  in   The compact input to convert
+ * @param  buf  The buffer passed to libterminput_compact
+ */
+void libterminput_expand(union libterminput_input *out, const union libterminput_compact_input *in, const char *buf);
+
+
+/**
+ * Create an event ring, for publishing input to other
+ * processes, in a shared memory object
+ * 
+ * @param   ring      Output parameter for the ring
+ * @param   fd        File descriptor to the shared memory object, e.g. from
+ *                    memfd_create(2) or shm_open(3), it will be resized
+ * @param   capacity  The number of events the ring can hold, must be a power of 2
+ * @return            0 on success, -1 on error
+ */
+int libterminput_ring_create(struct libterminput_ring *ring, int fd, size_t capacity);
+
+/**
+ * Attach to an event ring, created by another process
+ * with libterminput_ring_create, for reading
+ * 
+ * @param   ring  Output parameter for the ring
+ * @param   fd    File descriptor to the shared memory object
+ * @return        0 on success, -1 on error
+ */
+int libterminput_ring_attach(struct libterminput_ring *ring, int fd);
+
+/**
+ * Unmap an event ring, the file descriptor is not closed
+ * 
+ * @param  ring  The ring
+ */
+void libterminput_ring_close(struct libterminput_ring *ring);
+
+/**
+ * Publish input to an event ring; only one process
+ * may publish to a ring, and it must have created it
+ * 
+ * @param   ring   The ring
+ * @param   input  The input to publish
+ * @return         0 on success, -1 on error
+ */
+int libterminput_ring_publish(struct libterminput_ring *ring, const union libterminput_input *input);
+
+/**
+ * Get the next input published to an event ring,
+ * without blocking
+ * 
+ * @param   ring     The ring
+ * @param   input    Output parameter for the input
+ * @param   missedp  Output parameter for the number of events that were
+ *                   overwritten before they could be read, and thus skipped
+ * @return           1 if input was read, 0 if there was no new input
+ */
+int libterminput_ring_consume(struct libterminput_ring *ring, union libterminput_input *input, unsigned long long int *missedp);
+
+
+/**
+ * Create an empty set of key bindings
+ * 
+ * @return  The key bindings, `NULL` on error
+ */
+struct libterminput_keymap *libterminput_keymap_create(void);
+
+/**
+ * Deallocate a set of key bindings
+ * 
+ * @param  map  The key bindings, may be `NULL`
+ */
+void libterminput_keymap_free(struct libterminput_keymap *map);
+
+/**
+ * Add a key binding
+ * 
+ * @param   map   The key bindings
+ * @param   spec  The keys, separated by spaces, for example "C-x C-s",
+ *                "M-<up>", or "<f5>"
+ * @param   data  User data to return when the binding is matched
+ * @return        0 on success, -1 on error
+ */
+int libterminput_keymap_bind(struct libterminput_keymap *map, const char *spec, void *data);
+
+/**
+ * Set the maximum time between the keys in a chord
+ * 
+ * @param  map      The key bindings
+ * @param  timeout  The timeout in milliseconds, 0 for no timeout
+ */
+void libterminput_keymap_set_timeout(struct libterminput_keymap *map, unsigned int timeout);
+
+/**
+ * Cancel any pending chord
+ * 
+ * @param  map  The key bindings
+ */
+void libterminput_keymap_reset(struct libterminput_keymap *map);
+
+/**
+ * Look up input in a set of key bindings
+ * 
+ * @param   map     The key bindings
+ * @param   input   Input from libterminput_read
+ * @param   datap   Output parameter for the binding's user data
+ * @param   timesp  Output parameter for the number of times the binding
+ *                  was pressed; if greater than 1, `input` is updated so
+ *                  that libterminput_read will not return the repetitions
+ * @return          Whether the input matched a binding
+ */
+enum libterminput_keymap_result libterminput_keymap_lookup(struct libterminput_keymap *map, union libterminput_input *input,
+                                                           void **datap, unsigned long long int *timesp);
+
+
+/**
+ * Create a bounded queue for decoded input
+ * 
+ * @param   capacity   The maximum number of queued events
+ * @param   text_size  The number of bytes for text, strings, and
+ *                     report parameters, at least 512
+ * @param   policies   What the queue may do when it is full
+ * @return             The queue, `NULL` on error
+ */
+struct libterminput_queue *libterminput_queue_create(size_t capacity, size_t text_size, enum libterminput_overload_policy policies);
+
+/**
+ * Deallocate a bounded event queue
+ * 
+ * @param  queue  The queue, may be `NULL`
+ */
+void libterminput_queue_free(struct libterminput_queue *queue);
+
+/**
+ * Decode input from the terminal into a bounded event
+ * queue, until the queue is full or no more input is
+ * available without blocking; only the first read may block
+ * 
+ * @param   fd     The file descriptor to the terminal
+ * @param   queue  The queue
+ * @param   ctx    State for the terminal
+ * @return         1 normally, 0 on end of input, -1 on error
+ */
+int libterminput_queue_fill(int fd, struct libterminput_queue *queue, struct libterminput_state *ctx);
+
+/**
+ * Decode input from a memory buffer into a bounded event
+ * queue, until the queue is full or the buffer has been
+ * fully consumed
+ * 
+ * @param   bufp   Pointer to the input, will be updated to point to the unread input
+ * @param   lenp   Pointer to the length of the input, will be updated to the length of the unread input
+ * @param   queue  The queue
+ * @param   ctx    State for the terminal
+ * @return         1 normally, 0 when the buffer has been fully consumed
+ */
+int libterminput_queue_fill_mem(const char **bufp, size_t *lenp, struct libterminput_queue *queue, struct libterminput_state *ctx);
+
+/**
+ * Deliver replies to queries through a separate lane of a
+ * bounded event queue, so that they are not delayed by user
+ * input; when the queue is full, the remaining input that is
+ * available is scanned for replies
+ * 
+ * @param   queue     The queue
+ * @param   capacity  The maximum number of queued replies
+ * @return            0 on success, -1 on error
+ */
+int libterminput_queue_separate_replies(struct libterminput_queue *queue, size_t capacity);
+
+/**
+ * Remove the oldest event from a bounded event queue
+ * 
+ * @param   queue  The queue
+ * @param   input  Output parameter for the input
+ * @return         1 if input was removed, 0 if the queue is empty
+ */
+int libterminput_queue_pop(struct libterminput_queue *queue, union libterminput_input *input);
+
+/**
+ * Remove the oldest reply to a query from a bounded event
+ * queue, see libterminput_queue_separate_replies
+ * 
+ * @param   queue  The queue
+ * @param   input  Output parameter for the reply
+ * @return         1 if a reply was removed, 0 if there is none
+ */
+int libterminput_queue_pop_reply(struct libterminput_queue *queue, union libterminput_input *input);
+
+/**
+ * Get the number of events a bounded event queue
+ * has discarded because of its overload policies
+ * 
+ * @param   queue     The queue
+ * @param   policies  The policies to count
+ * @return            The number of events discarded by `policies`
+ */
+unsigned long long int libterminput_queue_dropped(const struct libterminput_queue *queue, enum libterminput_overload_policy policies);
+
+
+/**
+ * Encode input as a terminal would send it to an
+ * application that has set the specified modes
+ * 
+ * @param   input  The input to encode, .keypress.times is ignored
+ * @param   mode   The application's modes
+ * @param   out    Output buffer, it will not be NUL-terminated
+ * @param   size   The size of `out`
+ * @return         The number of bytes written to `out`, 0 if the
+ *                 input is not sent to the application, -1 on error
+ */
+ssize_t libterminput_encode(const union libterminput_input *input, const struct libterminput_mode *mode, char *out, size_t size);
+
+
+/**
+ * The version of the format written by libterminput_save_state
+ */
+#define LIBTERMINPUT_SAVED_STATE_VERSION 1
+
+/**
+ * The maximum number of bytes written by libterminput_save_state
+ */
+#define LIBTERMINPUT_SAVED_STATE_MAX 1024
+
+/**
+ * Serialise the decoder state, including partially read
+ * input and a keypress that is being repeated, so that
+ * decoding can be resumed in another process
+ * 
+ * The result does not depend on the host's byte order
+ * or type sizes; libterminput_enable_wakeup is not saved
+ * 
+ * @param   ctx    State for the terminal
+ * @param   input  The last input returned for the terminal
+ * @param   buf    Output buffer
+ * @param   size   The size of `buf`
+ * @return         The number of bytes written to `buf`, -1 on error
+ */
+ssize_t libterminput_save_state(const struct libterminput_state *ctx, const union libterminput_input *input, void *buf, size_t size);
+
+/**
+ * Restore a decoder state saved with libterminput_save_state
+ * 
+ * Nothing is modified on failure, and whether
+ * libterminput_enable_wakeup has been called for
+ * `ctx` is not changed
+ * 
+ * @param   ctx    Output parameter for the state
+ * @param   input  Output parameter for the input, to be passed to
+ *                 libterminput_read or libterminput_read_mem with `ctx`
+ * @param   buf    The saved state
+ * @param   len    The number of bytes in `buf`
+ * @return         0 on success, -1 on error
+ */
+int libterminput_restore_state(struct libterminput_state *ctx, union libterminput_input *input, const void *buf, size_t len);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+
+#ifndef LIBTERMINPUT_IMPL_H
+#define LIBTERMINPUT_IMPL_H
+/* See LICENSE file for copyright and license details. */
+/* This file is concatenated into libterminput_impl.h, after libterminput.h */
+
+
+/* Whether libterminput_read and libterminput_read_mem would simply
+ * return a printable ASCII character if the next byte is one */
+static inline int
+libterminput_inline_plain_(const struct libterminput_state *ctx)
+{
+	return ctx->inited && !ctx->meta && !ctx->n && !ctx->mods && !*ctx->key &&
+	       !ctx->bracketed_paste && !ctx->control_string && !ctx->mouse_tracking;
+}
+
+
+/* Return `c` as a keypress without modifiers */
+static inline int
+libterminput_inline_symbol_(union libterminput_input *input, unsigned char c)
+{
+	input->keypress.type = LIBTERMINPUT_KEYPRESS;
+	input->keypress.key = LIBTERMINPUT_SYMBOL;
+	input->keypress.mods = (enum libterminput_mod)0;
+	input->keypress.times = 1;
+	input->keypress.symbol[0] = (char)c;
+	input->keypress.symbol[1] = '\0';
+	return 1;
+}
+
+
+/**
+ * Identical to libterminput_read, except that repeated
+ * keypresses and printable ASCII characters that have
+ * already been read from the file are returned without
+ * calling libterminput_read
+ *
+ * @param   fd     See libterminput_read
+ * @param   input  See libterminput_read
+ * @param   ctx    See libterminput_read
+ * @return         See libterminput_read
+ */
+static inline int
+libterminput_read_inline(int fd, union libterminput_input *input, struct libterminput_state *ctx)
+{
+	unsigned char c;
+	if (ctx->inited && input->type == LIBTERMINPUT_KEYPRESS && input->keypress.times > 1) {
+		input->keypress.times -= 1;
+		return 1;
+	}
+	if (ctx->stored_head != ctx->stored_tail && libterminput_inline_plain_(ctx)) {
+		c = (unsigned char)ctx->stored[ctx->stored_tail];
+		if (c >= ' ' && c < 127) {
+			if (++ctx->stored_tail == ctx->stored_head)
+				ctx->stored_tail = ctx->stored_head = 0;
+			return libterminput_inline_symbol_(input, c);
+		}
+	}
+	return libterminput_read(fd, input, ctx);
+}
+
+
+/**
+ * Identical to libterminput_read_mem, except that repeated
+ * keypresses and printable ASCII characters are returned
+ * without calling libterminput_read_mem
+ *
+ * @param   bufp   See libterminput_read_mem
+ * @param   lenp   See libterminput_read_mem
+ * @param   input  See libterminput_read_mem
+ * @param   ctx    See libterminput_read_mem
+ * @return         See libterminput_read_mem
+ */
+static inline int
+libterminput_read_mem_inline(const char **bufp, size_t *lenp, union libterminput_input *input, struct libterminput_state *ctx)
+{
+	unsigned char c;
+	if (ctx->inited && input->type == LIBTERMINPUT_KEYPRESS && input->keypress.times > 1) {
+		input->keypress.times -= 1;
+		return 1;
+	}
+	if (libterminput_inline_plain_(ctx)) {
+		if (ctx->stored_head != ctx->stored_tail) {
+			c = (unsigned char)ctx->stored[ctx->stored_tail];
+			if (c >= ' ' && c < 127) {
+				if (++ctx->stored_tail == ctx->stored_head)
+					ctx->stored_tail = ctx->stored_head = 0;
+				return libterminput_inline_symbol_(input, c);
+			}
+		} else if (*lenp) {
+			c = (unsigned char)**bufp;
+			if (c >= ' ' && c < 127) {
+				*bufp += 1;
+				*lenp -= 1;
+				return libterminput_inline_symbol_(input, c);
+			}
+		}
+	}
+	return libterminput_read_mem(bufp, lenp, input, ctx);
+}
+#endif
+
+#if defined(LIBTERMINPUT_IMPLEMENTATION) && !defined(LIBTERMINPUT_IMPLEMENTED)
+#define LIBTERMINPUT_IMPLEMENTED
+
+/* libterminput.c */
+/* See LICENSE file for copyright and license details. */
+
+#include <alloca.h>
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <string.h>
+#include <unistd.h>
+#if defined(__linux__)
+# include <sys/eventfd.h>
+#endif
+
+
+struct input {
+	enum libterminput_mod mods;
+	char symbol[7];
+};
+
+struct source {
+	int fd;
+	const char **bufp; /* NULL if reading from `fd` */
+	size_t *lenp;
+	int wakeup_fd; /* -1 unless libterminput_enable_wakeup has been called */
+};
+
+
+/* Wait until `src->fd` is readable, unless libterminput_wakeup is called first;
+ * a non-blocking `src->fd` is not waited for, so that read(3) fails with EAGAIN */
+static int
+wait_for_input(struct source *src)
+{
+	struct pollfd pfds[2];
+	char drain[64];
+	int flags;
+
+	flags = fcntl(src->fd, F_GETFL);
+	if (flags < 0)
+		return -1;
+	pfds[0].fd = src->fd;
+	pfds[0].events = POLLIN;
+	pfds[1].fd = src->wakeup_fd;
+	pfds[1].events = POLLIN;
+	if (poll(pfds, 2, (flags & O_NONBLOCK) ? 0 : -1) < 0)
+		return -1;
+	if (!pfds[1].revents)
+		return 0;
+
+	/* Consume the wakeup, the partially read input is left in the state */
+	while (read(src->wakeup_fd, drain, sizeof(drain)) > 0);
+	errno = ECANCELED;
+	return -1;
+}
+
+
+static ssize_t
+read_source(struct source *src, void *buf, size_t n)
+{
+	if (!src->bufp) {
+		if (src->wakeup_fd >= 0 && wait_for_input(src))
+			return -1;
+		return read(src->fd, buf, n);
+	}
+	if (n > *src->lenp)
+		n = *src->lenp;
+	memcpy(buf, *src->bufp, n);
+	*src->bufp += n;
+	*src->lenp -= n;
+	return (ssize_t)n;
+}
+
+
+static int
+read_input(struct source *src, struct input *input, struct libterminput_state *ctx)
+{
+	unsigned char c, tc;
+	ssize_t r;
+
+	/* Get next byte from input */
+	if (ctx->stored_head != ctx->stored_tail) {
+		c = ((unsigned char *)ctx->stored)[ctx->stored_tail++];
+		if (ctx->stored_tail == ctx->stored_head)
+			ctx->stored_tail = ctx->stored_head = 0;
+	} else {
+		r = read_source(src, ctx->stored, sizeof(ctx->stored));
+		if (r <= 0)
+			return (int)r;
+		c = (unsigned char)ctx->stored[0];
+		if (r > 1) {
+			ctx->stored_tail = 1;
+			ctx->stored_head = (size_t)r;
+		}
+	}
+
+again:
+	if (ctx->n) {
+		/* Continuation of multibyte-character */
+		if ((c & 0xC0) != 0x80) {
+			/* Short multibyte-character: return short and store read byte from next input */
+			input->mods = ctx->mods;
+			ctx->partial[(unsigned char)ctx->npartial] = '\0';
+			ctx->n = 0;
+			ctx->npartial = 0;
+			ctx->mods = 0;
+			if (ctx->stored_tail) {
+				ctx->stored_tail -= 1;
+			} else {
+				ctx->stored[0] = (char)c;
+				ctx->stored_head = 1;
+			}
+			strcpy(input->symbol, ctx->partial);
+			return 1;
+		} else {
+			/* Store byte, and if done, return */
+			ctx->partial[(unsigned char)ctx->npartial++] = (char)c;
+			if (ctx->npartial == ctx->n) {
+				ctx->partial[(unsigned char)ctx->npartial] = '\0';
+				input->mods = ctx->mods;
+				ctx->npartial = 0;
+				ctx->mods = 0;
+				ctx->n = 0;
+				strcpy(input->symbol, ctx->partial);
+				return 1;
+			}
+		}
+	} else if (c == 033 && !*ctx->key) {
+		/* ESC at the beginning, save as a Meta/ESC (for default behaviour) */
+		if ((ctx->flags & LIBTERMINPUT_ESC_ON_BLOCK) && ctx->stored_tail == ctx->stored_head) {
+			input->symbol[0] = (char)c;
+			input->symbol[1] = '\0';
+			input->mods = ctx->mods;
+			ctx->mods = 0;
+			return 1;
+		}
+		ctx->meta += 1;
+	} else if (c == 0) {
+		/* CTRL on Space */
+		input->symbol[0] = ' ';
+		input->symbol[1] = '\0';
+		input->mods = ctx->mods | LIBTERMINPUT_CTRL;
+		ctx->mods = 0;
+		return 1;
+	} else if (c < (unsigned char)' ' && (char)c != '\t' && (char)c != '\b' && (char)c != '\n') {
+		/* CTRL on some some character key */
+		input->symbol[0] = (char)c + '@';
+		input->symbol[1] = '\0';
+		input->mods = ctx->mods | LIBTERMINPUT_CTRL;
+		ctx->mods = 0;
+		return 1;
+	} else if ((c & 0xC0) == 0xC0 && c != 0xFF) {
+		/* Beginning of multibyte-character */
+		ctx->n = 0;
+		for (tc = c; tc & 0x80; tc <<= 1)
+			ctx->n++;
+		if (ctx->n > 6) {
+			/* If overlong, return first byte a single-byte-character */
+			ctx->n = 0;
+			input->symbol[0] = (char)c;
+			input->symbol[1] = '\0';
+			input->mods = ctx->mods;
+			ctx->mods = 0;
+			return 1;
+		}
+		ctx->partial[0] = (char)c;
+		ctx->npartial = 1;
+	} else if (c & 0x80) {
+		/* 8th bit set to signify META */
+		c ^= 0x80;
+		ctx->mods |= LIBTERMINPUT_META;
+		goto again;
+	} else {
+		/* Single-byte-character */
+		input->symbol[0] = (char)c;
+		input->symbol[1] = '\0';
+		input->mods = ctx->mods;
+		ctx->mods = 0;
+		return 1;
+	}
+
+	input->symbol[0] = '\0';
+	input->mods = -1;
+	return 1;
+}
+
+
+static void
+encode_utf8(unsigned long long int codepoint, char buffer[7])
+{
+	static const char masks[6] = {(char)0x00, (char)0xC0, (char)0xE0, (char)0xF0, (char)0xF8, (char)0xFC};
+	static const unsigned long long int limits[6] = {
+		1ULL << (7 + 0 * 6),
+		1ULL << (5 + 1 * 6),
+		1ULL << (4 + 2 * 6),
+		1ULL << (3 + 3 * 6),
+		1ULL << (2 + 4 * 6),
+		1ULL << (1 + 5 * 6)
+	};
+	size_t len;
+	for (len = 0; codepoint >= limits[len]; len++);
+	buffer[0] = masks[len];
+	len += 1;
+	buffer[len] = '\0';
+	for (; --len; codepoint >>= 6)
+		buffer[len] = (char)((codepoint & 0x3FULL) | 0x80ULL);
+	buffer[0] |= (char)codepoint;
+}
+
+
+static int
+check_utf8_char(const char *s, size_t *lenp, size_t size)
+{
+	size_t i;
+	*lenp = 0;
+	if (!size) {
+		return 0;
+	} else if ((*s & 0x80) == 0) {
+		*lenp = 1;
+		return 1;
+	} else if ((*s & 0xE0) == 0xC0) {
+		*lenp = 2;
+	} else if ((*s & 0xF0) == 0xE0) {
+		*lenp = 3;
+	} else if ((*s & 0xF8) == 0xF0) {
+		*lenp = 4;
+	} else if ((*s & 0xFC) == 0xF8) {
+		*lenp = 5;
+	} else if ((*s & 0xFE) == 0xFC) {
+		*lenp = 6;
+	} else {
+		*lenp = 0;
+		return -1;
+	}
+	for (i = 1; i < *lenp; i++) {
+		if (i == size)
+			return 0;
+		if ((s[i] & 0xC0) != 0x80)
+			return -1;
+	}
+	return 1;
+}
+
+
+static unsigned long long int
+utf8_decode(const char *s, size_t *ip)
+{
+	unsigned long long int cp = 0;
+	size_t len;
+
+	if ((s[*ip] & 0x80) == 0) {
+		return (unsigned long long int)s[(*ip)++];
+	} else if ((s[*ip] & 0xE0) == 0xC0) {
+		cp = (unsigned long long int)((unsigned char)s[(*ip)++] ^ 0xC0U);
+		len = 2;
+		goto need_1;
+	} else if ((s[*ip] & 0xF0) == 0xE0) {
+		cp = (unsigned long long int)((unsigned char)s[(*ip)++] ^ 0xE0U);
+		len = 3;
+		goto need_2;
+	} else if ((s[*ip] & 0xF8) == 0xF0) {
+		cp = (unsigned long long int)((unsigned char)s[(*ip)++] ^ 0xF0U);
+		len = 4;
+		goto need_3;
+	} else if ((s[*ip] & 0xFC) == 0xF8) {
+		cp = (unsigned long long int)((unsigned char)s[(*ip)++] ^ 0xF8U);
+		len = 5;
+		goto need_4;
+	} else if ((s[*ip] & 0xFE) == 0xFC) {
+		cp = (unsigned long long int)((unsigned char)s[(*ip)++] ^ 0xFCU);
+		len = 6;
+		goto need_5;
+	}
+
+need_5:
+	if ((s[*ip] & 0xC0) != 0x80) return 0;
+	cp <<= 6;
+	cp |= (unsigned long long int)((unsigned char)s[(*ip)++] ^ 0x80U);
+
+need_4:
+	if ((s[*ip] & 0xC0) != 0x80) return 0;
+	cp <<= 6;
+	cp |= (unsigned long long int)((unsigned char)s[(*ip)++] ^ 0x80U);
+
+need_3:
+	if ((s[*ip] & 0xC0) != 0x80) return 0;
+	cp <<= 6;
+	cp |= (unsigned long long int)((unsigned char)s[(*ip)++] ^ 0x80U);
+
+need_2:
+	if ((s[*ip] & 0xC0) != 0x80) return 0;
+	cp <<= 6;
+	cp |= (unsigned long long int)((unsigned char)s[(*ip)++] ^ 0x80U);
+
+need_1:
+	if ((s[*ip] & 0xC0) != 0x80) return 0;
+	cp <<= 6;
+	cp |= (unsigned long long int)((unsigned char)s[(*ip)++] ^ 0x80U);
+
+	/* Let's ignore the 0x10FFFF upper bound. */
+
+	if (cp < 1ULL << (7 + 0 * 6))
+		return 0;
+	if (cp < 1ULL << (5 + 1 * 6))
+		return len > 2 ? 0ULL : cp;
+	if (cp < 1ULL << (4 + 2 * 6))
+		return len > 3 ? 0ULL : cp;
+	if (cp < 1ULL << (3 + 3 * 6))
+		return len > 4 ? 0ULL : cp;
+	if (cp < 1ULL << (2 + 4 * 6))
+		return len > 5 ? 0ULL : cp;
+	if (cp < 1ULL << (1 + 5 * 6))
+		return len > 6 ? 0ULL : cp;
+
+	return 0;
+}
+
+
+static void
+set_position(union libterminput_input *input, struct libterminput_state *ctx,
+             unsigned long long int y, unsigned long long int x, unsigned long long int page)
+{
+	input->position.type = LIBTERMINPUT_CURSOR_POSITION;
+	input->position.y = (size_t)y + (size_t)!y;
+	input->position.x = (size_t)x + (size_t)!x;
+	input->position.page = (size_t)page + (size_t)!page;
+	input->position.sequence = ctx->positions_received++;
+	if (ctx->awaiting_positions)
+		ctx->awaiting_positions -= 1;
+}
+
+
+static void
+set_resize(union libterminput_input *input, const unsigned long long int *nums, size_t nnums)
+{
+	input->resize.type = LIBTERMINPUT_RESIZE;
+	input->resize.rows = (size_t)nums[0];
+	input->resize.columns = (size_t)nums[1];
+	input->resize.height = nnums > 2 ? (size_t)nums[2] : 0;
+	input->resize.width = nnums > 3 ? (size_t)nums[3] : 0;
+}
+
+
+/* Replace a resize notification with the last of any directly following ones that are already buffered */
+static void
+coalesce_resizes(union libterminput_input *input, struct libterminput_state *ctx)
+{
+	unsigned long long int nums[4];
+	size_t i, n, nnums;
+	const char *s;
+
+	for (;;) {
+		s = &ctx->stored[ctx->stored_tail];
+		n = ctx->stored_head - ctx->stored_tail;
+		if (n < 5 || strncmp(s, "\033[48;", 5))
+			return;
+		nums[0] = 0;
+		for (i = 5, nnums = 1; i < n && (isdigit(s[i]) || s[i] == ';'); i++) {
+			if (s[i] == ';') {
+				if (nnums < 4)
+					nums[nnums] = 0;
+				nnums += 1;
+			} else if (nnums <= 4) {
+				if (nums[nnums - 1] < (ULLONG_MAX - (s[i] & 15)) / 10)
+					nums[nnums - 1] = nums[nnums - 1] * 10 + (s[i] & 15);
+				else
+					nums[nnums - 1] = ULLONG_MAX;
+			}
+		}
+		if (i == n || s[i] != 't' || nnums < 2)
+			return;
+		set_resize(input, nums, nnums < 4 ? nnums : 4);
+		ctx->stored_tail += i + 1;
+		if (ctx->stored_tail == ctx->stored_head)
+			ctx->stored_tail = ctx->stored_head = 0;
+	}
+}
+
+
+static void
+parse_report(union libterminput_input *input, struct libterminput_state *ctx)
+{
+	struct libterminput_report *report = &input->report;
+	const size_t maxparams = sizeof(report->params) / sizeof(*report->params);
+	size_t i = 0;
+	char *p = &ctx->key[2];
+
+	report->type = LIBTERMINPUT_REPORT;
+	report->prefix = ctx->key[1];
+	report->intermediate = '\0';
+	report->params[0] = 0;
+	report->nparams = p[1] ? 1 : 0;
+
+	for (; p[1]; p++) {
+		if (*p == ';' || *p == ':') {
+			if (++i < maxparams) {
+				report->params[i] = 0;
+				report->nparams = i + 1;
+			}
+		} else if (!isdigit(*p)) {
+			report->intermediate = *p;
+		} else if (i < maxparams) {
+			if (report->params[i] < (ULLONG_MAX - (*p & 15)) / 10)
+				report->params[i] = report->params[i] * 10 + (*p & 15);
+			else
+				report->params[i] = ULLONG_MAX;
+		}
+	}
+	report->final = *p;
+}
+
+
+static void
+parse_raw_sequence(union libterminput_input *input, const char *key)
+{
+	struct libterminput_sequence *sequence = &input->sequence;
+	const size_t maxparams = sizeof(sequence->params) / sizeof(*sequence->params);
+	size_t i = 0, nintermediates = 0;
+	const char *p = &key[1];
+
+	sequence->type = LIBTERMINPUT_RAW_SEQUENCE;
+	sequence->introducer = key[0];
+	sequence->prefix = '\0';
+	if (*p == '<' || *p == '=' || *p == '>' || *p == '?')
+		sequence->prefix = *p++;
+	sequence->params[0] = 0;
+	sequence->nparams = 0;
+	sequence->subparams = 0;
+
+	for (; p[1]; p++) {
+		if (*p == ';' || *p == ':') {
+			if (++i < maxparams) {
+				sequence->params[i] = 0;
+				if (*p == ':')
+					sequence->subparams |= 1U << i;
+			}
+		} else if (isdigit(*p)) {
+			if (i < maxparams) {
+				if (sequence->params[i] < (ULLONG_MAX - (*p & 15)) / 10)
+					sequence->params[i] = sequence->params[i] * 10 + (*p & 15);
+				else
+					sequence->params[i] = ULLONG_MAX;
+			}
+		} else {
+			if (nintermediates < sizeof(sequence->intermediates) - 1)
+				sequence->intermediates[nintermediates++] = *p;
+			continue;
+		}
+		sequence->nparams = i < maxparams ? i + 1 : maxparams;
+	}
+	sequence->intermediates[nintermediates] = '\0';
+	sequence->final = *p;
+}
+
+
+static void
+parse_sequence(union libterminput_input *input, struct libterminput_state *ctx)
+{
+	unsigned long long int *nums, numsbuf[6];
+	size_t keylen, n, nnums = 0, pos;
+	char *p, raw[sizeof(ctx->key)];
+
+	if (ctx->key[0] == '[' && (ctx->key[1] == '?' || ctx->key[1] == '>')) {
+		parse_report(input, ctx);
+		if (input->report.prefix == '?' && input->report.final == 'R' &&
+		    !input->report.intermediate && input->report.nparams >= 2) {
+			/* DECXCPR, CSI ? Pl ; Pc ; Pp R, cannot be mistaken for a key press */
+			numsbuf[0] = input->report.params[0];
+			numsbuf[1] = input->report.params[1];
+			numsbuf[2] = input->report.nparams >= 3 ? input->report.params[2] : 1;
+			set_position(input, ctx, numsbuf[0], numsbuf[1], numsbuf[2]);
+		} else if (ctx->flags & LIBTERMINPUT_AWAITING_DEVICE_REPORTS) {
+			/* keep report */
+		} else if (ctx->flags & LIBTERMINPUT_RAW_UNKNOWN_SEQUENCES) {
+			parse_raw_sequence(input, ctx->key);
+		} else {
+			input->type = LIBTERMINPUT_NONE;
+		}
+		return;
+	}
+
+	/* The numbers are removed from the sequence below, so keep
+	 * a copy in case the sequence turns out to be unknown */
+	if (ctx->flags & LIBTERMINPUT_RAW_UNKNOWN_SEQUENCES)
+		strcpy(raw, ctx->key);
+
+	/* Get number of numbers in the sequence, and allocate an array of at least 2 */
+	if (ctx->key[0] == '[' && (ctx->key[1] == '<' ? isdigit(ctx->key[2]) : isdigit(ctx->key[1])))
+		nnums += 1;
+	for (n = 2, p = ctx->key; *p; p++) {
+		if (*p == ';') {
+			n += 1;
+			nnums += 1;
+		}
+	}
+	nums = alloca(n * sizeof(*nums));
+	nums[0] = nums[1] = 0;
+
+	/* Read numbers and remove numbers and delimiters */
+	for (keylen = 0, n = 0, p = ctx->key; *p; p++) {
+		if (*p == ';') {
+			nums[++n] = 0; /* We made sure above to allocate one extra */
+		} else if (!isdigit(*p)) {
+			ctx->key[keylen++] = *p;
+		} else {
+			if (nums[n] < (ULLONG_MAX - (*p & 15)) / 10)
+				nums[n] = nums[n] * 10 + (*p & 15);
+			else
+				nums[n] = ULLONG_MAX;
+		}
+	}
+	ctx->key[keylen] = '\0';
+
+	/* Get times and mods, and reset symbol, and more as keypress */
+	input->type = LIBTERMINPUT_KEYPRESS;
+	input->keypress.symbol[0] = '\0';
+	input->keypress.times = nums[0] + !nums[0];
+	input->keypress.mods = nums[1] > 1 ? nums[1] - 1 : 0;
+	input->keypress.mods |= ctx->meta > 1 ? LIBTERMINPUT_META : 0;
+
+	switch (ctx->key[0]) {
+	case '[':
+		switch (keylen) {
+		case 2:
+			switch (ctx->key[1]) {
+			case 'A': input->keypress.key = LIBTERMINPUT_UP;    break;
+			case 'B': input->keypress.key = LIBTERMINPUT_DOWN;  break;
+			case 'C': input->keypress.key = LIBTERMINPUT_RIGHT; break;
+			case 'D': input->keypress.key = LIBTERMINPUT_LEFT;  break;
+			case 'E': input->keypress.key = LIBTERMINPUT_BEGIN; break;
+			case 'F': input->keypress.key = LIBTERMINPUT_END;   break;
+			case 'G': input->keypress.key = LIBTERMINPUT_BEGIN; break;
+			case 'H': input->keypress.key = LIBTERMINPUT_HOME;  break;
+			case 'I':
+			case 'O':
+				/* Focus tracking (\e[?1004h) */
+				if (nnums)
+					goto suppress;
+				ctx->unfocused = ctx->key[1] == 'O';
+				input->type = ctx->unfocused ? LIBTERMINPUT_FOCUS_OUT : LIBTERMINPUT_FOCUS_IN;
+				break;
+			case 'M':
+				if (ctx->flags & LIBTERMINPUT_MACRO_ON_CSI_M) {
+					input->keypress.key = LIBTERMINPUT_MACRO;
+				} else if (nnums >= 3) {
+					/* Parsing for \e[?1000;1015h output. */
+					nums[0] -= 32ULL;
+				decimal_mouse_tracking_set_press:
+					input->mouseevent.event = LIBTERMINPUT_PRESS;
+				decimal_mouse_tracking:
+					input->mouseevent.type = LIBTERMINPUT_MOUSEEVENT;
+					input->mouseevent.x = (size_t)nums[1] + (size_t)!nums[1];
+					input->mouseevent.y = (size_t)nums[2] + (size_t)!nums[2];
+					input->mouseevent.mods = (enum libterminput_mod)((nums[0] >> 2) & 7ULL);
+					if (nums[0] & 32)
+						input->mouseevent.event = LIBTERMINPUT_MOTION;
+					nums[0] = (nums[0] & 3ULL) | ((nums[0] >> 4) & ~3ULL);
+					if (nums[0] < 4) {
+						nums[0] = (nums[0] + 1) & 3;
+						if (!nums[0] && input->mouseevent.event == LIBTERMINPUT_PRESS) {
+							input->mouseevent.event = LIBTERMINPUT_RELEASE;
+							nums[0] = 1;
+						}
+					}
+					input->mouseevent.button = (enum libterminput_button)nums[0];
+				} else if (!nnums && !(ctx->flags & LIBTERMINPUT_DECSET_1005)) {
+					/* Parsing output for legacy mouse tracking output. */
+					ctx->mouse_tracking = 0;
+					nums = numsbuf;
+					nums[0] = (unsigned long long int)(unsigned char)ctx->stored[ctx->stored_tail++];
+					nums[1] = (unsigned long long int)(unsigned char)ctx->stored[ctx->stored_tail++];
+					nums[2] = (unsigned long long int)(unsigned char)ctx->stored[ctx->stored_tail++];
+					nums[0] = (nums[0] - 32ULL) & 255ULL;
+					nums[1] = (nums[1] - 32ULL) & 255ULL;
+					nums[2] = (nums[2] - 32ULL) & 255ULL;
+					if (ctx->stored_head == ctx->stored_tail)
+						ctx->stored_head = ctx->stored_tail = 0;
+					goto decimal_mouse_tracking_set_press;
+				} else if (!nnums) {
+					/* Parsing for semi-legacy \e[?1000;1005h output. */
+					ctx->mouse_tracking = 0;
+					nums = numsbuf;
+					pos = ctx->stored_tail;
+					if ((nums[0] = utf8_decode(ctx->stored, &ctx->stored_tail)) < 32 ||
+					    (nums[1] = utf8_decode(ctx->stored, &ctx->stored_tail)) < 32 ||
+					    (nums[2] = utf8_decode(ctx->stored, &ctx->stored_tail)) < 32) {
+						ctx->stored_tail = pos;
+						input->keypress.key = LIBTERMINPUT_MACRO;
+						return;
+					}
+					nums[0] = nums[0] - 32ULL;
+					nums[1] = nums[1] - 32ULL;
+					nums[2] = nums[2] - 32ULL;
+					if (ctx->stored_head == ctx->stored_tail)
+						ctx->stored_head = ctx->stored_tail = 0;
+					goto decimal_mouse_tracking_set_press;
+				} else {
+					goto suppress;
+				}
+				break;
+			case 'P':
+				input->keypress.key = LIBTERMINPUT_F1;
+				if (ctx->flags & LIBTERMINPUT_PAUSE_ON_CSI_P)
+					input->keypress.key = LIBTERMINPUT_PAUSE;
+				break;
+			case 'Q':
+				input->keypress.key = LIBTERMINPUT_F2;
+				break;
+			case 'R':
+				if (((ctx->flags & LIBTERMINPUT_AWAITING_CURSOR_POSITION) || ctx->awaiting_positions) && nnums >= 2) {
+					set_position(input, ctx, nums[0], nums[1], 1);
+				} else {
+					input->keypress.key = LIBTERMINPUT_F3;
+				}
+				break;
+			case 'S':
+				input->keypress.key = LIBTERMINPUT_F4;
+				break;
+			case 'T':
+				/* Parsing output for legacy mouse highlight tracking output. (\e[?1001h);
+				 * only CSI T, which is followed by 6 bytes, is such output */
+				if (nnums || ctx->stored_head - ctx->stored_tail < 6)
+					goto suppress;
+				ctx->mouse_tracking = 0;
+				nums = numsbuf;
+				nums[0] = (unsigned long long int)(unsigned char)ctx->stored[ctx->stored_tail++];
+				nums[1] = (unsigned long long int)(unsigned char)ctx->stored[ctx->stored_tail++];
+				nums[2] = (unsigned long long int)(unsigned char)ctx->stored[ctx->stored_tail++];
+				nums[3] = (unsigned long long int)(unsigned char)ctx->stored[ctx->stored_tail++];
+				nums[4] = (unsigned long long int)(unsigned char)ctx->stored[ctx->stored_tail++];
+				nums[5] = (unsigned long long int)(unsigned char)ctx->stored[ctx->stored_tail++];
+				nums[0] = (nums[0] - 32ULL) & 255ULL;
+				nums[1] = (nums[1] - 32ULL) & 255ULL;
+				nums[2] = (nums[2] - 32ULL) & 255ULL;
+				nums[3] = (nums[3] - 32ULL) & 255ULL;
+				nums[4] = (nums[4] - 32ULL) & 255ULL;
+				nums[5] = (nums[5] - 32ULL) & 255ULL;
+				if (ctx->stored_head == ctx->stored_tail)
+					ctx->stored_head = ctx->stored_tail = 0;
+				input->mouseevent.type = LIBTERMINPUT_MOUSEEVENT;
+				input->mouseevent.event = LIBTERMINPUT_HIGHLIGHT_OUTSIDE;
+				input->mouseevent.mods = 0;
+				input->mouseevent.button = LIBTERMINPUT_BUTTON1;
+				input->mouseevent.start_x = (size_t)nums[0] + (size_t)!nums[0];
+				input->mouseevent.start_y = (size_t)nums[1] + (size_t)!nums[1];
+				input->mouseevent.end_x = (size_t)nums[2] + (size_t)!nums[2];
+				input->mouseevent.end_y = (size_t)nums[3] + (size_t)!nums[3];
+				input->mouseevent.x = (size_t)nums[4] + (size_t)!nums[4];
+				input->mouseevent.y = (size_t)nums[5] + (size_t)!nums[5];
+				break;
+			case 'U': input->keypress.key = LIBTERMINPUT_NEXT;  break;
+			case 'V': input->keypress.key = LIBTERMINPUT_PRIOR; break;
+			case 'Z':
+				if (!(ctx->flags & LIBTERMINPUT_SEPARATE_BACKTAB)) {
+					input->keypress.key = LIBTERMINPUT_TAB;
+					input->keypress.mods |= LIBTERMINPUT_SHIFT;
+				} else {
+					input->keypress.key = LIBTERMINPUT_BACKTAB;
+				}
+				break;
+			case 'a':
+				input->keypress.key = LIBTERMINPUT_UP;
+				input->keypress.mods |= LIBTERMINPUT_SHIFT;
+				break;
+			case 'b':
+				input->keypress.key = LIBTERMINPUT_DOWN;
+				input->keypress.mods |= LIBTERMINPUT_SHIFT;
+				break;
+			case 'c':
+				input->keypress.key = LIBTERMINPUT_RIGHT;
+				input->keypress.mods |= LIBTERMINPUT_SHIFT;
+				break;
+			case 'd':
+				input->keypress.key = LIBTERMINPUT_LEFT;
+				input->keypress.mods |= LIBTERMINPUT_SHIFT;
+				break;
+			case 'n':
+				if (nnums == 1 && nums[0] == 0) {
+					input->type = LIBTERMINPUT_TERMINAL_IS_OK;
+				} else if (nnums == 1 && nums[0] == 3) {
+					input->type = LIBTERMINPUT_TERMINAL_IS_NOT_OK;
+				} else {
+					goto suppress;
+				}
+				break;
+			case 't':
+				if (nnums) {
+					/* In-band window resize notification (\e[?2048h) */
+					if (nums[0] != 48 || nnums < 3)
+						goto suppress;
+					set_resize(input, &nums[1], nnums - 1);
+					break;
+				}
+				/* Parsing output for legacy mouse highlight tracking output (\e[?1001h). */
+				if (ctx->stored_head - ctx->stored_tail < 2)
+					goto suppress;
+				ctx->mouse_tracking = 0;
+				nums = numsbuf;
+				nums[0] = (unsigned long long int)(unsigned char)ctx->stored[ctx->stored_tail++];
+				nums[1] = (unsigned long long int)(unsigned char)ctx->stored[ctx->stored_tail++];
+				nums[0] = (nums[0] - 32ULL) & 255ULL;
+				nums[1] = (nums[1] - 32ULL) & 255ULL;
+				if (ctx->stored_head == ctx->stored_tail)
+					ctx->stored_head = ctx->stored_tail = 0;
+				input->mouseevent.type = LIBTERMINPUT_MOUSEEVENT;
+				input->mouseevent.event = LIBTERMINPUT_HIGHLIGHT_INSIDE;
+				input->mouseevent.mods = 0;
+				input->mouseevent.button = LIBTERMINPUT_BUTTON1;
+				input->mouseevent.x = (size_t)nums[0] + (size_t)!nums[0];
+				input->mouseevent.y = (size_t)nums[1] + (size_t)!nums[1];
+				break;
+			case 'u':
+				input->keypress.times = 1;
+				/* Keys that the kitty keyboard protocol encodes by their legacy byte */
+				switch (nums[0]) {
+				case   9: input->keypress.key = LIBTERMINPUT_TAB;   break;
+				case  13: input->keypress.key = LIBTERMINPUT_ENTER; break;
+				case  27: input->keypress.key = LIBTERMINPUT_ESC;   break;
+				case 127: input->keypress.key = LIBTERMINPUT_ERASE; break;
+				default:
+					if (nums[0] > 0x10FFFFULL || (nums[0] & 0xFFF800ULL) == 0xD800ULL) {
+						input->type = LIBTERMINPUT_NONE;
+						break;
+					}
+					input->keypress.key = LIBTERMINPUT_SYMBOL;
+					encode_utf8(nums[0], input->keypress.symbol);
+					break;
+				}
+				break;
+			case '$':
+				input->keypress.mods |= LIBTERMINPUT_SHIFT;
+				if (nums[0] >= 200)
+					goto suppress;
+				goto tilde_case;
+			case '@':
+				if (ctx->flags & LIBTERMINPUT_INS_ON_CSI_AT) {
+					input->keypress.key = LIBTERMINPUT_INS;
+					break;
+				}
+				input->keypress.mods |= LIBTERMINPUT_SHIFT;
+				/* fall through */
+			case '^':
+				input->keypress.mods |= LIBTERMINPUT_CTRL;
+				if (nums[0] >= 200)
+					goto suppress;
+				/* fall through */
+			case '~':
+			tilde_case:
+				input->keypress.times = 1;
+				switch (nums[0]) {
+				case  1: input->keypress.key = LIBTERMINPUT_HOME;  break;
+				case  2: input->keypress.key = LIBTERMINPUT_INS;   break;
+				case  3: input->keypress.key = LIBTERMINPUT_DEL;   break;
+				case  4: input->keypress.key = LIBTERMINPUT_END;   break;
+				case  5: input->keypress.key = LIBTERMINPUT_PRIOR; break;
+				case  6: input->keypress.key = LIBTERMINPUT_NEXT;  break;
+				case  7: input->keypress.key = LIBTERMINPUT_HOME;  break;
+				case  8: input->keypress.key = LIBTERMINPUT_END;   break;
+				case  9: input->keypress.key = LIBTERMINPUT_ESC;   break; /* just made this one up */
+				case 11: input->keypress.key = LIBTERMINPUT_F1;    break;
+				case 12: input->keypress.key = LIBTERMINPUT_F2;    break;
+				case 13: input->keypress.key = LIBTERMINPUT_F3;    break;
+				case 14: input->keypress.key = LIBTERMINPUT_F4;    break;
+				case 15: input->keypress.key = LIBTERMINPUT_F5;    break;
+				case 17: input->keypress.key = LIBTERMINPUT_F6;    break;
+				case 18: input->keypress.key = LIBTERMINPUT_F7;    break;
+				case 19: input->keypress.key = LIBTERMINPUT_F8;    break;
+				case 20: input->keypress.key = LIBTERMINPUT_F9;    break;
+				case 21: input->keypress.key = LIBTERMINPUT_F10;   break;
+				case 23: input->keypress.key = LIBTERMINPUT_F11;   break;
+				case 24: input->keypress.key = LIBTERMINPUT_F12;   break;
+				case 25: input->keypress.key = LIBTERMINPUT_F1;    break;
+				case 26: input->keypress.key = LIBTERMINPUT_F2;    break;
+				case 28: input->keypress.key = LIBTERMINPUT_F3;    break;
+				case 29: input->keypress.key = LIBTERMINPUT_F4;    break;
+				case 31: input->keypress.key = LIBTERMINPUT_F5;    break;
+				case 32: input->keypress.key = LIBTERMINPUT_F6;    break;
+				case 33: input->keypress.key = LIBTERMINPUT_F7;    break;
+				case 34: input->keypress.key = LIBTERMINPUT_F8;    break;
+				case 200:
+					ctx->bracketed_paste = 1;
+					input->type = LIBTERMINPUT_BRACKETED_PASTE_START;
+					return;
+				case 201:
+					ctx->bracketed_paste = 0;
+					input->type = LIBTERMINPUT_BRACKETED_PASTE_END;
+					return;
+				default:
+					goto suppress;
+				}
+				if (25 <= nums[0] && nums[0] <= 34)
+					input->keypress.mods |= LIBTERMINPUT_SHIFT;
+				break;
+			default:
+				goto suppress;
+			}
+			break;
+		case 3:
+			switch (ctx->key[1] == '[' ? ctx->key[2] : 0) {
+			case 'A': input->keypress.key = LIBTERMINPUT_F1; break;
+			case 'B': input->keypress.key = LIBTERMINPUT_F2; break;
+			case 'C': input->keypress.key = LIBTERMINPUT_F3; break;
+			case 'D': input->keypress.key = LIBTERMINPUT_F4; break;
+			case 'E': input->keypress.key = LIBTERMINPUT_F5; break;
+			default:
+				if (ctx->key[1] == '<' && (ctx->key[2] == 'M' || ctx->key[2] == 'm') && nnums >= 3) {
+					/* Parsing for \e[?1003;1006h output. */
+					input->mouseevent.event = LIBTERMINPUT_PRESS;
+					if (ctx->key[2] == 'm')
+						input->mouseevent.event = LIBTERMINPUT_RELEASE;
+					goto decimal_mouse_tracking;
+				} else {
+					goto suppress;
+				}
+			}
+			break;
+		default:
+			goto suppress;
+		}
+		break;
+
+	case 'O':
+		switch (!ctx->key[2] ? ctx->key[1] : 0) {
+		case 'A': input->keypress.key = LIBTERMINPUT_UP;              break;
+		case 'B': input->keypress.key = LIBTERMINPUT_DOWN;            break;
+		case 'C': input->keypress.key = LIBTERMINPUT_RIGHT;           break;
+		case 'D': input->keypress.key = LIBTERMINPUT_LEFT;            break;
+		case 'E': input->keypress.key = LIBTERMINPUT_BEGIN;           break; /* not attested */
+		case 'F': input->keypress.key = LIBTERMINPUT_END;             break;
+		case 'G': input->keypress.key = LIBTERMINPUT_BEGIN;           break; /* not attested */
+		case 'H': input->keypress.key = LIBTERMINPUT_HOME;            break;
+		case 'P': input->keypress.key = LIBTERMINPUT_F1;              break;
+		case 'Q': input->keypress.key = LIBTERMINPUT_F2;              break;
+		case 'R': input->keypress.key = LIBTERMINPUT_F3;              break;
+		case 'S': input->keypress.key = LIBTERMINPUT_F4;              break;
+		case 'p': input->keypress.key = LIBTERMINPUT_KEYPAD_0;        break;
+		case 'q': input->keypress.key = LIBTERMINPUT_KEYPAD_1;        break;
+		case 'r': input->keypress.key = LIBTERMINPUT_KEYPAD_2;        break;
+		case 's': input->keypress.key = LIBTERMINPUT_KEYPAD_3;        break;
+		case 't': input->keypress.key = LIBTERMINPUT_KEYPAD_4;        break;
+		case 'u': input->keypress.key = LIBTERMINPUT_KEYPAD_5;        break;
+		case 'v': input->keypress.key = LIBTERMINPUT_KEYPAD_6;        break;
+		case 'w': input->keypress.key = LIBTERMINPUT_KEYPAD_7;        break;
+		case 'x': input->keypress.key = LIBTERMINPUT_KEYPAD_8;        break;
+		case 'y': input->keypress.key = LIBTERMINPUT_KEYPAD_9;        break;
+		case 'k': input->keypress.key = LIBTERMINPUT_KEYPAD_PLUS;     break;
+		case 'm': input->keypress.key = LIBTERMINPUT_KEYPAD_MINUS;    break;
+		case 'j': input->keypress.key = LIBTERMINPUT_KEYPAD_TIMES;    break;
+		case 'o': input->keypress.key = LIBTERMINPUT_KEYPAD_DIVISION; break;
+		case 'n': input->keypress.key = LIBTERMINPUT_KEYPAD_DECIMAL;  break;
+		case 'l': input->keypress.key = LIBTERMINPUT_KEYPAD_COMMA;    break;
+		case 'b': input->keypress.key = LIBTERMINPUT_KEYPAD_POINT;    break;
+		case 'M': input->keypress.key = LIBTERMINPUT_KEYPAD_ENTER;    break;
+		default:
+			goto suppress;
+		}
+		break;
+
+	default:
+		/* This shouldn't happen (without goto) */
+	suppress:
+		if (ctx->flags & LIBTERMINPUT_RAW_UNKNOWN_SEQUENCES)
+			parse_raw_sequence(input, raw);
+		else
+			input->type = LIBTERMINPUT_NONE;
+		break;
+	}		
+}
+
+
+static int
+read_bracketed_paste(struct source *src, union libterminput_input *input, struct libterminput_state *ctx)
+{
+	ssize_t r;
+	size_t n;
+
+	/* Unfortunately there is no standard for how to handle pasted ESC's,
+	 * not even ESC [201~ or ESC ESC. Terminates seem to just paste ESC as
+	 * is, so we cannot do anything about them, however, a good terminal
+	 * would stop the paste at the ~ in ESC [201~, send ~ as normal, and
+	 * then continue the brackated paste mode. */
+
+	if (ctx->stored_head - ctx->stored_tail) {
+		ctx->paused = 0;
+		n = ctx->stored_head - ctx->stored_tail;
+		if (!strncmp(&ctx->stored[ctx->stored_tail], "\033[201~", n < 6 ? n : 6)) {
+			if (n >= 6) {
+				ctx->stored_tail += 6;
+				if (ctx->stored_tail == ctx->stored_head)
+					ctx->stored_tail = ctx->stored_head = 0;
+				ctx->bracketed_paste = 0;
+				input->type = LIBTERMINPUT_BRACKETED_PASTE_END;
+				return 1;
+			}
+			input->text.nbytes = ctx->stored_head - ctx->stored_tail;
+			memcpy(input->text.bytes, &ctx->stored[ctx->stored_tail], input->text.nbytes);
+			r = read_source(src, &input->text.bytes[input->text.nbytes], sizeof(input->text.bytes) - input->text.nbytes);
+			if (r <= 0)
+				return (int)r;
+			input->text.nbytes += (size_t)r;
+			ctx->stored_head = ctx->stored_tail = 0;
+			goto normal;
+		}
+		input->text.nbytes = ctx->stored_head - ctx->stored_tail;
+		memcpy(input->text.bytes, &ctx->stored[ctx->stored_tail], input->text.nbytes);
+		ctx->stored_head = ctx->stored_tail = 0;
+		goto normal;
+	}
+
+	r = read_source(src, input->text.bytes, sizeof(input->text.bytes));
+	if (r <= 0)
+		return (int)r;
+	input->text.nbytes = (size_t)r;
+
+normal:
+	for (n = 0; n + 5 < input->text.nbytes; n++) {
+		if (input->text.bytes[n + 0] == '\033' && input->text.bytes[n + 1] == '[' && input->text.bytes[n + 2] == '2' &&
+		    input->text.bytes[n + 3] == '0'    && input->text.bytes[n + 4] == '1' && input->text.bytes[n + 5] == '~')
+			break;
+	}
+	do {
+		if (n + 4 < input->text.nbytes) {
+			if (input->text.bytes[n + 0] == '\033' && input->text.bytes[n + 1] == '[' && input->text.bytes[n + 2] == '2' &&
+			    input->text.bytes[n + 3] == '0'    && input->text.bytes[n + 4] == '1')
+				break;
+			n += 1;
+		}
+		if (n + 3 < input->text.nbytes) {
+			if (input->text.bytes[n + 0] == '\033' && input->text.bytes[n + 1] == '[' && input->text.bytes[n + 2] == '2' &&
+			    input->text.bytes[n + 3] == '0')
+				break;
+			n += 1;
+		}
+		if (n + 2 < input->text.nbytes) {
+			if (input->text.bytes[n + 0] == '\033' && input->text.bytes[n + 1] == '[' && input->text.bytes[n + 2] == '2')
+				break;
+			n += 1;
+		}
+		if (n + 1 < input->text.nbytes) {
+			if (input->text.bytes[n + 0] == '\033' && input->text.bytes[n + 1] == '[')
+				break;
+			n += 1;
+		}
+		if (n + 0 < input->text.nbytes) {
+			if (input->text.bytes[n + 0] == '\033')
+				break;
+			n += 1;
+		}
+	} while (0);
+	if (!n) {
+		if (input->text.nbytes < 6) {
+			input->text.type = LIBTERMINPUT_NONE;
+			memcpy(ctx->stored, input->text.bytes, input->text.nbytes);
+			ctx->stored_tail = 0;
+			ctx->stored_head = input->text.nbytes;
+			ctx->paused = 1;
+			return 1;
+		}
+		ctx->stored_tail = 0;
+		ctx->stored_head = input->text.nbytes - 6;
+		memcpy(ctx->stored, &input->text.bytes[6], ctx->stored_head);
+		if (ctx->stored_tail == ctx->stored_head)
+			ctx->stored_tail = ctx->stored_head = 0;
+		ctx->bracketed_paste = 0;
+		input->type = LIBTERMINPUT_BRACKETED_PASTE_END;
+		return 1;
+	}
+	ctx->stored_tail = 0;
+	ctx->stored_head = input->text.nbytes - n;
+	memcpy(ctx->stored, &input->text.bytes[n], ctx->stored_head);
+	input->text.nbytes = n;
+	input->text.type = LIBTERMINPUT_TEXT;
+	return 1;
+}
+
+
+static int
+read_control_string(struct source *src, union libterminput_input *input, struct libterminput_state *ctx)
+{
+	struct libterminput_string *string = &input->string;
+	ssize_t r;
+	size_t n, i;
+	char *p, *q;
+
+	if (ctx->paused) {
+		/* An ESC was left at the end, it may be the beginning of the ST */
+		memmove(ctx->stored, &ctx->stored[ctx->stored_tail], ctx->stored_head - ctx->stored_tail);
+		ctx->stored_head -= ctx->stored_tail;
+		ctx->stored_tail = 0;
+		r = read_source(src, &ctx->stored[ctx->stored_head], sizeof(ctx->stored) - ctx->stored_head);
+		if (r <= 0)
+			return (int)r;
+		ctx->stored_head += (size_t)r;
+		ctx->paused = 0;
+	} else if (ctx->stored_head == ctx->stored_tail) {
+		r = read_source(src, ctx->stored, sizeof(ctx->stored));
+		if (r <= 0)
+			return (int)r;
+		ctx->stored_tail = 0;
+		ctx->stored_head = (size_t)r;
+	}
+
+	p = &ctx->stored[ctx->stored_tail];
+	n = ctx->stored_head - ctx->stored_tail;
+	if (ctx->control_string == ']') {
+		for (i = 0; i < n && p[i] != '\033' && p[i] != '\a'; i++);
+		string->type = LIBTERMINPUT_OPERATING_SYSTEM_COMMAND;
+	} else {
+		q = memchr(p, '\033', n);
+		i = q ? (size_t)(q - p) : n;
+		string->type = LIBTERMINPUT_DEVICE_CONTROL_STRING;
+	}
+
+	string->more = 1;
+	string->nbytes = i;
+	memcpy(string->bytes, p, i);
+	ctx->stored_tail += i;
+
+	if (i < n && p[i] == '\a') {
+		/* BEL terminates operating system commands */
+		string->more = 0;
+		ctx->control_string = 0;
+		ctx->stored_tail += 1;
+	} else if (i + 1 == n) {
+		/* Wait for the byte after the ESC */
+		if (!i) {
+			input->type = LIBTERMINPUT_NONE;
+			ctx->paused = 1;
+		}
+		return 1;
+	} else if (i < n) {
+		/* ESC \ terminates the string, any other ESC aborts it and is parsed normally */
+		string->more = 0;
+		ctx->control_string = 0;
+		if (p[i + 1] == '\\')
+			ctx->stored_tail += 2;
+	}
+	if (ctx->stored_tail == ctx->stored_head)
+		ctx->stored_tail = ctx->stored_head = 0;
+	return 1;
+}
+
+
+static int
+read_event(struct source *src, union libterminput_input *input, struct libterminput_state *ctx)
+{
+	struct input ret;
+	size_t n, m;
+	char *p;
+	int r;
+	ssize_t rd;
+
+	if (!ctx->inited) {
+		ctx->inited = 1;
+		memset(input, 0, sizeof(*input));
+	} else if (input->type == LIBTERMINPUT_KEYPRESS && input->keypress.times > 1) {
+		input->keypress.times -= 1;
+		return 1;
+	}
+
+	if (ctx->bracketed_paste)
+		return read_bracketed_paste(src, input, ctx);
+	if (ctx->control_string)
+		return read_control_string(src, input, ctx);
+	if (!ctx->mouse_tracking) {
+		r = read_input(src, &ret, ctx);
+		if (r <= 0)
+			return r;
+	} else if (ctx->mouse_tracking == 1) {
+		if (ctx->stored_tail == sizeof(ctx->stored)) {
+			memmove(ctx->stored, &ctx->stored[ctx->stored_tail], ctx->stored_head - ctx->stored_tail);
+			ctx->stored_head -= ctx->stored_tail;
+			ctx->stored_tail = 0;
+		}
+		rd = read_source(src, &ctx->stored[ctx->stored_head], 1);
+		if (rd <= 0)
+			return (int)rd;
+		ctx->stored_head += 1;
+		p = strchr(ctx->key, '\0');
+		goto continue_incomplete;
+	} else {
+		if (ctx->stored_tail > sizeof(ctx->stored) - (size_t)ctx->mouse_tracking) {
+			memmove(ctx->stored, &ctx->stored[ctx->stored_tail], ctx->stored_head - ctx->stored_tail);
+			ctx->stored_head -= ctx->stored_tail;
+			ctx->stored_tail = 0;
+		}
+		rd = read_source(src, &ctx->stored[ctx->stored_head], (size_t)ctx->mouse_tracking - (ctx->stored_head - ctx->stored_tail));
+		if (rd <= 0)
+			return (int)rd;
+		ctx->stored_head += (size_t)rd;
+		p = strchr(ctx->key, '\0');
+		goto continue_incomplete;
+	}
+
+again:
+	if (!*ret.symbol) {
+		/* Incomplete input */
+		if (ctx->meta < 3) {
+			/* Up to two Meta/ESC, wait until a third or something else is read */
+			input->type = LIBTERMINPUT_NONE;
+			return 1;
+		}
+		/* Three ESC's */
+		input->type = LIBTERMINPUT_KEYPRESS;
+		input->keypress.key = LIBTERMINPUT_ESC;
+		input->keypress.times = 3;
+		input->keypress.mods = 0;
+		input->keypress.symbol[0] = '\0';
+		ctx->meta -= 3;
+	} else if (*ctx->key) {
+		/* Special keys */
+		if (ret.mods) {
+			/* Special key was aborted, restart */
+			*ctx->key = '\0';
+			goto again;
+		}
+		/* Add new input to sequence */
+		n = strlen(ctx->key);
+		m = strlen(ret.symbol);
+		if (n + m >= sizeof(ctx->key)) {
+			/* Abort if too long */
+			input->type = LIBTERMINPUT_NONE;
+			return 1;
+		}
+		p = stpcpy(&ctx->key[n], ret.symbol);
+		/* Check if sequence is complete */
+	continue_incomplete:
+		if (!isalpha(p[-1]) && p[-1] != '~' && p[-1] != '@' && p[-1] != '^' && p[-1] != '$') {
+			input->type = LIBTERMINPUT_NONE;
+			return 1;
+		} else if (p[-1] == '$' && ctx->key[1] == '?' && (ctx->flags & LIBTERMINPUT_AWAITING_DEVICE_REPORTS)) {
+			/* DECRPM, CSI ? Pd ; Ps $ y */
+			input->type = LIBTERMINPUT_NONE;
+			return 1;
+		} else if (ctx->key[0] == '[' && ctx->key[1] == '<' && p == &ctx->key[2]) {
+			input->type = LIBTERMINPUT_NONE;
+			return 1;
+		} else if (ctx->key[0] == '[' && ctx->key[1] == 'M' && (ctx->flags & LIBTERMINPUT_MACRO_ON_CSI_M)) {
+			/* complete */
+		} else if (ctx->key[0] == '[' && ctx->key[1] == 'M' && (ctx->flags & LIBTERMINPUT_DECSET_1005)) {
+			ctx->mouse_tracking = 1;
+			if (ctx->stored_head == ctx->stored_tail) {
+				input->type = LIBTERMINPUT_NONE;
+				return 1;
+			}
+			n = ctx->stored_tail;
+			r = check_utf8_char(&ctx->stored[n], &m, ctx->stored_head - n);
+			if (r <= 0)
+				goto fallback_to_none_or_macro;
+			n += m;
+			r = check_utf8_char(&ctx->stored[n], &m, ctx->stored_head - n);
+			if (r <= 0)
+				goto fallback_to_none_or_macro;
+			n += m;
+			r = check_utf8_char(&ctx->stored[n], &m, ctx->stored_head - n);
+			if (r <= 0) {
+			fallback_to_none_or_macro:
+				if (!r) {
+					input->type = LIBTERMINPUT_NONE;
+					return 1;
+				}
+				ctx->mouse_tracking = 0;
+				input->type = LIBTERMINPUT_KEYPRESS;
+				input->keypress.key = LIBTERMINPUT_MACRO;
+				input->keypress.mods = ret.mods;
+				input->keypress.times = 1;
+				if (ctx->meta > 1)
+					input->keypress.mods |= LIBTERMINPUT_META;
+				ctx->meta = 0;
+				ctx->key[0] = '\0';
+				return 1;
+			}
+		} else if (ctx->key[0] == '[' && ctx->key[1] == 'M' && ctx->stored_head - ctx->stored_tail < 3) {
+			ctx->mouse_tracking = 3;
+			input->type = LIBTERMINPUT_NONE;
+			return 1;
+		} else if (ctx->key[0] == '[' && ctx->key[1] == 't' && ctx->stored_head - ctx->stored_tail < 2) {
+			ctx->mouse_tracking = 2;
+			input->type = LIBTERMINPUT_NONE;
+			return 1;
+		} else if (ctx->key[0] == '[' && ctx->key[1] == 'T' && ctx->stored_head - ctx->stored_tail < 6) {
+			ctx->mouse_tracking = 6;
+			input->type = LIBTERMINPUT_NONE;
+			return 1;
+		}
+		/* Parse the complete sequence */
+		parse_sequence(input, ctx);
+		/* Reset */
+		ctx->meta = 0;
+		ctx->key[0] = '\0';
+		/* Only when reading from a terminal, so that the
+		 * events in memory do not depend on how it is split */
+		if (input->type == LIBTERMINPUT_RESIZE && !src->bufp)
+			coalesce_resizes(input, ctx);
+	} else if (ctx->meta && !(ret.mods & LIBTERMINPUT_CTRL) && !strcmp(ret.symbol, "P") && (ctx->flags & LIBTERMINPUT_AWAITING_DEVICE_REPORTS)) {
+		/* ESC P begins a device control string */
+		ctx->control_string = 'P';
+		ctx->meta = 0;
+		input->type = LIBTERMINPUT_NONE;
+	} else if (ctx->meta && !(ret.mods & LIBTERMINPUT_CTRL) && !strcmp(ret.symbol, "]") && (ctx->flags & LIBTERMINPUT_AWAITING_OSC)) {
+		/* ESC ] begins an operating system command */
+		ctx->control_string = ']';
+		ctx->meta = 0;
+		input->type = LIBTERMINPUT_NONE;
+	} else if (ctx->meta && !(ret.mods & LIBTERMINPUT_CTRL) && (!strcmp(ret.symbol, "[") || !strcmp(ret.symbol, "O"))) {
+		/* ESC [ or ESC 0 is used as the beginning of most special keys,
+		 * but ESC ^O is Meta+Ctrl+O */
+		strcpy(ctx->key, ret.symbol);
+		input->type = LIBTERMINPUT_NONE;
+	} else {
+		/* Character input and single-byte special keys */
+		input->type = LIBTERMINPUT_KEYPRESS;
+		input->keypress.mods = ret.mods;
+		input->keypress.times = 1;
+		if (ctx->meta) {
+			/* Transfer meta modifier from state to input */
+			input->keypress.mods |= LIBTERMINPUT_META;
+			ctx->meta = 0;
+		}
+		switch (ret.symbol[1] ? 0 : ret.symbol[0]) {
+		case 127:
+		case '\b':
+			input->keypress.key = LIBTERMINPUT_ERASE;
+			input->keypress.symbol[0] = '\0';
+			break;
+		case '\t':
+			input->keypress.key = LIBTERMINPUT_TAB;
+			input->keypress.symbol[0] = '\0';
+			break;
+		case '\n':
+			input->keypress.key = LIBTERMINPUT_ENTER;
+			input->keypress.symbol[0] = '\0';
+			break;
+		case 033:
+			input->keypress.key = LIBTERMINPUT_ESC;
+			input->keypress.symbol[0] = '\0';
+			break;
+		default:
+			input->keypress.key = LIBTERMINPUT_SYMBOL;
+			strcpy(input->keypress.symbol, ret.symbol);
+			break;
+		}
+	}
+
+	return 1;
+}
+
+
+/* Get the class of input for libterminput_set_event_mask, 0 if it has none */
+static enum libterminput_event_class
+get_event_class(const union libterminput_input *input)
+{
+	switch (input->type) {
+	case LIBTERMINPUT_KEYPRESS:
+		if (input->keypress.key >= LIBTERMINPUT_KEYPAD_0 && input->keypress.key <= LIBTERMINPUT_KEYPAD_ENTER)
+			return LIBTERMINPUT_EVENT_KEYPAD;
+		return 0;
+	case LIBTERMINPUT_MOUSEEVENT:
+		if (input->mouseevent.event == LIBTERMINPUT_MOTION)
+			return LIBTERMINPUT_EVENT_MOUSE_MOTION;
+		if (input->mouseevent.event != LIBTERMINPUT_PRESS && input->mouseevent.event != LIBTERMINPUT_RELEASE)
+			return LIBTERMINPUT_EVENT_MOUSE_HIGHLIGHT;
+		if (input->mouseevent.button >= LIBTERMINPUT_SCROLL_UP && input->mouseevent.button <= LIBTERMINPUT_SCROLL_RIGHT)
+			return LIBTERMINPUT_EVENT_MOUSE_SCROLL;
+		return LIBTERMINPUT_EVENT_MOUSE_BUTTON;
+	case LIBTERMINPUT_BRACKETED_PASTE_START:
+	case LIBTERMINPUT_BRACKETED_PASTE_END:
+	case LIBTERMINPUT_TEXT:
+		return LIBTERMINPUT_EVENT_PASTE;
+	case LIBTERMINPUT_TERMINAL_IS_OK:
+	case LIBTERMINPUT_TERMINAL_IS_NOT_OK:
+		return LIBTERMINPUT_EVENT_TERMINAL_STATUS;
+	case LIBTERMINPUT_FOCUS_IN:
+	case LIBTERMINPUT_FOCUS_OUT:
+		return LIBTERMINPUT_EVENT_FOCUS;
+	default:
+		return 0;
+	}
+}
+
+
+static int
+read_common(struct source *src, union libterminput_input *input, struct libterminput_state *ctx)
+{
+	enum libterminput_event_class class;
+	int r, i;
+
+	for (;;) {
+		r = read_event(src, input, ctx);
+		if (r <= 0 || !ctx->event_mask)
+			return r;
+		class = get_event_class(input) & ctx->event_mask;
+		if (!class)
+			return r;
+		for (i = 0; !(class & (1 << i)); i++);
+		ctx->dropped_events[i] += 1;
+		input->type = LIBTERMINPUT_NONE;
+		/* Continue with input that has already been read, but do
+		 * not block on the terminal, the caller may want to poll */
+		if (ctx->stored_head == ctx->stored_tail && !(src->lenp && *src->lenp))
+			return 1;
+	}
+}
+
+
+int
+libterminput_read(int fd, union libterminput_input *input, struct libterminput_state *ctx)
+{
+	struct source src;
+	src.fd = fd;
+	src.bufp = NULL;
+	src.lenp = NULL;
+	src.wakeup_fd = ctx->wakeup ? ctx->wakeup_fds[0] : -1;
+	return read_common(&src, input, ctx);
+}
+
+
+int
+libterminput_read_mem(const char **bufp, size_t *lenp, union libterminput_input *input, struct libterminput_state *ctx)
+{
+	struct source src;
+	src.fd = -1;
+	src.bufp = bufp;
+	src.lenp = lenp;
+	src.wakeup_fd = -1;
+	return read_common(&src, input, ctx);
+}
+
+
+unsigned long long int
+libterminput_await_cursor_position(struct libterminput_state *ctx)
+{
+	return ctx->positions_received + (unsigned long long int)ctx->awaiting_positions++;
+}
+
+
+int
+libterminput_set_flags(struct libterminput_state *ctx, enum libterminput_flags flags)
+{
+	ctx->flags |= flags;
+	return 0;
+}
+
+
+int
+libterminput_clear_flags(struct libterminput_state *ctx, enum libterminput_flags flags)
+{
+	ctx->flags |= flags;
+	ctx->flags ^= flags;
+	return 0;
+}
+
+
+int
+libterminput_set_event_mask(struct libterminput_state *ctx, enum libterminput_event_class mask)
+{
+	ctx->event_mask = mask;
+	return 0;
+}
+
+
+unsigned long long int
+libterminput_get_dropped_events(const struct libterminput_state *ctx, enum libterminput_event_class classes)
+{
+	unsigned long long int n = 0;
+	int i;
+	for (i = 0; i < LIBTERMINPUT_EVENT_CLASSES; i++)
+		if (classes & (1 << i))
+			n += ctx->dropped_events[i];
+	return n;
+}
+
+
+static uint32_t
+saturate_u32(unsigned long long int value)
+{
+	return value > UINT32_MAX ? UINT32_MAX : (uint32_t)value;
+}
+
+
+/* Append data for a compact input to the side buffer */
+static int
+append_compact(uint32_t *offsetp, const void *data, size_t n, char *buf, size_t size, size_t *lenp)
+{
+	if (n > size - *lenp || *lenp > UINT32_MAX) {
+		errno = ENOBUFS;
+		return -1;
+	}
+	*offsetp = (uint32_t)*lenp;
+	memcpy(&buf[*lenp], data, n);
+	*lenp += n;
+	return 0;
+}
+
+
+int
+libterminput_compact(union libterminput_compact_input *out, const union libterminput_input *in,
+                     char *buf, size_t size, size_t *lenp)
+{
+	size_t i = 0;
+
+	memset(out, 0, sizeof(*out));
+	out->type = (uint8_t)in->type;
+
+	switch (in->type) {
+	case LIBTERMINPUT_KEYPRESS:
+		out->keypress.key = (uint8_t)in->keypress.key;
+		out->keypress.mods = (uint8_t)in->keypress.mods;
+		out->keypress.times = saturate_u32(in->keypress.times);
+		memcpy(out->keypress.symbol, in->keypress.symbol, sizeof(out->keypress.symbol));
+		if (in->keypress.key == LIBTERMINPUT_SYMBOL && *in->keypress.symbol)
+			out->keypress.codepoint = saturate_u32(utf8_decode(in->keypress.symbol, &i));
+		break;
+
+	case LIBTERMINPUT_MOUSEEVENT:
+		out->mouseevent.mods = (uint8_t)in->mouseevent.mods;
+		out->mouseevent.button = (uint8_t)in->mouseevent.button;
+		out->mouseevent.event = (uint8_t)in->mouseevent.event;
+		out->mouseevent.x = saturate_u32(in->mouseevent.x);
+		out->mouseevent.y = saturate_u32(in->mouseevent.y);
+		out->mouseevent.start_x = saturate_u32(in->mouseevent.start_x);
+		out->mouseevent.start_y = saturate_u32(in->mouseevent.start_y);
+		out->mouseevent.end_x = saturate_u32(in->mouseevent.end_x);
+		out->mouseevent.end_y = saturate_u32(in->mouseevent.end_y);
+		break;
+
+	case LIBTERMINPUT_CURSOR_POSITION:
+		out->position.x = saturate_u32(in->position.x);
+		out->position.y = saturate_u32(in->position.y);
+		out->position.page = saturate_u32(in->position.page);
+		out->position.sequence = (uint64_t)in->position.sequence;
+		break;
+
+	case LIBTERMINPUT_RESIZE:
+		out->resize.rows = saturate_u32(in->resize.rows);
+		out->resize.columns = saturate_u32(in->resize.columns);
+		out->resize.height = saturate_u32(in->resize.height);
+		out->resize.width = saturate_u32(in->resize.width);
+		break;
+
+	case LIBTERMINPUT_REPORT:
+		out->report.prefix = in->report.prefix;
+		out->report.intermediate = in->report.intermediate;
+		out->report.final = in->report.final;
+		out->report.nparams = (uint32_t)in->report.nparams;
+		return append_compact(&out->report.offset, in->report.params,
+		                      in->report.nparams * sizeof(*in->report.params), buf, size, lenp);
+
+	case LIBTERMINPUT_RAW_SEQUENCE:
+		out->sequence.introducer = in->sequence.introducer;
+		out->sequence.prefix = in->sequence.prefix;
+		out->sequence.final = in->sequence.final;
+		memcpy(out->sequence.intermediates, in->sequence.intermediates, sizeof(out->sequence.intermediates));
+		out->sequence.nparams = (uint32_t)in->sequence.nparams;
+		out->sequence.subparams = (uint32_t)in->sequence.subparams;
+		return append_compact(&out->sequence.offset, in->sequence.params,
+		                      in->sequence.nparams * sizeof(*in->sequence.params), buf, size, lenp);
+
+	case LIBTERMINPUT_TEXT:
+		out->text.nbytes = (uint32_t)in->text.nbytes;
+		return append_compact(&out->text.offset, in->text.bytes, in->text.nbytes, buf, size, lenp);
+
+	case LIBTERMINPUT_DEVICE_CONTROL_STRING:
+	case LIBTERMINPUT_OPERATING_SYSTEM_COMMAND:
+		out->text.more = in->string.more;
+		out->text.nbytes = (uint32_t)in->string.nbytes;
+		return append_compact(&out->text.offset, in->string.bytes, in->string.nbytes, buf, size, lenp);
+
+	default:
+		break;
+	}
+
+	return 0;
+}
+
+
+void
+libterminput_expand(union libterminput_input *out, const union libterminput_compact_input *in, const char *buf)
+{
+	size_t n;
+
+	out->type = (enum libterminput_type)in->type;
+
+	switch (out->type) {
+	case LIBTERMINPUT_KEYPRESS:
+		out->keypress.key = (enum libterminput_key)in->keypress.key;
+		out->keypress.mods = (enum libterminput_mod)in->keypress.mods;
+		out->keypress.times = (unsigned long long int)in->keypress.times;
+		memcpy(out->keypress.symbol, in->keypress.symbol, sizeof(out->keypress.symbol));
+		break;
+
+	case LIBTERMINPUT_MOUSEEVENT:
+		out->mouseevent.mods = (enum libterminput_mod)in->mouseevent.mods;
+		out->mouseevent.button = (enum libterminput_button)in->mouseevent.button;
+		out->mouseevent.event = (enum libterminput_event)in->mouseevent.event;
+		out->mouseevent.x = (size_t)in->mouseevent.x;
+		out->mouseevent.y = (size_t)in->mouseevent.y;
+		out->mouseevent.start_x = (size_t)in->mouseevent.start_x;
+		out->mouseevent.start_y = (size_t)in->mouseevent.start_y;
+		out->mouseevent.end_x = (size_t)in->mouseevent.end_x;
+		out->mouseevent.end_y = (size_t)in->mouseevent.end_y;
+		break;
+
+	case LIBTERMINPUT_CURSOR_POSITION:
+		out->position.x = (size_t)in->position.x;
+		out->position.y = (size_t)in->position.y;
+		out->position.page = (size_t)in->position.page;
+		out->position.sequence = (unsigned long long int)in->position.sequence;
+		break;
+
+	case LIBTERMINPUT_RESIZE:
+		out->resize.rows = (size_t)in->resize.rows;
+		out->resize.columns = (size_t)in->resize.columns;
+		out->resize.height = (size_t)in->resize.height;
+		out->resize.width = (size_t)in->resize.width;
+		break;
+
+	case LIBTERMINPUT_REPORT:
+		out->report.prefix = in->report.prefix;
+		out->report.intermediate = in->report.intermediate;
+		out->report.final = in->report.final;
+		n = (size_t)in->report.nparams;
+		if (n > sizeof(out->report.params) / sizeof(*out->report.params))
+			n = sizeof(out->report.params) / sizeof(*out->report.params);
+		out->report.nparams = n;
+		memcpy(out->report.params, &buf[in->report.offset], n * sizeof(*out->report.params));
+		break;
+
+	case LIBTERMINPUT_RAW_SEQUENCE:
+		out->sequence.introducer = in->sequence.introducer;
+		out->sequence.prefix = in->sequence.prefix;
+		out->sequence.final = in->sequence.final;
+		memcpy(out->sequence.intermediates, in->sequence.intermediates, sizeof(out->sequence.intermediates));
+		out->sequence.intermediates[sizeof(out->sequence.intermediates) - 1] = '\0';
+		out->sequence.subparams = (unsigned int)in->sequence.subparams;
+		n = (size_t)in->sequence.nparams;
+		if (n > sizeof(out->sequence.params) / sizeof(*out->sequence.params))
+			n = sizeof(out->sequence.params) / sizeof(*out->sequence.params);
+		out->sequence.nparams = n;
+		memcpy(out->sequence.params, &buf[in->sequence.offset], n * sizeof(*out->sequence.params));
+		break;
+
+	case LIBTERMINPUT_TEXT:
+		n = (size_t)in->text.nbytes;
+		if (n > sizeof(out->text.bytes))
+			n = sizeof(out->text.bytes);
+		out->text.nbytes = n;
+		memcpy(out->text.bytes, &buf[in->text.offset], n);
+		break;
+
+	case LIBTERMINPUT_DEVICE_CONTROL_STRING:
+	case LIBTERMINPUT_OPERATING_SYSTEM_COMMAND:
+		n = (size_t)in->text.nbytes;
+		if (n > sizeof(out->string.bytes))
+			n = sizeof(out->string.bytes);
+		out->string.more = in->text.more;
+		out->string.nbytes = n;
+		memcpy(out->string.bytes, &buf[in->text.offset], n);
+		break;
+
+	default:
+		break;
+	}
+}
+
+
+extern inline int libterminput_is_ready(union libterminput_input *input, struct libterminput_state *ctx);
+extern inline int libterminput_is_focused(struct libterminput_state *ctx);
+
+
+int
+libterminput_enable_wakeup(struct libterminput_state *ctx)
+{
+#if !defined(__linux__)
+	int i, flags;
+#endif
+
+	if (ctx->wakeup)
+		return 0;
+
+#if defined(__linux__)
+	ctx->wakeup_fds[0] = ctx->wakeup_fds[1] = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (ctx->wakeup_fds[0] < 0)
+		return -1;
+#else
+	if (pipe(ctx->wakeup_fds))
+		return -1;
+	for (i = 0; i < 2; i++) {
+		flags = fcntl(ctx->wakeup_fds[i], F_GETFL);
+		if (flags < 0 || fcntl(ctx->wakeup_fds[i], F_SETFL, flags | O_NONBLOCK) ||
+		    fcntl(ctx->wakeup_fds[i], F_SETFD, FD_CLOEXEC)) {
+			close(ctx->wakeup_fds[0]);
+			close(ctx->wakeup_fds[1]);
+			return -1;
+		}
+	}
+#endif
+
+	ctx->wakeup = 1;
+	return 0;
+}
+
+
+void
+libterminput_disable_wakeup(struct libterminput_state *ctx)
+{
+	if (!ctx->wakeup)
+		return;
+	close(ctx->wakeup_fds[0]);
+	if (ctx->wakeup_fds[1] != ctx->wakeup_fds[0])
+		close(ctx->wakeup_fds[1]);
+	ctx->wakeup = 0;
+}
+
+
+int
+libterminput_wakeup(struct libterminput_state *ctx)
+{
+	uint64_t one = 1; /* an eventfd requires exactly 8 bytes */
+	if (!ctx->wakeup) {
+		errno = EINVAL;
+		return -1;
+	}
+	/* EAGAIN means that a wakeup is already pending */
+	if (write(ctx->wakeup_fds[1], &one, sizeof(one)) < 0 && errno != EAGAIN)
+		return -1;
+	return 0;
+}
+
+/* libterminput_probe.c */
+/* See LICENSE file for copyright and license details. */
+
+#include <errno.h>
+#include <limits.h>
+#include <poll.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+
+#define ELEMSOF(ARR) (sizeof(ARR) / sizeof(*(ARR)))
+
+
+static unsigned long long int
+now_ms(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (unsigned long long int)ts.tv_sec * 1000ULL + (unsigned long long int)ts.tv_nsec / 1000000ULL;
+}
+
+
+static int
+hex_value(char c)
+{
+	if ('0' <= c && c <= '9')
+		return c - '0';
+	if ('a' <= c && c <= 'f')
+		return c - 'a' + 10;
+	if ('A' <= c && c <= 'F')
+		return c - 'A' + 10;
+	return -1;
+}
+
+
+/* Decode `n` hexadecimal digits into a NUL-terminated string, truncating if too long */
+static void
+hex_decode(char *out, size_t size, const char *s, size_t n)
+{
+	int hi, lo;
+	for (; n >= 2 && size > 1; s += 2, n -= 2) {
+		hi = hex_value(s[0]);
+		lo = hex_value(s[1]);
+		if (hi < 0 || lo < 0)
+			break;
+		*out++ = (char)(hi << 4 | lo);
+		size -= 1;
+	}
+	*out = '\0';
+}
+
+
+static void
+finish(struct libterminput_probe *probe, struct libterminput_state *ctx, int complete)
+{
+	probe->finished = 1;
+	probe->complete = (char)complete;
+	/* On timeout the flag is kept so that late replies are not parsed as key presses */
+	if (complete && probe->set_flag)
+		libterminput_clear_flags(ctx, LIBTERMINPUT_AWAITING_DEVICE_REPORTS);
+}
+
+
+/* Returns 1 if the report was a reply to the probe */
+static int
+handle_report(struct libterminput_report *report, struct libterminput_state *ctx, struct libterminput_probe *probe)
+{
+	size_t i;
+
+	if (report->prefix == '?' && report->final == 'c' && !report->intermediate) {
+		probe->nda1 = report->nparams < ELEMSOF(probe->da1) ? report->nparams : ELEMSOF(probe->da1);
+		memcpy(probe->da1, report->params, probe->nda1 * sizeof(*probe->da1));
+		finish(probe, ctx, 1);
+		return 1;
+	}
+	if (report->prefix == '>' && report->final == 'c' && !report->intermediate) {
+		probe->have_da2 = 1;
+		for (i = 0; i < ELEMSOF(probe->da2); i++)
+			probe->da2[i] = i < report->nparams ? report->params[i] : 0;
+		return 1;
+	}
+	if (report->prefix == '?' && report->final == 'y' && report->intermediate == '$' && report->nparams >= 2) {
+		for (i = 0; i < probe->nmodes; i++) {
+			if (probe->modes[i].mode == report->params[0]) {
+				probe->modes[i].value = report->params[1] <= 4 ? (int)report->params[1] : 0;
+				return 1;
+			}
+		}
+		return 0;
+	}
+	if (report->prefix == '?' && report->final == 'u' && !report->intermediate && (probe->queries & LIBTERMINPUT_PROBE_KITTY_KEYBOARD)) {
+		probe->kitty_keyboard_flags = report->nparams && report->params[0] <= LONG_MAX ? (long int)report->params[0] : 0;
+		return 1;
+	}
+	return 0;
+}
+
+
+/* Parse XTGETTCAP reply, DCS 1 + r name = value ; ... ST, or DCS 0 + r name ST */
+static void
+handle_capabilities(const char *s, size_t n, struct libterminput_probe *probe)
+{
+	char name[sizeof(probe->capabilities->name)];
+	int status = s[0] == '1';
+	const char *end = &s[n], *sep, *eq;
+	size_t i;
+
+	for (s += 3; s < end; s = sep + 1) {
+		sep = memchr(s, ';', (size_t)(end - s));
+		if (!sep)
+			sep = end;
+		eq = memchr(s, '=', (size_t)(sep - s));
+		hex_decode(name, sizeof(name), s, (size_t)((eq ? eq : sep) - s));
+		for (i = 0; i < probe->ncapabilities; i++) {
+			if (!strcmp(probe->capabilities[i].name, name)) {
+				probe->capabilities[i].status = status;
+				if (status && eq)
+					hex_decode(probe->capabilities[i].value, sizeof(probe->capabilities[i].value),
+					           &eq[1], (size_t)(sep - &eq[1]));
+				break;
+			}
+		}
+	}
+}
+
+
+static void
+handle_string(struct libterminput_string *string, struct libterminput_probe *probe)
+{
+	size_t n = string->nbytes;
+	if (n > sizeof(probe->string) - probe->nstring)
+		n = sizeof(probe->string) - probe->nstring;
+	memcpy(&probe->string[probe->nstring], string->bytes, n);
+	probe->nstring += n;
+	if (string->more)
+		return;
+
+	n = probe->nstring;
+	probe->nstring = 0;
+	if (n >= 2 && probe->string[0] == '>' && probe->string[1] == '|') {
+		n -= 2;
+		if (n >= sizeof(probe->version))
+			n = sizeof(probe->version) - 1;
+		memcpy(probe->version, &probe->string[2], n);
+		probe->version[n] = '\0';
+	} else if (n >= 3 && (probe->string[0] == '0' || probe->string[0] == '1') && !strncmp(&probe->string[1], "+r", 2)) {
+		handle_capabilities(probe->string, n, probe);
+	}
+}
+
+
+int
+libterminput_probe_send(int fd, struct libterminput_state *ctx, struct libterminput_probe *probe, unsigned int timeout)
+{
+	static const char hex[] = "0123456789ABCDEF";
+	char buf[LIBTERMINPUT_PROBE_MAX_MODES * 24 + LIBTERMINPUT_PROBE_MAX_CAPABILITIES * 72 + 32];
+	size_t i, n = 0, off;
+	const char *s;
+	ssize_t r;
+
+	if (probe->nmodes > LIBTERMINPUT_PROBE_MAX_MODES || probe->ncapabilities > LIBTERMINPUT_PROBE_MAX_CAPABILITIES) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	probe->complete = 0;
+	probe->finished = 0;
+	probe->have_da2 = 0;
+	probe->nda1 = 0;
+	probe->version[0] = '\0';
+	probe->kitty_keyboard_flags = -1;
+	probe->nstring = 0;
+
+	for (i = 0; i < probe->nmodes; i++) {
+		probe->modes[i].value = -1;
+		n += (size_t)sprintf(&buf[n], "\033[?%u$p", probe->modes[i].mode);
+	}
+	if (probe->queries & LIBTERMINPUT_PROBE_DA2)
+		n += (size_t)sprintf(&buf[n], "\033[>c");
+	if (probe->queries & LIBTERMINPUT_PROBE_XTVERSION)
+		n += (size_t)sprintf(&buf[n], "\033[>q");
+	if (probe->queries & LIBTERMINPUT_PROBE_KITTY_KEYBOARD)
+		n += (size_t)sprintf(&buf[n], "\033[?u");
+	for (i = 0; i < probe->ncapabilities; i++) {
+		probe->capabilities[i].status = -1;
+		probe->capabilities[i].value[0] = '\0';
+		n += (size_t)sprintf(&buf[n], "\033P+q");
+		for (s = probe->capabilities[i].name; *s && s != &probe->capabilities[i].name[sizeof(probe->capabilities[i].name)]; s++) {
+			buf[n++] = hex[((unsigned char)*s >> 4) & 15];
+			buf[n++] = hex[((unsigned char)*s >> 0) & 15];
+		}
+		n += (size_t)sprintf(&buf[n], "\033\\");
+	}
+	/* Terminals reply in order, and all support DA1, so its reply marks the end */
+	n += (size_t)sprintf(&buf[n], "\033[c");
+
+	probe->set_flag = !(ctx->flags & LIBTERMINPUT_AWAITING_DEVICE_REPORTS);
+	libterminput_set_flags(ctx, LIBTERMINPUT_AWAITING_DEVICE_REPORTS);
+	probe->deadline = now_ms() + timeout;
+
+	for (off = 0; off < n; off += (size_t)r) {
+		r = write(fd, &buf[off], n - off);
+		if (r < 0) {
+			if (errno == EINTR)
+				r = 0;
+			else
+				return -1;
+		}
+	}
+	return 0;
+}
+
+
+int
+libterminput_probe_read(int fd, union libterminput_input *input, struct libterminput_state *ctx, struct libterminput_probe *probe)
+{
+	struct pollfd pfd;
+	unsigned long long int now;
+	int r;
+
+	while (!probe->finished) {
+		if (!libterminput_is_ready(input, ctx)) {
+			now = now_ms();
+			pfd.fd = fd;
+			pfd.events = POLLIN;
+			r = poll(&pfd, 1, now >= probe->deadline ? 0 :
+			         probe->deadline - now > INT_MAX ? INT_MAX : (int)(probe->deadline - now));
+			if (r < 0) {
+				if (errno == EINTR)
+					continue;
+				return -1;
+			}
+			if (!r) {
+				finish(probe, ctx, 0);
+				break;
+			}
+		}
+		r = libterminput_read(fd, input, ctx);
+		if (r <= 0) {
+			if (r < 0 && errno == EAGAIN)
+				continue;
+			return r;
+		}
+		if (input->type == LIBTERMINPUT_REPORT) {
+			if (!handle_report(&input->report, ctx, probe))
+				return 1;
+		} else if (input->type == LIBTERMINPUT_DEVICE_CONTROL_STRING) {
+			handle_string(&input->string, probe);
+		} else if (input->type != LIBTERMINPUT_NONE) {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+/* libterminput_base64.c */
+/* See LICENSE file for copyright and license details. */
+
+#include <errno.h>
+
+
+#define XX 0xFF /* not in the alphabet */
+#define PD 0xFE /* padding */
+
+static const unsigned char values[256] = {
+	XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX,
+	XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX,
+	XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, 62, XX, XX, XX, 63,
+	52, 53, 54, 55, 56, 57, 58, 59, 60, 61, XX, XX, XX, PD, XX, XX,
+	XX,  0,  1,  2,  3,  4,  5,  6,  7,  8,  9, 10, 11, 12, 13, 14,
+	15, 16, 17, 18, 19, 20, 21, 22, 23, 24, 25, XX, XX, XX, XX, XX,
+	XX, 26, 27, 28, 29, 30, 31, 32, 33, 34, 35, 36, 37, 38, 39, 40,
+	41, 42, 43, 44, 45, 46, 47, 48, 49, 50, 51, XX, XX, XX, XX, XX,
+	XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX,
+	XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX,
+	XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX,
+	XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX,
+	XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX,
+	XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX,
+	XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX,
+	XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX
+};
+
+
+ssize_t
+libterminput_base64_decode(struct libterminput_base64 *state, const char *in, size_t n, void *out)
+{
+	const unsigned char *s = (const void *)in;
+	unsigned char *o = out;
+	unsigned long int a, b, c, d;
+	size_t i = 0;
+
+	for (;;) {
+		/* Whole groups of four characters, which make three bytes,
+		 * are decoded together and checked with a single branch */
+		if (!state->nbits && !state->padded) {
+			for (; n - i >= 4; i += 4, o += 3) {
+				a = values[s[i + 0]];
+				b = values[s[i + 1]];
+				c = values[s[i + 2]];
+				d = values[s[i + 3]];
+				if ((a | b | c | d) & 0x80)
+					break;
+				a = (a << 18) | (b << 12) | (c << 6) | d;
+				o[0] = (unsigned char)(a >> 16);
+				o[1] = (unsigned char)(a >> 8);
+				o[2] = (unsigned char)(a >> 0);
+			}
+		}
+		if (i == n)
+			break;
+
+		/* Otherwise decode one character at a time, this happens at
+		 * padding and when a group was split between two parts */
+		a = values[s[i++]];
+		if (a == PD) {
+			if (!state->padded && state->nbits != 2 && state->nbits != 4)
+				goto einval;
+			state->padded = 1;
+			state->nbits = 0;
+			state->bits = 0;
+		} else if (a == XX || state->padded) {
+			goto einval;
+		} else {
+			state->bits = ((state->bits << 6) | a) & 0xFFFUL;
+			state->nbits += 6;
+			if (state->nbits >= 8) {
+				state->nbits -= 8;
+				*o++ = (unsigned char)(state->bits >> state->nbits);
+			}
+		}
+	}
+
+	return (ssize_t)(o - (unsigned char *)out);
+
+einval:
+	errno = EINVAL;
+	return -1;
+}
+
+/* libterminput_ring.c */
+/* See LICENSE file for copyright and license details. */
+
+#include <errno.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+
+#define RING_MAGIC 0x54495249474E0001ULL
+
+#define LOAD(P)             __atomic_load_n(P, __ATOMIC_ACQUIRE)
+#define LOAD_RELAXED(P)     __atomic_load_n(P, __ATOMIC_RELAXED)
+#define STORE(P, V)         __atomic_store_n(P, V, __ATOMIC_RELEASE)
+#define STORE_RELAXED(P, V) __atomic_store_n(P, V, __ATOMIC_RELAXED)
+
+
+/*
+ * The shared memory begins with a header, followed by `capacity`
+ * slots, followed by `datasize` bytes for text, strings, and report
+ * parameters. Each slot is guarded by a sequence lock: while event
+ * number n is being written to it, its sequence number is 2n + 1,
+ * and once it has been written, its sequence number is 2n + 2. The
+ * data area is written cyclically, and `data_reserved` is advanced
+ * before it is written to, so readers can detect if data they have
+ * copied has been overwritten.
+ */
+
+struct header {
+	uint64_t magic;
+	uint64_t capacity;
+	uint64_t datasize;
+	uint64_t head;          /* number of published events */
+	uint64_t data_reserved; /* end of the data that is written or being written */
+	uint64_t padding[3];
+};
+
+struct slot {
+	uint64_t seq;
+	uint64_t datapos; /* absolute position of the slot's data */
+	union libterminput_compact_input input;
+};
+
+
+static size_t
+map_size(size_t capacity, size_t datasize)
+{
+	return sizeof(struct header) + capacity * sizeof(struct slot) + datasize;
+}
+
+
+/* Whether `capacity` is a power of 2 small enough that map_size cannot overflow */
+static int
+valid_capacity(uint64_t capacity)
+{
+	return capacity && !(capacity & (capacity - 1)) && capacity <= SIZE_MAX / 128 / sizeof(struct slot);
+}
+
+
+static size_t
+data_size(size_t capacity)
+{
+	return capacity * 128 < 4096 ? 4096 : capacity * 128;
+}
+
+
+/* Get the offset and length of data a compact input refers to */
+static uint32_t *
+data_of(union libterminput_compact_input *input, size_t *lenp)
+{
+	switch (input->type) {
+	case LIBTERMINPUT_REPORT:
+		*lenp = (size_t)input->report.nparams * sizeof(unsigned long long int);
+		return &input->report.offset;
+	case LIBTERMINPUT_RAW_SEQUENCE:
+		*lenp = (size_t)input->sequence.nparams * sizeof(unsigned long long int);
+		return &input->sequence.offset;
+	case LIBTERMINPUT_TEXT:
+	case LIBTERMINPUT_DEVICE_CONTROL_STRING:
+	case LIBTERMINPUT_OPERATING_SYSTEM_COMMAND:
+		*lenp = (size_t)input->text.nbytes;
+		return &input->text.offset;
+	default:
+		*lenp = 0;
+		return NULL;
+	}
+}
+
+
+static int
+map_ring(struct libterminput_ring *ring, int fd, size_t size, int writable)
+{
+	ring->map = mmap(NULL, size, writable ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, fd, 0);
+	if (ring->map == MAP_FAILED) {
+		ring->map = NULL;
+		return -1;
+	}
+	ring->map_size = size;
+	ring->writable = (char)writable;
+	return 0;
+}
+
+
+int
+libterminput_ring_create(struct libterminput_ring *ring, int fd, size_t capacity)
+{
+	struct header *header;
+	size_t datasize;
+
+	if (!valid_capacity((uint64_t)capacity)) {
+		errno = EINVAL;
+		return -1;
+	}
+	datasize = data_size(capacity);
+
+	if (ftruncate(fd, (off_t)map_size(capacity, datasize)))
+		return -1;
+	if (map_ring(ring, fd, map_size(capacity, datasize), 1))
+		return -1;
+
+	header = ring->map;
+	memset(header, 0, sizeof(*header));
+	header->capacity = (uint64_t)capacity;
+	header->datasize = (uint64_t)datasize;
+	STORE(&header->magic, RING_MAGIC);
+	ring->cursor = 0;
+	return 0;
+}
+
+
+int
+libterminput_ring_attach(struct libterminput_ring *ring, int fd)
+{
+	struct header *header;
+	struct stat st;
+	size_t capacity, datasize;
+
+	if (fstat(fd, &st))
+		return -1;
+	if (st.st_size < (off_t)sizeof(struct header))
+		goto einval;
+	if (map_ring(ring, fd, sizeof(struct header), 0))
+		return -1;
+	header = ring->map;
+	capacity = (size_t)header->capacity;
+	datasize = (size_t)header->datasize;
+	/* Do not trust the shared memory more than necessary */
+	if (LOAD(&header->magic) != RING_MAGIC || !valid_capacity(header->capacity) ||
+	    header->datasize != (uint64_t)data_size(capacity) ||
+	    (uintmax_t)st.st_size < (uintmax_t)map_size(capacity, datasize)) {
+		munmap(ring->map, ring->map_size);
+		ring->map = NULL;
+		goto einval;
+	}
+	munmap(ring->map, ring->map_size);
+
+	if (map_ring(ring, fd, map_size(capacity, datasize), 0))
+		return -1;
+	header = ring->map;
+	/* Only events published after attaching will be read */
+	ring->cursor = (unsigned long long int)LOAD(&header->head);
+	return 0;
+
+einval:
+	errno = EINVAL;
+	return -1;
+}
+
+
+void
+libterminput_ring_close(struct libterminput_ring *ring)
+{
+	if (ring->map)
+		munmap(ring->map, ring->map_size);
+	ring->map = NULL;
+}
+
+
+int
+libterminput_ring_publish(struct libterminput_ring *ring, const union libterminput_input *input)
+{
+	struct header *header = ring->map;
+	struct slot *slots = (void *)&header[1];
+	char *data = (void *)&slots[header->capacity];
+	union libterminput_compact_input compact;
+	uint64_t n = header->head, pos = header->data_reserved;
+	uint32_t *offsetp;
+	size_t len = 0;
+	struct slot *slot;
+
+	if (!ring->writable) {
+		errno = EBADF;
+		return -1;
+	}
+
+	if (libterminput_compact(&compact, input, ring->buf, sizeof(ring->buf), &len))
+		return -1;
+	offsetp = data_of(&compact, &len);
+	if (offsetp) {
+		/* Keep the data contiguous */
+		if (pos % header->datasize + len > header->datasize)
+			pos += header->datasize - pos % header->datasize;
+		STORE_RELAXED(&header->data_reserved, pos + len);
+		__atomic_thread_fence(__ATOMIC_RELEASE);
+		memcpy(&data[pos % header->datasize], ring->buf, len);
+		*offsetp = (uint32_t)(pos % header->datasize);
+	}
+
+	slot = &slots[n & (header->capacity - 1)];
+	STORE_RELAXED(&slot->seq, 2 * n + 1);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	slot->datapos = pos;
+	slot->input = compact;
+	STORE(&slot->seq, 2 * n + 2);
+	STORE(&header->head, n + 1);
+	return 0;
+}
+
+
+int
+libterminput_ring_consume(struct libterminput_ring *ring, union libterminput_input *input, unsigned long long int *missedp)
+{
+	const struct header *header = ring->map;
+	const struct slot *slots = (const void *)&header[1];
+	const char *data = (const void *)&slots[header->capacity];
+	union libterminput_compact_input compact;
+	uint64_t n, seq, pos, head;
+	uint32_t *offsetp;
+	size_t len;
+	const struct slot *slot;
+	int valid;
+
+	*missedp = 0;
+	for (;;) {
+		n = (uint64_t)ring->cursor;
+		slot = &slots[n & (header->capacity - 1)];
+		seq = LOAD(&slot->seq);
+		if (seq < 2 * n + 2)
+			return 0;
+		if (seq == 2 * n + 2) {
+			compact = slot->input;
+			pos = slot->datapos;
+			offsetp = data_of(&compact, &len);
+			/* A torn `datapos` and `len` may lie outside of the data area */
+			valid = len <= sizeof(ring->buf) && pos % header->datasize + len <= header->datasize;
+			if (offsetp && valid)
+				memcpy(ring->buf, &data[pos % header->datasize], len);
+			__atomic_thread_fence(__ATOMIC_ACQUIRE);
+			if (LOAD_RELAXED(&slot->seq) == seq && valid &&
+			    (!offsetp || LOAD_RELAXED(&header->data_reserved) - pos <= header->datasize)) {
+				if (offsetp)
+					*offsetp = 0;
+				libterminput_expand(input, &compact, ring->buf);
+				ring->cursor += 1;
+				return 1;
+			}
+		}
+		/* The event has been overwritten, skip to the oldest event that may still be intact */
+		head = LOAD(&header->head);
+		if (head - n > header->capacity / 2) {
+			*missedp += (unsigned long long int)(head - header->capacity / 2 - n);
+			ring->cursor = (unsigned long long int)(head - header->capacity / 2);
+		} else {
+			*missedp += 1;
+			ring->cursor += 1;
+		}
+	}
+}
+
+/* libterminput_keymap.c */
+/* See LICENSE file for copyright and license details. */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+
+/*
+ * Bindings are stored in a trie, whose nodes are numbered, with
+ * the root as node 0. The edges of all nodes are stored in one
+ * open-addressing hash table keyed by the parent node and the
+ * normalised key press, so each key press is looked up in
+ * constant time regardless of the number of bindings.
+ */
+
+struct node {
+	void *data;
+	char bound;   /* a binding ends at the node */
+	char prefix;  /* the node has children */
+};
+
+struct edge {
+	size_t parent;
+	size_t child; /* 0 if the entry is unused */
+	uint32_t codepoint;
+	uint8_t key;
+	uint8_t mods;
+};
+
+struct libterminput_keymap {
+	struct node *nodes;
+	size_t nnodes;
+	size_t nodes_size;
+	struct edge *edges;
+	size_t nedges;
+	size_t edges_size; /* power of 2 */
+	size_t state;      /* current node in a chord */
+	unsigned int timeout;
+	unsigned long long int deadline;
+};
+
+static const struct {
+	const char *name;
+	enum libterminput_key key;
+	uint32_t codepoint;
+} key_names[] = {
+	{"space",        LIBTERMINPUT_SYMBOL,          ' '},
+	{"up",           LIBTERMINPUT_UP,               0},
+	{"down",         LIBTERMINPUT_DOWN,             0},
+	{"right",        LIBTERMINPUT_RIGHT,            0},
+	{"left",         LIBTERMINPUT_LEFT,             0},
+	{"begin",        LIBTERMINPUT_BEGIN,            0},
+	{"tab",          LIBTERMINPUT_TAB,              0},
+	{"backtab",      LIBTERMINPUT_BACKTAB,          0},
+	{"f1",           LIBTERMINPUT_F1,               0},
+	{"f2",           LIBTERMINPUT_F2,               0},
+	{"f3",           LIBTERMINPUT_F3,               0},
+	{"f4",           LIBTERMINPUT_F4,               0},
+	{"f5",           LIBTERMINPUT_F5,               0},
+	{"f6",           LIBTERMINPUT_F6,               0},
+	{"f7",           LIBTERMINPUT_F7,               0},
+	{"f8",           LIBTERMINPUT_F8,               0},
+	{"f9",           LIBTERMINPUT_F9,               0},
+	{"f10",          LIBTERMINPUT_F10,              0},
+	{"f11",          LIBTERMINPUT_F11,              0},
+	{"f12",          LIBTERMINPUT_F12,              0},
+	{"home",         LIBTERMINPUT_HOME,             0},
+	{"insert",       LIBTERMINPUT_INS,              0},
+	{"delete",       LIBTERMINPUT_DEL,              0},
+	{"end",          LIBTERMINPUT_END,              0},
+	{"prior",        LIBTERMINPUT_PRIOR,            0},
+	{"next",         LIBTERMINPUT_NEXT,             0},
+	{"backspace",    LIBTERMINPUT_ERASE,            0},
+	{"return",       LIBTERMINPUT_ENTER,            0},
+	{"escape",       LIBTERMINPUT_ESC,              0},
+	{"macro",        LIBTERMINPUT_MACRO,            0},
+	{"pause",        LIBTERMINPUT_PAUSE,            0},
+	{"kp-0",         LIBTERMINPUT_KEYPAD_0,         0},
+	{"kp-1",         LIBTERMINPUT_KEYPAD_1,         0},
+	{"kp-2",         LIBTERMINPUT_KEYPAD_2,         0},
+	{"kp-3",         LIBTERMINPUT_KEYPAD_3,         0},
+	{"kp-4",         LIBTERMINPUT_KEYPAD_4,         0},
+	{"kp-5",         LIBTERMINPUT_KEYPAD_5,         0},
+	{"kp-6",         LIBTERMINPUT_KEYPAD_6,         0},
+	{"kp-7",         LIBTERMINPUT_KEYPAD_7,         0},
+	{"kp-8",         LIBTERMINPUT_KEYPAD_8,         0},
+	{"kp-9",         LIBTERMINPUT_KEYPAD_9,         0},
+	{"kp-add",       LIBTERMINPUT_KEYPAD_PLUS,      0},
+	{"kp-subtract",  LIBTERMINPUT_KEYPAD_MINUS,     0},
+	{"kp-multiply",  LIBTERMINPUT_KEYPAD_TIMES,     0},
+	{"kp-divide",    LIBTERMINPUT_KEYPAD_DIVISION,  0},
+	{"kp-decimal",   LIBTERMINPUT_KEYPAD_DECIMAL,   0},
+	{"kp-separator", LIBTERMINPUT_KEYPAD_COMMA,     0},
+	{"kp-point",     LIBTERMINPUT_KEYPAD_POINT,     0},
+	{"kp-enter",     LIBTERMINPUT_KEYPAD_ENTER,     0}
+};
+
+
+static unsigned long long int
+keymap_now_ms(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (unsigned long long int)ts.tv_sec * 1000ULL + (unsigned long long int)ts.tv_nsec / 1000000ULL;
+}
+
+
+/* Decode one UTF-8 character, *lenp is set to 0 if invalid */
+static uint32_t
+decode_codepoint(const char *s, size_t *lenp)
+{
+	const unsigned char *u = (const void *)s;
+	uint32_t cp;
+	size_t n, i;
+
+	if (u[0] < 0x80) {
+		*lenp = u[0] ? 1 : 0;
+		return u[0];
+	} else if ((u[0] & 0xE0) == 0xC0) {
+		n = 2;
+		cp = u[0] & 0x1FU;
+	} else if ((u[0] & 0xF0) == 0xE0) {
+		n = 3;
+		cp = u[0] & 0x0FU;
+	} else if ((u[0] & 0xF8) == 0xF0) {
+		n = 4;
+		cp = u[0] & 0x07U;
+	} else {
+		*lenp = 0;
+		return 0;
+	}
+	for (i = 1; i < n; i++) {
+		if ((u[i] & 0xC0) != 0x80) {
+			*lenp = 0;
+			return 0;
+		}
+		cp = (cp << 6) | (u[i] & 0x3FU);
+	}
+	*lenp = n;
+	return cp;
+}
+
+
+/* Terminals report shift+letter as an upper case letter, and
+ * control+letter as control and an upper case letter */
+static void
+normalise(struct edge *edge)
+{
+	if (edge->key != LIBTERMINPUT_SYMBOL)
+		return;
+	if ('a' <= edge->codepoint && edge->codepoint <= 'z' && (edge->mods & (LIBTERMINPUT_SHIFT | LIBTERMINPUT_CTRL)))
+		edge->codepoint -= 'a' - 'A';
+	if ('A' <= edge->codepoint && edge->codepoint <= 'Z')
+		edge->mods &= (uint8_t)~LIBTERMINPUT_SHIFT;
+}
+
+
+static size_t
+hash_edge(const struct edge *edge)
+{
+	unsigned long long int h;
+	h = (unsigned long long int)edge->parent * 0x9E3779B97F4A7C15ULL;
+	h ^= ((unsigned long long int)edge->codepoint << 16) | ((unsigned long long int)edge->key << 8) | edge->mods;
+	h *= 0xBF58476D1CE4E5B9ULL;
+	return (size_t)(h ^ (h >> 31));
+}
+
+
+/* Find the edge's slot in the hash table, either its entry or an unused entry */
+static struct edge *
+find_edge(const struct libterminput_keymap *map, const struct edge *edge)
+{
+	size_t i, mask = map->edges_size - 1;
+	struct edge *e;
+	for (i = hash_edge(edge) & mask;; i = (i + 1) & mask) {
+		e = &map->edges[i];
+		if (!e->child)
+			return e;
+		if (e->parent == edge->parent && e->codepoint == edge->codepoint && e->key == edge->key && e->mods == edge->mods)
+			return e;
+	}
+}
+
+
+static int
+grow_edges(struct libterminput_keymap *map)
+{
+	struct edge *old = map->edges, *e;
+	size_t i, old_size = map->edges_size;
+
+	map->edges_size = old_size ? old_size * 2 : 64;
+	map->edges = calloc(map->edges_size, sizeof(*map->edges));
+	if (!map->edges) {
+		map->edges = old;
+		map->edges_size = old_size;
+		return -1;
+	}
+	for (i = 0; i < old_size; i++) {
+		if (old[i].child) {
+			e = find_edge(map, &old[i]);
+			*e = old[i];
+		}
+	}
+	free(old);
+	return 0;
+}
+
+
+static size_t
+add_node(struct libterminput_keymap *map)
+{
+	struct node *new;
+	if (map->nnodes == map->nodes_size) {
+		new = realloc(map->nodes, (map->nodes_size * 2) * sizeof(*map->nodes));
+		if (!new)
+			return 0;
+		map->nodes = new;
+		map->nodes_size *= 2;
+	}
+	memset(&map->nodes[map->nnodes], 0, sizeof(*map->nodes));
+	return map->nnodes++;
+}
+
+
+/* Parse a key, such as C-x, M-<up>, or ö, in a binding specification */
+static const char *
+parse_key(const char *s, struct edge *edge)
+{
+	size_t i, n, len;
+	const char *end;
+
+	edge->mods = 0;
+	for (; s[0] && s[1] == '-' && s[2] && s[2] != ' '; s += 2) {
+		if (s[0] == 'C')
+			edge->mods |= LIBTERMINPUT_CTRL;
+		else if (s[0] == 'M')
+			edge->mods |= LIBTERMINPUT_META;
+		else if (s[0] == 'S')
+			edge->mods |= LIBTERMINPUT_SHIFT;
+		else
+			break;
+	}
+
+	for (end = s; *end && *end != ' '; end++);
+	n = (size_t)(end - s);
+	if (n > 2 && s[0] == '<' && end[-1] == '>') {
+		for (i = 0; i < sizeof(key_names) / sizeof(*key_names); i++) {
+			if (strlen(key_names[i].name) == n - 2 && !strncmp(key_names[i].name, &s[1], n - 2)) {
+				edge->key = (uint8_t)key_names[i].key;
+				edge->codepoint = key_names[i].codepoint;
+				goto out;
+			}
+		}
+		return NULL;
+	}
+	edge->key = LIBTERMINPUT_SYMBOL;
+	edge->codepoint = decode_codepoint(s, &len);
+	if (!len || len != n)
+		return NULL;
+
+out:
+	normalise(edge);
+	return end;
+}
+
+
+struct libterminput_keymap *
+libterminput_keymap_create(void)
+{
+	struct libterminput_keymap *map = calloc(1, sizeof(*map));
+	if (!map)
+		return NULL;
+	map->nodes_size = 16;
+	map->nodes = calloc(map->nodes_size, sizeof(*map->nodes));
+	if (!map->nodes || grow_edges(map)) {
+		libterminput_keymap_free(map);
+		return NULL;
+	}
+	map->nnodes = 1;
+	return map;
+}
+
+
+void
+libterminput_keymap_free(struct libterminput_keymap *map)
+{
+	if (map) {
+		free(map->nodes);
+		free(map->edges);
+		free(map);
+	}
+}
+
+
+int
+libterminput_keymap_bind(struct libterminput_keymap *map, const char *spec, void *data)
+{
+	struct edge edge, *e;
+	size_t node = 0, nkeys = 0;
+	const char *s;
+
+	/* Validate the specification before modifying the trie */
+	for (s = spec;;) {
+		while (*s == ' ')
+			s++;
+		if (!*s)
+			break;
+		if (node && map->nodes[node].bound)
+			goto eexist;
+		s = parse_key(s, &edge);
+		if (!s) {
+			errno = EINVAL;
+			return -1;
+		}
+		if (node || !nkeys) {
+			edge.parent = node;
+			node = find_edge(map, &edge)->child;
+		}
+		nkeys += 1;
+	}
+	if (!nkeys) {
+		errno = EINVAL;
+		return -1;
+	}
+	if (node && map->nodes[node].prefix)
+		goto eexist;
+
+	for (node = 0;;) {
+		while (*spec == ' ')
+			spec++;
+		if (!*spec)
+			break;
+		spec = parse_key(spec, &edge);
+		edge.parent = node;
+		e = find_edge(map, &edge);
+		if (!e->child) {
+			if ((map->nedges + 1) * 2 > map->edges_size) {
+				if (grow_edges(map))
+					return -1;
+				e = find_edge(map, &edge);
+			}
+			edge.child = add_node(map);
+			if (!edge.child)
+				return -1;
+			*e = edge;
+			map->nedges += 1;
+			map->nodes[node].prefix = 1;
+		}
+		node = e->child;
+	}
+
+	map->nodes[node].bound = 1;
+	map->nodes[node].data = data;
+	return 0;
+
+eexist:
+	errno = EEXIST;
+	return -1;
+}
+
+
+void
+libterminput_keymap_set_timeout(struct libterminput_keymap *map, unsigned int timeout)
+{
+	map->timeout = timeout;
+}
+
+
+void
+libterminput_keymap_reset(struct libterminput_keymap *map)
+{
+	map->state = 0;
+}
+
+
+enum libterminput_keymap_result
+libterminput_keymap_lookup(struct libterminput_keymap *map, union libterminput_input *input,
+                           void **datap, unsigned long long int *timesp)
+{
+	struct edge edge, *e;
+	size_t len;
+
+	*datap = NULL;
+	*timesp = 0;
+	if (input->type != LIBTERMINPUT_KEYPRESS)
+		return LIBTERMINPUT_KEYMAP_UNBOUND;
+
+	if (map->state && map->timeout && keymap_now_ms() > map->deadline)
+		map->state = 0;
+
+	edge.parent = map->state;
+	edge.key = (uint8_t)input->keypress.key;
+	edge.mods = (uint8_t)input->keypress.mods;
+	edge.codepoint = 0;
+	if (input->keypress.key == LIBTERMINPUT_SYMBOL)
+		edge.codepoint = decode_codepoint(input->keypress.symbol, &len);
+	normalise(&edge);
+
+	e = find_edge(map, &edge);
+	if (!e->child) {
+		map->state = 0;
+		return LIBTERMINPUT_KEYMAP_UNBOUND;
+	}
+
+	if (map->nodes[e->child].prefix) {
+		map->state = e->child;
+		if (map->timeout)
+			map->deadline = keymap_now_ms() + map->timeout;
+		return LIBTERMINPUT_KEYMAP_PREFIX;
+	}
+
+	*datap = map->nodes[e->child].data;
+	if (!map->state) {
+		/* Consume the repetitions, so libterminput_read(3) does not return them */
+		*timesp = input->keypress.times;
+		input->keypress.times = 1;
+	} else {
+		*timesp = 1;
+	}
+	map->state = 0;
+	return LIBTERMINPUT_KEYMAP_MATCH;
+}
+
+/* libterminput_encode.c */
+/* See LICENSE file for copyright and license details. */
+
+#include <errno.h>
+#include <string.h>
+
+
+enum encoding {
+	ENCODE_SYMBOL,  /* the text, or CSI codepoint u */
+	ENCODE_CONTROL, /* a control character, or CSI codepoint u */
+	ENCODE_CURSOR,  /* CSI final, or SS3 final in application cursor key mode */
+	ENCODE_SS3,     /* SS3 final */
+	ENCODE_CSI,     /* CSI final */
+	ENCODE_TILDE,   /* CSI number ~ */
+	ENCODE_KEYPAD   /* SS3 final in application keypad mode, otherwise the character `number` */
+};
+
+/* Modified keys are encoded as CSI 1 ; modifiers final, except
+ * ENCODE_TILDE keys which are encoded as CSI number ; modifiers ~ */
+static const struct key_encoding {
+	unsigned char encoding;
+	char final;
+	unsigned char number;
+} keys[] = {
+	[LIBTERMINPUT_SYMBOL]          = {ENCODE_SYMBOL,  0,    0},
+	[LIBTERMINPUT_UP]              = {ENCODE_CURSOR,  'A',  0},
+	[LIBTERMINPUT_DOWN]            = {ENCODE_CURSOR,  'B',  0},
+	[LIBTERMINPUT_RIGHT]           = {ENCODE_CURSOR,  'C',  0},
+	[LIBTERMINPUT_LEFT]            = {ENCODE_CURSOR,  'D',  0},
+	[LIBTERMINPUT_BEGIN]           = {ENCODE_CURSOR,  'E',  0},
+	[LIBTERMINPUT_TAB]             = {ENCODE_CONTROL, 0,    '\t'},
+	[LIBTERMINPUT_BACKTAB]         = {ENCODE_CSI,     'Z',  0},
+	[LIBTERMINPUT_F1]              = {ENCODE_SS3,     'P',  0},
+	[LIBTERMINPUT_F2]              = {ENCODE_SS3,     'Q',  0},
+	[LIBTERMINPUT_F3]              = {ENCODE_SS3,     'R',  0},
+	[LIBTERMINPUT_F4]              = {ENCODE_SS3,     'S',  0},
+	[LIBTERMINPUT_F5]              = {ENCODE_TILDE,   '~',  15},
+	[LIBTERMINPUT_F6]              = {ENCODE_TILDE,   '~',  17},
+	[LIBTERMINPUT_F7]              = {ENCODE_TILDE,   '~',  18},
+	[LIBTERMINPUT_F8]              = {ENCODE_TILDE,   '~',  19},
+	[LIBTERMINPUT_F9]              = {ENCODE_TILDE,   '~',  20},
+	[LIBTERMINPUT_F10]             = {ENCODE_TILDE,   '~',  21},
+	[LIBTERMINPUT_F11]             = {ENCODE_TILDE,   '~',  23},
+	[LIBTERMINPUT_F12]             = {ENCODE_TILDE,   '~',  24},
+	[LIBTERMINPUT_HOME]            = {ENCODE_CURSOR,  'H',  0},
+	[LIBTERMINPUT_INS]             = {ENCODE_TILDE,   '~',  2},
+	[LIBTERMINPUT_DEL]             = {ENCODE_TILDE,   '~',  3},
+	[LIBTERMINPUT_END]             = {ENCODE_CURSOR,  'F',  0},
+	[LIBTERMINPUT_PRIOR]           = {ENCODE_TILDE,   '~',  5},
+	[LIBTERMINPUT_NEXT]            = {ENCODE_TILDE,   '~',  6},
+	[LIBTERMINPUT_ERASE]           = {ENCODE_CONTROL, 0,    127},
+	[LIBTERMINPUT_ENTER]           = {ENCODE_CONTROL, 0,    '\r'},
+	[LIBTERMINPUT_ESC]             = {ENCODE_CONTROL, 0,    033},
+	[LIBTERMINPUT_MACRO]           = {ENCODE_CSI,     'M',  0},
+	[LIBTERMINPUT_PAUSE]           = {ENCODE_CSI,     'P',  0},
+	[LIBTERMINPUT_KEYPAD_0]        = {ENCODE_KEYPAD,  'p',  '0'},
+	[LIBTERMINPUT_KEYPAD_1]        = {ENCODE_KEYPAD,  'q',  '1'},
+	[LIBTERMINPUT_KEYPAD_2]        = {ENCODE_KEYPAD,  'r',  '2'},
+	[LIBTERMINPUT_KEYPAD_3]        = {ENCODE_KEYPAD,  's',  '3'},
+	[LIBTERMINPUT_KEYPAD_4]        = {ENCODE_KEYPAD,  't',  '4'},
+	[LIBTERMINPUT_KEYPAD_5]        = {ENCODE_KEYPAD,  'u',  '5'},
+	[LIBTERMINPUT_KEYPAD_6]        = {ENCODE_KEYPAD,  'v',  '6'},
+	[LIBTERMINPUT_KEYPAD_7]        = {ENCODE_KEYPAD,  'w',  '7'},
+	[LIBTERMINPUT_KEYPAD_8]        = {ENCODE_KEYPAD,  'x',  '8'},
+	[LIBTERMINPUT_KEYPAD_9]        = {ENCODE_KEYPAD,  'y',  '9'},
+	[LIBTERMINPUT_KEYPAD_PLUS]     = {ENCODE_KEYPAD,  'k',  '+'},
+	[LIBTERMINPUT_KEYPAD_MINUS]    = {ENCODE_KEYPAD,  'm',  '-'},
+	[LIBTERMINPUT_KEYPAD_TIMES]    = {ENCODE_KEYPAD,  'j',  '*'},
+	[LIBTERMINPUT_KEYPAD_DIVISION] = {ENCODE_KEYPAD,  'o',  '/'},
+	[LIBTERMINPUT_KEYPAD_DECIMAL]  = {ENCODE_KEYPAD,  'n',  '.'},
+	[LIBTERMINPUT_KEYPAD_COMMA]    = {ENCODE_KEYPAD,  'l',  ','},
+	[LIBTERMINPUT_KEYPAD_POINT]    = {ENCODE_KEYPAD,  'b',  '.'},
+	[LIBTERMINPUT_KEYPAD_ENTER]    = {ENCODE_KEYPAD,  'M',  '\r'}
+};
+
+/* Button numbers in mouse reports, before modifiers and motion are added */
+static const unsigned char buttons[] = {
+	[LIBTERMINPUT_NO_BUTTON]    = 3,
+	[LIBTERMINPUT_BUTTON1]      = 0,
+	[LIBTERMINPUT_BUTTON2]      = 1,
+	[LIBTERMINPUT_BUTTON3]      = 2,
+	[LIBTERMINPUT_SCROLL_UP]    = 64,
+	[LIBTERMINPUT_SCROLL_DOWN]  = 65,
+	[LIBTERMINPUT_SCROLL_LEFT]  = 66,
+	[LIBTERMINPUT_SCROLL_RIGHT] = 67,
+	[LIBTERMINPUT_XBUTTON1]     = 128,
+	[LIBTERMINPUT_XBUTTON2]     = 129,
+	[LIBTERMINPUT_XBUTTON3]     = 130,
+	[LIBTERMINPUT_XBUTTON4]     = 131
+};
+
+
+/* Output is counted even if it does not fit, so that
+ * overflow can be checked once at the end */
+struct output {
+	char *buf;
+	size_t size;
+	size_t len;
+};
+
+
+static void
+put(struct output *out, const char *s, size_t n)
+{
+	if (out->len <= out->size && n <= out->size - out->len)
+		memcpy(&out->buf[out->len], s, n);
+	out->len += n;
+}
+
+
+static void
+put_byte(struct output *out, unsigned char c)
+{
+	if (out->len < out->size)
+		out->buf[out->len] = (char)c;
+	out->len += 1;
+}
+
+
+static void
+put_number(struct output *out, unsigned long long int n)
+{
+	char digits[3 * sizeof(n)];
+	size_t i = sizeof(digits);
+	do
+		digits[--i] = (char)('0' + n % 10);
+	while (n /= 10);
+	put(out, &digits[i], sizeof(digits) - i);
+}
+
+
+/* CSI parameter ; parameter final, the second parameter is omitted if 0 */
+static void
+put_csi(struct output *out, unsigned long long int param1, unsigned int param2, char final)
+{
+	put(out, "\033[", 2);
+	put_number(out, param1);
+	if (param2) {
+		put_byte(out, ';');
+		put_number(out, param2);
+	}
+	put_byte(out, (unsigned char)final);
+}
+
+
+/* Get the codepoint of a NUL-terminated UTF-8 character, and its length, 0 if invalid */
+static size_t
+symbol_codepoint(const char *s, unsigned long int *cpp)
+{
+	const unsigned char *u = (const void *)s;
+	size_t n, i;
+
+	if (u[0] < 0x80) {
+		*cpp = u[0];
+		return u[0] ? 1 : 0;
+	}
+	for (n = 0; n < 7 && (u[0] & (0x80 >> n)); n++);
+	if (n < 2 || n > 6)
+		return 0;
+	*cpp = u[0] & (0x7FU >> n);
+	for (i = 1; i < n; i++) {
+		if ((u[i] & 0xC0) != 0x80)
+			return 0;
+		*cpp = (*cpp << 6) | (u[i] & 0x3F);
+	}
+	return u[n] ? 0 : n;
+}
+
+
+static int
+encode_keypress(struct output *out, const struct libterminput_keypress *keypress, const struct libterminput_mode *mode)
+{
+	const struct key_encoding *key;
+	unsigned int mods = (unsigned int)keypress->mods & 7U;
+	unsigned int modparam = mods ? mods + 1 : 0;
+	unsigned long int cp;
+	const char *text;
+	size_t n;
+	unsigned char c;
+
+	if ((size_t)keypress->key >= sizeof(keys) / sizeof(*keys))
+		goto einval;
+	key = &keys[keypress->key];
+
+	switch (key->encoding) {
+	case ENCODE_CURSOR:
+		if (!mods && mode->application_cursor_keys) {
+			put(out, "\033O", 2);
+			put_byte(out, (unsigned char)key->final);
+			return 0;
+		}
+		/* fall through */
+	case ENCODE_CSI:
+		if (!mods) {
+			put(out, "\033[", 2);
+			put_byte(out, (unsigned char)key->final);
+		} else {
+			put_csi(out, 1, modparam, key->final);
+		}
+		return 0;
+
+	case ENCODE_SS3:
+		if (!mods) {
+			put(out, "\033O", 2);
+			put_byte(out, (unsigned char)key->final);
+		} else {
+			put_csi(out, 1, modparam, key->final);
+		}
+		return 0;
+
+	case ENCODE_TILDE:
+		put_csi(out, key->number, modparam, '~');
+		return 0;
+
+	case ENCODE_KEYPAD:
+		if (!mods && mode->application_keypad) {
+			put(out, "\033O", 2);
+			put_byte(out, (unsigned char)key->final);
+			return 0;
+		}
+		if (key->number == '\r')
+			goto control;
+		cp = key->number;
+		text = (const char *)&key->number;
+		n = 1;
+		goto symbol;
+
+	case ENCODE_CONTROL:
+	control:
+		c = key->number;
+		cp = c;
+		if (mode->kitty_flags & LIBTERMINPUT_KITTY_REPORT_ALL_KEYS)
+			goto csi_u;
+		if (!mode->kitty_flags && c == '\t' && mods == LIBTERMINPUT_SHIFT) {
+			put(out, "\033[Z", 3);
+			return 0;
+		}
+		if (c == 033 && (mods || (mode->kitty_flags & LIBTERMINPUT_KITTY_DISAMBIGUATE)))
+			goto csi_u;
+		if (mods == LIBTERMINPUT_META && !mode->kitty_flags)
+			put_byte(out, 033);
+		else if (mods)
+			goto csi_u;
+		put_byte(out, c);
+		return 0;
+
+	case ENCODE_SYMBOL:
+	default:
+		text = keypress->symbol;
+		n = symbol_codepoint(text, &cp);
+		if (!n) {
+			if (*text)
+				goto einval;
+			cp = 0;
+			goto csi_u;
+		}
+	symbol:
+		if (mode->kitty_flags & LIBTERMINPUT_KITTY_REPORT_ALL_KEYS)
+			goto csi_u;
+		if ((mode->kitty_flags & LIBTERMINPUT_KITTY_DISAMBIGUATE) && (mods & (LIBTERMINPUT_META | LIBTERMINPUT_CTRL)))
+			goto csi_u;
+		if (mods & LIBTERMINPUT_CTRL) {
+			/* Only some characters have control characters, and some
+			 * control characters are the same as other keys */
+			c = (unsigned char)text[0];
+			if (n != 1 || !(c == ' ' || ('@' <= c && c <= '_') || ('a' <= c && c <= 'z')))
+				goto csi_u;
+			c &= 0x1F;
+			if (c == '\b' || c == '\t' || c == '\n' || c == 033)
+				goto csi_u;
+			if (mods & LIBTERMINPUT_META)
+				put_byte(out, 033);
+			put_byte(out, c);
+			return 0;
+		}
+		if (mods & LIBTERMINPUT_META) {
+			/* ESC [ and ESC O begin escape sequences */
+			if (n == 1 && (text[0] == '[' || text[0] == 'O'))
+				goto csi_u;
+			put_byte(out, 033);
+		}
+		/* Shift is already applied to the text */
+		put(out, text, n);
+		return 0;
+	}
+
+csi_u:
+	put_csi(out, cp, modparam, 'u');
+	return 0;
+
+einval:
+	errno = EINVAL;
+	return -1;
+}
+
+
+static void
+put_utf8(struct output *out, unsigned long long int value)
+{
+	if (value < 0x80) {
+		put_byte(out, (unsigned char)value);
+	} else {
+		put_byte(out, (unsigned char)(0xC0 | (value >> 6)));
+		put_byte(out, (unsigned char)(0x80 | (value & 0x3F)));
+	}
+}
+
+
+static int
+encode_mouseevent(struct output *out, const struct libterminput_mouseevent *mouse, const struct libterminput_mode *mode)
+{
+	unsigned long long int b, values[6];
+	size_t i, n = 3;
+
+	if (mouse->event == LIBTERMINPUT_HIGHLIGHT_INSIDE || mouse->event == LIBTERMINPUT_HIGHLIGHT_OUTSIDE) {
+		/* Mouse highlight tracking, CSI t Cx Cy or CSI T Cx Cy Cx Cy Cx Cy */
+		if (mouse->event == LIBTERMINPUT_HIGHLIGHT_INSIDE) {
+			put(out, "\033[t", 3);
+			values[0] = mouse->x;
+			values[1] = mouse->y;
+			n = 2;
+		} else {
+			put(out, "\033[T", 3);
+			values[0] = mouse->start_x;
+			values[1] = mouse->start_y;
+			values[2] = mouse->end_x;
+			values[3] = mouse->end_y;
+			values[4] = mouse->x;
+			values[5] = mouse->y;
+			n = 6;
+		}
+		for (i = 0; i < n; i++) {
+			if (values[i] > 255 - 32)
+				goto einval;
+			put_byte(out, (unsigned char)(values[i] + 32));
+		}
+		return 0;
+	}
+
+	if ((size_t)mouse->button >= sizeof(buttons) / sizeof(*buttons))
+		goto einval;
+	b = buttons[mouse->button];
+	if (mouse->event == LIBTERMINPUT_RELEASE && mode->mouse_encoding != LIBTERMINPUT_MOUSE_SGR)
+		b = 3; /* only SGR reports which button was released */
+	b |= ((unsigned long long int)mouse->mods & 7ULL) << 2;
+	if (mouse->event == LIBTERMINPUT_MOTION)
+		b |= 32;
+
+	switch (mode->mouse_encoding) {
+	case LIBTERMINPUT_MOUSE_SGR:
+		put(out, "\033[<", 3);
+		put_number(out, b);
+		put_byte(out, ';');
+		put_number(out, mouse->x);
+		put_byte(out, ';');
+		put_number(out, mouse->y);
+		put_byte(out, mouse->event == LIBTERMINPUT_RELEASE ? 'm' : 'M');
+		return 0;
+
+	case LIBTERMINPUT_MOUSE_URXVT:
+		put(out, "\033[", 2);
+		put_number(out, b + 32);
+		put_byte(out, ';');
+		put_number(out, mouse->x);
+		put_byte(out, ';');
+		put_number(out, mouse->y);
+		put_byte(out, 'M');
+		return 0;
+
+	case LIBTERMINPUT_MOUSE_UTF8:
+	case LIBTERMINPUT_MOUSE_X10:
+		values[0] = b;
+		values[1] = mouse->x;
+		values[2] = mouse->y;
+		put(out, "\033[M", 3);
+		for (i = 0; i < n; i++) {
+			if (mode->mouse_encoding == LIBTERMINPUT_MOUSE_X10) {
+				if (values[i] > 255 - 32)
+					goto einval;
+				put_byte(out, (unsigned char)(values[i] + 32));
+			} else {
+				if (values[i] > 0x7FF - 32)
+					goto einval;
+				put_utf8(out, values[i] + 32);
+			}
+		}
+		return 0;
+
+	default:
+		goto einval;
+	}
+
+einval:
+	errno = EINVAL;
+	return -1;
+}
+
+
+static void
+encode_sequence(struct output *out, const struct libterminput_sequence *sequence)
+{
+	size_t i;
+	put_byte(out, 033);
+	put_byte(out, (unsigned char)sequence->introducer);
+	if (sequence->prefix)
+		put_byte(out, (unsigned char)sequence->prefix);
+	for (i = 0; i < sequence->nparams && i < sizeof(sequence->params) / sizeof(*sequence->params); i++) {
+		if (i)
+			put_byte(out, ((sequence->subparams >> i) & 1U) ? ':' : ';');
+		put_number(out, sequence->params[i]);
+	}
+	put(out, sequence->intermediates, strnlen(sequence->intermediates, sizeof(sequence->intermediates)));
+	put_byte(out, (unsigned char)sequence->final);
+}
+
+
+ssize_t
+libterminput_encode(const union libterminput_input *input, const struct libterminput_mode *mode, char *buf, size_t size)
+{
+	struct output out;
+
+	out.buf = buf;
+	out.size = size;
+	out.len = 0;
+
+	switch (input->type) {
+	case LIBTERMINPUT_KEYPRESS:
+		if (encode_keypress(&out, &input->keypress, mode))
+			return -1;
+		break;
+
+	case LIBTERMINPUT_MOUSEEVENT:
+		if (encode_mouseevent(&out, &input->mouseevent, mode))
+			return -1;
+		break;
+
+	case LIBTERMINPUT_BRACKETED_PASTE_START:
+		if (mode->bracketed_paste)
+			put(&out, "\033[200~", 6);
+		break;
+
+	case LIBTERMINPUT_BRACKETED_PASTE_END:
+		if (mode->bracketed_paste)
+			put(&out, "\033[201~", 6);
+		break;
+
+	case LIBTERMINPUT_TEXT:
+		put(&out, input->text.bytes, input->text.nbytes);
+		break;
+
+	case LIBTERMINPUT_FOCUS_IN:
+		if (mode->focus_events)
+			put(&out, "\033[I", 3);
+		break;
+
+	case LIBTERMINPUT_FOCUS_OUT:
+		if (mode->focus_events)
+			put(&out, "\033[O", 3);
+		break;
+
+	case LIBTERMINPUT_TERMINAL_IS_OK:
+		put(&out, "\033[0n", 4);
+		break;
+
+	case LIBTERMINPUT_TERMINAL_IS_NOT_OK:
+		put(&out, "\033[3n", 4);
+		break;
+
+	case LIBTERMINPUT_CURSOR_POSITION:
+		put_csi(&out, input->position.y, 0, ';');
+		put_number(&out, input->position.x);
+		put_byte(&out, 'R');
+		break;
+
+	case LIBTERMINPUT_RAW_SEQUENCE:
+		encode_sequence(&out, &input->sequence);
+		break;
+
+	default:
+		/* Replies to queries and notifications that the
+		 * application has not asked for are not sent */
+		break;
+	}
+
+	if (out.len > size) {
+		errno = ENOBUFS;
+		return -1;
+	}
+	return (ssize_t)out.len;
+}
+
+/* libterminput_queue.c */
+/* See LICENSE file for copyright and license details. */
+
+#include <errno.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+
+#define NPOLICIES 3
+
+
+/*
+ * Events are stored in compact form in a circular array. Their
+ * text, strings, and report parameters are appended to a side
+ * buffer, which is reset whenever the queue becomes empty.
+ * The queue decodes into its own union libterminput_input,
+ * because the decoder stores parts of its state in it; if
+ * an event cannot be queued, it is left there, and decoding
+ * stops until there is room for it.
+ *
+ * Input from the terminal is read into `raw` and decoded from
+ * there, so that, when decoding stops, the rest of the input
+ * can be scanned for replies to queries with a copy of the
+ * decoder's state. Replies found this way are delivered at
+ * once, and the offsets, in the input, of their ends are
+ * recorded in `ahead`, so that they are skipped when the
+ * decoder proper reaches them. The caller may change the
+ * state in the meantime, so the decoder may decode the input
+ * differently; a reply is only skipped if it ends where a
+ * reply delivered ahead ended.
+ */
+
+struct libterminput_queue {
+	union libterminput_compact_input *events;
+	size_t capacity;
+	size_t head;
+	size_t count;
+	char *text;
+	size_t text_size;
+	size_t text_len;
+	enum libterminput_overload_policy policies;
+	char pending;    /* `input` has not been queued yet */
+	char truncating; /* the rest of the current paste is discarded */
+	unsigned long long int dropped[NPOLICIES];
+	union libterminput_input *replies; /* NULL unless replies are separated */
+	size_t replies_capacity;
+	size_t replies_head;
+	size_t replies_count;
+	unsigned long long int consumed; /* bytes of input passed to the decoder */
+	unsigned long long int *ahead;   /* offsets of the ends of replies delivered by scan_ahead */
+	size_t ahead_head;
+	size_t ahead_count;
+	size_t raw_off;
+	size_t raw_len;
+	char raw[4096];
+	union libterminput_input input;
+};
+
+
+static union libterminput_compact_input *
+get_event(struct libterminput_queue *queue, size_t i)
+{
+	return &queue->events[(queue->head + i) % queue->capacity];
+}
+
+
+static int
+is_motion(const union libterminput_compact_input *event)
+{
+	return event->type == LIBTERMINPUT_MOUSEEVENT && event->mouseevent.event == LIBTERMINPUT_MOTION;
+}
+
+
+static int
+is_scroll(const union libterminput_compact_input *event)
+{
+	return event->type == LIBTERMINPUT_MOUSEEVENT && event->mouseevent.event == LIBTERMINPUT_PRESS &&
+	       event->mouseevent.button >= LIBTERMINPUT_SCROLL_UP && event->mouseevent.button <= LIBTERMINPUT_SCROLL_RIGHT;
+}
+
+
+static int
+is_same_scroll(const union libterminput_compact_input *a, const union libterminput_compact_input *b)
+{
+	return is_scroll(a) && is_scroll(b) && a->mouseevent.button == b->mouseevent.button &&
+	       a->mouseevent.mods == b->mouseevent.mods;
+}
+
+
+static int
+is_reply(const union libterminput_input *input)
+{
+	switch (input->type) {
+	case LIBTERMINPUT_TERMINAL_IS_OK:
+	case LIBTERMINPUT_TERMINAL_IS_NOT_OK:
+	case LIBTERMINPUT_CURSOR_POSITION:
+	case LIBTERMINPUT_REPORT:
+	case LIBTERMINPUT_DEVICE_CONTROL_STRING:
+	case LIBTERMINPUT_OPERATING_SYSTEM_COMMAND:
+		return 1;
+	default:
+		return 0;
+	}
+}
+
+
+static void
+drop(struct libterminput_queue *queue, enum libterminput_overload_policy policy)
+{
+	int i;
+	for (i = 0; !(policy & (1 << i)); i++);
+	queue->dropped[i] += 1;
+}
+
+
+static void
+remove_event(struct libterminput_queue *queue, size_t i)
+{
+	for (; i + 1 < queue->count; i++)
+		*get_event(queue, i) = *get_event(queue, i + 1);
+	queue->count -= 1;
+}
+
+
+/* Discard a queued event according to the overload policies */
+static int
+make_room(struct libterminput_queue *queue)
+{
+	size_t i;
+
+	if (queue->policies & LIBTERMINPUT_DROP_OLDEST_MOTION) {
+		for (i = 0; i < queue->count; i++) {
+			if (is_motion(get_event(queue, i))) {
+				remove_event(queue, i);
+				drop(queue, LIBTERMINPUT_DROP_OLDEST_MOTION);
+				return 0;
+			}
+		}
+	}
+
+	if (queue->policies & LIBTERMINPUT_MERGE_SCROLL) {
+		for (i = 1; i < queue->count; i++) {
+			if (is_same_scroll(get_event(queue, i - 1), get_event(queue, i))) {
+				remove_event(queue, i);
+				drop(queue, LIBTERMINPUT_MERGE_SCROLL);
+				return 0;
+			}
+		}
+	}
+
+	return -1;
+}
+
+
+/* Queue `queue->input`, 0 on success, -1 if there is no room */
+static int
+push(struct libterminput_queue *queue)
+{
+	size_t len;
+
+	if (!queue->count)
+		queue->text_len = 0;
+	if (queue->count == queue->capacity && make_room(queue))
+		return -1;
+
+	len = queue->text_len;
+	if (libterminput_compact(get_event(queue, queue->count), &queue->input, queue->text, queue->text_size, &len))
+		return -1;
+	queue->text_len = len;
+	queue->count += 1;
+	return 0;
+}
+
+
+/* Handle `queue->input` when there is no room for it, 0 if it was discarded */
+static int
+overload(struct libterminput_queue *queue)
+{
+	union libterminput_input *input = &queue->input;
+	union libterminput_compact_input event;
+	size_t len = 0;
+
+	if (input->type == LIBTERMINPUT_MOUSEEVENT && input->mouseevent.event == LIBTERMINPUT_MOTION &&
+	    (queue->policies & LIBTERMINPUT_DROP_OLDEST_MOTION)) {
+		/* No motion is queued, so this is the oldest */
+		drop(queue, LIBTERMINPUT_DROP_OLDEST_MOTION);
+		return 0;
+	}
+
+	if (input->type == LIBTERMINPUT_MOUSEEVENT && (queue->policies & LIBTERMINPUT_MERGE_SCROLL) && queue->count) {
+		libterminput_compact(&event, input, NULL, 0, &len);
+		if (is_same_scroll(&event, get_event(queue, queue->count - 1))) {
+			drop(queue, LIBTERMINPUT_MERGE_SCROLL);
+			return 0;
+		}
+	}
+
+	if (input->type == LIBTERMINPUT_TEXT && (queue->policies & LIBTERMINPUT_TRUNCATE_PASTE)) {
+		drop(queue, LIBTERMINPUT_TRUNCATE_PASTE);
+		queue->truncating = 1;
+		input->type = LIBTERMINPUT_PASTE_TRUNCATED;
+		return push(queue);
+	}
+
+	return -1;
+}
+
+
+static int
+push_reply(struct libterminput_queue *queue, const union libterminput_input *input)
+{
+	if (queue->replies_count == queue->replies_capacity)
+		return -1;
+	queue->replies[(queue->replies_head + queue->replies_count++) % queue->replies_capacity] = *input;
+	return 0;
+}
+
+
+/* Offset, in the input, of the end of the last decoded event */
+static unsigned long long int
+position(unsigned long long int consumed, const struct libterminput_state *ctx)
+{
+	return consumed - (unsigned long long int)(ctx->stored_head - ctx->stored_tail);
+}
+
+
+/* Check whether `queue->input` has already been delivered by scan_ahead,
+ * and forget replies delivered ahead from input that has been decoded */
+static int
+delivered_ahead(struct libterminput_queue *queue, const struct libterminput_state *ctx)
+{
+	unsigned long long int pos = position(queue->consumed, ctx), end;
+
+	while (queue->ahead_count) {
+		end = queue->ahead[queue->ahead_head];
+		if (end > pos)
+			break;
+		queue->ahead_head = (queue->ahead_head + 1) % queue->replies_capacity;
+		queue->ahead_count -= 1;
+		if (end == pos)
+			return is_reply(&queue->input);
+	}
+	return 0;
+}
+
+
+/* Queue `queue->input` in the appropriate lane, 0 on success, -1 if there is no room */
+static int
+queue_input(struct libterminput_queue *queue)
+{
+	if (queue->replies && is_reply(&queue->input))
+		return push_reply(queue, &queue->input);
+	if (push(queue) && overload(queue))
+		return -1;
+	return 0;
+}
+
+
+/* Decode input until it has been consumed, 0, or the queue is full, 1 */
+static int
+decode(const char **bufp, size_t *lenp, struct libterminput_queue *queue, struct libterminput_state *ctx)
+{
+	size_t len;
+	int r;
+
+	for (;;) {
+		if (queue->pending) {
+			if (queue_input(queue))
+				return 1;
+			queue->pending = 0;
+		}
+
+		len = *lenp;
+		r = libterminput_read_mem(bufp, lenp, &queue->input, ctx);
+		queue->consumed += len - *lenp;
+		if (r <= 0)
+			return 0;
+
+		if (queue->input.type == LIBTERMINPUT_NONE)
+			continue;
+		if (queue->truncating) {
+			if (queue->input.type == LIBTERMINPUT_TEXT) {
+				drop(queue, LIBTERMINPUT_TRUNCATE_PASTE);
+				continue;
+			}
+			queue->truncating = 0;
+		}
+		if (queue->ahead_count && delivered_ahead(queue, ctx))
+			continue;
+
+		if (queue_input(queue)) {
+			/* Leave the remaining input undecoded */
+			queue->pending = 1;
+			return 1;
+		}
+	}
+}
+
+
+/* Deliver replies in input that cannot be decoded yet because the queue is full */
+static void
+scan_ahead(const char *buf, size_t len, struct libterminput_queue *queue, const struct libterminput_state *ctx)
+{
+	struct libterminput_state ahead = *ctx;
+	union libterminput_input input = queue->input;
+	unsigned long long int consumed = queue->consumed, pos, last = 0;
+	size_t capacity = queue->replies_capacity, n;
+
+	if (!queue->replies)
+		return;
+	if (queue->ahead_count)
+		last = queue->ahead[(queue->ahead_head + queue->ahead_count - 1) % capacity];
+	while (queue->replies_count < capacity && queue->ahead_count < capacity) {
+		n = len;
+		if (libterminput_read_mem(&buf, &len, &input, &ahead) <= 0)
+			break;
+		consumed += n - len;
+		if (!is_reply(&input))
+			continue;
+		pos = position(consumed, &ahead);
+		if (queue->ahead_count && pos <= last)
+			continue; /* delivered by an earlier scan */
+		push_reply(queue, &input);
+		queue->ahead[(queue->ahead_head + queue->ahead_count++) % capacity] = pos;
+	}
+}
+
+
+/* Read input that is available without blocking, EAGAIN if there is none */
+static ssize_t
+read_available(int fd, struct libterminput_queue *queue)
+{
+	struct pollfd pfd;
+	ssize_t r;
+
+	pfd.fd = fd;
+	pfd.events = POLLIN;
+	r = poll(&pfd, 1, 0);
+	if (r <= 0) {
+		if (!r || errno == EINTR)
+			errno = EAGAIN;
+		return -1;
+	}
+	r = read(fd, &queue->raw[queue->raw_len], sizeof(queue->raw) - queue->raw_len);
+	if (r > 0)
+		queue->raw_len += (size_t)r;
+	return r;
+}
+
+
+struct libterminput_queue *
+libterminput_queue_create(size_t capacity, size_t text_size, enum libterminput_overload_policy policies)
+{
+	struct libterminput_queue *queue;
+
+	if (!capacity || text_size < sizeof(queue->input.text.bytes)) {
+		errno = EINVAL;
+		return NULL;
+	}
+
+	queue = calloc(1, sizeof(*queue));
+	if (!queue)
+		return NULL;
+	queue->events = calloc(capacity, sizeof(*queue->events));
+	queue->text = malloc(text_size);
+	if (!queue->events || !queue->text) {
+		libterminput_queue_free(queue);
+		return NULL;
+	}
+	queue->capacity = capacity;
+	queue->text_size = text_size;
+	queue->policies = policies;
+	return queue;
+}
+
+
+void
+libterminput_queue_free(struct libterminput_queue *queue)
+{
+	if (queue) {
+		free(queue->events);
+		free(queue->text);
+		free(queue->replies);
+		free(queue->ahead);
+		free(queue);
+	}
+}
+
+
+int
+libterminput_queue_separate_replies(struct libterminput_queue *queue, size_t capacity)
+{
+	if (!capacity || queue->replies) {
+		errno = EINVAL;
+		return -1;
+	}
+	queue->replies = calloc(capacity, sizeof(*queue->replies));
+	queue->ahead = calloc(capacity, sizeof(*queue->ahead));
+	if (!queue->replies || !queue->ahead) {
+		free(queue->replies);
+		free(queue->ahead);
+		queue->replies = NULL;
+		queue->ahead = NULL;
+		return -1;
+	}
+	queue->replies_capacity = capacity;
+	return 0;
+}
+
+
+int
+libterminput_queue_fill(int fd, struct libterminput_queue *queue, struct libterminput_state *ctx)
+{
+	/* Only block on the terminal if there is nothing to decode */
+	int may_block = !queue->pending && queue->raw_off == queue->raw_len;
+	const char *buf;
+	size_t len;
+	ssize_t r;
+
+	for (;;) {
+		buf = &queue->raw[queue->raw_off];
+		len = queue->raw_len - queue->raw_off;
+		r = decode(&buf, &len, queue, ctx);
+		queue->raw_off = queue->raw_len - len;
+		if (r)
+			break;
+		queue->raw_off = queue->raw_len = 0;
+		if (may_block) {
+			may_block = 0;
+			r = read(fd, queue->raw, sizeof(queue->raw));
+			if (r <= 0)
+				return (int)r;
+			queue->raw_len = (size_t)r;
+		} else if ((r = read_available(fd, queue)) <= 0) {
+			return r < 0 && errno == EAGAIN ? 1 : (int)r;
+		}
+	}
+
+	/* The queue is full, read what the terminal has sent
+	 * and look for replies to queries in it */
+	memmove(queue->raw, &queue->raw[queue->raw_off], queue->raw_len - queue->raw_off);
+	queue->raw_len -= queue->raw_off;
+	queue->raw_off = 0;
+	if (queue->replies && queue->raw_len < sizeof(queue->raw) && read_available(fd, queue) < 0 && errno != EAGAIN)
+		return -1;
+	scan_ahead(queue->raw, queue->raw_len, queue, ctx);
+	return 1;
+}
+
+
+int
+libterminput_queue_fill_mem(const char **bufp, size_t *lenp, struct libterminput_queue *queue, struct libterminput_state *ctx)
+{
+	if (!decode(bufp, lenp, queue, ctx))
+		return 0;
+	scan_ahead(*bufp, *lenp, queue, ctx);
+	return 1;
+}
+
+
+int
+libterminput_queue_pop(struct libterminput_queue *queue, union libterminput_input *input)
+{
+	if (!queue->count)
+		return 0;
+	libterminput_expand(input, &queue->events[queue->head], queue->text);
+	queue->head = (queue->head + 1) % queue->capacity;
+	queue->count -= 1;
+	return 1;
+}
+
+
+int
+libterminput_queue_pop_reply(struct libterminput_queue *queue, union libterminput_input *input)
+{
+	if (!queue->replies_count)
+		return 0;
+	*input = queue->replies[queue->replies_head];
+	queue->replies_head = (queue->replies_head + 1) % queue->replies_capacity;
+	queue->replies_count -= 1;
+	return 1;
+}
+
+
+unsigned long long int
+libterminput_queue_dropped(const struct libterminput_queue *queue, enum libterminput_overload_policy policies)
+{
+	unsigned long long int n = 0;
+	int i;
+	for (i = 0; i < NPOLICIES; i++)
+		if (policies & (1 << i))
+			n += queue->dropped[i];
+	return n;
+}
+
+/* libterminput_state.c */
+/* See LICENSE file for copyright and license details. */
+
+#include <errno.h>
+#include <string.h>
+
+
+#define KNOWN_FLAGS\
+	(LIBTERMINPUT_DECSET_1005 | LIBTERMINPUT_MACRO_ON_CSI_M | LIBTERMINPUT_PAUSE_ON_CSI_P |\
+	 LIBTERMINPUT_INS_ON_CSI_AT | LIBTERMINPUT_SEPARATE_BACKTAB | LIBTERMINPUT_ESC_ON_BLOCK |\
+	 LIBTERMINPUT_AWAITING_CURSOR_POSITION | LIBTERMINPUT_AWAITING_DEVICE_REPORTS |\
+	 LIBTERMINPUT_AWAITING_OSC | LIBTERMINPUT_RAW_UNKNOWN_SEQUENCES)
+
+
+/* Layout, all numbers are little-endian:
+ *   version                          1 byte
+ *   flags, mods, event_mask          4 bytes each
+ *   inited, bracketed_paste,
+ *   control_string, unfocused,
+ *   mouse_tracking, meta, n, paused  1 byte each
+ *   npartial, partial                1 + npartial bytes
+ *   strlen(key), key                 1 + strlen(key) bytes
+ *   awaiting_positions,
+ *   positions_received,
+ *   dropped_events                   8 bytes each
+ *   number of stored bytes, bytes    2 + n bytes
+ *   remaining repetitions            8 bytes, 0 unless a keypress is being repeated
+ *   key, mods                        4 bytes each, only if repeating
+ *   strlen(symbol), symbol           1 + strlen(symbol) bytes, only if repeating */
+
+
+static unsigned char *
+save_number(unsigned char *p, unsigned long long int value, int size)
+{
+	while (size--) {
+		*p++ = (unsigned char)(value & 255);
+		value >>= 8;
+	}
+	return p;
+}
+
+
+static unsigned long long int
+load_number(const unsigned char **pp, int size)
+{
+	unsigned long long int value = 0;
+	int i;
+	for (i = 0; i < size; i++)
+		value |= (unsigned long long int)(*pp)[i] << (8 * i);
+	*pp += size;
+	return value;
+}
+
+
+ssize_t
+libterminput_save_state(const struct libterminput_state *ctx, const union libterminput_input *input, void *buf, size_t size)
+{
+	unsigned char saved[LIBTERMINPUT_SAVED_STATE_MAX];
+	unsigned char *p = saved;
+	size_t n, i;
+	int repeating = ctx->inited && input->type == LIBTERMINPUT_KEYPRESS && input->keypress.times > 1;
+
+	*p++ = LIBTERMINPUT_SAVED_STATE_VERSION;
+	p = save_number(p, (unsigned long long int)ctx->flags, 4);
+	p = save_number(p, (unsigned long long int)ctx->mods, 4);
+	p = save_number(p, (unsigned long long int)ctx->event_mask, 4);
+	*p++ = (unsigned char)ctx->inited;
+	*p++ = (unsigned char)ctx->bracketed_paste;
+	*p++ = (unsigned char)ctx->control_string;
+	*p++ = (unsigned char)ctx->unfocused;
+	*p++ = (unsigned char)ctx->mouse_tracking;
+	*p++ = (unsigned char)ctx->meta;
+	*p++ = (unsigned char)ctx->n;
+	*p++ = (unsigned char)ctx->paused;
+	*p++ = (unsigned char)ctx->npartial;
+	memcpy(p, ctx->partial, (size_t)ctx->npartial);
+	p += ctx->npartial;
+	n = strnlen(ctx->key, sizeof(ctx->key) - 1);
+	*p++ = (unsigned char)n;
+	memcpy(p, ctx->key, n);
+	p += n;
+	p = save_number(p, (unsigned long long int)ctx->awaiting_positions, 8);
+	p = save_number(p, ctx->positions_received, 8);
+	for (i = 0; i < LIBTERMINPUT_EVENT_CLASSES; i++)
+		p = save_number(p, ctx->dropped_events[i], 8);
+	n = ctx->stored_head - ctx->stored_tail;
+	p = save_number(p, (unsigned long long int)n, 2);
+	memcpy(p, &ctx->stored[ctx->stored_tail], n);
+	p += n;
+	p = save_number(p, repeating ? input->keypress.times : 0, 8);
+	if (repeating) {
+		p = save_number(p, (unsigned long long int)input->keypress.key, 4);
+		p = save_number(p, (unsigned long long int)input->keypress.mods, 4);
+		n = strnlen(input->keypress.symbol, sizeof(input->keypress.symbol) - 1);
+		*p++ = (unsigned char)n;
+		memcpy(p, input->keypress.symbol, n);
+		p += n;
+	}
+
+	n = (size_t)(p - saved);
+	if (n > size) {
+		errno = ENOBUFS;
+		return -1;
+	}
+	memcpy(buf, saved, n);
+	return (ssize_t)n;
+}
+
+
+int
+libterminput_restore_state(struct libterminput_state *ctx, union libterminput_input *input, const void *buf, size_t len)
+{
+	struct libterminput_state state;
+	union libterminput_input repeat;
+	const unsigned char *p = buf, *end = &p[len];
+	unsigned long long int value;
+	size_t n, i;
+
+#define NEED(N)\
+	do {\
+		if ((size_t)(end - p) < (size_t)(N))\
+			goto invalid;\
+	} while (0)
+
+	NEED(1);
+	if (*p++ != LIBTERMINPUT_SAVED_STATE_VERSION) {
+		errno = ENOTSUP;
+		return -1;
+	}
+
+	memset(&state, 0, sizeof(state));
+	NEED(3 * 4 + 9);
+	value = load_number(&p, 4);
+	if (value & ~(unsigned long long int)KNOWN_FLAGS)
+		goto invalid;
+	state.flags = (enum libterminput_flags)value;
+	state.mods = (enum libterminput_mod)load_number(&p, 4);
+	state.event_mask = (enum libterminput_event_class)load_number(&p, 4);
+	if (p[0] > 1 || p[1] > 1 || p[3] > 1 || p[7] > 1)
+		goto invalid; /* inited, bracketed_paste, unfocused, paused */
+	state.inited = *p++;
+	state.bracketed_paste = (char)*p++;
+	if (*p && *p != 'P' && *p != ']')
+		goto invalid;
+	state.control_string = (char)*p++;
+	state.unfocused = (char)*p++;
+	if (*p > 6 || *p == 4 || *p == 5)
+		goto invalid; /* bytes to read for a legacy mouse report: 0, 1, 2, 3, or 6 */
+	state.mouse_tracking = (char)*p++;
+	if (*p > 2)
+		goto invalid; /* a third ESC is reported at once */
+	state.meta = (char)*p++;
+	if (*p == 1 || *p > 6)
+		goto invalid; /* length of a UTF-8 character being read */
+	state.n = (char)*p++;
+	state.paused = (char)*p++;
+	n = *p++;
+	if (state.n ? !n || n >= (size_t)state.n : n)
+		goto invalid;
+	state.npartial = (char)n;
+	NEED(n + 1);
+	memcpy(state.partial, p, n);
+	p += n;
+	n = *p++;
+	if (n >= sizeof(state.key))
+		goto invalid;
+	NEED(n);
+	memcpy(state.key, p, n);
+	p += n;
+	NEED(8 * (2 + LIBTERMINPUT_EVENT_CLASSES) + 2);
+	state.awaiting_positions = (size_t)load_number(&p, 8);
+	state.positions_received = load_number(&p, 8);
+	for (i = 0; i < LIBTERMINPUT_EVENT_CLASSES; i++)
+		state.dropped_events[i] = load_number(&p, 8);
+	n = (size_t)load_number(&p, 2);
+	if (n > sizeof(state.stored))
+		goto invalid;
+	if (state.mouse_tracking > 1 && n >= (size_t)state.mouse_tracking)
+		goto invalid; /* the rest of the report is read into the buffer */
+	NEED(n + 8);
+	memcpy(state.stored, p, n);
+	p += n;
+	state.stored_head = n;
+
+	memset(&repeat, 0, sizeof(repeat));
+	repeat.keypress.times = load_number(&p, 8);
+	if (repeat.keypress.times) {
+		NEED(4 + 4 + 1);
+		repeat.keypress.type = LIBTERMINPUT_KEYPRESS;
+		repeat.keypress.key = (enum libterminput_key)load_number(&p, 4);
+		repeat.keypress.mods = (enum libterminput_mod)load_number(&p, 4);
+		n = *p++;
+		if (n >= sizeof(repeat.keypress.symbol))
+			goto invalid;
+		NEED(n);
+		memcpy(repeat.keypress.symbol, p, n);
+		p += n;
+	}
+	if (p != end)
+		goto invalid;
+
+#undef NEED
+
+	/* The wakeup descriptors belong to this process */
+	state.wakeup = ctx->wakeup;
+	state.wakeup_fds[0] = ctx->wakeup_fds[0];
+	state.wakeup_fds[1] = ctx->wakeup_fds[1];
+	*ctx = state;
+	*input = repeat;
+	return 0;
+
+invalid:
+	errno = EINVAL;
+	return -1;
+}
+
+#undef ELEMSOF
+#undef XX
+#undef PD
+#undef RING_MAGIC
+#undef LOAD
+#undef LOAD_RELAXED
+#undef STORE
+#undef STORE_RELAXED
+#undef NPOLICIES
+#undef KNOWN_FLAGS
+#undef NEED
+#endif
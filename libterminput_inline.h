@@ -0,0 +1,97 @@
+/* See LICENSE file for copyright and license details. */
+/* This file is concatenated into libterminput_impl.h, after libterminput.h */
+
+
+/* Whether libterminput_read and libterminput_read_mem would simply
+ * return a printable ASCII character if the next byte is one */
+static inline int
+libterminput_inline_plain_(const struct libterminput_state *ctx)
+{
+	return ctx->inited && !ctx->meta && !ctx->n && !ctx->mods && !*ctx->key &&
+	       !ctx->bracketed_paste && !ctx->control_string && !ctx->mouse_tracking;
+}
+
+
+/* Return `c` as a keypress without modifiers */
+static inline int
+libterminput_inline_symbol_(union libterminput_input *input, unsigned char c)
+{
+	input->keypress.type = LIBTERMINPUT_KEYPRESS;
+	input->keypress.key = LIBTERMINPUT_SYMBOL;
+	input->keypress.mods = (enum libterminput_mod)0;
+	input->keypress.times = 1;
+	input->keypress.symbol[0] = (char)c;
+	input->keypress.symbol[1] = '\0';
+	return 1;
+}
+
+
+/**
+ * Identical to libterminput_read, except that repeated
+ * keypresses and printable ASCII characters that have
+ * already been read from the file are returned without
+ * calling libterminput_read
+ *
+ * @param   fd     See libterminput_read
+ * @param   input  See libterminput_read
+ * @param   ctx    See libterminput_read
+ * @return         See libterminput_read
+ */
+static inline int
+libterminput_read_inline(int fd, union libterminput_input *input, struct libterminput_state *ctx)
+{
+	unsigned char c;
+	if (ctx->inited && input->type == LIBTERMINPUT_KEYPRESS && input->keypress.times > 1) {
+		input->keypress.times -= 1;
+		return 1;
+	}
+	if (ctx->stored_head != ctx->stored_tail && libterminput_inline_plain_(ctx)) {
+		c = (unsigned char)ctx->stored[ctx->stored_tail];
+		if (c >= ' ' && c < 127) {
+			if (++ctx->stored_tail == ctx->stored_head)
+				ctx->stored_tail = ctx->stored_head = 0;
+			return libterminput_inline_symbol_(input, c);
+		}
+	}
+	return libterminput_read(fd, input, ctx);
+}
+
+
+/**
+ * Identical to libterminput_read_mem, except that repeated
+ * keypresses and printable ASCII characters are returned
+ * without calling libterminput_read_mem
+ *
+ * @param   bufp   See libterminput_read_mem
+ * @param   lenp   See libterminput_read_mem
+ * @param   input  See libterminput_read_mem
+ * @param   ctx    See libterminput_read_mem
+ * @return         See libterminput_read_mem
+ */
+static inline int
+libterminput_read_mem_inline(const char **bufp, size_t *lenp, union libterminput_input *input, struct libterminput_state *ctx)
+{
+	unsigned char c;
+	if (ctx->inited && input->type == LIBTERMINPUT_KEYPRESS && input->keypress.times > 1) {
+		input->keypress.times -= 1;
+		return 1;
+	}
+	if (libterminput_inline_plain_(ctx)) {
+		if (ctx->stored_head != ctx->stored_tail) {
+			c = (unsigned char)ctx->stored[ctx->stored_tail];
+			if (c >= ' ' && c < 127) {
+				if (++ctx->stored_tail == ctx->stored_head)
+					ctx->stored_tail = ctx->stored_head = 0;
+				return libterminput_inline_symbol_(input, c);
+			}
+		} else if (*lenp) {
+			c = (unsigned char)**bufp;
+			if (c >= ' ' && c < 127) {
+				*bufp += 1;
+				*lenp -= 1;
+				return libterminput_inline_symbol_(input, c);
+			}
+		}
+	}
+	return libterminput_read_mem(bufp, lenp, input, ctx);
+}
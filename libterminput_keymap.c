@@ -0,0 +1,424 @@
+/* See LICENSE file for copyright and license details. */
+#include "libterminput.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+
+/*
+ * Bindings are stored in a trie, whose nodes are numbered, with
+ * the root as node 0. The edges of all nodes are stored in one
+ * open-addressing hash table keyed by the parent node and the
+ * normalised key press, so each key press is looked up in
+ * constant time regardless of the number of bindings.
+ */
+
+struct node {
+	void *data;
+	char bound;   /* a binding ends at the node */
+	char prefix;  /* the node has children */
+};
+
+struct edge {
+	size_t parent;
+	size_t child; /* 0 if the entry is unused */
+	uint32_t codepoint;
+	uint8_t key;
+	uint8_t mods;
+};
+
+struct libterminput_keymap {
+	struct node *nodes;
+	size_t nnodes;
+	size_t nodes_size;
+	struct edge *edges;
+	size_t nedges;
+	size_t edges_size; /* power of 2 */
+	size_t state;      /* current node in a chord */
+	unsigned int timeout;
+	unsigned long long int deadline;
+};
+
+static const struct {
+	const char *name;
+	enum libterminput_key key;
+	uint32_t codepoint;
+} key_names[] = {
+	{"space",        LIBTERMINPUT_SYMBOL,          ' '},
+	{"up",           LIBTERMINPUT_UP,               0},
+	{"down",         LIBTERMINPUT_DOWN,             0},
+	{"right",        LIBTERMINPUT_RIGHT,            0},
+	{"left",         LIBTERMINPUT_LEFT,             0},
+	{"begin",        LIBTERMINPUT_BEGIN,            0},
+	{"tab",          LIBTERMINPUT_TAB,              0},
+	{"backtab",      LIBTERMINPUT_BACKTAB,          0},
+	{"f1",           LIBTERMINPUT_F1,               0},
+	{"f2",           LIBTERMINPUT_F2,               0},
+	{"f3",           LIBTERMINPUT_F3,               0},
+	{"f4",           LIBTERMINPUT_F4,               0},
+	{"f5",           LIBTERMINPUT_F5,               0},
+	{"f6",           LIBTERMINPUT_F6,               0},
+	{"f7",           LIBTERMINPUT_F7,               0},
+	{"f8",           LIBTERMINPUT_F8,               0},
+	{"f9",           LIBTERMINPUT_F9,               0},
+	{"f10",          LIBTERMINPUT_F10,              0},
+	{"f11",          LIBTERMINPUT_F11,              0},
+	{"f12",          LIBTERMINPUT_F12,              0},
+	{"home",         LIBTERMINPUT_HOME,             0},
+	{"insert",       LIBTERMINPUT_INS,              0},
+	{"delete",       LIBTERMINPUT_DEL,              0},
+	{"end",          LIBTERMINPUT_END,              0},
+	{"prior",        LIBTERMINPUT_PRIOR,            0},
+	{"next",         LIBTERMINPUT_NEXT,             0},
+	{"backspace",    LIBTERMINPUT_ERASE,            0},
+	{"return",       LIBTERMINPUT_ENTER,            0},
+	{"escape",       LIBTERMINPUT_ESC,              0},
+	{"macro",        LIBTERMINPUT_MACRO,            0},
+	{"pause",        LIBTERMINPUT_PAUSE,            0},
+	{"kp-0",         LIBTERMINPUT_KEYPAD_0,         0},
+	{"kp-1",         LIBTERMINPUT_KEYPAD_1,         0},
+	{"kp-2",         LIBTERMINPUT_KEYPAD_2,         0},
+	{"kp-3",         LIBTERMINPUT_KEYPAD_3,         0},
+	{"kp-4",         LIBTERMINPUT_KEYPAD_4,         0},
+	{"kp-5",         LIBTERMINPUT_KEYPAD_5,         0},
+	{"kp-6",         LIBTERMINPUT_KEYPAD_6,         0},
+	{"kp-7",         LIBTERMINPUT_KEYPAD_7,         0},
+	{"kp-8",         LIBTERMINPUT_KEYPAD_8,         0},
+	{"kp-9",         LIBTERMINPUT_KEYPAD_9,         0},
+	{"kp-add",       LIBTERMINPUT_KEYPAD_PLUS,      0},
+	{"kp-subtract",  LIBTERMINPUT_KEYPAD_MINUS,     0},
+	{"kp-multiply",  LIBTERMINPUT_KEYPAD_TIMES,     0},
+	{"kp-divide",    LIBTERMINPUT_KEYPAD_DIVISION,  0},
+	{"kp-decimal",   LIBTERMINPUT_KEYPAD_DECIMAL,   0},
+	{"kp-separator", LIBTERMINPUT_KEYPAD_COMMA,     0},
+	{"kp-point",     LIBTERMINPUT_KEYPAD_POINT,     0},
+	{"kp-enter",     LIBTERMINPUT_KEYPAD_ENTER,     0}
+};
+
+
+static unsigned long long int
+keymap_now_ms(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (unsigned long long int)ts.tv_sec * 1000ULL + (unsigned long long int)ts.tv_nsec / 1000000ULL;
+}
+
+
+/* Decode one UTF-8 character, *lenp is set to 0 if invalid */
+static uint32_t
+decode_codepoint(const char *s, size_t *lenp)
+{
+	const unsigned char *u = (const void *)s;
+	uint32_t cp;
+	size_t n, i;
+
+	if (u[0] < 0x80) {
+		*lenp = u[0] ? 1 : 0;
+		return u[0];
+	} else if ((u[0] & 0xE0) == 0xC0) {
+		n = 2;
+		cp = u[0] & 0x1FU;
+	} else if ((u[0] & 0xF0) == 0xE0) {
+		n = 3;
+		cp = u[0] & 0x0FU;
+	} else if ((u[0] & 0xF8) == 0xF0) {
+		n = 4;
+		cp = u[0] & 0x07U;
+	} else {
+		*lenp = 0;
+		return 0;
+	}
+	for (i = 1; i < n; i++) {
+		if ((u[i] & 0xC0) != 0x80) {
+			*lenp = 0;
+			return 0;
+		}
+		cp = (cp << 6) | (u[i] & 0x3FU);
+	}
+	*lenp = n;
+	return cp;
+}
+
+
+/* Terminals report shift+letter as an upper case letter, and
+ * control+letter as control and an upper case letter */
+static void
+normalise(struct edge *edge)
+{
+	if (edge->key != LIBTERMINPUT_SYMBOL)
+		return;
+	if ('a' <= edge->codepoint && edge->codepoint <= 'z' && (edge->mods & (LIBTERMINPUT_SHIFT | LIBTERMINPUT_CTRL)))
+		edge->codepoint -= 'a' - 'A';
+	if ('A' <= edge->codepoint && edge->codepoint <= 'Z')
+		edge->mods &= (uint8_t)~LIBTERMINPUT_SHIFT;
+}
+
+
+static size_t
+hash_edge(const struct edge *edge)
+{
+	unsigned long long int h;
+	h = (unsigned long long int)edge->parent * 0x9E3779B97F4A7C15ULL;
+	h ^= ((unsigned long long int)edge->codepoint << 16) | ((unsigned long long int)edge->key << 8) | edge->mods;
+	h *= 0xBF58476D1CE4E5B9ULL;
+	return (size_t)(h ^ (h >> 31));
+}
+
+
+/* Find the edge's slot in the hash table, either its entry or an unused entry */
+static struct edge *
+find_edge(const struct libterminput_keymap *map, const struct edge *edge)
+{
+	size_t i, mask = map->edges_size - 1;
+	struct edge *e;
+	for (i = hash_edge(edge) & mask;; i = (i + 1) & mask) {
+		e = &map->edges[i];
+		if (!e->child)
+			return e;
+		if (e->parent == edge->parent && e->codepoint == edge->codepoint && e->key == edge->key && e->mods == edge->mods)
+			return e;
+	}
+}
+
+
+static int
+grow_edges(struct libterminput_keymap *map)
+{
+	struct edge *old = map->edges, *e;
+	size_t i, old_size = map->edges_size;
+
+	map->edges_size = old_size ? old_size * 2 : 64;
+	map->edges = calloc(map->edges_size, sizeof(*map->edges));
+	if (!map->edges) {
+		map->edges = old;
+		map->edges_size = old_size;
+		return -1;
+	}
+	for (i = 0; i < old_size; i++) {
+		if (old[i].child) {
+			e = find_edge(map, &old[i]);
+			*e = old[i];
+		}
+	}
+	free(old);
+	return 0;
+}
+
+
+static size_t
+add_node(struct libterminput_keymap *map)
+{
+	struct node *new;
+	if (map->nnodes == map->nodes_size) {
+		new = realloc(map->nodes, (map->nodes_size * 2) * sizeof(*map->nodes));
+		if (!new)
+			return 0;
+		map->nodes = new;
+		map->nodes_size *= 2;
+	}
+	memset(&map->nodes[map->nnodes], 0, sizeof(*map->nodes));
+	return map->nnodes++;
+}
+
+
+/* Parse a key, such as C-x, M-<up>, or ö, in a binding specification */
+static const char *
+parse_key(const char *s, struct edge *edge)
+{
+	size_t i, n, len;
+	const char *end;
+
+	edge->mods = 0;
+	for (; s[0] && s[1] == '-' && s[2] && s[2] != ' '; s += 2) {
+		if (s[0] == 'C')
+			edge->mods |= LIBTERMINPUT_CTRL;
+		else if (s[0] == 'M')
+			edge->mods |= LIBTERMINPUT_META;
+		else if (s[0] == 'S')
+			edge->mods |= LIBTERMINPUT_SHIFT;
+		else
+			break;
+	}
+
+	for (end = s; *end && *end != ' '; end++);
+	n = (size_t)(end - s);
+	if (n > 2 && s[0] == '<' && end[-1] == '>') {
+		for (i = 0; i < sizeof(key_names) / sizeof(*key_names); i++) {
+			if (strlen(key_names[i].name) == n - 2 && !strncmp(key_names[i].name, &s[1], n - 2)) {
+				edge->key = (uint8_t)key_names[i].key;
+				edge->codepoint = key_names[i].codepoint;
+				goto out;
+			}
+		}
+		return NULL;
+	}
+	edge->key = LIBTERMINPUT_SYMBOL;
+	edge->codepoint = decode_codepoint(s, &len);
+	if (!len || len != n)
+		return NULL;
+
+out:
+	normalise(edge);
+	return end;
+}
+
+
+struct libterminput_keymap *
+libterminput_keymap_create(void)
+{
+	struct libterminput_keymap *map = calloc(1, sizeof(*map));
+	if (!map)
+		return NULL;
+	map->nodes_size = 16;
+	map->nodes = calloc(map->nodes_size, sizeof(*map->nodes));
+	if (!map->nodes || grow_edges(map)) {
+		libterminput_keymap_free(map);
+		return NULL;
+	}
+	map->nnodes = 1;
+	return map;
+}
+
+
+void
+libterminput_keymap_free(struct libterminput_keymap *map)
+{
+	if (map) {
+		free(map->nodes);
+		free(map->edges);
+		free(map);
+	}
+}
+
+
+int
+libterminput_keymap_bind(struct libterminput_keymap *map, const char *spec, void *data)
+{
+	struct edge edge, *e;
+	size_t node = 0, nkeys = 0;
+	const char *s;
+
+	/* Validate the specification before modifying the trie */
+	for (s = spec;;) {
+		while (*s == ' ')
+			s++;
+		if (!*s)
+			break;
+		if (node && map->nodes[node].bound)
+			goto eexist;
+		s = parse_key(s, &edge);
+		if (!s) {
+			errno = EINVAL;
+			return -1;
+		}
+		if (node || !nkeys) {
+			edge.parent = node;
+			node = find_edge(map, &edge)->child;
+		}
+		nkeys += 1;
+	}
+	if (!nkeys) {
+		errno = EINVAL;
+		return -1;
+	}
+	if (node && map->nodes[node].prefix)
+		goto eexist;
+
+	for (node = 0;;) {
+		while (*spec == ' ')
+			spec++;
+		if (!*spec)
+			break;
+		spec = parse_key(spec, &edge);
+		edge.parent = node;
+		e = find_edge(map, &edge);
+		if (!e->child) {
+			if ((map->nedges + 1) * 2 > map->edges_size) {
+				if (grow_edges(map))
+					return -1;
+				e = find_edge(map, &edge);
+			}
+			edge.child = add_node(map);
+			if (!edge.child)
+				return -1;
+			*e = edge;
+			map->nedges += 1;
+			map->nodes[node].prefix = 1;
+		}
+		node = e->child;
+	}
+
+	map->nodes[node].bound = 1;
+	map->nodes[node].data = data;
+	return 0;
+
+eexist:
+	errno = EEXIST;
+	return -1;
+}
+
+
+void
+libterminput_keymap_set_timeout(struct libterminput_keymap *map, unsigned int timeout)
+{
+	map->timeout = timeout;
+}
+
+
+void
+libterminput_keymap_reset(struct libterminput_keymap *map)
+{
+	map->state = 0;
+}
+
+
+enum libterminput_keymap_result
+libterminput_keymap_lookup(struct libterminput_keymap *map, union libterminput_input *input,
+                           void **datap, unsigned long long int *timesp)
+{
+	struct edge edge, *e;
+	size_t len;
+
+	*datap = NULL;
+	*timesp = 0;
+	if (input->type != LIBTERMINPUT_KEYPRESS)
+		return LIBTERMINPUT_KEYMAP_UNBOUND;
+
+	if (map->state && map->timeout && keymap_now_ms() > map->deadline)
+		map->state = 0;
+
+	edge.parent = map->state;
+	edge.key = (uint8_t)input->keypress.key;
+	edge.mods = (uint8_t)input->keypress.mods;
+	edge.codepoint = 0;
+	if (input->keypress.key == LIBTERMINPUT_SYMBOL)
+		edge.codepoint = decode_codepoint(input->keypress.symbol, &len);
+	normalise(&edge);
+
+	e = find_edge(map, &edge);
+	if (!e->child) {
+		map->state = 0;
+		return LIBTERMINPUT_KEYMAP_UNBOUND;
+	}
+
+	if (map->nodes[e->child].prefix) {
+		map->state = e->child;
+		if (map->timeout)
+			map->deadline = keymap_now_ms() + map->timeout;
+		return LIBTERMINPUT_KEYMAP_PREFIX;
+	}
+
+	*datap = map->nodes[e->child].data;
+	if (!map->state) {
+		/* Consume the repetitions, so libterminput_read(3) does not return them */
+		*timesp = input->keypress.times;
+		input->keypress.times = 1;
+	} else {
+		*timesp = 1;
+	}
+	map->state = 0;
+	return LIBTERMINPUT_KEYMAP_MATCH;
+}
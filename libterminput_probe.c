@@ -0,0 +1,256 @@
+/* See LICENSE file for copyright and license details. */
+#include "libterminput.h"
+
+#include <errno.h>
+#include <limits.h>
+#include <poll.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+
+#define ELEMSOF(ARR) (sizeof(ARR) / sizeof(*(ARR)))
+
+
+static unsigned long long int
+now_ms(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (unsigned long long int)ts.tv_sec * 1000ULL + (unsigned long long int)ts.tv_nsec / 1000000ULL;
+}
+
+
+static int
+hex_value(char c)
+{
+	if ('0' <= c && c <= '9')
+		return c - '0';
+	if ('a' <= c && c <= 'f')
+		return c - 'a' + 10;
+	if ('A' <= c && c <= 'F')
+		return c - 'A' + 10;
+	return -1;
+}
+
+
+/* Decode `n` hexadecimal digits into a NUL-terminated string, truncating if too long */
+static void
+hex_decode(char *out, size_t size, const char *s, size_t n)
+{
+	int hi, lo;
+	for (; n >= 2 && size > 1; s += 2, n -= 2) {
+		hi = hex_value(s[0]);
+		lo = hex_value(s[1]);
+		if (hi < 0 || lo < 0)
+			break;
+		*out++ = (char)(hi << 4 | lo);
+		size -= 1;
+	}
+	*out = '\0';
+}
+
+
+static void
+finish(struct libterminput_probe *probe, struct libterminput_state *ctx, int complete)
+{
+	probe->finished = 1;
+	probe->complete = (char)complete;
+	/* On timeout the flag is kept so that late replies are not parsed as key presses */
+	if (complete && probe->set_flag)
+		libterminput_clear_flags(ctx, LIBTERMINPUT_AWAITING_DEVICE_REPORTS);
+}
+
+
+/* Returns 1 if the report was a reply to the probe */
+static int
+handle_report(struct libterminput_report *report, struct libterminput_state *ctx, struct libterminput_probe *probe)
+{
+	size_t i;
+
+	if (report->prefix == '?' && report->final == 'c' && !report->intermediate) {
+		probe->nda1 = report->nparams < ELEMSOF(probe->da1) ? report->nparams : ELEMSOF(probe->da1);
+		memcpy(probe->da1, report->params, probe->nda1 * sizeof(*probe->da1));
+		finish(probe, ctx, 1);
+		return 1;
+	}
+	if (report->prefix == '>' && report->final == 'c' && !report->intermediate) {
+		probe->have_da2 = 1;
+		for (i = 0; i < ELEMSOF(probe->da2); i++)
+			probe->da2[i] = i < report->nparams ? report->params[i] : 0;
+		return 1;
+	}
+	if (report->prefix == '?' && report->final == 'y' && report->intermediate == '$' && report->nparams >= 2) {
+		for (i = 0; i < probe->nmodes; i++) {
+			if (probe->modes[i].mode == report->params[0]) {
+				probe->modes[i].value = report->params[1] <= 4 ? (int)report->params[1] : 0;
+				return 1;
+			}
+		}
+		return 0;
+	}
+	if (report->prefix == '?' && report->final == 'u' && !report->intermediate && (probe->queries & LIBTERMINPUT_PROBE_KITTY_KEYBOARD)) {
+		probe->kitty_keyboard_flags = report->nparams && report->params[0] <= LONG_MAX ? (long int)report->params[0] : 0;
+		return 1;
+	}
+	return 0;
+}
+
+
+/* Parse XTGETTCAP reply, DCS 1 + r name = value ; ... ST, or DCS 0 + r name ST */
+static void
+handle_capabilities(const char *s, size_t n, struct libterminput_probe *probe)
+{
+	char name[sizeof(probe->capabilities->name)];
+	int status = s[0] == '1';
+	const char *end = &s[n], *sep, *eq;
+	size_t i;
+
+	for (s += 3; s < end; s = sep + 1) {
+		sep = memchr(s, ';', (size_t)(end - s));
+		if (!sep)
+			sep = end;
+		eq = memchr(s, '=', (size_t)(sep - s));
+		hex_decode(name, sizeof(name), s, (size_t)((eq ? eq : sep) - s));
+		for (i = 0; i < probe->ncapabilities; i++) {
+			if (!strcmp(probe->capabilities[i].name, name)) {
+				probe->capabilities[i].status = status;
+				if (status && eq)
+					hex_decode(probe->capabilities[i].value, sizeof(probe->capabilities[i].value),
+					           &eq[1], (size_t)(sep - &eq[1]));
+				break;
+			}
+		}
+	}
+}
+
+
+static void
+handle_string(struct libterminput_string *string, struct libterminput_probe *probe)
+{
+	size_t n = string->nbytes;
+	if (n > sizeof(probe->string) - probe->nstring)
+		n = sizeof(probe->string) - probe->nstring;
+	memcpy(&probe->string[probe->nstring], string->bytes, n);
+	probe->nstring += n;
+	if (string->more)
+		return;
+
+	n = probe->nstring;
+	probe->nstring = 0;
+	if (n >= 2 && probe->string[0] == '>' && probe->string[1] == '|') {
+		n -= 2;
+		if (n >= sizeof(probe->version))
+			n = sizeof(probe->version) - 1;
+		memcpy(probe->version, &probe->string[2], n);
+		probe->version[n] = '\0';
+	} else if (n >= 3 && (probe->string[0] == '0' || probe->string[0] == '1') && !strncmp(&probe->string[1], "+r", 2)) {
+		handle_capabilities(probe->string, n, probe);
+	}
+}
+
+
+int
+libterminput_probe_send(int fd, struct libterminput_state *ctx, struct libterminput_probe *probe, unsigned int timeout)
+{
+	static const char hex[] = "0123456789ABCDEF";
+	char buf[LIBTERMINPUT_PROBE_MAX_MODES * 24 + LIBTERMINPUT_PROBE_MAX_CAPABILITIES * 72 + 32];
+	size_t i, n = 0, off;
+	const char *s;
+	ssize_t r;
+
+	if (probe->nmodes > LIBTERMINPUT_PROBE_MAX_MODES || probe->ncapabilities > LIBTERMINPUT_PROBE_MAX_CAPABILITIES) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	probe->complete = 0;
+	probe->finished = 0;
+	probe->have_da2 = 0;
+	probe->nda1 = 0;
+	probe->version[0] = '\0';
+	probe->kitty_keyboard_flags = -1;
+	probe->nstring = 0;
+
+	for (i = 0; i < probe->nmodes; i++) {
+		probe->modes[i].value = -1;
+		n += (size_t)sprintf(&buf[n], "\033[?%u$p", probe->modes[i].mode);
+	}
+	if (probe->queries & LIBTERMINPUT_PROBE_DA2)
+		n += (size_t)sprintf(&buf[n], "\033[>c");
+	if (probe->queries & LIBTERMINPUT_PROBE_XTVERSION)
+		n += (size_t)sprintf(&buf[n], "\033[>q");
+	if (probe->queries & LIBTERMINPUT_PROBE_KITTY_KEYBOARD)
+		n += (size_t)sprintf(&buf[n], "\033[?u");
+	for (i = 0; i < probe->ncapabilities; i++) {
+		probe->capabilities[i].status = -1;
+		probe->capabilities[i].value[0] = '\0';
+		n += (size_t)sprintf(&buf[n], "\033P+q");
+		for (s = probe->capabilities[i].name; *s && s != &probe->capabilities[i].name[sizeof(probe->capabilities[i].name)]; s++) {
+			buf[n++] = hex[((unsigned char)*s >> 4) & 15];
+			buf[n++] = hex[((unsigned char)*s >> 0) & 15];
+		}
+		n += (size_t)sprintf(&buf[n], "\033\\");
+	}
+	/* Terminals reply in order, and all support DA1, so its reply marks the end */
+	n += (size_t)sprintf(&buf[n], "\033[c");
+
+	probe->set_flag = !(ctx->flags & LIBTERMINPUT_AWAITING_DEVICE_REPORTS);
+	libterminput_set_flags(ctx, LIBTERMINPUT_AWAITING_DEVICE_REPORTS);
+	probe->deadline = now_ms() + timeout;
+
+	for (off = 0; off < n; off += (size_t)r) {
+		r = write(fd, &buf[off], n - off);
+		if (r < 0) {
+			if (errno == EINTR)
+				r = 0;
+			else
+				return -1;
+		}
+	}
+	return 0;
+}
+
+
+int
+libterminput_probe_read(int fd, union libterminput_input *input, struct libterminput_state *ctx, struct libterminput_probe *probe)
+{
+	struct pollfd pfd;
+	unsigned long long int now;
+	int r;
+
+	while (!probe->finished) {
+		if (!libterminput_is_ready(input, ctx)) {
+			now = now_ms();
+			pfd.fd = fd;
+			pfd.events = POLLIN;
+			r = poll(&pfd, 1, now >= probe->deadline ? 0 :
+			         probe->deadline - now > INT_MAX ? INT_MAX : (int)(probe->deadline - now));
+			if (r < 0) {
+				if (errno == EINTR)
+					continue;
+				return -1;
+			}
+			if (!r) {
+				finish(probe, ctx, 0);
+				break;
+			}
+		}
+		r = libterminput_read(fd, input, ctx);
+		if (r <= 0) {
+			if (r < 0 && errno == EAGAIN)
+				continue;
+			return r;
+		}
+		if (input->type == LIBTERMINPUT_REPORT) {
+			if (!handle_report(&input->report, ctx, probe))
+				return 1;
+		} else if (input->type == LIBTERMINPUT_DEVICE_CONTROL_STRING) {
+			handle_string(&input->string, probe);
+		} else if (input->type != LIBTERMINPUT_NONE) {
+			return 1;
+		}
+	}
+	return 0;
+}
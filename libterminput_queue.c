@@ -0,0 +1,496 @@
+/* See LICENSE file for copyright and license details. */
+#include "libterminput.h"
+
+#include <errno.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+
+#define NPOLICIES 3
+
+
+/*
+ * Events are stored in compact form in a circular array. Their
+ * text, strings, and report parameters are appended to a side
+ * buffer, which is reset whenever the queue becomes empty.
+ * The queue decodes into its own union libterminput_input,
+ * because the decoder stores parts of its state in it; if
+ * an event cannot be queued, it is left there, and decoding
+ * stops until there is room for it.
+ *
+ * Input from the terminal is read into `raw` and decoded from
+ * there, so that, when decoding stops, the rest of the input
+ * can be scanned for replies to queries with a copy of the
+ * decoder's state. Replies found this way are delivered at
+ * once, and the offsets, in the input, of their ends are
+ * recorded in `ahead`, so that they are skipped when the
+ * decoder proper reaches them. The caller may change the
+ * state in the meantime, so the decoder may decode the input
+ * differently; a reply is only skipped if it ends where a
+ * reply delivered ahead ended.
+ */
+
+struct libterminput_queue {
+	union libterminput_compact_input *events;
+	size_t capacity;
+	size_t head;
+	size_t count;
+	char *text;
+	size_t text_size;
+	size_t text_len;
+	enum libterminput_overload_policy policies;
+	char pending;    /* `input` has not been queued yet */
+	char truncating; /* the rest of the current paste is discarded */
+	unsigned long long int dropped[NPOLICIES];
+	union libterminput_input *replies; /* NULL unless replies are separated */
+	size_t replies_capacity;
+	size_t replies_head;
+	size_t replies_count;
+	unsigned long long int consumed; /* bytes of input passed to the decoder */
+	unsigned long long int *ahead;   /* offsets of the ends of replies delivered by scan_ahead */
+	size_t ahead_head;
+	size_t ahead_count;
+	size_t raw_off;
+	size_t raw_len;
+	char raw[4096];
+	union libterminput_input input;
+};
+
+
+static union libterminput_compact_input *
+get_event(struct libterminput_queue *queue, size_t i)
+{
+	return &queue->events[(queue->head + i) % queue->capacity];
+}
+
+
+static int
+is_motion(const union libterminput_compact_input *event)
+{
+	return event->type == LIBTERMINPUT_MOUSEEVENT && event->mouseevent.event == LIBTERMINPUT_MOTION;
+}
+
+
+static int
+is_scroll(const union libterminput_compact_input *event)
+{
+	return event->type == LIBTERMINPUT_MOUSEEVENT && event->mouseevent.event == LIBTERMINPUT_PRESS &&
+	       event->mouseevent.button >= LIBTERMINPUT_SCROLL_UP && event->mouseevent.button <= LIBTERMINPUT_SCROLL_RIGHT;
+}
+
+
+static int
+is_same_scroll(const union libterminput_compact_input *a, const union libterminput_compact_input *b)
+{
+	return is_scroll(a) && is_scroll(b) && a->mouseevent.button == b->mouseevent.button &&
+	       a->mouseevent.mods == b->mouseevent.mods;
+}
+
+
+static int
+is_reply(const union libterminput_input *input)
+{
+	switch (input->type) {
+	case LIBTERMINPUT_TERMINAL_IS_OK:
+	case LIBTERMINPUT_TERMINAL_IS_NOT_OK:
+	case LIBTERMINPUT_CURSOR_POSITION:
+	case LIBTERMINPUT_REPORT:
+	case LIBTERMINPUT_DEVICE_CONTROL_STRING:
+	case LIBTERMINPUT_OPERATING_SYSTEM_COMMAND:
+		return 1;
+	default:
+		return 0;
+	}
+}
+
+
+static void
+drop(struct libterminput_queue *queue, enum libterminput_overload_policy policy)
+{
+	int i;
+	for (i = 0; !(policy & (1 << i)); i++);
+	queue->dropped[i] += 1;
+}
+
+
+static void
+remove_event(struct libterminput_queue *queue, size_t i)
+{
+	for (; i + 1 < queue->count; i++)
+		*get_event(queue, i) = *get_event(queue, i + 1);
+	queue->count -= 1;
+}
+
+
+/* Discard a queued event according to the overload policies */
+static int
+make_room(struct libterminput_queue *queue)
+{
+	size_t i;
+
+	if (queue->policies & LIBTERMINPUT_DROP_OLDEST_MOTION) {
+		for (i = 0; i < queue->count; i++) {
+			if (is_motion(get_event(queue, i))) {
+				remove_event(queue, i);
+				drop(queue, LIBTERMINPUT_DROP_OLDEST_MOTION);
+				return 0;
+			}
+		}
+	}
+
+	if (queue->policies & LIBTERMINPUT_MERGE_SCROLL) {
+		for (i = 1; i < queue->count; i++) {
+			if (is_same_scroll(get_event(queue, i - 1), get_event(queue, i))) {
+				remove_event(queue, i);
+				drop(queue, LIBTERMINPUT_MERGE_SCROLL);
+				return 0;
+			}
+		}
+	}
+
+	return -1;
+}
+
+
+/* Queue `queue->input`, 0 on success, -1 if there is no room */
+static int
+push(struct libterminput_queue *queue)
+{
+	size_t len;
+
+	if (!queue->count)
+		queue->text_len = 0;
+	if (queue->count == queue->capacity && make_room(queue))
+		return -1;
+
+	len = queue->text_len;
+	if (libterminput_compact(get_event(queue, queue->count), &queue->input, queue->text, queue->text_size, &len))
+		return -1;
+	queue->text_len = len;
+	queue->count += 1;
+	return 0;
+}
+
+
+/* Handle `queue->input` when there is no room for it, 0 if it was discarded */
+static int
+overload(struct libterminput_queue *queue)
+{
+	union libterminput_input *input = &queue->input;
+	union libterminput_compact_input event;
+	size_t len = 0;
+
+	if (input->type == LIBTERMINPUT_MOUSEEVENT && input->mouseevent.event == LIBTERMINPUT_MOTION &&
+	    (queue->policies & LIBTERMINPUT_DROP_OLDEST_MOTION)) {
+		/* No motion is queued, so this is the oldest */
+		drop(queue, LIBTERMINPUT_DROP_OLDEST_MOTION);
+		return 0;
+	}
+
+	if (input->type == LIBTERMINPUT_MOUSEEVENT && (queue->policies & LIBTERMINPUT_MERGE_SCROLL) && queue->count) {
+		libterminput_compact(&event, input, NULL, 0, &len);
+		if (is_same_scroll(&event, get_event(queue, queue->count - 1))) {
+			drop(queue, LIBTERMINPUT_MERGE_SCROLL);
+			return 0;
+		}
+	}
+
+	if (input->type == LIBTERMINPUT_TEXT && (queue->policies & LIBTERMINPUT_TRUNCATE_PASTE)) {
+		drop(queue, LIBTERMINPUT_TRUNCATE_PASTE);
+		queue->truncating = 1;
+		input->type = LIBTERMINPUT_PASTE_TRUNCATED;
+		return push(queue);
+	}
+
+	return -1;
+}
+
+
+static int
+push_reply(struct libterminput_queue *queue, const union libterminput_input *input)
+{
+	if (queue->replies_count == queue->replies_capacity)
+		return -1;
+	queue->replies[(queue->replies_head + queue->replies_count++) % queue->replies_capacity] = *input;
+	return 0;
+}
+
+
+/* Offset, in the input, of the end of the last decoded event */
+static unsigned long long int
+position(unsigned long long int consumed, const struct libterminput_state *ctx)
+{
+	return consumed - (unsigned long long int)(ctx->stored_head - ctx->stored_tail);
+}
+
+
+/* Check whether `queue->input` has already been delivered by scan_ahead,
+ * and forget replies delivered ahead from input that has been decoded */
+static int
+delivered_ahead(struct libterminput_queue *queue, const struct libterminput_state *ctx)
+{
+	unsigned long long int pos = position(queue->consumed, ctx), end;
+
+	while (queue->ahead_count) {
+		end = queue->ahead[queue->ahead_head];
+		if (end > pos)
+			break;
+		queue->ahead_head = (queue->ahead_head + 1) % queue->replies_capacity;
+		queue->ahead_count -= 1;
+		if (end == pos)
+			return is_reply(&queue->input);
+	}
+	return 0;
+}
+
+
+/* Queue `queue->input` in the appropriate lane, 0 on success, -1 if there is no room */
+static int
+queue_input(struct libterminput_queue *queue)
+{
+	if (queue->replies && is_reply(&queue->input))
+		return push_reply(queue, &queue->input);
+	if (push(queue) && overload(queue))
+		return -1;
+	return 0;
+}
+
+
+/* Decode input until it has been consumed, 0, or the queue is full, 1 */
+static int
+decode(const char **bufp, size_t *lenp, struct libterminput_queue *queue, struct libterminput_state *ctx)
+{
+	size_t len;
+	int r;
+
+	for (;;) {
+		if (queue->pending) {
+			if (queue_input(queue))
+				return 1;
+			queue->pending = 0;
+		}
+
+		len = *lenp;
+		r = libterminput_read_mem(bufp, lenp, &queue->input, ctx);
+		queue->consumed += len - *lenp;
+		if (r <= 0)
+			return 0;
+
+		if (queue->input.type == LIBTERMINPUT_NONE)
+			continue;
+		if (queue->truncating) {
+			if (queue->input.type == LIBTERMINPUT_TEXT) {
+				drop(queue, LIBTERMINPUT_TRUNCATE_PASTE);
+				continue;
+			}
+			queue->truncating = 0;
+		}
+		if (queue->ahead_count && delivered_ahead(queue, ctx))
+			continue;
+
+		if (queue_input(queue)) {
+			/* Leave the remaining input undecoded */
+			queue->pending = 1;
+			return 1;
+		}
+	}
+}
+
+
+/* Deliver replies in input that cannot be decoded yet because the queue is full */
+static void
+scan_ahead(const char *buf, size_t len, struct libterminput_queue *queue, const struct libterminput_state *ctx)
+{
+	struct libterminput_state ahead = *ctx;
+	union libterminput_input input = queue->input;
+	unsigned long long int consumed = queue->consumed, pos, last = 0;
+	size_t capacity = queue->replies_capacity, n;
+
+	if (!queue->replies)
+		return;
+	if (queue->ahead_count)
+		last = queue->ahead[(queue->ahead_head + queue->ahead_count - 1) % capacity];
+	while (queue->replies_count < capacity && queue->ahead_count < capacity) {
+		n = len;
+		if (libterminput_read_mem(&buf, &len, &input, &ahead) <= 0)
+			break;
+		consumed += n - len;
+		if (!is_reply(&input))
+			continue;
+		pos = position(consumed, &ahead);
+		if (queue->ahead_count && pos <= last)
+			continue; /* delivered by an earlier scan */
+		push_reply(queue, &input);
+		queue->ahead[(queue->ahead_head + queue->ahead_count++) % capacity] = pos;
+	}
+}
+
+
+/* Read input that is available without blocking, EAGAIN if there is none */
+static ssize_t
+read_available(int fd, struct libterminput_queue *queue)
+{
+	struct pollfd pfd;
+	ssize_t r;
+
+	pfd.fd = fd;
+	pfd.events = POLLIN;
+	r = poll(&pfd, 1, 0);
+	if (r <= 0) {
+		if (!r || errno == EINTR)
+			errno = EAGAIN;
+		return -1;
+	}
+	r = read(fd, &queue->raw[queue->raw_len], sizeof(queue->raw) - queue->raw_len);
+	if (r > 0)
+		queue->raw_len += (size_t)r;
+	return r;
+}
+
+
+struct libterminput_queue *
+libterminput_queue_create(size_t capacity, size_t text_size, enum libterminput_overload_policy policies)
+{
+	struct libterminput_queue *queue;
+
+	if (!capacity || text_size < sizeof(queue->input.text.bytes)) {
+		errno = EINVAL;
+		return NULL;
+	}
+
+	queue = calloc(1, sizeof(*queue));
+	if (!queue)
+		return NULL;
+	queue->events = calloc(capacity, sizeof(*queue->events));
+	queue->text = malloc(text_size);
+	if (!queue->events || !queue->text) {
+		libterminput_queue_free(queue);
+		return NULL;
+	}
+	queue->capacity = capacity;
+	queue->text_size = text_size;
+	queue->policies = policies;
+	return queue;
+}
+
+
+void
+libterminput_queue_free(struct libterminput_queue *queue)
+{
+	if (queue) {
+		free(queue->events);
+		free(queue->text);
+		free(queue->replies);
+		free(queue->ahead);
+		free(queue);
+	}
+}
+
+
+int
+libterminput_queue_separate_replies(struct libterminput_queue *queue, size_t capacity)
+{
+	if (!capacity || queue->replies) {
+		errno = EINVAL;
+		return -1;
+	}
+	queue->replies = calloc(capacity, sizeof(*queue->replies));
+	queue->ahead = calloc(capacity, sizeof(*queue->ahead));
+	if (!queue->replies || !queue->ahead) {
+		free(queue->replies);
+		free(queue->ahead);
+		queue->replies = NULL;
+		queue->ahead = NULL;
+		return -1;
+	}
+	queue->replies_capacity = capacity;
+	return 0;
+}
+
+
+int
+libterminput_queue_fill(int fd, struct libterminput_queue *queue, struct libterminput_state *ctx)
+{
+	/* Only block on the terminal if there is nothing to decode */
+	int may_block = !queue->pending && queue->raw_off == queue->raw_len;
+	const char *buf;
+	size_t len;
+	ssize_t r;
+
+	for (;;) {
+		buf = &queue->raw[queue->raw_off];
+		len = queue->raw_len - queue->raw_off;
+		r = decode(&buf, &len, queue, ctx);
+		queue->raw_off = queue->raw_len - len;
+		if (r)
+			break;
+		queue->raw_off = queue->raw_len = 0;
+		if (may_block) {
+			may_block = 0;
+			r = read(fd, queue->raw, sizeof(queue->raw));
+			if (r <= 0)
+				return (int)r;
+			queue->raw_len = (size_t)r;
+		} else if ((r = read_available(fd, queue)) <= 0) {
+			return r < 0 && errno == EAGAIN ? 1 : (int)r;
+		}
+	}
+
+	/* The queue is full, read what the terminal has sent
+	 * and look for replies to queries in it */
+	memmove(queue->raw, &queue->raw[queue->raw_off], queue->raw_len - queue->raw_off);
+	queue->raw_len -= queue->raw_off;
+	queue->raw_off = 0;
+	if (queue->replies && queue->raw_len < sizeof(queue->raw) && read_available(fd, queue) < 0 && errno != EAGAIN)
+		return -1;
+	scan_ahead(queue->raw, queue->raw_len, queue, ctx);
+	return 1;
+}
+
+
+int
+libterminput_queue_fill_mem(const char **bufp, size_t *lenp, struct libterminput_queue *queue, struct libterminput_state *ctx)
+{
+	if (!decode(bufp, lenp, queue, ctx))
+		return 0;
+	scan_ahead(*bufp, *lenp, queue, ctx);
+	return 1;
+}
+
+
+int
+libterminput_queue_pop(struct libterminput_queue *queue, union libterminput_input *input)
+{
+	if (!queue->count)
+		return 0;
+	libterminput_expand(input, &queue->events[queue->head], queue->text);
+	queue->head = (queue->head + 1) % queue->capacity;
+	queue->count -= 1;
+	return 1;
+}
+
+
+int
+libterminput_queue_pop_reply(struct libterminput_queue *queue, union libterminput_input *input)
+{
+	if (!queue->replies_count)
+		return 0;
+	*input = queue->replies[queue->replies_head];
+	queue->replies_head = (queue->replies_head + 1) % queue->replies_capacity;
+	queue->replies_count -= 1;
+	return 1;
+}
+
+
+unsigned long long int
+libterminput_queue_dropped(const struct libterminput_queue *queue, enum libterminput_overload_policy policies)
+{
+	unsigned long long int n = 0;
+	int i;
+	for (i = 0; i < NPOLICIES; i++)
+		if (policies & (1 << i))
+			n += queue->dropped[i];
+	return n;
+}
@@ -0,0 +1,269 @@
+/* See LICENSE file for copyright and license details. */
+#include "libterminput.h"
+
+#include <errno.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+
+#define RING_MAGIC 0x54495249474E0001ULL
+
+#define LOAD(P)             __atomic_load_n(P, __ATOMIC_ACQUIRE)
+#define LOAD_RELAXED(P)     __atomic_load_n(P, __ATOMIC_RELAXED)
+#define STORE(P, V)         __atomic_store_n(P, V, __ATOMIC_RELEASE)
+#define STORE_RELAXED(P, V) __atomic_store_n(P, V, __ATOMIC_RELAXED)
+
+
+/*
+ * The shared memory begins with a header, followed by `capacity`
+ * slots, followed by `datasize` bytes for text, strings, and report
+ * parameters. Each slot is guarded by a sequence lock: while event
+ * number n is being written to it, its sequence number is 2n + 1,
+ * and once it has been written, its sequence number is 2n + 2. The
+ * data area is written cyclically, and `data_reserved` is advanced
+ * before it is written to, so readers can detect if data they have
+ * copied has been overwritten.
+ */
+
+struct header {
+	uint64_t magic;
+	uint64_t capacity;
+	uint64_t datasize;
+	uint64_t head;          /* number of published events */
+	uint64_t data_reserved; /* end of the data that is written or being written */
+	uint64_t padding[3];
+};
+
+struct slot {
+	uint64_t seq;
+	uint64_t datapos; /* absolute position of the slot's data */
+	union libterminput_compact_input input;
+};
+
+
+static size_t
+map_size(size_t capacity, size_t datasize)
+{
+	return sizeof(struct header) + capacity * sizeof(struct slot) + datasize;
+}
+
+
+/* Whether `capacity` is a power of 2 small enough that map_size cannot overflow */
+static int
+valid_capacity(uint64_t capacity)
+{
+	return capacity && !(capacity & (capacity - 1)) && capacity <= SIZE_MAX / 128 / sizeof(struct slot);
+}
+
+
+static size_t
+data_size(size_t capacity)
+{
+	return capacity * 128 < 4096 ? 4096 : capacity * 128;
+}
+
+
+/* Get the offset and length of data a compact input refers to */
+static uint32_t *
+data_of(union libterminput_compact_input *input, size_t *lenp)
+{
+	switch (input->type) {
+	case LIBTERMINPUT_REPORT:
+		*lenp = (size_t)input->report.nparams * sizeof(unsigned long long int);
+		return &input->report.offset;
+	case LIBTERMINPUT_RAW_SEQUENCE:
+		*lenp = (size_t)input->sequence.nparams * sizeof(unsigned long long int);
+		return &input->sequence.offset;
+	case LIBTERMINPUT_TEXT:
+	case LIBTERMINPUT_DEVICE_CONTROL_STRING:
+	case LIBTERMINPUT_OPERATING_SYSTEM_COMMAND:
+		*lenp = (size_t)input->text.nbytes;
+		return &input->text.offset;
+	default:
+		*lenp = 0;
+		return NULL;
+	}
+}
+
+
+static int
+map_ring(struct libterminput_ring *ring, int fd, size_t size, int writable)
+{
+	ring->map = mmap(NULL, size, writable ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, fd, 0);
+	if (ring->map == MAP_FAILED) {
+		ring->map = NULL;
+		return -1;
+	}
+	ring->map_size = size;
+	ring->writable = (char)writable;
+	return 0;
+}
+
+
+int
+libterminput_ring_create(struct libterminput_ring *ring, int fd, size_t capacity)
+{
+	struct header *header;
+	size_t datasize;
+
+	if (!valid_capacity((uint64_t)capacity)) {
+		errno = EINVAL;
+		return -1;
+	}
+	datasize = data_size(capacity);
+
+	if (ftruncate(fd, (off_t)map_size(capacity, datasize)))
+		return -1;
+	if (map_ring(ring, fd, map_size(capacity, datasize), 1))
+		return -1;
+
+	header = ring->map;
+	memset(header, 0, sizeof(*header));
+	header->capacity = (uint64_t)capacity;
+	header->datasize = (uint64_t)datasize;
+	STORE(&header->magic, RING_MAGIC);
+	ring->cursor = 0;
+	return 0;
+}
+
+
+int
+libterminput_ring_attach(struct libterminput_ring *ring, int fd)
+{
+	struct header *header;
+	struct stat st;
+	size_t capacity, datasize;
+
+	if (fstat(fd, &st))
+		return -1;
+	if (st.st_size < (off_t)sizeof(struct header))
+		goto einval;
+	if (map_ring(ring, fd, sizeof(struct header), 0))
+		return -1;
+	header = ring->map;
+	capacity = (size_t)header->capacity;
+	datasize = (size_t)header->datasize;
+	/* Do not trust the shared memory more than necessary */
+	if (LOAD(&header->magic) != RING_MAGIC || !valid_capacity(header->capacity) ||
+	    header->datasize != (uint64_t)data_size(capacity) ||
+	    (uintmax_t)st.st_size < (uintmax_t)map_size(capacity, datasize)) {
+		munmap(ring->map, ring->map_size);
+		ring->map = NULL;
+		goto einval;
+	}
+	munmap(ring->map, ring->map_size);
+
+	if (map_ring(ring, fd, map_size(capacity, datasize), 0))
+		return -1;
+	header = ring->map;
+	/* Only events published after attaching will be read */
+	ring->cursor = (unsigned long long int)LOAD(&header->head);
+	return 0;
+
+einval:
+	errno = EINVAL;
+	return -1;
+}
+
+
+void
+libterminput_ring_close(struct libterminput_ring *ring)
+{
+	if (ring->map)
+		munmap(ring->map, ring->map_size);
+	ring->map = NULL;
+}
+
+
+int
+libterminput_ring_publish(struct libterminput_ring *ring, const union libterminput_input *input)
+{
+	struct header *header = ring->map;
+	struct slot *slots = (void *)&header[1];
+	char *data = (void *)&slots[header->capacity];
+	union libterminput_compact_input compact;
+	uint64_t n = header->head, pos = header->data_reserved;
+	uint32_t *offsetp;
+	size_t len = 0;
+	struct slot *slot;
+
+	if (!ring->writable) {
+		errno = EBADF;
+		return -1;
+	}
+
+	if (libterminput_compact(&compact, input, ring->buf, sizeof(ring->buf), &len))
+		return -1;
+	offsetp = data_of(&compact, &len);
+	if (offsetp) {
+		/* Keep the data contiguous */
+		if (pos % header->datasize + len > header->datasize)
+			pos += header->datasize - pos % header->datasize;
+		STORE_RELAXED(&header->data_reserved, pos + len);
+		__atomic_thread_fence(__ATOMIC_RELEASE);
+		memcpy(&data[pos % header->datasize], ring->buf, len);
+		*offsetp = (uint32_t)(pos % header->datasize);
+	}
+
+	slot = &slots[n & (header->capacity - 1)];
+	STORE_RELAXED(&slot->seq, 2 * n + 1);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	slot->datapos = pos;
+	slot->input = compact;
+	STORE(&slot->seq, 2 * n + 2);
+	STORE(&header->head, n + 1);
+	return 0;
+}
+
+
+int
+libterminput_ring_consume(struct libterminput_ring *ring, union libterminput_input *input, unsigned long long int *missedp)
+{
+	const struct header *header = ring->map;
+	const struct slot *slots = (const void *)&header[1];
+	const char *data = (const void *)&slots[header->capacity];
+	union libterminput_compact_input compact;
+	uint64_t n, seq, pos, head;
+	uint32_t *offsetp;
+	size_t len;
+	const struct slot *slot;
+	int valid;
+
+	*missedp = 0;
+	for (;;) {
+		n = (uint64_t)ring->cursor;
+		slot = &slots[n & (header->capacity - 1)];
+		seq = LOAD(&slot->seq);
+		if (seq < 2 * n + 2)
+			return 0;
+		if (seq == 2 * n + 2) {
+			compact = slot->input;
+			pos = slot->datapos;
+			offsetp = data_of(&compact, &len);
+			/* A torn `datapos` and `len` may lie outside of the data area */
+			valid = len <= sizeof(ring->buf) && pos % header->datasize + len <= header->datasize;
+			if (offsetp && valid)
+				memcpy(ring->buf, &data[pos % header->datasize], len);
+			__atomic_thread_fence(__ATOMIC_ACQUIRE);
+			if (LOAD_RELAXED(&slot->seq) == seq && valid &&
+			    (!offsetp || LOAD_RELAXED(&header->data_reserved) - pos <= header->datasize)) {
+				if (offsetp)
+					*offsetp = 0;
+				libterminput_expand(input, &compact, ring->buf);
+				ring->cursor += 1;
+				return 1;
+			}
+		}
+		/* The event has been overwritten, skip to the oldest event that may still be intact */
+		head = LOAD(&header->head);
+		if (head - n > header->capacity / 2) {
+			*missedp += (unsigned long long int)(head - header->capacity / 2 - n);
+			ring->cursor = (unsigned long long int)(head - header->capacity / 2);
+		} else {
+			*missedp += 1;
+			ring->cursor += 1;
+		}
+	}
+}
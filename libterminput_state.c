@@ -0,0 +1,215 @@
+/* See LICENSE file for copyright and license details. */
+#include "libterminput.h"
+
+#include <errno.h>
+#include <string.h>
+
+
+#define KNOWN_FLAGS\
+	(LIBTERMINPUT_DECSET_1005 | LIBTERMINPUT_MACRO_ON_CSI_M | LIBTERMINPUT_PAUSE_ON_CSI_P |\
+	 LIBTERMINPUT_INS_ON_CSI_AT | LIBTERMINPUT_SEPARATE_BACKTAB | LIBTERMINPUT_ESC_ON_BLOCK |\
+	 LIBTERMINPUT_AWAITING_CURSOR_POSITION | LIBTERMINPUT_AWAITING_DEVICE_REPORTS |\
+	 LIBTERMINPUT_AWAITING_OSC | LIBTERMINPUT_RAW_UNKNOWN_SEQUENCES)
+
+
+/* Layout, all numbers are little-endian:
+ *   version                          1 byte
+ *   flags, mods, event_mask          4 bytes each
+ *   inited, bracketed_paste,
+ *   control_string, unfocused,
+ *   mouse_tracking, meta, n, paused  1 byte each
+ *   npartial, partial                1 + npartial bytes
+ *   strlen(key), key                 1 + strlen(key) bytes
+ *   awaiting_positions,
+ *   positions_received,
+ *   dropped_events                   8 bytes each
+ *   number of stored bytes, bytes    2 + n bytes
+ *   remaining repetitions            8 bytes, 0 unless a keypress is being repeated
+ *   key, mods                        4 bytes each, only if repeating
+ *   strlen(symbol), symbol           1 + strlen(symbol) bytes, only if repeating */
+
+
+static unsigned char *
+save_number(unsigned char *p, unsigned long long int value, int size)
+{
+	while (size--) {
+		*p++ = (unsigned char)(value & 255);
+		value >>= 8;
+	}
+	return p;
+}
+
+
+static unsigned long long int
+load_number(const unsigned char **pp, int size)
+{
+	unsigned long long int value = 0;
+	int i;
+	for (i = 0; i < size; i++)
+		value |= (unsigned long long int)(*pp)[i] << (8 * i);
+	*pp += size;
+	return value;
+}
+
+
+ssize_t
+libterminput_save_state(const struct libterminput_state *ctx, const union libterminput_input *input, void *buf, size_t size)
+{
+	unsigned char saved[LIBTERMINPUT_SAVED_STATE_MAX];
+	unsigned char *p = saved;
+	size_t n, i;
+	int repeating = ctx->inited && input->type == LIBTERMINPUT_KEYPRESS && input->keypress.times > 1;
+
+	*p++ = LIBTERMINPUT_SAVED_STATE_VERSION;
+	p = save_number(p, (unsigned long long int)ctx->flags, 4);
+	p = save_number(p, (unsigned long long int)ctx->mods, 4);
+	p = save_number(p, (unsigned long long int)ctx->event_mask, 4);
+	*p++ = (unsigned char)ctx->inited;
+	*p++ = (unsigned char)ctx->bracketed_paste;
+	*p++ = (unsigned char)ctx->control_string;
+	*p++ = (unsigned char)ctx->unfocused;
+	*p++ = (unsigned char)ctx->mouse_tracking;
+	*p++ = (unsigned char)ctx->meta;
+	*p++ = (unsigned char)ctx->n;
+	*p++ = (unsigned char)ctx->paused;
+	*p++ = (unsigned char)ctx->npartial;
+	memcpy(p, ctx->partial, (size_t)ctx->npartial);
+	p += ctx->npartial;
+	n = strnlen(ctx->key, sizeof(ctx->key) - 1);
+	*p++ = (unsigned char)n;
+	memcpy(p, ctx->key, n);
+	p += n;
+	p = save_number(p, (unsigned long long int)ctx->awaiting_positions, 8);
+	p = save_number(p, ctx->positions_received, 8);
+	for (i = 0; i < LIBTERMINPUT_EVENT_CLASSES; i++)
+		p = save_number(p, ctx->dropped_events[i], 8);
+	n = ctx->stored_head - ctx->stored_tail;
+	p = save_number(p, (unsigned long long int)n, 2);
+	memcpy(p, &ctx->stored[ctx->stored_tail], n);
+	p += n;
+	p = save_number(p, repeating ? input->keypress.times : 0, 8);
+	if (repeating) {
+		p = save_number(p, (unsigned long long int)input->keypress.key, 4);
+		p = save_number(p, (unsigned long long int)input->keypress.mods, 4);
+		n = strnlen(input->keypress.symbol, sizeof(input->keypress.symbol) - 1);
+		*p++ = (unsigned char)n;
+		memcpy(p, input->keypress.symbol, n);
+		p += n;
+	}
+
+	n = (size_t)(p - saved);
+	if (n > size) {
+		errno = ENOBUFS;
+		return -1;
+	}
+	memcpy(buf, saved, n);
+	return (ssize_t)n;
+}
+
+
+int
+libterminput_restore_state(struct libterminput_state *ctx, union libterminput_input *input, const void *buf, size_t len)
+{
+	struct libterminput_state state;
+	union libterminput_input repeat;
+	const unsigned char *p = buf, *end = &p[len];
+	unsigned long long int value;
+	size_t n, i;
+
+#define NEED(N)\
+	do {\
+		if ((size_t)(end - p) < (size_t)(N))\
+			goto invalid;\
+	} while (0)
+
+	NEED(1);
+	if (*p++ != LIBTERMINPUT_SAVED_STATE_VERSION) {
+		errno = ENOTSUP;
+		return -1;
+	}
+
+	memset(&state, 0, sizeof(state));
+	NEED(3 * 4 + 9);
+	value = load_number(&p, 4);
+	if (value & ~(unsigned long long int)KNOWN_FLAGS)
+		goto invalid;
+	state.flags = (enum libterminput_flags)value;
+	state.mods = (enum libterminput_mod)load_number(&p, 4);
+	state.event_mask = (enum libterminput_event_class)load_number(&p, 4);
+	if (p[0] > 1 || p[1] > 1 || p[3] > 1 || p[7] > 1)
+		goto invalid; /* inited, bracketed_paste, unfocused, paused */
+	state.inited = *p++;
+	state.bracketed_paste = (char)*p++;
+	if (*p && *p != 'P' && *p != ']')
+		goto invalid;
+	state.control_string = (char)*p++;
+	state.unfocused = (char)*p++;
+	if (*p > 6 || *p == 4 || *p == 5)
+		goto invalid; /* bytes to read for a legacy mouse report: 0, 1, 2, 3, or 6 */
+	state.mouse_tracking = (char)*p++;
+	if (*p > 2)
+		goto invalid; /* a third ESC is reported at once */
+	state.meta = (char)*p++;
+	if (*p == 1 || *p > 6)
+		goto invalid; /* length of a UTF-8 character being read */
+	state.n = (char)*p++;
+	state.paused = (char)*p++;
+	n = *p++;
+	if (state.n ? !n || n >= (size_t)state.n : n)
+		goto invalid;
+	state.npartial = (char)n;
+	NEED(n + 1);
+	memcpy(state.partial, p, n);
+	p += n;
+	n = *p++;
+	if (n >= sizeof(state.key))
+		goto invalid;
+	NEED(n);
+	memcpy(state.key, p, n);
+	p += n;
+	NEED(8 * (2 + LIBTERMINPUT_EVENT_CLASSES) + 2);
+	state.awaiting_positions = (size_t)load_number(&p, 8);
+	state.positions_received = load_number(&p, 8);
+	for (i = 0; i < LIBTERMINPUT_EVENT_CLASSES; i++)
+		state.dropped_events[i] = load_number(&p, 8);
+	n = (size_t)load_number(&p, 2);
+	if (n > sizeof(state.stored))
+		goto invalid;
+	if (state.mouse_tracking > 1 && n >= (size_t)state.mouse_tracking)
+		goto invalid; /* the rest of the report is read into the buffer */
+	NEED(n + 8);
+	memcpy(state.stored, p, n);
+	p += n;
+	state.stored_head = n;
+
+	memset(&repeat, 0, sizeof(repeat));
+	repeat.keypress.times = load_number(&p, 8);
+	if (repeat.keypress.times) {
+		NEED(4 + 4 + 1);
+		repeat.keypress.type = LIBTERMINPUT_KEYPRESS;
+		repeat.keypress.key = (enum libterminput_key)load_number(&p, 4);
+		repeat.keypress.mods = (enum libterminput_mod)load_number(&p, 4);
+		n = *p++;
+		if (n >= sizeof(repeat.keypress.symbol))
+			goto invalid;
+		NEED(n);
+		memcpy(repeat.keypress.symbol, p, n);
+		p += n;
+	}
+	if (p != end)
+		goto invalid;
+
+#undef NEED
+
+	/* The wakeup descriptors belong to this process */
+	state.wakeup = ctx->wakeup;
+	state.wakeup_fds[0] = ctx->wakeup_fds[0];
+	state.wakeup_fds[1] = ctx->wakeup_fds[1];
+	*ctx = state;
+	*input = repeat;
+	return 0;
+
+invalid:
+	errno = EINVAL;
+	return -1;
+}
@@ -0,0 +1,41 @@
+/* See LICENSE file for copyright and license details. */
+
+/*
+ * Capture files written by terminput-record and read by
+ * terminput-replay begin with CAPTURE_MAGIC, followed by
+ * one record per read(3) made from the terminal. Each
+ * record consists of a CAPTURE_HEADER_SIZE-octet header,
+ * followed by the read data. The header contains, in
+ * big-endian order, the time (in nanoseconds, measured
+ * with CLOCK_MONOTONIC) since the recording started as
+ * an 8-octet unsigned integer, and the number of octets
+ * that were read as a 2-octet unsigned integer.
+ */
+
+#define CAPTURE_MAGIC "TIREC\0\0\1"
+#define CAPTURE_MAGIC_SIZE 8
+#define CAPTURE_HEADER_SIZE 10
+
+/* Same as the size of the read buffer in struct libterminput_state */
+#define CAPTURE_CHUNK_MAX 512
+
+
+static inline void
+capture_encode_header(unsigned char header[CAPTURE_HEADER_SIZE], unsigned long long int ns, size_t len)
+{
+	int i;
+	for (i = 7; i >= 0; i--, ns >>= 8)
+		header[i] = (unsigned char)(ns & 255ULL);
+	header[8] = (unsigned char)((len >> 8) & 255U);
+	header[9] = (unsigned char)((len >> 0) & 255U);
+}
+
+
+static inline void
+capture_decode_header(const unsigned char header[CAPTURE_HEADER_SIZE], unsigned long long int *ns, size_t *len)
+{
+	int i;
+	for (*ns = 0, i = 0; i < 8; i++)
+		*ns = (*ns << 8) | (unsigned long long int)header[i];
+	*len = ((size_t)header[8] << 8) | (size_t)header[9];
+}
@@ -0,0 +1,672 @@
+/* See LICENSE file for copyright and license details. */
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "libterminput.h"
+#include "terminput-capture.h"
+
+
+/*
+ * Events are written either as JSON lines (default), or, with -b, as
+ * binary records. Consecutive LIBTERMINPUT_TEXT events are joined into
+ * one record, so the output does not depend on how the input was split.
+ * A binary record begins with the event type as one octet, integers
+ * are 4-octet unsigned big-endian numbers, and the remainder is:
+ *
+ *   LIBTERMINPUT_KEYPRESS:        key (1 octet), mods (1 octet), times,
+ *                                 symbol length (1 octet), symbol
+ *   LIBTERMINPUT_TEXT:            text length, text
+ *   LIBTERMINPUT_MOUSEEVENT:      event (1 octet), button (1 octet), mods (1 octet), x, y,
+ *                                 and for LIBTERMINPUT_HIGHLIGHT_OUTSIDE also
+ *                                 start_x, start_y, end_x, end_y
+ *   LIBTERMINPUT_CURSOR_POSITION: x, y
+ *   LIBTERMINPUT_RESIZE:          rows, columns, height, width
+ *   other:                        nothing
+ *
+ * With -j, raw input (not capture files) is split into segments that
+ * are decoded by that many threads; the output is identical to that
+ * of a serial decode, which -c verifies by running both and comparing
+ * the output instead of writing it. Neither may be combined with
+ * LIBTERMINPUT_ESC_ON_BLOCK in -F, as a lone ESC at the end of a
+ * segment would be reported as ESC rather than merged with the key
+ * that begins the next segment.
+ */
+
+
+#define FLUSH_THRESHOLD (1 << 20)
+
+/* With -j, the input is decoded in batches of one segment of
+ * about SEGMENT_SIZE octets per thread; a segment boundary
+ * is placed directly after a control character, searching at
+ * most SPLIT_SEARCH_LIMIT octets for one */
+#define SEGMENT_SIZE (1UL << 20)
+#define SPLIT_SEARCH_LIMIT (64UL << 10)
+
+
+struct output {
+	char *buf;
+	size_t len;
+	size_t size;
+	char *text;
+	size_t ntext;
+	size_t text_size;
+	char in_text;
+	char flushable; /* whether it may be written to stdout while decoding */
+};
+
+struct decoder {
+	struct libterminput_state ctx;
+	union libterminput_input input;
+	struct output out;
+};
+
+struct segment {
+	const char *data;
+	size_t len;
+	struct decoder dec;
+	pthread_t thread;
+};
+
+
+static const char *const key_names[] = {
+	"symbol", "up", "down", "right", "left", "begin", "tab", "backtab",
+	"f1", "f2", "f3", "f4", "f5", "f6", "f7", "f8", "f9", "f10", "f11", "f12",
+	"home", "ins", "del", "end", "prior", "next", "erase", "enter", "esc", "macro", "pause",
+	"keypad 0", "keypad 1", "keypad 2", "keypad 3", "keypad 4",
+	"keypad 5", "keypad 6", "keypad 7", "keypad 8", "keypad 9",
+	"keypad plus", "keypad minus", "keypad times", "keypad division",
+	"keypad decimal", "keypad comma", "keypad point", "keypad enter"
+};
+
+static const char *const event_names[] = {
+	"press", "release", "motion", "highlight inside", "highlight outside"
+};
+
+static const char *argv0;
+static enum libterminput_flags flags = 0;
+static int binary = 0;
+static int compare = 0;
+static size_t nthreads = 1;
+static size_t nresplices = 0;
+static struct output compare_out;
+static unsigned long long int compared = 0;
+
+
+static void
+usage(void)
+{
+	fprintf(stderr, "usage: %s [-bc] [-F flags] [-j threads] capture-file\n", argv0);
+	exit(1);
+}
+
+
+static void
+enomem(void)
+{
+	fprintf(stderr, "%s: out of memory\n", argv0);
+	exit(1);
+}
+
+
+static void
+out_reserve(struct output *out, size_t n)
+{
+	if (out->len + n > out->size) {
+		out->size = (out->len + n) * 2;
+		out->buf = realloc(out->buf, out->size);
+		if (!out->buf)
+			enomem();
+	}
+}
+
+
+static void
+out_write(struct output *out, const char *s, size_t n)
+{
+	out_reserve(out, n);
+	memcpy(&out->buf[out->len], s, n);
+	out->len += n;
+}
+
+
+static void
+out_str(struct output *out, const char *s)
+{
+	out_write(out, s, strlen(s));
+}
+
+
+static void
+out_byte(struct output *out, unsigned char c)
+{
+	out_reserve(out, 1);
+	out->buf[out->len++] = (char)c;
+}
+
+
+static void
+out_u32(struct output *out, unsigned long long int n)
+{
+	if (n > 0xFFFFFFFFULL)
+		n = 0xFFFFFFFFULL;
+	out_reserve(out, 4);
+	out->buf[out->len++] = (char)((n >> 24) & 255U);
+	out->buf[out->len++] = (char)((n >> 16) & 255U);
+	out->buf[out->len++] = (char)((n >> 8) & 255U);
+	out->buf[out->len++] = (char)((n >> 0) & 255U);
+}
+
+
+static void
+out_uint(struct output *out, unsigned long long int n)
+{
+	char buf[3 * sizeof(n) + 1], *p = &buf[sizeof(buf)];
+	do {
+		*--p = (char)('0' + n % 10);
+	} while (n /= 10);
+	out_write(out, p, (size_t)(&buf[sizeof(buf)] - p));
+}
+
+
+static void
+out_json_field(struct output *out, const char *name, unsigned long long int value)
+{
+	out_str(out, ",\"");
+	out_str(out, name);
+	out_str(out, "\":");
+	out_uint(out, value);
+}
+
+
+static void
+out_json_string(struct output *out, const char *s, size_t n)
+{
+	static const char hex[] = "0123456789abcdef";
+	size_t i;
+	out_reserve(out, n * 6);
+	for (i = 0; i < n; i++) {
+		unsigned char c = (unsigned char)s[i];
+		if (c == '"' || c == '\\') {
+			out->buf[out->len++] = '\\';
+			out->buf[out->len++] = (char)c;
+		} else if (c < ' ' || c == 127) {
+			memcpy(&out->buf[out->len], "\\u00", 4);
+			out->len += 4;
+			out->buf[out->len++] = hex[c >> 4];
+			out->buf[out->len++] = hex[c & 15];
+		} else {
+			out->buf[out->len++] = (char)c;
+		}
+	}
+}
+
+
+static void
+end_text(struct output *out)
+{
+	if (!out->in_text)
+		return;
+	out->in_text = 0;
+	if (binary) {
+		out_byte(out, LIBTERMINPUT_TEXT);
+		out_u32(out, out->ntext);
+		out_write(out, out->text, out->ntext);
+		out->ntext = 0;
+	} else {
+		out_str(out, "\"}\n");
+	}
+}
+
+
+static void
+add_text(struct output *out, const char *s, size_t n)
+{
+	if (binary) {
+		if (out->ntext + n > out->text_size) {
+			out->text_size = (out->ntext + n) * 2;
+			out->text = realloc(out->text, out->text_size);
+			if (!out->text)
+				enomem();
+		}
+		memcpy(&out->text[out->ntext], s, n);
+		out->ntext += n;
+	} else {
+		if (!out->in_text)
+			out_str(out, "{\"type\":\"text\",\"data\":\"");
+		out_json_string(out, s, n);
+	}
+	out->in_text = 1;
+}
+
+
+static void
+emit_binary(struct output *out, const union libterminput_input *input)
+{
+	size_t n;
+
+	out_byte(out, (unsigned char)input->type);
+	switch (input->type) {
+	case LIBTERMINPUT_KEYPRESS:
+		n = strlen(input->keypress.symbol);
+		out_byte(out, (unsigned char)input->keypress.key);
+		out_byte(out, (unsigned char)input->keypress.mods);
+		out_u32(out, input->keypress.times);
+		out_byte(out, (unsigned char)n);
+		out_write(out, input->keypress.symbol, n);
+		break;
+	case LIBTERMINPUT_MOUSEEVENT:
+		out_byte(out, (unsigned char)input->mouseevent.event);
+		out_byte(out, (unsigned char)input->mouseevent.button);
+		out_byte(out, (unsigned char)input->mouseevent.mods);
+		out_u32(out, input->mouseevent.x);
+		out_u32(out, input->mouseevent.y);
+		if (input->mouseevent.event == LIBTERMINPUT_HIGHLIGHT_OUTSIDE) {
+			out_u32(out, input->mouseevent.start_x);
+			out_u32(out, input->mouseevent.start_y);
+			out_u32(out, input->mouseevent.end_x);
+			out_u32(out, input->mouseevent.end_y);
+		}
+		break;
+	case LIBTERMINPUT_CURSOR_POSITION:
+		out_u32(out, input->position.x);
+		out_u32(out, input->position.y);
+		break;
+	case LIBTERMINPUT_RESIZE:
+		out_u32(out, input->resize.rows);
+		out_u32(out, input->resize.columns);
+		out_u32(out, input->resize.height);
+		out_u32(out, input->resize.width);
+		break;
+	default:
+		break;
+	}
+}
+
+
+static void
+emit_json(struct output *out, const union libterminput_input *input)
+{
+	switch (input->type) {
+	case LIBTERMINPUT_KEYPRESS:
+		out_str(out, "{\"type\":\"keypress\",\"key\":\"");
+		if ((size_t)input->keypress.key < sizeof(key_names) / sizeof(*key_names))
+			out_str(out, key_names[input->keypress.key]);
+		else
+			out_uint(out, (unsigned long long int)input->keypress.key);
+		out_str(out, "\"");
+		if (input->keypress.key == LIBTERMINPUT_SYMBOL) {
+			out_str(out, ",\"symbol\":\"");
+			out_json_string(out, input->keypress.symbol, strlen(input->keypress.symbol));
+			out_str(out, "\"");
+		}
+		out_json_field(out, "mods", (unsigned long long int)input->keypress.mods);
+		out_json_field(out, "times", input->keypress.times);
+		break;
+	case LIBTERMINPUT_BRACKETED_PASTE_START:
+		out_str(out, "{\"type\":\"paste start\"");
+		break;
+	case LIBTERMINPUT_BRACKETED_PASTE_END:
+		out_str(out, "{\"type\":\"paste end\"");
+		break;
+	case LIBTERMINPUT_MOUSEEVENT:
+		out_str(out, "{\"type\":\"mouse\",\"event\":\"");
+		if ((size_t)input->mouseevent.event < sizeof(event_names) / sizeof(*event_names))
+			out_str(out, event_names[input->mouseevent.event]);
+		else
+			out_uint(out, (unsigned long long int)input->mouseevent.event);
+		out_str(out, "\"");
+		out_json_field(out, "button", (unsigned long long int)input->mouseevent.button);
+		out_json_field(out, "mods", (unsigned long long int)input->mouseevent.mods);
+		out_json_field(out, "x", input->mouseevent.x);
+		out_json_field(out, "y", input->mouseevent.y);
+		if (input->mouseevent.event == LIBTERMINPUT_HIGHLIGHT_OUTSIDE) {
+			out_json_field(out, "start_x", input->mouseevent.start_x);
+			out_json_field(out, "start_y", input->mouseevent.start_y);
+			out_json_field(out, "end_x", input->mouseevent.end_x);
+			out_json_field(out, "end_y", input->mouseevent.end_y);
+		}
+		break;
+	case LIBTERMINPUT_TERMINAL_IS_OK:
+		out_str(out, "{\"type\":\"terminal ok\"");
+		break;
+	case LIBTERMINPUT_TERMINAL_IS_NOT_OK:
+		out_str(out, "{\"type\":\"terminal not ok\"");
+		break;
+	case LIBTERMINPUT_CURSOR_POSITION:
+		out_str(out, "{\"type\":\"cursor position\"");
+		out_json_field(out, "x", input->position.x);
+		out_json_field(out, "y", input->position.y);
+		break;
+	case LIBTERMINPUT_FOCUS_IN:
+		out_str(out, "{\"type\":\"focus in\"");
+		break;
+	case LIBTERMINPUT_FOCUS_OUT:
+		out_str(out, "{\"type\":\"focus out\"");
+		break;
+	case LIBTERMINPUT_RESIZE:
+		out_str(out, "{\"type\":\"resize\"");
+		out_json_field(out, "rows", input->resize.rows);
+		out_json_field(out, "columns", input->resize.columns);
+		out_json_field(out, "height", input->resize.height);
+		out_json_field(out, "width", input->resize.width);
+		break;
+	default:
+		out_str(out, "{\"type\":");
+		out_uint(out, (unsigned long long int)input->type);
+		break;
+	}
+	out_str(out, "}\n");
+}
+
+
+static void
+flush_output(struct output *out)
+{
+	if (out->len && fwrite(out->buf, 1, out->len, stdout) != out->len) {
+		perror(argv0);
+		exit(1);
+	}
+	out->len = 0;
+}
+
+
+static void
+decode(const char *data, size_t len, union libterminput_input *input, struct libterminput_state *ctx, struct output *out)
+{
+	while (libterminput_read_mem(&data, &len, input, ctx)) {
+		if (input->type == LIBTERMINPUT_NONE)
+			continue;
+		if (input->type == LIBTERMINPUT_TEXT) {
+			add_text(out, input->text.bytes, input->text.nbytes);
+			continue;
+		}
+		end_text(out);
+		if (binary)
+			emit_binary(out, input);
+		else
+			emit_json(out, input);
+		/* Repetitions are reported in the record, so skip them */
+		if (input->type == LIBTERMINPUT_KEYPRESS)
+			input->keypress.times = 1;
+		if (out->flushable && out->len >= FLUSH_THRESHOLD)
+			flush_output(out);
+	}
+}
+
+
+
+/* Whether decoding the remaining input from a fresh state
+ * gives the same result as continuing from `ctx` */
+static int
+is_clean(const struct libterminput_state *ctx)
+{
+	return !ctx->bracketed_paste && !ctx->control_string && !ctx->mouse_tracking && !ctx->meta && !ctx->n && !ctx->mods &&
+	       !ctx->paused && !*ctx->key && ctx->stored_head == ctx->stored_tail;
+}
+
+
+/* Find a likely clean point, directly after a control character that
+ * aborts any incomplete escape sequence, at or after `start`; if none
+ * is found, `len` is returned. This is only a guess, a control character
+ * inside a bracketed paste or a mouse event does not end them, so each
+ * split is checked with is_clean() once the previous segment is decoded. */
+static size_t
+find_split(const char *data, size_t len, size_t start)
+{
+	size_t end = len - start > SPLIT_SEARCH_LIMIT ? start + SPLIT_SEARCH_LIMIT : len;
+	unsigned char c;
+	for (; start < end; start++) {
+		c = (unsigned char)data[start];
+		if (c && c < ' ' && c != '\033' && c != '\t' && c != '\b' && c != '\n')
+			return start + 1;
+	}
+	return len;
+}
+
+
+static void
+reset_decoder(struct decoder *dec)
+{
+	memset(&dec->ctx, 0, sizeof(dec->ctx));
+	memset(&dec->input, 0, sizeof(dec->input));
+	libterminput_set_flags(&dec->ctx, flags);
+	dec->out.len = 0;
+	dec->out.ntext = 0;
+	dec->out.in_text = 0;
+	dec->out.flushable = 0;
+}
+
+
+static void *
+decode_segment(void *arg)
+{
+	struct segment *seg = arg;
+	decode(seg->data, seg->len, &seg->dec.input, &seg->dec.ctx, &seg->dec.out);
+	return NULL;
+}
+
+
+/* Write the decoded output, or in compare mode, check it against the serial decode */
+static void
+emit_output(struct output *out)
+{
+	if (!compare) {
+		flush_output(out);
+		return;
+	}
+
+	out_write(&compare_out, out->buf, out->len);
+	out->len = 0;
+}
+
+
+static void
+compare_output(struct output *ref, int final)
+{
+	size_t i, n = ref->len < compare_out.len ? ref->len : compare_out.len;
+
+	for (i = 0; i < n; i++)
+		if (ref->buf[i] != compare_out.buf[i])
+			break;
+	if (i < n || (final && ref->len != compare_out.len)) {
+		fprintf(stderr, "%s: parallel and serial output differ at output octet %llu\n",
+		        argv0, compared + (unsigned long long int)i);
+		exit(1);
+	}
+	compared += (unsigned long long int)n;
+	memmove(ref->buf, &ref->buf[n], ref->len -= n);
+	memmove(compare_out.buf, &compare_out.buf[n], compare_out.len -= n);
+}
+
+
+static void
+swap_decoders(struct decoder *a, struct decoder *b)
+{
+	struct decoder t = *a;
+	*a = *b;
+	*b = t;
+}
+
+
+/* Decode in batches of up to `nthreads` segments that are decoded
+ * concurrently, each starting from a fresh state, except the first
+ * which continues from the previous batch. When a segment ends in
+ * a state that is not clean, the next segment is decoded again,
+ * continuing from that state, so the result is always identical
+ * to a serial decode. The state at the end is left in segs[0].dec. */
+static void
+decode_parallel(const char *data, size_t len, struct segment *segs, struct decoder *ref)
+{
+	size_t i, n, batch, pos, split;
+
+	while (len) {
+		batch = len < nthreads * SEGMENT_SIZE ? len : nthreads * SEGMENT_SIZE;
+
+		segs[0].data = data;
+		for (n = 1, pos = 0; n < nthreads; n++) {
+			split = find_split(data, batch, batch * n / nthreads > pos ? batch * n / nthreads : pos);
+			if (split == batch)
+				break;
+			segs[n - 1].len = split - pos;
+			segs[n].data = &data[split];
+			pos = split;
+		}
+		segs[n - 1].len = batch - pos;
+
+		for (i = 1; i < n; i++) {
+			reset_decoder(&segs[i].dec);
+			errno = pthread_create(&segs[i].thread, NULL, decode_segment, &segs[i]);
+			if (errno) {
+				perror(argv0);
+				exit(1);
+			}
+		}
+		decode_segment(&segs[0]);
+		for (i = 1; i < n; i++)
+			pthread_join(segs[i].thread, NULL);
+
+		for (i = 1; i < n; i++) {
+			if (is_clean(&segs[i - 1].dec.ctx)) {
+				emit_output(&segs[i - 1].dec.out);
+			} else {
+				/* Mispredicted split, continue the previous segment instead */
+				nresplices += 1;
+				decode(segs[i].data, segs[i].len, &segs[i - 1].dec.input, &segs[i - 1].dec.ctx, &segs[i - 1].dec.out);
+				swap_decoders(&segs[i - 1].dec, &segs[i].dec);
+			}
+		}
+		/* Output from the last segment may end with a partial text record */
+		emit_output(&segs[n - 1].dec.out);
+		if (n > 1)
+			swap_decoders(&segs[0].dec, &segs[n - 1].dec);
+
+		if (ref) {
+			decode(data, batch, &ref->input, &ref->ctx, &ref->out);
+			compare_output(&ref->out, 0);
+		}
+
+		data += batch;
+		len -= batch;
+	}
+}
+
+int
+main(int argc, char *argv[])
+{
+	struct segment *segs;
+	struct decoder *dec, ref;
+	struct stat st;
+	unsigned long long int ns;
+	const char *data, *end;
+	size_t i, len;
+	int fd, opt;
+
+	argv0 = argv[0];
+	while ((opt = getopt(argc, argv, "bcF:j:")) != -1) {
+		switch (opt) {
+		case 'b':
+			binary = 1;
+			break;
+		case 'c':
+			compare = 1;
+			break;
+		case 'F':
+			flags = (enum libterminput_flags)strtoul(optarg, NULL, 0);
+			break;
+		case 'j':
+			nthreads = (size_t)strtoul(optarg, NULL, 10);
+			if (!nthreads)
+				usage();
+			break;
+		default:
+			usage();
+		}
+	}
+	if (optind + 1 != argc)
+		usage();
+	if ((compare || nthreads > 1) && (flags & LIBTERMINPUT_ESC_ON_BLOCK)) {
+		fprintf(stderr, "%s: -c and -j cannot be combined with LIBTERMINPUT_ESC_ON_BLOCK\n", argv0);
+		return 1;
+	}
+
+	fd = open(argv[optind], O_RDONLY);
+	if (fd < 0 || fstat(fd, &st)) {
+		perror(argv[optind]);
+		return 1;
+	}
+	data = NULL;
+	if (st.st_size) {
+		data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (data == MAP_FAILED) {
+			perror(argv[optind]);
+			return 1;
+		}
+		posix_madvise((void *)data, (size_t)st.st_size, POSIX_MADV_SEQUENTIAL);
+	}
+	close(fd);
+	end = &data[st.st_size];
+
+	segs = calloc(nthreads, sizeof(*segs));
+	if (!segs)
+		enomem();
+	dec = &segs[0].dec;
+	reset_decoder(dec);
+	memset(&ref, 0, sizeof(ref));
+	reset_decoder(&ref);
+
+	if ((size_t)st.st_size >= CAPTURE_MAGIC_SIZE && !memcmp(data, CAPTURE_MAGIC, CAPTURE_MAGIC_SIZE)) {
+		/* Capture from terminput-record, decode its data as one stream */
+		if (compare || nthreads > 1) {
+			fprintf(stderr, "%s: -c and -j are only supported for raw input\n", argv0);
+			return 1;
+		}
+		dec->out.flushable = 1;
+		data += CAPTURE_MAGIC_SIZE;
+		while ((size_t)(end - data) >= CAPTURE_HEADER_SIZE) {
+			capture_decode_header((const void *)data, &ns, &len);
+			data += CAPTURE_HEADER_SIZE;
+			if (len > (size_t)(end - data)) {
+				fprintf(stderr, "%s: %s: truncated capture file\n", argv0, argv[optind]);
+				return 1;
+			}
+			decode(data, len, &dec->input, &dec->ctx, &dec->out);
+			data += len;
+		}
+	} else if (compare || nthreads > 1) {
+		decode_parallel(data, (size_t)st.st_size, segs, compare ? &ref : NULL);
+	} else {
+		dec->out.flushable = 1;
+		decode(data, (size_t)st.st_size, &dec->input, &dec->ctx, &dec->out);
+	}
+	end_text(&dec->out);
+	emit_output(&dec->out);
+
+	if (compare) {
+		end_text(&ref.out);
+		compare_output(&ref.out, 1);
+		fprintf(stderr, "%s: parallel and serial output are identical (%llu octets, %zu mispredicted splits)\n",
+		        argv0, compared, nresplices);
+	}
+
+	for (i = 0; i < nthreads; i++) {
+		free(segs[i].dec.out.buf);
+		free(segs[i].dec.out.text);
+	}
+	free(segs);
+	free(ref.out.buf);
+	free(ref.out.text);
+	free(compare_out.buf);
+
+	if (fflush(stdout) || ferror(stdout)) {
+		perror(argv0);
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,106 @@
+/* See LICENSE file for copyright and license details. */
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "terminput-capture.h"
+
+
+static volatile sig_atomic_t interrupted = 0;
+
+
+static void
+sigint(int signo)
+{
+	(void) signo;
+	interrupted = 1;
+}
+
+
+static unsigned long long int
+elapsed(const struct timespec *start)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (unsigned long long int)(now.tv_sec - start->tv_sec) * 1000000000ULL + (unsigned long long int)now.tv_nsec
+	       - (unsigned long long int)start->tv_nsec;
+}
+
+
+int
+main(int argc, char *argv[])
+{
+	struct termios stty, saved_stty;
+	struct sigaction sa;
+	struct timespec start;
+	unsigned char header[CAPTURE_HEADER_SIZE];
+	char buf[CAPTURE_CHUNK_MAX];
+	int have_stty, ret = 0;
+	ssize_t r;
+	FILE *fp;
+
+	if (argc != 2) {
+		fprintf(stderr, "usage: %s capture-file\n", argv[0]);
+		return 1;
+	}
+
+	fp = fopen(argv[1], "wb");
+	if (!fp) {
+		perror(argv[1]);
+		return 1;
+	}
+	if (fwrite(CAPTURE_MAGIC, 1, CAPTURE_MAGIC_SIZE, fp) != CAPTURE_MAGIC_SIZE) {
+		perror(argv[1]);
+		return 1;
+	}
+
+	/* Stop on SIGINT, without restarting read(3) */
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = sigint;
+	sigemptyset(&sa.sa_mask);
+	sigaction(SIGINT, &sa, NULL);
+	sigaction(SIGTERM, &sa, NULL);
+
+	have_stty = !tcgetattr(STDIN_FILENO, &stty);
+	if (have_stty) {
+		saved_stty = stty;
+		stty.c_lflag &= (tcflag_t)~(ECHO | ICANON);
+		if (tcsetattr(STDIN_FILENO, TCSAFLUSH, &stty)) {
+			perror("tcsetattr STDIN_FILENO TCSAFLUSH");
+			return 1;
+		}
+		fprintf(stderr, "Recording, press control+c to stop\n");
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	while (!interrupted) {
+		r = read(STDIN_FILENO, buf, sizeof(buf));
+		if (r <= 0) {
+			if (r < 0 && errno == EINTR)
+				continue;
+			if (r < 0) {
+				perror("read STDIN_FILENO");
+				ret = 1;
+			}
+			break;
+		}
+		capture_encode_header(header, elapsed(&start), (size_t)r);
+		if (fwrite(header, 1, sizeof(header), fp) != sizeof(header) || fwrite(buf, 1, (size_t)r, fp) != (size_t)r) {
+			perror(argv[1]);
+			ret = 1;
+			break;
+		}
+	}
+
+	if (have_stty)
+		tcsetattr(STDIN_FILENO, TCSAFLUSH, &saved_stty);
+	if (fclose(fp)) {
+		perror(argv[1]);
+		ret = 1;
+	}
+	return ret;
+}
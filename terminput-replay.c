@@ -0,0 +1,205 @@
+/* See LICENSE file for copyright and license details. */
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "libterminput.h"
+#include "terminput-capture.h"
+
+
+static struct libterminput_state ctx;
+static union libterminput_input input;
+static int quiet = 0;
+static size_t nevents = 0;
+static struct timespec decode_time;
+
+
+static void
+usage(const char *argv0)
+{
+	fprintf(stderr, "usage: %s [-fq] [-F flags] capture-file\n", argv0);
+	exit(1);
+}
+
+
+static void
+print_event(void)
+{
+	switch (input.type) {
+	case LIBTERMINPUT_KEYPRESS:
+		printf("keypress key=%i mods=%i times=%llu symbol=\"%s\"\n", (int)input.keypress.key,
+		       (int)input.keypress.mods, input.keypress.times, input.keypress.symbol);
+		break;
+	case LIBTERMINPUT_BRACKETED_PASTE_START:
+		printf("bracketed paste start\n");
+		break;
+	case LIBTERMINPUT_BRACKETED_PASTE_END:
+		printf("bracketed paste end\n");
+		break;
+	case LIBTERMINPUT_TEXT:
+		printf("text nbytes=%zu\n", input.text.nbytes);
+		break;
+	case LIBTERMINPUT_MOUSEEVENT:
+		printf("mouseevent event=%i button=%i mods=%i x=%zu y=%zu\n", (int)input.mouseevent.event,
+		       (int)input.mouseevent.button, (int)input.mouseevent.mods, input.mouseevent.x, input.mouseevent.y);
+		break;
+	case LIBTERMINPUT_TERMINAL_IS_OK:
+		printf("terminal ok\n");
+		break;
+	case LIBTERMINPUT_TERMINAL_IS_NOT_OK:
+		printf("terminal not ok\n");
+		break;
+	case LIBTERMINPUT_CURSOR_POSITION:
+		printf("cursor position x=%zu y=%zu\n", input.position.x, input.position.y);
+		break;
+	case LIBTERMINPUT_FOCUS_IN:
+		printf("focus in\n");
+		break;
+	case LIBTERMINPUT_FOCUS_OUT:
+		printf("focus out\n");
+		break;
+	case LIBTERMINPUT_RESIZE:
+		printf("resize rows=%zu columns=%zu height=%zu width=%zu\n", input.resize.rows,
+		       input.resize.columns, input.resize.height, input.resize.width);
+		break;
+	default:
+		printf("other type=%i\n", (int)input.type);
+		break;
+	}
+}
+
+
+static void
+add_time(struct timespec *acc, const struct timespec *start, const struct timespec *end)
+{
+	acc->tv_sec += end->tv_sec - start->tv_sec;
+	acc->tv_nsec += end->tv_nsec - start->tv_nsec;
+	if (acc->tv_nsec < 0) {
+		acc->tv_sec -= 1;
+		acc->tv_nsec += 1000000000L;
+	} else if (acc->tv_nsec >= 1000000000L) {
+		acc->tv_sec += 1;
+		acc->tv_nsec -= 1000000000L;
+	}
+}
+
+
+/* Decode everything that is available in the pipe */
+static int
+drain(int fd)
+{
+	struct timespec start, end;
+	int r;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	while ((r = libterminput_read(fd, &input, &ctx)) > 0) {
+		if (input.type == LIBTERMINPUT_NONE)
+			continue;
+		nevents += 1;
+		if (!quiet)
+			print_event();
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	add_time(&decode_time, &start, &end);
+
+	if (r < 0 && errno != EAGAIN) {
+		perror("libterminput_read");
+		return -1;
+	}
+	return 0;
+}
+
+
+int
+main(int argc, char *argv[])
+{
+	struct timespec start, when;
+	unsigned char header[CAPTURE_HEADER_SIZE];
+	char buf[CAPTURE_CHUNK_MAX];
+	unsigned long long int ns;
+	size_t len, nchunks = 0, nbytes = 0;
+	int fds[2], fast = 0, opt;
+	FILE *fp;
+
+	while ((opt = getopt(argc, argv, "fqF:")) != -1) {
+		switch (opt) {
+		case 'f':
+			fast = 1;
+			break;
+		case 'q':
+			quiet = 1;
+			break;
+		case 'F':
+			libterminput_set_flags(&ctx, (enum libterminput_flags)strtoul(optarg, NULL, 0));
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (optind + 1 != argc)
+		usage(argv[0]);
+
+	fp = fopen(argv[optind], "rb");
+	if (!fp) {
+		perror(argv[optind]);
+		return 1;
+	}
+	if (fread(buf, 1, CAPTURE_MAGIC_SIZE, fp) != CAPTURE_MAGIC_SIZE || memcmp(buf, CAPTURE_MAGIC, CAPTURE_MAGIC_SIZE)) {
+		fprintf(stderr, "%s: %s: not a capture file\n", argv[0], argv[optind]);
+		return 1;
+	}
+
+	/* The decoder reads from a non-blocking pipe, so that each
+	 * chunk can be fully decoded before the next one is written,
+	 * this preserves the chunking even when replaying at maximum
+	 * speed */
+	if (pipe(fds) || fcntl(fds[0], F_SETFL, fcntl(fds[0], F_GETFL) | O_NONBLOCK) == -1) {
+		perror("pipe");
+		return 1;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	while (fread(header, 1, sizeof(header), fp) == sizeof(header)) {
+		capture_decode_header(header, &ns, &len);
+		if (len > sizeof(buf) || fread(buf, 1, len, fp) != len) {
+			fprintf(stderr, "%s: %s: truncated or corrupt capture file\n", argv[0], argv[optind]);
+			return 1;
+		}
+		if (!fast) {
+			when.tv_sec = start.tv_sec + (time_t)(ns / 1000000000ULL);
+			when.tv_nsec = start.tv_nsec + (long int)(ns % 1000000000ULL);
+			if (when.tv_nsec >= 1000000000L) {
+				when.tv_sec += 1;
+				when.tv_nsec -= 1000000000L;
+			}
+			while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &when, NULL) == EINTR);
+		}
+		if (write(fds[1], buf, len) != (ssize_t)len) {
+			perror("write");
+			return 1;
+		}
+		nchunks += 1;
+		nbytes += len;
+		if (drain(fds[0]))
+			return 1;
+	}
+	if (ferror(fp)) {
+		perror(argv[optind]);
+		return 1;
+	}
+	fclose(fp);
+
+	close(fds[1]);
+	if (drain(fds[0]))
+		return 1;
+	close(fds[0]);
+
+	fflush(stdout);
+	fprintf(stderr, "%zu chunks, %zu bytes, %zu events, %lli.%09li seconds spent decoding\n",
+	        nchunks, nbytes, nevents, (long long int)decode_time.tv_sec, decode_time.tv_nsec);
+	return 0;
+}
@@ -0,0 +1,248 @@
+/* See LICENSE file for copyright and license details. */
+#include <cerrno>
+#include <coroutine>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "libterminput.hpp"
+#include "libterminput_impl.h"
+
+
+#define TEST(EXPR)\
+	do {\
+		if (EXPR)\
+			break;\
+		fprintf(stderr, "Failure at line %i: %s\n", __LINE__, #EXPR);\
+		exit(1);\
+	} while (0)
+
+
+using namespace libterminput;
+
+
+/* Coroutine that runs until it awaits input that is not available */
+struct task {
+	struct promise_type {
+		task get_return_object() noexcept { return {}; }
+		std::suspend_never initial_suspend() const noexcept { return {}; }
+		std::suspend_never final_suspend() const noexcept { return {}; }
+		void return_void() noexcept {}
+		void unhandled_exception() noexcept { std::terminate(); }
+	};
+};
+
+/* Records the requests to wait, the test wakes the waiter itself */
+class fake_reactor : public reactor {
+public:
+	int calls = 0;
+	int timeout = 0;
+	waiter *w = nullptr;
+
+	void
+	wait_readable(int, int t, waiter &w_) override
+	{
+		calls += 1;
+		timeout = t;
+		w = &w_;
+	}
+};
+
+struct results {
+	union libterminput_input events[8];
+	size_t nevents = 0;
+	bool eof = false;
+};
+
+
+static task
+consume(terminal &t, results &res, size_t n)
+{
+	const union libterminput_input *input;
+	while (res.nevents < n) {
+		input = co_await t.next_event();
+		if (!input) {
+			res.eof = true;
+			co_return;
+		}
+		res.events[res.nevents++] = *input;
+	}
+}
+
+
+static task
+consume_generator(event_generator &gen, results &res)
+{
+	const union libterminput_input *input;
+	while ((input = co_await gen.next()))
+		res.events[res.nevents++] = *input;
+	res.eof = true;
+}
+
+
+/* Dispatch with event::visit, and describe the typed view it was given */
+static int
+describe(const event &e, char *out)
+{
+	return e.visit(overloaded{
+		[&](const keypress_event &k) {
+			std::u32string_view cps = k.codepoints();
+			sprintf(out, "key %i %i %lx", (int)k.data.key, (int)k.data.mods, cps.empty() ? 0UL : (unsigned long)cps[0]);
+			return 1;
+		},
+		[&](const text_event &t) {
+			sprintf(out, "text %.*s", (int)t.bytes().size(), t.bytes().data());
+			return 2;
+		},
+		[&](const mouse_event &m) {
+			sprintf(out, "mouse %i %i %zu %zu", (int)m.data.event, (int)m.data.button, m.data.x, m.data.y);
+			return 3;
+		},
+		[&](const signal_event &sig) {
+			sprintf(out, "signal %i", (int)sig.type);
+			return 4;
+		},
+		[&](const auto &) {
+			sprintf(out, "other %i", (int)e.type());
+			return 5;
+		}
+	});
+}
+
+
+static bool
+is_key(const union libterminput_input &input, enum libterminput_key key, enum libterminput_mod mods, const char *symbol = "")
+{
+	return input.type == LIBTERMINPUT_KEYPRESS && input.keypress.key == key &&
+	       input.keypress.mods == mods && !strcmp(input.keypress.symbol, symbol);
+}
+
+
+int
+main(void)
+{
+	fake_reactor loop;
+	results res;
+	char buf[8];
+	int fds[2];
+
+	TEST(!pipe(fds));
+	TEST(fcntl(fds[0], F_SETFL, fcntl(fds[0], F_GETFL) | O_NONBLOCK) != -1);
+	terminal t(fds[0], loop);
+
+	/* Input that has already been read is returned without suspending */
+	TEST(write(fds[1], "abc", 3) == 3);
+	consume(t, res, 1);
+	TEST(res.nevents == 1 && is_key(res.events[0], LIBTERMINPUT_SYMBOL, (enum libterminput_mod)0, "a"));
+	TEST(read(fds[0], buf, sizeof(buf)) == -1 && errno == EAGAIN);
+	consume(t, res, 3);
+	TEST(res.nevents == 3 && !loop.calls);
+	TEST(is_key(res.events[1], LIBTERMINPUT_SYMBOL, (enum libterminput_mod)0, "b"));
+	TEST(is_key(res.events[2], LIBTERMINPUT_SYMBOL, (enum libterminput_mod)0, "c"));
+
+	/* Without input, the coroutine waits without a timeout */
+	res = {};
+	consume(t, res, 1);
+	TEST(!res.nevents && loop.calls == 1 && loop.timeout == -1);
+
+	/* A lone ESC is returned as ESC when the timeout expires */
+	TEST(write(fds[1], "\033", 1) == 1);
+	loop.w->wake(false);
+	TEST(!res.nevents && loop.calls == 2 && loop.timeout == 50);
+	loop.w->wake(true);
+	TEST(res.nevents == 1 && is_key(res.events[0], LIBTERMINPUT_ESC, (enum libterminput_mod)0));
+	TEST(!t.state().meta);
+
+	/* ESC ESC is returned as Meta+ESC when the timeout expires */
+	res = {};
+	TEST(write(fds[1], "\033\033", 2) == 2);
+	consume(t, res, 1);
+	TEST(!res.nevents && loop.calls == 3 && loop.timeout == 50);
+	loop.w->wake(true);
+	TEST(res.nevents == 1 && is_key(res.events[0], LIBTERMINPUT_ESC, LIBTERMINPUT_META));
+	TEST(!t.state().meta);
+
+	/* A key that arrives before the timeout completes the ESC */
+	res = {};
+	TEST(write(fds[1], "\033", 1) == 1);
+	consume(t, res, 1);
+	TEST(!res.nevents && loop.calls == 4 && loop.timeout == 50);
+	TEST(write(fds[1], "x", 1) == 1);
+	loop.w->wake(false);
+	TEST(res.nevents == 1 && is_key(res.events[0], LIBTERMINPUT_SYMBOL, LIBTERMINPUT_META, "x"));
+
+	/* The generator yields every event, and ends on end of input */
+	res = {};
+	TEST(write(fds[1], "de", 2) == 2);
+	event_generator gen = t.events();
+	consume_generator(gen, res);
+	TEST(res.nevents == 2 && !res.eof && loop.calls == 5 && loop.timeout == -1);
+	TEST(is_key(res.events[0], LIBTERMINPUT_SYMBOL, (enum libterminput_mod)0, "d"));
+	TEST(is_key(res.events[1], LIBTERMINPUT_SYMBOL, (enum libterminput_mod)0, "e"));
+	TEST(write(fds[1], "f", 1) == 1);
+	loop.w->wake(false);
+	TEST(res.nevents == 3 && !res.eof && loop.calls == 6);
+	TEST(is_key(res.events[2], LIBTERMINPUT_SYMBOL, (enum libterminput_mod)0, "f"));
+	close(fds[1]);
+	loop.w->wake(false);
+	TEST(res.nevents == 3 && res.eof && loop.calls == 6);
+
+	/* End of input is also returned without suspending */
+	res = {};
+	consume(t, res, 1);
+	TEST(!res.nevents && res.eof && loop.calls == 6);
+
+	close(fds[0]);
+
+	/* A session's events are visited as typed views */
+	session s;
+	char descs[8][64], want[64];
+	int kinds[8];
+	size_t n = 0;
+	for (event e : s.events("a\303\266\033[1;5A\033[<0;12;34M\033[200~hi\033[201~\033[1;"))
+		kinds[n] = describe(e, descs[n]), n++;
+	TEST(n == 7);
+	TEST(kinds[0] == 1 && !strcmp(descs[0], "key 0 0 61"));
+	TEST(kinds[1] == 1 && !strcmp(descs[1], "key 0 0 f6"));
+	TEST(kinds[2] == 1 && !strcmp(descs[2], "key 1 4 0"));
+	sprintf(want, "mouse %i %i 12 34", (int)LIBTERMINPUT_PRESS, (int)LIBTERMINPUT_BUTTON1);
+	TEST(kinds[3] == 3 && !strcmp(descs[3], want));
+	sprintf(want, "signal %i", (int)LIBTERMINPUT_BRACKETED_PASTE_START);
+	TEST(kinds[4] == 4 && !strcmp(descs[4], want));
+	TEST(kinds[5] == 2 && !strcmp(descs[5], "text hi"));
+	sprintf(want, "signal %i", (int)LIBTERMINPUT_BRACKETED_PASTE_END);
+	TEST(kinds[6] == 4 && !strcmp(descs[6], want));
+
+	/* Incomplete input is kept in the session for the next range */
+	n = 0;
+	for (event e : s.events("2B"))
+		kinds[n] = describe(e, descs[n]), n++;
+	TEST(n == 1 && kinds[0] == 1 && !strcmp(descs[0], "key 2 1 0"));
+
+	/* Moving the session moves the state, and the range ends on end of input */
+	s.state().mods = LIBTERMINPUT_CTRL;
+	session s2(std::move(s));
+	TEST(s2.state().mods == LIBTERMINPUT_CTRL && !s.state().mods);
+	s2.state().mods = (enum libterminput_mod)0;
+	TEST(!pipe(fds));
+	TEST(write(fds[1], "z", 1) == 1);
+	close(fds[1]);
+	n = 0;
+	for (event e : s2.events(fds[0]))
+		kinds[n] = describe(e, descs[n]), n++;
+	TEST(n == 1 && kinds[0] == 1 && !strcmp(descs[0], "key 0 0 7a"));
+	close(fds[0]);
+
+	/* The inline functions of the single-header distribution are also C++ */
+	struct libterminput_state ctx = {};
+	union libterminput_input input = {};
+	const char *mem = "q";
+	size_t memlen = 1;
+	TEST(libterminput_read_mem_inline(&mem, &memlen, &input, &ctx) == 1);
+	TEST(is_key(input, LIBTERMINPUT_SYMBOL, (enum libterminput_mod)0, "q"));
+
+	return 0;
+}
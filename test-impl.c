@@ -0,0 +1,74 @@
+/* See LICENSE file for copyright and license details. */
+#define LIBTERMINPUT_IMPLEMENTATION
+#include "libterminput_impl.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+
+/* Compiled without CPPFLAGS, and linked without
+ * libterminput, to check that libterminput_impl.h
+ * is a complete implementation on its own */
+
+
+#define TEST(EXPR)\
+	do {\
+		if (EXPR)\
+			break;\
+		fprintf(stderr, "Failure at line %i, with errno = %i (%s): %s\n",\
+		        __LINE__, errno, strerror(errno), #EXPR);\
+		exit(1);\
+	} while (0)
+
+
+static int
+next(const char **bufp, size_t *lenp, union libterminput_input *input, struct libterminput_state *ctx)
+{
+	int r;
+	do
+		r = libterminput_read_mem_inline(bufp, lenp, input, ctx);
+	while (r > 0 && input->type == LIBTERMINPUT_NONE);
+	return r;
+}
+
+
+int
+main(void)
+{
+	struct libterminput_state ctx;
+	union libterminput_input input;
+	const char *mem = "a\033[1;5A\303\266\033[<0;12;34M";
+	size_t memlen = strlen(mem);
+	int fds[2];
+
+	memset(&ctx, 0, sizeof(ctx));
+	memset(&input, 0, sizeof(input));
+	TEST(next(&mem, &memlen, &input, &ctx) == 1);
+	TEST(input.type == LIBTERMINPUT_KEYPRESS && !strcmp(input.keypress.symbol, "a"));
+	TEST(next(&mem, &memlen, &input, &ctx) == 1);
+	TEST(input.type == LIBTERMINPUT_KEYPRESS && input.keypress.key == LIBTERMINPUT_UP);
+	TEST(input.keypress.mods == LIBTERMINPUT_CTRL);
+	TEST(next(&mem, &memlen, &input, &ctx) == 1);
+	TEST(input.type == LIBTERMINPUT_KEYPRESS && !strcmp(input.keypress.symbol, "\303\266"));
+	TEST(next(&mem, &memlen, &input, &ctx) == 1);
+	TEST(input.type == LIBTERMINPUT_MOUSEEVENT && input.mouseevent.x == 12 && input.mouseevent.y == 34);
+	TEST(next(&mem, &memlen, &input, &ctx) == 0 && !memlen);
+
+	memset(&ctx, 0, sizeof(ctx));
+	TEST(!pipe(fds));
+	TEST(!libterminput_enable_wakeup(&ctx));
+	TEST(write(fds[1], "xy", 2) == 2);
+	close(fds[1]);
+	TEST(libterminput_read_inline(fds[0], &input, &ctx) == 1);
+	TEST(input.type == LIBTERMINPUT_KEYPRESS && !strcmp(input.keypress.symbol, "x"));
+	TEST(libterminput_read_inline(fds[0], &input, &ctx) == 1);
+	TEST(input.type == LIBTERMINPUT_KEYPRESS && !strcmp(input.keypress.symbol, "y"));
+	TEST(libterminput_read_inline(fds[0], &input, &ctx) == 0);
+	libterminput_disable_wakeup(&ctx);
+	close(fds[0]);
+
+	return 0;
+}
@@ -1,11 +1,15 @@
 /* See LICENSE file for copyright and license details. */
 #include <errno.h>
+#include <fcntl.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 
-#include "libterminput.h"
+#include "libterminput_impl.h"
+
+
+#define PROBE_QUERIES "\033[?2026$p\033[?2004$p\033[>c\033[>q\033[?u\033P+q544E\033\\\033P+q536D756C78\033\\\033[c"
 
 
 static const struct keypress {
@@ -329,8 +333,124 @@ static int lineno3 = 0;
 static char buffer[512], numbuf[3 * sizeof(int) + 2];
 static struct libterminput_state ctx;
 static union libterminput_input input;
+static struct libterminput_probe probe;
+static struct libterminput_base64 base64;
+static union libterminput_input input2;
+static union libterminput_compact_input compact, compact2;
+static char compact_buf[64];
+static size_t compact_len;
+static struct libterminput_ring ring, reader;
+static uint64_t *ring_header, *ring_slot;
+static unsigned long long int missed;
+static FILE *shm;
+static struct libterminput_keymap *keymap;
+static int bindings[6];
+static void *data;
+static unsigned long long int times;
+static const char *mem;
+static size_t memlen;
 static int fds[2];
+static struct libterminput_state ctx2, ctx3;
+static const char *mem2;
+static size_t memlen2;
+static struct libterminput_mode mode;
+static struct libterminput_queue *queue;
+static union libterminput_input events[64], expected[64];
+static size_t nevents, nexpected;
+
+
+static int
+same_input(const union libterminput_input *a, const union libterminput_input *b)
+{
+	if (a->type != b->type)
+		return 0;
+	switch (a->type) {
+	case LIBTERMINPUT_KEYPRESS:
+		return a->keypress.key == b->keypress.key && a->keypress.mods == b->keypress.mods &&
+		       a->keypress.times == b->keypress.times &&
+		       (a->keypress.key != LIBTERMINPUT_SYMBOL || !strcmp(a->keypress.symbol, b->keypress.symbol));
+	case LIBTERMINPUT_MOUSEEVENT:
+		return a->mouseevent.mods == b->mouseevent.mods && a->mouseevent.button == b->mouseevent.button &&
+		       a->mouseevent.event == b->mouseevent.event &&
+		       a->mouseevent.x == b->mouseevent.x && a->mouseevent.y == b->mouseevent.y &&
+		       (a->mouseevent.event != LIBTERMINPUT_HIGHLIGHT_OUTSIDE ||
+		        (a->mouseevent.start_x == b->mouseevent.start_x && a->mouseevent.start_y == b->mouseevent.start_y &&
+		         a->mouseevent.end_x == b->mouseevent.end_x && a->mouseevent.end_y == b->mouseevent.end_y));
+	case LIBTERMINPUT_RESIZE:
+		return a->resize.rows == b->resize.rows && a->resize.columns == b->resize.columns &&
+		       a->resize.height == b->resize.height && a->resize.width == b->resize.width;
+	case LIBTERMINPUT_TEXT:
+		return a->text.nbytes == b->text.nbytes && !memcmp(a->text.bytes, b->text.bytes, a->text.nbytes);
+	case LIBTERMINPUT_DEVICE_CONTROL_STRING:
+	case LIBTERMINPUT_OPERATING_SYSTEM_COMMAND:
+		return a->string.more == b->string.more && a->string.nbytes == b->string.nbytes &&
+		       !memcmp(a->string.bytes, b->string.bytes, a->string.nbytes);
+	case LIBTERMINPUT_CURSOR_POSITION:
+		return a->position.x == b->position.x && a->position.y == b->position.y &&
+		       a->position.page == b->position.page && a->position.sequence == b->position.sequence;
+	case LIBTERMINPUT_REPORT:
+		return a->report.prefix == b->report.prefix && a->report.intermediate == b->report.intermediate &&
+		       a->report.final == b->report.final && a->report.nparams == b->report.nparams &&
+		       !memcmp(a->report.params, b->report.params, a->report.nparams * sizeof(*a->report.params));
+	case LIBTERMINPUT_RAW_SEQUENCE:
+		return a->sequence.introducer == b->sequence.introducer && a->sequence.prefix == b->sequence.prefix &&
+		       !strcmp(a->sequence.intermediates, b->sequence.intermediates) &&
+		       a->sequence.final == b->sequence.final && a->sequence.nparams == b->sequence.nparams &&
+		       a->sequence.subparams == b->sequence.subparams &&
+		       !memcmp(a->sequence.params, b->sequence.params, a->sequence.nparams * sizeof(*a->sequence.params));
+	default:
+		return 1;
+	}
+}
 
+/* Decode a chunk of input from memory, with the state in ctx2 and input2,
+ * and append the events to events[] */
+static void
+feed(const char *str, size_t len)
+{
+	int r;
+	mem2 = str;
+	memlen2 = len;
+	while ((r = libterminput_read_mem(&mem2, &memlen2, &input2, &ctx2)) > 0) {
+		if (input2.type == LIBTERMINPUT_NONE)
+			continue;
+		TEST(nevents < sizeof(events) / sizeof(*events));
+		events[nevents++] = input2;
+	}
+	TEST(!r);
+	TEST(!memlen2);
+}
+
+/* Decode `str` from the state `start` split into chunks in every
+ * possible way, check that the events are always the same, and
+ * store them in expected[] */
+static void
+check_chunkings(const struct libterminput_state *start, const char *str)
+{
+	size_t len = strlen(str), i, j;
+	unsigned long long int splits;
+
+	ctx2 = *start;
+	memset(&input2, 0, sizeof(input2));
+	nevents = 0;
+	feed(str, len);
+	memcpy(expected, events, nevents * sizeof(*events));
+	nexpected = nevents;
+
+	TEST(len <= 20); /* there are 2^(len - 1) ways to split it */
+	for (splits = 1; len > 1 && splits < 1ULL << (len - 1); splits++) {
+		ctx2 = *start;
+		memset(&input2, 0, sizeof(input2));
+		nevents = 0;
+		for (i = 0; i < len; i = j) {
+			for (j = i + 1; j < len && !((splits >> (j - 1)) & 1); j++);
+			feed(&str[i], j - i);
+		}
+		TEST(nevents == nexpected);
+		for (i = 0; i < nevents; i++)
+			TEST(same_input(&events[i], &expected[i]));
+	}
+}
 
 static void
 type_mem(const char *str, size_t len, enum libterminput_type type)
@@ -348,6 +468,7 @@ static void
 keypress_(const char *str1, const char *str2, const char *str3, const char *str4,
           enum libterminput_key key, enum libterminput_mod mods, unsigned long long int times)
 {
+	struct libterminput_state start = ctx;
 	unsigned long long int times_;
 	size_t i;
 	alarm(5);
@@ -363,24 +484,13 @@ keypress_(const char *str1, const char *str2, const char *str3, const char *str4
 		TEST(input.keypress.mods == mods);
 		TEST(input.keypress.times == times_);
 	}
-	if (buffer[0] && buffer[1]) {
-		for (i = 0; buffer[i + 1]; i++) {
-			TEST(write(fds[1], &buffer[i], 1) == 1);
-			TEST(libterminput_read(fds[0], &input, &ctx) == 1);
-			TEST(input.type == LIBTERMINPUT_NONE);
-		}
-		TEST(write(fds[1], &buffer[i], 1) == 1);
-		TEST(libterminput_read(fds[0], &input, &ctx) == 1);
-		TEST(input.keypress.key == key);
-		TEST(input.keypress.mods == mods);
-		TEST(input.keypress.times == times);
-		for (times_ = times - 1; times_; times_--) {
-			TEST(libterminput_read(fds[0], &input, &ctx) == 1);
-			TEST(input.type == LIBTERMINPUT_KEYPRESS);
-			TEST(input.keypress.key == key);
-			TEST(input.keypress.mods == mods);
-			TEST(input.keypress.times == times_);
-		}
+	check_chunkings(&start, buffer);
+	TEST(nexpected == times);
+	for (i = 0; i < nexpected; i++) {
+		TEST(expected[i].type == LIBTERMINPUT_KEYPRESS);
+		TEST(expected[i].keypress.key == key);
+		TEST(expected[i].keypress.mods == mods);
+		TEST(expected[i].keypress.times == times - i);
 	}
 }
 
@@ -492,11 +602,65 @@ mouseho(const char *str, size_t sx, size_t sy, size_t ex, size_t ey, size_t mx,
 	TEST(input.mouseevent.y == my);
 }
 
+static void
+reencode(enum libterminput_flags flags)
+{
+	ssize_t n;
+	alarm(5);
+	n = libterminput_encode(&input, &mode, buffer, sizeof(buffer));
+	TEST(n > 0);
+	memset(&ctx2, 0, sizeof(ctx2));
+	libterminput_set_flags(&ctx2, flags | LIBTERMINPUT_ESC_ON_BLOCK);
+	mem2 = buffer;
+	memlen2 = (size_t)n;
+	do {
+		TEST(libterminput_read_mem(&mem2, &memlen2, &input2, &ctx2) == 1);
+	} while (input2.type == LIBTERMINPUT_NONE);
+	TEST(!memlen2);
+}
+
+static void
+migrate(const char *str, size_t chunk, enum libterminput_flags flags)
+{
+	char saved[LIBTERMINPUT_SAVED_STATE_MAX];
+	size_t len = strlen(str), off;
+	ssize_t n;
+	int r;
+	alarm(5);
+	memset(&ctx, 0, sizeof(ctx));
+	memset(&ctx2, 0, sizeof(ctx2));
+	libterminput_set_flags(&ctx, flags);
+	libterminput_set_flags(&ctx2, flags);
+	for (off = 0; off < len; off += chunk) {
+		mem = mem2 = &str[off];
+		memlen = memlen2 = chunk < len - off ? chunk : len - off;
+		do {
+			/* Decode the same input in both states, but move ctx2
+			 * to a new state, through a saved copy, after every call */
+			r = libterminput_read_mem(&mem, &memlen, &input, &ctx);
+			TEST(libterminput_read_mem(&mem2, &memlen2, &input2, &ctx2) == r);
+			TEST(memlen2 == memlen);
+			TEST(!r || same_input(&input, &input2));
+			n = libterminput_save_state(&ctx2, &input2, saved, sizeof(saved));
+			TEST(n > 0);
+			memset(&ctx2, 0, sizeof(ctx2));
+			memset(&input2, 0x55, sizeof(input2));
+			TEST(!libterminput_restore_state(&ctx2, &input2, saved, (size_t)n));
+		} while (r > 0);
+	}
+}
+
 
 int
 main(void)
 {
-	size_t i;
+	static const char *const symbols[] = {"A", " ", "[", "O", "P", "~", "\303\266", NULL};
+	struct libterminput_state start;
+	unsigned long long int seq;
+	size_t len, k;
+	size_t i, j;
+	ssize_t n;
+	int r;
 
 	memset(&ctx, 0, sizeof(ctx));
 	TEST(!pipe(fds));
@@ -561,7 +725,31 @@ main(void)
 	TYPE("\033[25;93R", LIBTERMINPUT_CURSOR_POSITION);
 	TEST(input.position.y == 25);
 	TEST(input.position.x == 93);
+	TEST(input.position.page == 1);
 	libterminput_clear_flags(&ctx, LIBTERMINPUT_AWAITING_CURSOR_POSITION);
+	KEYPRESS_("\033[1;2R", "", "", "", LIBTERMINPUT_F3, LIBTERMINPUT_SHIFT, 1);
+	seq = libterminput_await_cursor_position(&ctx);
+	TEST(libterminput_await_cursor_position(&ctx) == seq + 1);
+	TEST(libterminput_await_cursor_position(&ctx) == seq + 2);
+	TYPE("\033[?5;10;2R", LIBTERMINPUT_CURSOR_POSITION);
+	TEST(input.position.y == 5);
+	TEST(input.position.x == 10);
+	TEST(input.position.page == 2);
+	TEST(input.position.sequence == seq);
+	TYPE("\033[1;2R", LIBTERMINPUT_CURSOR_POSITION);
+	TEST(input.position.y == 1);
+	TEST(input.position.x == 2);
+	TEST(input.position.page == 1);
+	TEST(input.position.sequence == seq + 1);
+	TYPE("\033[?7;3R", LIBTERMINPUT_CURSOR_POSITION);
+	TEST(input.position.sequence == seq + 2);
+	KEYPRESS_("\033[1;2R", "", "", "", LIBTERMINPUT_F3, LIBTERMINPUT_SHIFT, 1);
+	TYPE("\033[?1;1;1R", LIBTERMINPUT_CURSOR_POSITION);
+	TEST(input.position.sequence == seq + 3);
+	TEST(libterminput_await_cursor_position(&ctx) == seq + 4);
+	TYPE("\033[?1;1R", LIBTERMINPUT_CURSOR_POSITION);
+	TEST(input.position.page == 1);
+	TEST(input.position.sequence == seq + 4);
 
 	TYPE("\033", LIBTERMINPUT_NONE);
 	TYPE("\033", LIBTERMINPUT_NONE);
@@ -717,8 +905,13 @@ main(void)
 	TEST(input.keypress.times == 1);
 	TEST(!strcmp(input.keypress.symbol, " "));
 
-	for (i = 0; mice[i].str; i++)
+	for (i = 0; mice[i].str; i++) {
+		start = ctx;
 		MOUSE(mice[i].str, mice[i].event, mice[i].button, mice[i].mods, (size_t)mice[i].x, (size_t)mice[i].y);
+		check_chunkings(&start, mice[i].str);
+		TEST(nexpected == 1);
+		TEST(same_input(&expected[0], &input));
+	}
 
 	TYPE("\033[<0;1;2", LIBTERMINPUT_NONE);
 	MOUSE("m", LIBTERMINPUT_RELEASE, LIBTERMINPUT_BUTTON1, 0, 1, 2);
@@ -757,6 +950,14 @@ main(void)
 	TYPE("\033[M!#", LIBTERMINPUT_NONE);
 	MOUSE("!",       LIBTERMINPUT_PRESS, LIBTERMINPUT_BUTTON2, 0, 3, 1);
 
+	memset(buffer, 'x', sizeof(buffer) - 4);
+	memcpy(&buffer[sizeof(buffer) - 4], "\033[M!", 4);
+	TYPE_MEM(buffer, sizeof(buffer), LIBTERMINPUT_KEYPRESS);
+	for (i = 1; i < sizeof(buffer) - 4; i++)
+		CONTINUE(LIBTERMINPUT_KEYPRESS);
+	CONTINUE(LIBTERMINPUT_NONE);
+	MOUSE("#!",      LIBTERMINPUT_PRESS, LIBTERMINPUT_BUTTON2, 0, 3, 1);
+
 	libterminput_set_flags(&ctx, LIBTERMINPUT_DECSET_1005);
 
 	MOUSE("\033[M !#",          LIBTERMINPUT_PRESS,   LIBTERMINPUT_BUTTON1,  0, 1, 3);
@@ -854,6 +1055,15 @@ main(void)
 	MOUSEHO("\033[Tabcde ", 'a' - ' ', 'b' - ' ', 'c' - ' ', 'd' - ' ', 'e' - ' ', 1);
 	MOUSEHO("\033[T\xff\xff\xff\xff\xff\xff", 255 - 32, 255 - 32, 255 - 32, 255 - 32, 255 - 32, 255 - 32);
 	MOUSEHO("\033[T\x1f\x1f\x1f\x1f\x1f\x1f", 255, 255, 255, 255, 255, 255);
+	TYPE("\033[1Ta", LIBTERMINPUT_KEYPRESS);
+	TEST(!strcmp(input.keypress.symbol, "a"));
+	mem = "\033[1T";
+	memlen = strlen(mem);
+	memset(&ctx2, 0, sizeof(ctx2));
+	while ((r = libterminput_read_mem(&mem, &memlen, &input2, &ctx2)) == 1)
+		TEST(input2.type == LIBTERMINPUT_NONE);
+	TEST(!r);
+	TEST(ctx2.stored_tail <= ctx2.stored_head);
 
 	TYPE("\033[Tabcde", LIBTERMINPUT_NONE);
 	MOUSEHO("f", 'a' - ' ', 'b' - ' ', 'c' - ' ', 'd' - ' ', 'e' - ' ', 'f' - ' ');
@@ -985,6 +1195,841 @@ main(void)
 	TEST(input.keypress.symbol[0] == '\n');
 	TEST(input.keypress.symbol[1] == '\0');
 
+	TYPE("\033[48;24;80;480;640t", LIBTERMINPUT_RESIZE);
+	TEST(input.resize.rows == 24);
+	TEST(input.resize.columns == 80);
+	TEST(input.resize.height == 480);
+	TEST(input.resize.width == 640);
+	TEST(!libterminput_is_ready(&input, &ctx));
+	TYPE("\033[48;24;80t", LIBTERMINPUT_RESIZE);
+	TEST(input.resize.rows == 24);
+	TEST(input.resize.columns == 80);
+	TEST(input.resize.height == 0);
+	TEST(input.resize.width == 0);
+	TYPE("\033[48;24;80;480;640t\033[48;25;81;500;648t\033[48;26;82;520;656t", LIBTERMINPUT_RESIZE);
+	TEST(input.resize.rows == 26);
+	TEST(input.resize.columns == 82);
+	TEST(input.resize.height == 520);
+	TEST(input.resize.width == 656);
+	TEST(!libterminput_is_ready(&input, &ctx));
+	TYPE("\033[48;24;80;480;640tx", LIBTERMINPUT_RESIZE);
+	TEST(input.resize.rows == 24);
+	CONTINUE(LIBTERMINPUT_KEYPRESS);
+	TEST(!strcmp(input.keypress.symbol, "x"));
+	TYPE("\033[48;24;80;480;640t\033[48;25", LIBTERMINPUT_RESIZE);
+	TEST(input.resize.rows == 24);
+	TYPE(";81;500;648t", LIBTERMINPUT_NONE);
+	CONTINUE(LIBTERMINPUT_RESIZE);
+	TEST(input.resize.rows == 25);
+	TEST(input.resize.width == 648);
+	TYPE("\033[47;24;80t", LIBTERMINPUT_NONE);
+	TEST(!libterminput_is_ready(&input, &ctx));
+	/* Resizes are not coalesced when decoding from memory, however it is split */
+	check_chunkings(&ctx, "\033[48;1;2t\033[48;3;4t");
+	TEST(nexpected == 2);
+	TEST(expected[0].type == LIBTERMINPUT_RESIZE && expected[0].resize.rows == 1 && expected[0].resize.columns == 2);
+	TEST(expected[1].type == LIBTERMINPUT_RESIZE && expected[1].resize.rows == 3 && expected[1].resize.columns == 4);
+	mem = "\033[48;24;80;480;640t\033[48;25;81;500;648t\033[48;26;82t";
+	for (i = 1; i <= strlen(mem); i++) {
+		ctx2 = ctx;
+		memset(&input2, 0, sizeof(input2));
+		nevents = 0;
+		for (j = 0; j < strlen(mem); j += i)
+			feed(&mem[j], strlen(mem) - j < i ? strlen(mem) - j : i);
+		TEST(nevents == 3);
+		TEST(events[0].resize.rows == 24 && events[1].resize.rows == 25 && events[2].resize.rows == 26);
+	}
+	start = ctx;
+	libterminput_set_flags(&start, LIBTERMINPUT_AWAITING_CURSOR_POSITION | LIBTERMINPUT_AWAITING_DEVICE_REPORTS |
+	                               LIBTERMINPUT_RAW_UNKNOWN_SEQUENCES);
+	check_chunkings(&start, "\033[12;34R\033[5;6R");
+	TEST(nexpected == 2 && expected[0].type == LIBTERMINPUT_CURSOR_POSITION);
+	TEST(expected[0].position.y == 12 && expected[0].position.x == 34);
+	TEST(expected[1].position.y == 5 && expected[1].position.x == 6);
+	check_chunkings(&start, "\033[?1;22c\033[?62;4c");
+	TEST(nexpected == 2 && expected[0].type == LIBTERMINPUT_REPORT && expected[1].type == LIBTERMINPUT_REPORT);
+	TEST(expected[0].report.nparams == 2 && expected[0].report.params[1] == 22);
+	TEST(expected[1].report.nparams == 2 && expected[1].report.params[0] == 62);
+	check_chunkings(&start, "\033[1;23:4z\033[=5z");
+	TEST(nexpected == 2 && expected[0].type == LIBTERMINPUT_RAW_SEQUENCE && expected[1].type == LIBTERMINPUT_RAW_SEQUENCE);
+	TEST(expected[0].sequence.nparams == 3 && expected[0].sequence.params[2] == 4 && expected[0].sequence.final == 'z');
+	TEST(expected[1].sequence.prefix == '=' && expected[1].sequence.params[0] == 5);
+
+	TEST(libterminput_is_focused(&ctx));
+	TYPE("\033[O", LIBTERMINPUT_FOCUS_OUT);
+	TEST(!libterminput_is_focused(&ctx));
+	TYPE("\033[I", LIBTERMINPUT_FOCUS_IN);
+	TEST(libterminput_is_focused(&ctx));
+	TYPE("\033[1I", LIBTERMINPUT_NONE);
+	TEST(libterminput_is_focused(&ctx));
+
+	TYPE("\033[?62;22c", LIBTERMINPUT_NONE);
+	libterminput_set_flags(&ctx, LIBTERMINPUT_AWAITING_DEVICE_REPORTS);
+	TYPE("\033[?62;22c", LIBTERMINPUT_REPORT);
+	TEST(input.report.prefix == '?');
+	TEST(input.report.intermediate == '\0');
+	TEST(input.report.final == 'c');
+	TEST(input.report.nparams == 2);
+	TEST(input.report.params[0] == 62);
+	TEST(input.report.params[1] == 22);
+	TYPE("\033[>41;330;0c", LIBTERMINPUT_REPORT);
+	TEST(input.report.prefix == '>');
+	TEST(input.report.final == 'c');
+	TEST(input.report.nparams == 3);
+	TEST(input.report.params[0] == 41);
+	TEST(input.report.params[1] == 330);
+	TEST(input.report.params[2] == 0);
+	TYPE("\033[?2026;2$y", LIBTERMINPUT_REPORT);
+	TEST(input.report.prefix == '?');
+	TEST(input.report.intermediate == '$');
+	TEST(input.report.final == 'y');
+	TEST(input.report.nparams == 2);
+	TEST(input.report.params[0] == 2026);
+	TEST(input.report.params[1] == 2);
+	TYPE("\033[?u", LIBTERMINPUT_REPORT);
+	TEST(input.report.final == 'u');
+	TEST(input.report.nparams == 0);
+	TYPE("\033P>|xterm(388)\033\\", LIBTERMINPUT_DEVICE_CONTROL_STRING);
+	TEST(!input.string.more);
+	TEST(input.string.nbytes == strlen(">|xterm(388)"));
+	TEST(!memcmp(input.string.bytes, ">|xterm(388)", input.string.nbytes));
+	TYPE("\033P1+r", LIBTERMINPUT_DEVICE_CONTROL_STRING);
+	TEST(input.string.more);
+	TEST(input.string.nbytes == 3);
+	TYPE("54\033", LIBTERMINPUT_DEVICE_CONTROL_STRING);
+	TEST(input.string.more);
+	TEST(input.string.nbytes == 2);
+	CONTINUE(LIBTERMINPUT_NONE);
+	TYPE("\\", LIBTERMINPUT_DEVICE_CONTROL_STRING);
+	TEST(!input.string.more);
+	TEST(input.string.nbytes == 0);
+	TYPE("\033Pabc\033[A", LIBTERMINPUT_DEVICE_CONTROL_STRING);
+	TEST(!input.string.more);
+	TEST(input.string.nbytes == 3);
+	CONTINUE(LIBTERMINPUT_KEYPRESS);
+	TEST(input.keypress.key == LIBTERMINPUT_UP);
+	libterminput_clear_flags(&ctx, LIBTERMINPUT_AWAITING_DEVICE_REPORTS);
+	TYPE("\033P", LIBTERMINPUT_KEYPRESS);
+	TEST(input.keypress.key == LIBTERMINPUT_SYMBOL);
+	TEST(input.keypress.mods == LIBTERMINPUT_META);
+	TEST(!strcmp(input.keypress.symbol, "P"));
+
+	libterminput_set_flags(&ctx, LIBTERMINPUT_AWAITING_OSC);
+	TYPE("\033]11;rgb:0000/0000/0000\a", LIBTERMINPUT_OPERATING_SYSTEM_COMMAND);
+	TEST(!input.string.more);
+	TEST(input.string.nbytes == strlen("11;rgb:0000/0000/0000"));
+	TEST(!memcmp(input.string.bytes, "11;rgb:0000/0000/0000", input.string.nbytes));
+	TYPE("\033]52;c;aGVsbG8gd2", LIBTERMINPUT_OPERATING_SYSTEM_COMMAND);
+	TEST(input.string.more);
+	TEST(input.string.nbytes == 15);
+	memset(&base64, 0, sizeof(base64));
+	TEST(libterminput_base64_decode(&base64, &input.string.bytes[5], 10, buffer) == 7);
+	TEST(!memcmp(buffer, "hello w", 7));
+	TYPE("9ybGQ=\033", LIBTERMINPUT_OPERATING_SYSTEM_COMMAND);
+	TEST(input.string.more);
+	TEST(libterminput_base64_decode(&base64, input.string.bytes, input.string.nbytes, buffer) == 4);
+	TEST(!memcmp(buffer, "orld", 4));
+	CONTINUE(LIBTERMINPUT_NONE);
+	TYPE("\\", LIBTERMINPUT_OPERATING_SYSTEM_COMMAND);
+	TEST(!input.string.more);
+	TEST(input.string.nbytes == 0);
+	TEST(libterminput_base64_decode(&base64, "", 0, buffer) == 0);
+	TYPE("\033]10;?\033[B", LIBTERMINPUT_OPERATING_SYSTEM_COMMAND);
+	TEST(!input.string.more);
+	TEST(input.string.nbytes == 4);
+	CONTINUE(LIBTERMINPUT_KEYPRESS);
+	TEST(input.keypress.key == LIBTERMINPUT_DOWN);
+	libterminput_clear_flags(&ctx, LIBTERMINPUT_AWAITING_OSC);
+	TYPE("\033]", LIBTERMINPUT_KEYPRESS);
+	TEST(input.keypress.mods == LIBTERMINPUT_META);
+	TEST(!strcmp(input.keypress.symbol, "]"));
+
+	TEST(sizeof(compact) == 32);
+	compact_len = 0;
+	TYPE("\303\266", LIBTERMINPUT_KEYPRESS);
+	TEST(!libterminput_compact(&compact, &input, compact_buf, sizeof(compact_buf), &compact_len));
+	TEST(compact.type == LIBTERMINPUT_KEYPRESS);
+	TEST(compact.keypress.key == LIBTERMINPUT_SYMBOL);
+	TEST(compact.keypress.codepoint == 0xF6);
+	TEST(compact_len == 0);
+	libterminput_expand(&input2, &compact, compact_buf);
+	TEST(input2.type == LIBTERMINPUT_KEYPRESS);
+	TEST(input2.keypress.key == LIBTERMINPUT_SYMBOL);
+	TEST(input2.keypress.times == 1);
+	TEST(!strcmp(input2.keypress.symbol, "\303\266"));
+	TYPE("\033[<2;3;4m", LIBTERMINPUT_MOUSEEVENT);
+	TEST(!libterminput_compact(&compact, &input, compact_buf, sizeof(compact_buf), &compact_len));
+	libterminput_expand(&input2, &compact, compact_buf);
+	TEST(input2.type == LIBTERMINPUT_MOUSEEVENT);
+	TEST(input2.mouseevent.event == input.mouseevent.event);
+	TEST(input2.mouseevent.button == input.mouseevent.button);
+	TEST(input2.mouseevent.mods == input.mouseevent.mods);
+	TEST(input2.mouseevent.x == 3 && input2.mouseevent.y == 4);
+	libterminput_set_flags(&ctx, LIBTERMINPUT_AWAITING_DEVICE_REPORTS);
+	TYPE("\033[?62;22c", LIBTERMINPUT_REPORT);
+	libterminput_clear_flags(&ctx, LIBTERMINPUT_AWAITING_DEVICE_REPORTS);
+	TEST(!libterminput_compact(&compact, &input, compact_buf, sizeof(compact_buf), &compact_len));
+	TEST(compact_len == 2 * sizeof(unsigned long long int));
+	TYPE("\033[200~", LIBTERMINPUT_BRACKETED_PASTE_START);
+	TYPE("hello\033[201~", LIBTERMINPUT_TEXT);
+	TEST(!libterminput_compact(&compact2, &input, compact_buf, sizeof(compact_buf), &compact_len));
+	TEST(compact2.text.offset == 2 * sizeof(unsigned long long int));
+	TEST(compact2.text.nbytes == 5);
+	CONTINUE(LIBTERMINPUT_BRACKETED_PASTE_END);
+	libterminput_expand(&input2, &compact, compact_buf);
+	TEST(input2.type == LIBTERMINPUT_REPORT);
+	TEST(input2.report.prefix == '?' && input2.report.final == 'c');
+	TEST(input2.report.nparams == 2 && input2.report.params[0] == 62 && input2.report.params[1] == 22);
+	libterminput_expand(&input2, &compact2, compact_buf);
+	TEST(input2.type == LIBTERMINPUT_TEXT);
+	TEST(input2.text.nbytes == 5 && !memcmp(input2.text.bytes, "hello", 5));
+	TYPE("\033[200~", LIBTERMINPUT_BRACKETED_PASTE_START);
+	TYPE("hello\033[201~", LIBTERMINPUT_TEXT);
+	TEST(libterminput_compact(&compact2, &input, compact_buf, compact_len + 4, &compact_len) == -1 && errno == ENOBUFS);
+	CONTINUE(LIBTERMINPUT_BRACKETED_PASTE_END);
+
+	TEST((shm = tmpfile()));
+	TEST(!libterminput_ring_create(&ring, fileno(shm), 8));
+	TEST(!libterminput_ring_attach(&reader, fileno(shm)));
+	TEST(libterminput_ring_consume(&reader, &input2, &missed) == 0);
+	TYPE("a", LIBTERMINPUT_KEYPRESS);
+	TEST(!libterminput_ring_publish(&ring, &input));
+	TYPE("\033[200~", LIBTERMINPUT_BRACKETED_PASTE_START);
+	TYPE("hello\033[201~", LIBTERMINPUT_TEXT);
+	TEST(!libterminput_ring_publish(&ring, &input));
+	CONTINUE(LIBTERMINPUT_BRACKETED_PASTE_END);
+	TEST(libterminput_ring_consume(&reader, &input2, &missed) == 1);
+	TEST(!missed);
+	TEST(input2.type == LIBTERMINPUT_KEYPRESS && !strcmp(input2.keypress.symbol, "a"));
+	TEST(libterminput_ring_consume(&reader, &input2, &missed) == 1);
+	TEST(!missed);
+	TEST(input2.type == LIBTERMINPUT_TEXT);
+	TEST(input2.text.nbytes == 5 && !memcmp(input2.text.bytes, "hello", 5));
+	TEST(libterminput_ring_consume(&reader, &input2, &missed) == 0);
+	TEST(libterminput_ring_publish(&reader, &input) == -1 && errno == EBADF);
+	TYPE("b", LIBTERMINPUT_KEYPRESS);
+	for (i = 0; i < 20; i++)
+		TEST(!libterminput_ring_publish(&ring, &input));
+	TYPE("c", LIBTERMINPUT_KEYPRESS);
+	TEST(!libterminput_ring_publish(&ring, &input));
+	TEST(libterminput_ring_consume(&reader, &input2, &missed) == 1);
+	TEST(missed == 17);
+	TEST(!strcmp(input2.keypress.symbol, "b"));
+	for (i = 0; i < 2; i++)
+		TEST(libterminput_ring_consume(&reader, &input2, &missed) == 1 && !missed);
+	TEST(libterminput_ring_consume(&reader, &input2, &missed) == 1 && !missed);
+	TEST(!strcmp(input2.keypress.symbol, "c"));
+	TEST(libterminput_ring_consume(&reader, &input2, &missed) == 0);
+	/* An event whose data does not fit in the data area is skipped */
+	TYPE("\033[200~", LIBTERMINPUT_BRACKETED_PASTE_START);
+	TYPE("hello\033[201~", LIBTERMINPUT_TEXT);
+	TEST(!libterminput_ring_publish(&ring, &input));
+	CONTINUE(LIBTERMINPUT_BRACKETED_PASTE_END);
+	ring_header = ring.map;
+	ring_slot = (uint64_t *)((char *)&ring_header[8] + (ring_header[3] - 1) % 8 * (2 * sizeof(uint64_t) + sizeof(compact2)));
+	ring_slot[1] = ring_header[4] - ring_header[4] % ring_header[2] + ring_header[2] - 1;
+	ring_header[4] = ring_slot[1] + 5;
+	TEST(libterminput_ring_consume(&reader, &input2, &missed) == 0 && missed == 1);
+	libterminput_ring_close(&reader);
+	/* Only rings that libterminput_ring_create could have created are accepted */
+	ring_header[1] = 3;
+	TEST(libterminput_ring_attach(&reader, fileno(shm)) == -1 && errno == EINVAL);
+	ring_header[1] = 0;
+	TEST(libterminput_ring_attach(&reader, fileno(shm)) == -1 && errno == EINVAL);
+	ring_header[1] = (uint64_t)1 << 62;
+	TEST(libterminput_ring_attach(&reader, fileno(shm)) == -1 && errno == EINVAL);
+	ring_header[1] = 8;
+	ring_header[2] = 0;
+	TEST(libterminput_ring_attach(&reader, fileno(shm)) == -1 && errno == EINVAL);
+	ring_header[2] = 4096;
+	TEST(!libterminput_ring_attach(&reader, fileno(shm)));
+	libterminput_ring_close(&reader);
+	libterminput_ring_close(&ring);
+	fclose(shm);
+	TEST(libterminput_ring_create(&ring, -1, 3) == -1 && errno == EINVAL);
+
+	TEST((keymap = libterminput_keymap_create()));
+	TEST(!libterminput_keymap_bind(keymap, "C-x C-s", &bindings[0]));
+	TEST(!libterminput_keymap_bind(keymap, "C-x k", &bindings[1]));
+	TEST(!libterminput_keymap_bind(keymap, "M-<up>", &bindings[2]));
+	TEST(!libterminput_keymap_bind(keymap, "S-a", &bindings[3]));
+	TEST(!libterminput_keymap_bind(keymap, "\303\266", &bindings[4]));
+	TEST(!libterminput_keymap_bind(keymap, "<escape>", &bindings[5]));
+	TEST(libterminput_keymap_bind(keymap, "C-x", &bindings[0]) == -1 && errno == EEXIST);
+	TEST(libterminput_keymap_bind(keymap, "M-<up> a", &bindings[0]) == -1 && errno == EEXIST);
+	TEST(libterminput_keymap_bind(keymap, "C-x <nope>", &bindings[0]) == -1 && errno == EINVAL);
+	TEST(libterminput_keymap_bind(keymap, " ", &bindings[0]) == -1 && errno == EINVAL);
+	TYPE("\030", LIBTERMINPUT_KEYPRESS);
+	TEST(libterminput_keymap_lookup(keymap, &input, &data, &times) == LIBTERMINPUT_KEYMAP_PREFIX);
+	TYPE("\023", LIBTERMINPUT_KEYPRESS);
+	TEST(libterminput_keymap_lookup(keymap, &input, &data, &times) == LIBTERMINPUT_KEYMAP_MATCH);
+	TEST(data == &bindings[0] && times == 1);
+	TYPE("\030", LIBTERMINPUT_KEYPRESS);
+	TEST(libterminput_keymap_lookup(keymap, &input, &data, &times) == LIBTERMINPUT_KEYMAP_PREFIX);
+	TYPE("j", LIBTERMINPUT_KEYPRESS);
+	TEST(libterminput_keymap_lookup(keymap, &input, &data, &times) == LIBTERMINPUT_KEYMAP_UNBOUND);
+	TYPE("k", LIBTERMINPUT_KEYPRESS);
+	TEST(libterminput_keymap_lookup(keymap, &input, &data, &times) == LIBTERMINPUT_KEYMAP_UNBOUND);
+	TYPE("\030", LIBTERMINPUT_KEYPRESS);
+	TEST(libterminput_keymap_lookup(keymap, &input, &data, &times) == LIBTERMINPUT_KEYMAP_PREFIX);
+	TYPE("\033[A", LIBTERMINPUT_KEYPRESS);
+	TEST(libterminput_keymap_lookup(keymap, &input, &data, &times) == LIBTERMINPUT_KEYMAP_UNBOUND);
+	TYPE("\033\033[A", LIBTERMINPUT_KEYPRESS);
+	TEST(libterminput_keymap_lookup(keymap, &input, &data, &times) == LIBTERMINPUT_KEYMAP_MATCH);
+	TEST(data == &bindings[2]);
+	TYPE("A", LIBTERMINPUT_KEYPRESS);
+	TEST(libterminput_keymap_lookup(keymap, &input, &data, &times) == LIBTERMINPUT_KEYMAP_MATCH);
+	TEST(data == &bindings[3]);
+	TYPE("\303\266", LIBTERMINPUT_KEYPRESS);
+	TEST(libterminput_keymap_lookup(keymap, &input, &data, &times) == LIBTERMINPUT_KEYMAP_MATCH);
+	TEST(data == &bindings[4]);
+	TYPE("\033\033\033", LIBTERMINPUT_KEYPRESS);
+	TEST(input.keypress.times == 3);
+	TEST(libterminput_keymap_lookup(keymap, &input, &data, &times) == LIBTERMINPUT_KEYMAP_MATCH);
+	TEST(data == &bindings[5] && times == 3);
+	TEST(!libterminput_is_ready(&input, &ctx));
+	libterminput_keymap_set_timeout(keymap, 1);
+	TYPE("\030", LIBTERMINPUT_KEYPRESS);
+	TEST(libterminput_keymap_lookup(keymap, &input, &data, &times) == LIBTERMINPUT_KEYMAP_PREFIX);
+	usleep(20000);
+	TYPE("\023", LIBTERMINPUT_KEYPRESS);
+	TEST(libterminput_keymap_lookup(keymap, &input, &data, &times) == LIBTERMINPUT_KEYMAP_UNBOUND);
+	TYPE("\030", LIBTERMINPUT_KEYPRESS);
+	TEST(libterminput_keymap_lookup(keymap, &input, &data, &times) == LIBTERMINPUT_KEYMAP_PREFIX);
+	libterminput_keymap_reset(keymap);
+	TYPE("k", LIBTERMINPUT_KEYPRESS);
+	TEST(libterminput_keymap_lookup(keymap, &input, &data, &times) == LIBTERMINPUT_KEYMAP_UNBOUND);
+	for (i = 0; i < 2000; i++) {
+		buffer[0] = 'a' + (char)(i % 26);
+		buffer[1] = ' ';
+		buffer[2] = (char)(0xE4 + (i >> 12));
+		buffer[3] = (char)(0x80 | ((i >> 6) & 0x3F));
+		buffer[4] = (char)(0x80 | (i & 0x3F));
+		buffer[5] = '\0';
+		TEST(!libterminput_keymap_bind(keymap, buffer, &bindings[i % 6]));
+	}
+	TYPE("h", LIBTERMINPUT_KEYPRESS);
+	TEST(libterminput_keymap_lookup(keymap, &input, &data, &times) == LIBTERMINPUT_KEYMAP_PREFIX);
+	TYPE("\344\224\233", LIBTERMINPUT_KEYPRESS);
+	TEST(libterminput_keymap_lookup(keymap, &input, &data, &times) == LIBTERMINPUT_KEYMAP_MATCH);
+	TEST(data == &bindings[1307 % 6]);
+	libterminput_keymap_free(keymap);
+
+	mem = mem2 = "ab\033[1;5Ac \303\266d\033[3B\033[200~x\033[201~\033e\033\033\033f\tg\033[2~";
+	memlen = memlen2 = strlen(mem);
+	memset(&ctx2, 0, sizeof(ctx2));
+	memset(&ctx3, 0, sizeof(ctx3));
+	libterminput_set_flags(&ctx2, LIBTERMINPUT_ESC_ON_BLOCK);
+	libterminput_set_flags(&ctx3, LIBTERMINPUT_ESC_ON_BLOCK);
+	do {
+		r = libterminput_read_mem_inline(&mem, &memlen, &input, &ctx2);
+		TEST(libterminput_read_mem(&mem2, &memlen2, &input2, &ctx3) == r);
+		TEST(mem == mem2 && memlen == memlen2);
+		TEST(input.type == input2.type);
+		if (input.type == LIBTERMINPUT_KEYPRESS) {
+			TEST(input.keypress.key == input2.keypress.key);
+			TEST(input.keypress.mods == input2.keypress.mods);
+			TEST(input.keypress.times == input2.keypress.times);
+			TEST(!strcmp(input.keypress.symbol, input2.keypress.symbol));
+		}
+	} while (r > 0);
+	TEST(!memlen);
+	TEST(write(fds[1], "xyz\033[2B", 7) == 7);
+	TEST(libterminput_read_inline(fds[0], &input, &ctx) == 1);
+	TEST(input.type == LIBTERMINPUT_KEYPRESS);
+	TEST(!strcmp(input.keypress.symbol, "x"));
+	TEST(ctx.stored_head - ctx.stored_tail == 6);
+	TEST(libterminput_read_inline(fds[0], &input, &ctx) == 1);
+	TEST(!strcmp(input.keypress.symbol, "y"));
+	TEST(libterminput_read_inline(fds[0], &input, &ctx) == 1);
+	TEST(!strcmp(input.keypress.symbol, "z"));
+	TEST(ctx.stored_head - ctx.stored_tail == 4);
+	do
+		TEST(libterminput_read_inline(fds[0], &input, &ctx) == 1);
+	while (input.type == LIBTERMINPUT_NONE);
+	TEST(input.type == LIBTERMINPUT_KEYPRESS);
+	TEST(input.keypress.key == LIBTERMINPUT_DOWN);
+	TEST(input.keypress.times == 2);
+	TEST(libterminput_read_inline(fds[0], &input, &ctx) == 1);
+	TEST(input.keypress.key == LIBTERMINPUT_DOWN);
+	TEST(input.keypress.times == 1);
+	TEST(ctx.stored_head == ctx.stored_tail);
+
+	TYPE("\033[1;2:3;4X\033[A", LIBTERMINPUT_KEYPRESS);
+	TEST(input.keypress.key == LIBTERMINPUT_UP);
+	libterminput_set_flags(&ctx, LIBTERMINPUT_RAW_UNKNOWN_SEQUENCES);
+	TYPE("\033[1;2:3;;4X", LIBTERMINPUT_RAW_SEQUENCE);
+	TEST(input.sequence.introducer == '[');
+	TEST(input.sequence.prefix == '\0');
+	TEST(!*input.sequence.intermediates);
+	TEST(input.sequence.final == 'X');
+	TEST(input.sequence.nparams == 5);
+	TEST(input.sequence.params[0] == 1);
+	TEST(input.sequence.params[1] == 2);
+	TEST(input.sequence.params[2] == 3);
+	TEST(input.sequence.params[3] == 0);
+	TEST(input.sequence.params[4] == 4);
+	TEST(input.sequence.subparams == 1U << 2);
+	compact_len = 0;
+	TEST(!libterminput_compact(&compact, &input, compact_buf, sizeof(compact_buf), &compact_len));
+	TEST(compact_len == 5 * sizeof(unsigned long long int));
+	libterminput_expand(&input2, &compact, compact_buf);
+	TEST(input2.type == LIBTERMINPUT_RAW_SEQUENCE);
+	TEST(input2.sequence.final == 'X' && input2.sequence.subparams == 1U << 2);
+	TEST(input2.sequence.nparams == 5 && input2.sequence.params[4] == 4);
+	TYPE("\033[=5 q", LIBTERMINPUT_RAW_SEQUENCE);
+	TEST(input.sequence.prefix == '=');
+	TEST(!strcmp(input.sequence.intermediates, " "));
+	TEST(input.sequence.final == 'q');
+	TEST(input.sequence.nparams == 1);
+	TEST(input.sequence.params[0] == 5);
+	TYPE("\033Oz", LIBTERMINPUT_RAW_SEQUENCE);
+	TEST(input.sequence.introducer == 'O');
+	TEST(input.sequence.final == 'z');
+	TEST(input.sequence.nparams == 0);
+	TYPE("\033[?1;2x", LIBTERMINPUT_RAW_SEQUENCE);
+	TEST(input.sequence.prefix == '?');
+	TEST(input.sequence.nparams == 2);
+	TYPE("\033[A", LIBTERMINPUT_KEYPRESS);
+	TEST(input.keypress.key == LIBTERMINPUT_UP);
+	libterminput_clear_flags(&ctx, LIBTERMINPUT_RAW_UNKNOWN_SEQUENCES);
+
+	memset(&input, 0, sizeof(input));
+	memset(&mode, 0, sizeof(mode));
+	mode.application_keypad = 1;
+	input.keypress.type = LIBTERMINPUT_KEYPRESS;
+	input.keypress.times = 1;
+	for (i = 0; keypresses[i].part1; i++) {
+		for (j = 0; j < 8; j++) {
+			if (j && keypresses[i].key >= LIBTERMINPUT_KEYPAD_0 && keypresses[i].key <= LIBTERMINPUT_KEYPAD_ENTER)
+				break;
+			mode.application_cursor_keys = (char)(i & 1);
+			input.keypress.key = keypresses[i].key;
+			input.keypress.mods = keypresses[i].mods | (enum libterminput_mod)j;
+			reencode(keypresses[i].flags);
+			TEST(input2.type == LIBTERMINPUT_KEYPRESS);
+			TEST(input2.keypress.key == input.keypress.key);
+			TEST(input2.keypress.mods == input.keypress.mods);
+		}
+	}
+	for (i = 0; keynums[i].number; i++) {
+		for (j = 0; j < 8; j++) {
+			input.keypress.key = keynums[i].key;
+			input.keypress.mods = keynums[i].mods | (enum libterminput_mod)j;
+			reencode(keynums[i].flags);
+			TEST(input2.type == LIBTERMINPUT_KEYPRESS);
+			TEST(input2.keypress.key == input.keypress.key);
+			TEST(input2.keypress.mods == input.keypress.mods);
+		}
+	}
+	for (i = 0; symbols[i]; i++) {
+		for (j = 0; j < 8; j += 2) { /* Shift is already applied to the text */
+			input.keypress.key = LIBTERMINPUT_SYMBOL;
+			input.keypress.mods = (enum libterminput_mod)j;
+			strcpy(input.keypress.symbol, symbols[i]);
+			reencode(0);
+			TEST(input2.type == LIBTERMINPUT_KEYPRESS);
+			TEST(input2.keypress.key == LIBTERMINPUT_SYMBOL);
+			TEST(input2.keypress.mods == input.keypress.mods);
+			TEST(!strcmp(input2.keypress.symbol, input.keypress.symbol));
+		}
+	}
+	input.keypress.key = LIBTERMINPUT_ENTER;
+	input.keypress.mods = 0;
+	TEST(libterminput_encode(&input, &mode, buffer, sizeof(buffer)) == 1 && buffer[0] == '\r');
+	input.keypress.key = LIBTERMINPUT_UP;
+	mode.application_cursor_keys = 1;
+	TEST(libterminput_encode(&input, &mode, buffer, sizeof(buffer)) == 3 && !memcmp(buffer, "\033OA", 3));
+	TEST(libterminput_encode(&input, &mode, buffer, 2) == -1 && errno == ENOBUFS);
+	input.keypress.key = LIBTERMINPUT_SYMBOL;
+	input.keypress.mods = LIBTERMINPUT_CTRL;
+	strcpy(input.keypress.symbol, "c");
+	TEST(libterminput_encode(&input, &mode, buffer, sizeof(buffer)) == 1 && buffer[0] == 3);
+	mode.kitty_flags = LIBTERMINPUT_KITTY_DISAMBIGUATE;
+	TEST(libterminput_encode(&input, &mode, buffer, sizeof(buffer)) == 7 && !memcmp(buffer, "\033[99;5u", 7));
+	reencode(0);
+	TEST(input2.keypress.key == LIBTERMINPUT_SYMBOL && input2.keypress.mods == LIBTERMINPUT_CTRL);
+	TEST(!strcmp(input2.keypress.symbol, "c"));
+	input.keypress.mods = 0;
+	TEST(libterminput_encode(&input, &mode, buffer, sizeof(buffer)) == 1 && buffer[0] == 'c');
+	mode.kitty_flags = LIBTERMINPUT_KITTY_REPORT_ALL_KEYS;
+	TEST(libterminput_encode(&input, &mode, buffer, sizeof(buffer)) == 5 && !memcmp(buffer, "\033[99u", 5));
+	input.keypress.key = LIBTERMINPUT_ENTER;
+	TEST(libterminput_encode(&input, &mode, buffer, sizeof(buffer)) == 5 && !memcmp(buffer, "\033[13u", 5));
+	reencode(0);
+	TEST(input2.keypress.key == LIBTERMINPUT_ENTER && !input2.keypress.mods);
+	input.keypress.key = (enum libterminput_key)-1;
+	TEST(libterminput_encode(&input, &mode, buffer, sizeof(buffer)) == -1 && errno == EINVAL);
+	memset(&mode, 0, sizeof(mode));
+	memset(&input, 0, sizeof(input));
+	input.type = LIBTERMINPUT_MOUSEEVENT;
+	for (i = 0; mice[i].str; i++) {
+		input.mouseevent.event = mice[i].event;
+		input.mouseevent.button = mice[i].button;
+		input.mouseevent.mods = mice[i].mods;
+		input.mouseevent.x = (size_t)mice[i].x;
+		input.mouseevent.y = (size_t)mice[i].y;
+		for (j = 0; j < 4; j++) {
+			mode.mouse_encoding = (enum libterminput_mouse_encoding)j;
+			if (j == LIBTERMINPUT_MOUSE_X10 && mice[i].x > 223) {
+				TEST(libterminput_encode(&input, &mode, buffer, sizeof(buffer)) == -1 && errno == EINVAL);
+				continue;
+			}
+			if (j == LIBTERMINPUT_MOUSE_UTF8 && mice[i].x > 2015) {
+				TEST(libterminput_encode(&input, &mode, buffer, sizeof(buffer)) == -1 && errno == EINVAL);
+				continue;
+			}
+			reencode(j == LIBTERMINPUT_MOUSE_UTF8 ? LIBTERMINPUT_DECSET_1005 : 0);
+			TEST(input2.type == LIBTERMINPUT_MOUSEEVENT);
+			TEST(input2.mouseevent.event == mice[i].event);
+			if (mice[i].event != LIBTERMINPUT_RELEASE || j == LIBTERMINPUT_MOUSE_SGR)
+				TEST(input2.mouseevent.button == mice[i].button);
+			TEST(input2.mouseevent.mods == mice[i].mods);
+			TEST(input2.mouseevent.x == (size_t)mice[i].x);
+			TEST(input2.mouseevent.y == (size_t)mice[i].y);
+		}
+	}
+	input.type = LIBTERMINPUT_BRACKETED_PASTE_START;
+	TEST(libterminput_encode(&input, &mode, buffer, sizeof(buffer)) == 0);
+	mode.bracketed_paste = 1;
+	TEST(libterminput_encode(&input, &mode, buffer, sizeof(buffer)) == 6 && !memcmp(buffer, "\033[200~", 6));
+	input.type = LIBTERMINPUT_CURSOR_POSITION;
+	input.position.x = 12;
+	input.position.y = 3;
+	TEST(libterminput_encode(&input, &mode, buffer, sizeof(buffer)) == 7 && !memcmp(buffer, "\033[3;12R", 7));
+
+	TEST(!libterminput_set_event_mask(&ctx, LIBTERMINPUT_EVENT_MOUSE_MOTION | LIBTERMINPUT_EVENT_PASTE | LIBTERMINPUT_EVENT_KEYPAD));
+	TYPE("\033[<35;5;6M\033[<32;7;8Mx", LIBTERMINPUT_KEYPRESS);
+	TEST(input.keypress.key == LIBTERMINPUT_SYMBOL);
+	TEST(!strcmp(input.keypress.symbol, "x"));
+	TEST(libterminput_get_dropped_events(&ctx, LIBTERMINPUT_EVENT_MOUSE_MOTION) == 2);
+	TYPE("\033[<0;5;6M", LIBTERMINPUT_MOUSEEVENT);
+	TEST(input.mouseevent.event == LIBTERMINPUT_PRESS);
+	TYPE("\033[200~pasted\033[201~\033Op\033[A", LIBTERMINPUT_KEYPRESS);
+	TEST(input.keypress.key == LIBTERMINPUT_UP);
+	TEST(libterminput_get_dropped_events(&ctx, LIBTERMINPUT_EVENT_PASTE) == 3);
+	TEST(libterminput_get_dropped_events(&ctx, LIBTERMINPUT_EVENT_KEYPAD) == 1);
+	TEST(libterminput_get_dropped_events(&ctx, ~0) == 6);
+	mem = "\033[<64;1;1M\033[0n";
+	memlen = strlen(mem);
+	memset(&ctx2, 0, sizeof(ctx2));
+	TEST(!libterminput_set_event_mask(&ctx2, LIBTERMINPUT_EVENT_MOUSE_SCROLL | LIBTERMINPUT_EVENT_TERMINAL_STATUS));
+	while ((r = libterminput_read_mem(&mem, &memlen, &input2, &ctx2)) == 1)
+		TEST(input2.type == LIBTERMINPUT_NONE);
+	TEST(r == 0);
+	TEST(libterminput_get_dropped_events(&ctx2, LIBTERMINPUT_EVENT_MOUSE_SCROLL) == 1);
+	TEST(libterminput_get_dropped_events(&ctx2, LIBTERMINPUT_EVENT_TERMINAL_STATUS) == 1);
+	TEST(!libterminput_set_event_mask(&ctx, 0));
+	TYPE("\033[<35;5;6M", LIBTERMINPUT_MOUSEEVENT);
+	TEST(input.mouseevent.event == LIBTERMINPUT_MOTION);
+
+	TEST(!libterminput_queue_create(0, 512, 0) && errno == EINVAL);
+	TEST(!libterminput_queue_create(4, 511, 0) && errno == EINVAL);
+	TEST((queue = libterminput_queue_create(4, 1024, LIBTERMINPUT_DROP_OLDEST_MOTION | LIBTERMINPUT_TRUNCATE_PASTE)));
+	TEST(!libterminput_queue_pop(queue, &input2));
+	mem = "\033[<35;1;1M\033[<35;2;1M\033[<0;3;1M\033[<35;4;1M\033[<35;5;1M\033[<35;6;1Ma";
+	memlen = strlen(mem);
+	memset(&ctx2, 0, sizeof(ctx2));
+	TEST(libterminput_queue_fill_mem(&mem, &memlen, queue, &ctx2) == 0);
+	TEST(libterminput_queue_dropped(queue, LIBTERMINPUT_DROP_OLDEST_MOTION) == 3);
+	TEST(libterminput_queue_pop(queue, &input2) && input2.type == LIBTERMINPUT_MOUSEEVENT);
+	TEST(input2.mouseevent.event == LIBTERMINPUT_PRESS && input2.mouseevent.x == 3);
+	TEST(libterminput_queue_pop(queue, &input2) && input2.mouseevent.x == 5);
+	TEST(libterminput_queue_pop(queue, &input2) && input2.mouseevent.x == 6);
+	TEST(libterminput_queue_pop(queue, &input2) && input2.type == LIBTERMINPUT_KEYPRESS);
+	TEST(!strcmp(input2.keypress.symbol, "a"));
+	TEST(!libterminput_queue_pop(queue, &input2));
+	mem = "\033[200~";
+	memlen = strlen(mem);
+	TEST(libterminput_queue_fill_mem(&mem, &memlen, queue, &ctx2) == 0);
+	memset(buffer, 'x', sizeof(buffer));
+	for (i = 0; i < 4; i++) {
+		mem = buffer;
+		memlen = sizeof(buffer);
+		TEST(libterminput_queue_fill_mem(&mem, &memlen, queue, &ctx2) == 0);
+	}
+	TEST(libterminput_queue_dropped(queue, LIBTERMINPUT_TRUNCATE_PASTE) == 2);
+	mem = "\033[201~b";
+	memlen = strlen(mem);
+	TEST(libterminput_queue_fill_mem(&mem, &memlen, queue, &ctx2) == 1);
+	TEST(libterminput_queue_pop(queue, &input2) && input2.type == LIBTERMINPUT_BRACKETED_PASTE_START);
+	TEST(libterminput_queue_pop(queue, &input2) && input2.type == LIBTERMINPUT_TEXT);
+	TEST(input2.text.nbytes == sizeof(buffer) && input2.text.bytes[sizeof(buffer) - 1] == 'x');
+	TEST(libterminput_queue_pop(queue, &input2) && input2.type == LIBTERMINPUT_TEXT);
+	TEST(libterminput_queue_pop(queue, &input2) && input2.type == LIBTERMINPUT_PASTE_TRUNCATED);
+	TEST(!libterminput_queue_pop(queue, &input2));
+	TEST(libterminput_queue_fill_mem(&mem, &memlen, queue, &ctx2) == 0);
+	TEST(libterminput_queue_pop(queue, &input2) && input2.type == LIBTERMINPUT_BRACKETED_PASTE_END);
+	TEST(libterminput_queue_pop(queue, &input2) && input2.type == LIBTERMINPUT_KEYPRESS);
+	TEST(!strcmp(input2.keypress.symbol, "b"));
+	TEST(!libterminput_queue_pop(queue, &input2));
+	libterminput_queue_free(queue);
+	TEST((queue = libterminput_queue_create(2, 512, LIBTERMINPUT_MERGE_SCROLL)));
+	mem = "\033[<64;1;1M\033[<64;1;1M\033[<64;1;1M\033[<0;1;1M\033[<0;1;1M";
+	memlen = strlen(mem);
+	memset(&ctx2, 0, sizeof(ctx2));
+	TEST(libterminput_queue_fill_mem(&mem, &memlen, queue, &ctx2) == 1);
+	TEST(libterminput_queue_dropped(queue, LIBTERMINPUT_MERGE_SCROLL) == 2);
+	TEST(libterminput_queue_pop(queue, &input2) && input2.mouseevent.button == LIBTERMINPUT_SCROLL_UP);
+	TEST(libterminput_queue_pop(queue, &input2) && input2.mouseevent.button == LIBTERMINPUT_BUTTON1);
+	TEST(libterminput_queue_fill_mem(&mem, &memlen, queue, &ctx2) == 0);
+	TEST(libterminput_queue_pop(queue, &input2) && input2.mouseevent.button == LIBTERMINPUT_BUTTON1);
+	TEST(!libterminput_queue_pop(queue, &input2));
+	TEST(libterminput_queue_dropped(queue, ~0) == 2);
+	libterminput_queue_free(queue);
+
+	TEST((queue = libterminput_queue_create(2, 512, 0)));
+	TEST(!libterminput_queue_separate_replies(queue, 4));
+	TEST(libterminput_queue_separate_replies(queue, 4) == -1 && errno == EINVAL);
+	mem = "abc\033[0n\033[5;6R\033[?1;2cd";
+	memlen = strlen(mem);
+	memset(&ctx2, 0, sizeof(ctx2));
+	libterminput_set_flags(&ctx2, LIBTERMINPUT_AWAITING_CURSOR_POSITION | LIBTERMINPUT_AWAITING_DEVICE_REPORTS);
+	TEST(libterminput_queue_fill_mem(&mem, &memlen, queue, &ctx2) == 1);
+	TEST(libterminput_queue_pop_reply(queue, &input2) && input2.type == LIBTERMINPUT_TERMINAL_IS_OK);
+	TEST(libterminput_queue_pop_reply(queue, &input2) && input2.type == LIBTERMINPUT_CURSOR_POSITION);
+	TEST(input2.position.y == 5 && input2.position.x == 6);
+	TEST(libterminput_queue_pop_reply(queue, &input2) && input2.type == LIBTERMINPUT_REPORT);
+	TEST(!libterminput_queue_pop_reply(queue, &input2));
+	TEST(libterminput_queue_pop(queue, &input2) && !strcmp(input2.keypress.symbol, "a"));
+	TEST(libterminput_queue_pop(queue, &input2) && !strcmp(input2.keypress.symbol, "b"));
+	TEST(!libterminput_queue_pop(queue, &input2));
+	TEST(libterminput_queue_fill_mem(&mem, &memlen, queue, &ctx2) == 0);
+	TEST(libterminput_queue_pop(queue, &input2) && !strcmp(input2.keypress.symbol, "c"));
+	TEST(libterminput_queue_pop(queue, &input2) && !strcmp(input2.keypress.symbol, "d"));
+	TEST(!libterminput_queue_pop(queue, &input2));
+	TEST(!libterminput_queue_pop_reply(queue, &input2));
+	TEST(write(fds[1], "xyz\033[3n", 7) == 7);
+	TEST(libterminput_queue_fill(fds[0], queue, &ctx2) == 1);
+	TEST(libterminput_queue_pop_reply(queue, &input2) && input2.type == LIBTERMINPUT_TERMINAL_IS_NOT_OK);
+	TEST(libterminput_queue_pop(queue, &input2) && !strcmp(input2.keypress.symbol, "x"));
+	TEST(libterminput_queue_pop(queue, &input2) && !strcmp(input2.keypress.symbol, "y"));
+	TEST(libterminput_queue_fill(fds[0], queue, &ctx2) == 1);
+	TEST(libterminput_queue_pop(queue, &input2) && !strcmp(input2.keypress.symbol, "z"));
+	TEST(!libterminput_queue_pop(queue, &input2));
+	TEST(!libterminput_queue_pop_reply(queue, &input2));
+	libterminput_queue_free(queue);
+
+	/* A reply delivered ahead is not decoded as a reply once the flag
+	 * is cleared, the next reply must not be skipped in its place */
+	TEST((queue = libterminput_queue_create(1, 512, 0)));
+	TEST(!libterminput_queue_separate_replies(queue, 4));
+	mem = "ab\033[?1;2c\033[5;7R";
+	memlen = strlen(mem);
+	memset(&ctx2, 0, sizeof(ctx2));
+	libterminput_set_flags(&ctx2, LIBTERMINPUT_AWAITING_DEVICE_REPORTS);
+	TEST(libterminput_queue_fill_mem(&mem, &memlen, queue, &ctx2) == 1);
+	TEST(libterminput_queue_pop_reply(queue, &input2) && input2.type == LIBTERMINPUT_REPORT);
+	TEST(!libterminput_queue_pop_reply(queue, &input2));
+	libterminput_clear_flags(&ctx2, LIBTERMINPUT_AWAITING_DEVICE_REPORTS);
+	libterminput_await_cursor_position(&ctx2);
+	TEST(libterminput_queue_pop(queue, &input2) && !strcmp(input2.keypress.symbol, "a"));
+	TEST(libterminput_queue_fill_mem(&mem, &memlen, queue, &ctx2) == 0);
+	TEST(libterminput_queue_pop(queue, &input2) && !strcmp(input2.keypress.symbol, "b"));
+	TEST(!libterminput_queue_pop(queue, &input2));
+	TEST(libterminput_queue_pop_reply(queue, &input2) && input2.type == LIBTERMINPUT_CURSOR_POSITION);
+	TEST(input2.position.y == 5 && input2.position.x == 7);
+	TEST(!libterminput_queue_pop_reply(queue, &input2));
+	libterminput_queue_free(queue);
+
+	errno = 0;
+	TEST(libterminput_wakeup(&ctx) == -1 && errno == EINVAL);
+	TEST(!libterminput_enable_wakeup(&ctx));
+	alarm(5);
+	TEST(!libterminput_wakeup(&ctx));
+	TEST(!libterminput_wakeup(&ctx));
+	errno = 0;
+	TEST(libterminput_read(fds[0], &input, &ctx) == -1 && errno == ECANCELED);
+	TEST(write(fds[1], "\033", 1) == 1);
+	TEST(libterminput_read(fds[0], &input, &ctx) == 1);
+	TEST(input.type == LIBTERMINPUT_NONE);
+	TEST(write(fds[1], "[", 1) == 1);
+	TEST(libterminput_read(fds[0], &input, &ctx) == 1);
+	TEST(input.type == LIBTERMINPUT_NONE);
+	TEST(!libterminput_wakeup(&ctx));
+	errno = 0;
+	TEST(libterminput_read(fds[0], &input, &ctx) == -1 && errno == ECANCELED);
+	TEST(write(fds[1], "A", 1) == 1);
+	TEST(libterminput_read(fds[0], &input, &ctx) == 1);
+	TEST(input.type == LIBTERMINPUT_KEYPRESS);
+	TEST(input.keypress.key == LIBTERMINPUT_UP);
+	TEST(fcntl(fds[0], F_SETFL, fcntl(fds[0], F_GETFL) | O_NONBLOCK) != -1);
+	errno = 0;
+	TEST(libterminput_read(fds[0], &input, &ctx) == -1 && errno == EAGAIN);
+	TEST(!libterminput_wakeup(&ctx));
+	errno = 0;
+	TEST(libterminput_read(fds[0], &input, &ctx) == -1 && errno == ECANCELED);
+	TEST(write(fds[1], "b", 1) == 1);
+	TEST(libterminput_read(fds[0], &input, &ctx) == 1);
+	TEST(input.type == LIBTERMINPUT_KEYPRESS && !strcmp(input.keypress.symbol, "b"));
+	TEST(fcntl(fds[0], F_SETFL, fcntl(fds[0], F_GETFL) & ~O_NONBLOCK) != -1);
+	libterminput_disable_wakeup(&ctx);
+	TEST(libterminput_wakeup(&ctx) == -1 && errno == EINVAL);
+
+	for (i = 1; i <= 64; i *= 4) {
+		migrate("a\033[3Ab\303\266\033[<0;12;34M\033[M !!\033[200~pasted\033[201~\033\033x\033[15;5~\033\033\033\033O", i, 0);
+		migrate("\033P>|xterm(388)\033\\\033]11;rgb:0/0/0\a\033[?1;2c\033[6n\033[5;6Rq",
+		        i, LIBTERMINPUT_AWAITING_DEVICE_REPORTS | LIBTERMINPUT_AWAITING_OSC);
+	}
+	memset(&ctx, 0, sizeof(ctx));
+	mem = "\033[1;5";
+	memlen = strlen(mem);
+	while (libterminput_read_mem(&mem, &memlen, &input, &ctx) == 1);
+	errno = 0;
+	TEST(libterminput_save_state(&ctx, &input, buffer, 4) == -1 && errno == ENOBUFS);
+	TEST((n = libterminput_save_state(&ctx, &input, buffer, sizeof(buffer))) > 0);
+	memset(&ctx2, 0, sizeof(ctx2));
+	errno = 0;
+	TEST(libterminput_restore_state(&ctx2, &input2, buffer, (size_t)n - 1) == -1 && errno == EINVAL);
+	TEST(libterminput_restore_state(&ctx2, &input2, buffer, (size_t)n + 1) == -1 && errno == EINVAL);
+	buffer[0] += 1;
+	TEST(libterminput_restore_state(&ctx2, &input2, buffer, (size_t)n) == -1 && errno == ENOTSUP);
+	buffer[0] -= 1;
+	TEST(!ctx2.inited);
+	TEST(!libterminput_restore_state(&ctx2, &input2, buffer, (size_t)n));
+	mem2 = "C";
+	memlen2 = 1;
+	TEST(libterminput_read_mem(&mem2, &memlen2, &input2, &ctx2) == 1);
+	TEST(input2.type == LIBTERMINPUT_KEYPRESS);
+	TEST(input2.keypress.key == LIBTERMINPUT_RIGHT);
+	TEST(input2.keypress.mods == LIBTERMINPUT_CTRL);
+	memset(&ctx, 0, sizeof(ctx));
+	mem = "\303";
+	memlen = strlen(mem);
+	while (libterminput_read_mem(&mem, &memlen, &input, &ctx) == 1);
+	TEST((n = libterminput_save_state(&ctx, &input, buffer, sizeof(buffer))) > 21);
+	TEST(buffer[19] == 2 && buffer[21] == 1);
+	memset(&ctx2, 0, sizeof(ctx2));
+	TEST(!libterminput_restore_state(&ctx2, &input2, buffer, (size_t)n));
+	errno = 0;
+	buffer[19] = 100;
+	TEST(libterminput_restore_state(&ctx2, &input2, buffer, (size_t)n) == -1 && errno == EINVAL);
+	buffer[19] = 1;
+	TEST(libterminput_restore_state(&ctx2, &input2, buffer, (size_t)n) == -1 && errno == EINVAL);
+	buffer[19] = 2;
+	buffer[18] = 3;
+	TEST(libterminput_restore_state(&ctx2, &input2, buffer, (size_t)n) == -1 && errno == EINVAL);
+	buffer[18] = 0;
+	buffer[17] = 4;
+	TEST(libterminput_restore_state(&ctx2, &input2, buffer, (size_t)n) == -1 && errno == EINVAL);
+	buffer[17] = 0;
+	buffer[15] = 'X';
+	TEST(libterminput_restore_state(&ctx2, &input2, buffer, (size_t)n) == -1 && errno == EINVAL);
+	buffer[15] = 0;
+	buffer[4] = 0x40;
+	TEST(libterminput_restore_state(&ctx2, &input2, buffer, (size_t)n) == -1 && errno == EINVAL);
+	buffer[4] = 0;
+	TEST(!libterminput_restore_state(&ctx2, &input2, buffer, (size_t)n));
+	memset(&ctx, 0, sizeof(ctx));
+
+	/* Random interleavings of the sequences in the tables, split into random
+	 * chunks, must decode to the same events as the sequences one by one */
+	srand(1);
+	memset(&start, 0, sizeof(start));
+	for (i = 0; i < 2000; i++) {
+		nexpected = 0;
+		for (len = 0; len < sizeof(buffer) - 32;) {
+			switch (rand() % 3) {
+			case 0:
+				for (j = 0; keypresses[j].part1; j++);
+				j = (size_t)rand() % j;
+				if (keypresses[j].flags)
+					continue;
+				n = sprintf(&buffer[len], "%s%s", keypresses[j].part1, keypresses[j].part2);
+				break;
+			case 1:
+				for (j = 0; keynums[j].number; j++);
+				j = (size_t)rand() % j;
+				if (keynums[j].flags)
+					continue;
+				n = sprintf(&buffer[len], "\033[%i;%i~", keynums[j].number, rand() % 8 + 1);
+				break;
+			default:
+				for (j = 0; mice[j].str; j++);
+				j = (size_t)rand() % j;
+				n = sprintf(&buffer[len], "%s", mice[j].str);
+				break;
+			}
+			ctx2 = start;
+			memset(&input2, 0, sizeof(input2));
+			nevents = 0;
+			feed(&buffer[len], (size_t)n);
+			TEST(nexpected + nevents <= sizeof(expected) / sizeof(*expected));
+			memcpy(&expected[nexpected], events, nevents * sizeof(*events));
+			nexpected += nevents;
+			len += (size_t)n;
+			if (nexpected + 8 > sizeof(expected) / sizeof(*expected))
+				break;
+		}
+		ctx2 = start;
+		memset(&input2, 0, sizeof(input2));
+		nevents = 0;
+		for (j = 0; j < len; j += k) {
+			k = (size_t)rand() % 16 + 1;
+			if (k > len - j)
+				k = len - j;
+			feed(&buffer[j], k);
+		}
+		TEST(nevents == nexpected);
+		for (j = 0; j < nevents; j++)
+			TEST(same_input(&events[j], &expected[j]));
+	}
+
+	memset(&base64, 0, sizeof(base64));
+	TEST(libterminput_base64_decode(&base64, "TWFu", 4, buffer) == 3);
+	TEST(!memcmp(buffer, "Man", 3));
+	TEST(libterminput_base64_decode(&base64, "TW", 2, buffer) == 1);
+	TEST(libterminput_base64_decode(&base64, "E=", 2, buffer) == 1);
+	TEST(!memcmp(buffer, "a", 1));
+	TEST(libterminput_base64_decode(&base64, "=", 1, buffer) == 0);
+	TEST(libterminput_base64_decode(&base64, "TQ", 2, buffer) == -1 && errno == EINVAL);
+	memset(&base64, 0, sizeof(base64));
+	TEST(libterminput_base64_decode(&base64, "TWFuIGlzIGRpc3Rpbmd1aXNoZWQ=", 28, buffer) == 20);
+	TEST(!memcmp(buffer, "Man is distinguished", 20));
+	memset(&base64, 0, sizeof(base64));
+	TEST(libterminput_base64_decode(&base64, "TWF*", 4, buffer) == -1 && errno == EINVAL);
+	memset(&base64, 0, sizeof(base64));
+	TEST(libterminput_base64_decode(&base64, "T=", 2, buffer) == -1 && errno == EINVAL);
+
+	memset(&probe, 0, sizeof(probe));
+	probe.queries = LIBTERMINPUT_PROBE_DA2 | LIBTERMINPUT_PROBE_XTVERSION | LIBTERMINPUT_PROBE_KITTY_KEYBOARD;
+	probe.nmodes = 2;
+	probe.modes[0].mode = 2026;
+	probe.modes[1].mode = 2004;
+	probe.ncapabilities = 2;
+	strcpy(probe.capabilities[0].name, "TN");
+	strcpy(probe.capabilities[1].name, "Smulx");
+	TEST(!libterminput_probe_send(fds[1], &ctx, &probe, 5000));
+	TEST(read(fds[0], buffer, sizeof(buffer)) == (ssize_t)strlen(PROBE_QUERIES));
+	TEST(!memcmp(buffer, PROBE_QUERIES, strlen(PROBE_QUERIES)));
+	strcpy(buffer, "\033[?2026;2$yx\033[>1;4000;0c\033P>|xterm(388)\033\\\033[?0u");
+	strcat(buffer, "\033P1+r544E=787465726D\033\\\033P0+r536D756C78\033\\\033[?62;22c");
+	TEST(write(fds[1], buffer, strlen(buffer)) == (ssize_t)strlen(buffer));
+	TEST(libterminput_probe_read(fds[0], &input, &ctx, &probe) == 1);
+	TEST(input.type == LIBTERMINPUT_KEYPRESS);
+	TEST(!strcmp(input.keypress.symbol, "x"));
+	TEST(libterminput_probe_read(fds[0], &input, &ctx, &probe) == 0);
+	TEST(probe.complete);
+	TEST(probe.nda1 == 2 && probe.da1[0] == 62 && probe.da1[1] == 22);
+	TEST(probe.have_da2 && probe.da2[0] == 1 && probe.da2[1] == 4000 && probe.da2[2] == 0);
+	TEST(!strcmp(probe.version, "xterm(388)"));
+	TEST(probe.kitty_keyboard_flags == 0);
+	TEST(probe.modes[0].value == 2);
+	TEST(probe.modes[1].value == -1);
+	TEST(probe.capabilities[0].status == 1);
+	TEST(!strcmp(probe.capabilities[0].value, "xterm"));
+	TEST(probe.capabilities[1].status == 0);
+	TEST(!libterminput_is_ready(&input, &ctx));
+	TYPE("\033P", LIBTERMINPUT_KEYPRESS);
+	TEST(input.keypress.mods == LIBTERMINPUT_META);
+
+	memset(&probe, 0, sizeof(probe));
+	TEST(!libterminput_probe_send(fds[1], &ctx, &probe, 0));
+	TEST(read(fds[0], buffer, sizeof(buffer)) == 3);
+	TEST(libterminput_probe_read(fds[0], &input, &ctx, &probe) == 0);
+	TEST(!probe.complete);
+	libterminput_clear_flags(&ctx, LIBTERMINPUT_AWAITING_DEVICE_REPORTS);
+
 	close(fds[1]);
 	TEST(libterminput_read(fds[0], &input, &ctx) == 0);
 	close(fds[0]);